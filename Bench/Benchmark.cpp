@@ -0,0 +1,1068 @@
+#include "Benchmark.h"
+#include "Lexer.h"
+#include "CharScan.h"
+#include "ScriptParser.h"
+#include "IncrementalParser.h"
+#include "FlatAST.h"
+#include "CompiledScript.h"
+#include "ProgramCache.h"
+#include "Checker.h"
+#include "Resolver.h"
+#include "Interpreter.h"
+#include "Optimizer.h"
+#include "LoopInvariants.h"
+#include "TypeInference.h"
+#include "IRBuilder.h"
+#include "IROptimizer.h"
+#include "BytecodeCompiler.h"
+#include "ClosureCompiler.h"
+#include "AotCompiler.h"
+#include "Errors.h"
+#include "ReferenceLexer.h"
+#include "ReferenceParser.h"
+
+#include <QElapsedTimer>
+#include <QThread>
+#include <QStringList>
+#include <QScopedPointer>
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QTextStream>
+
+using namespace VTScript;
+
+namespace
+{
+    double megabytes_per_second( const QString& source, int iterations, qint64 nsecs )
+    {
+        double bytes = double(source.size()) * sizeof(QChar) * iterations;
+        double seconds = double(nsecs) / 1e9;
+        return seconds > 0 ? bytes / ( 1024.0 * 1024.0 ) / seconds : 0.0;
+    }
+
+    bool same_tokens( const QVector<Token>& a, const QVector<Token>& b )
+    {
+        if ( a.size() != b.size() )
+            return false;
+
+        for ( int i = 0; i < a.size(); ++i )
+            if ( a[i] != b[i] || a[i].line() != b[i].line() )
+                return false;
+
+        return true;
+    }
+
+    // visits the whole pointer tree, counting binary operators
+    class OperatorCounter : public ASTTools::NodeVisitor
+    {
+    public:
+        OperatorCounter() : count(0) {}
+
+        void visit(AST::Noop*) {}
+        void visit(AST::Leaf*) {}
+        void visit(AST::FunctionCall* node)
+        {
+            node->function_object()->accept(this);
+            foreach (AST::Expression* arg, node->arguments_expressions())
+                arg->accept(this);
+        }
+        void visit(AST::UnaryOperator* node) { node->argument()->accept(this); }
+        void visit(AST::BinaryOperator* node) { ++count; node->left()->accept(this); node->right()->accept(this); }
+        void visit(AST::Return* node) { node->expr()->accept(this); }
+        void visit(AST::Continue*) {}
+        void visit(AST::Break*) {}
+        void visit(AST::Block* node)
+        {
+            foreach (AST::Node* stmt, node->values())
+                stmt->accept(this);
+        }
+        void visit(AST::FunctionDeclaration* node) { node->body()->accept(this); }
+        void visit(AST::While* node) { node->condition()->accept(this); node->body()->accept(this); }
+        void visit(AST::If* node) { node->condition()->accept(this); node->then_stmt()->accept(this); node->else_stmt()->accept(this); }
+
+        int count;
+    };
+
+    // counts operators TypeInference marked and those the tree walker quickened, or takes the marks away
+    class TypeMarks : public ASTTools::NodeVisitor
+    {
+    public:
+        TypeMarks(bool clear) : clear(clear), marked(0), operators(0), quickened(0) {}
+
+        void visit(AST::Noop*) {}
+        void visit(AST::Leaf*) {}
+        void visit(AST::FunctionCall* node)
+        {
+            node->function_object()->accept(this);
+            foreach (AST::Expression* arg, node->arguments_expressions())
+                arg->accept(this);
+        }
+        void visit(AST::UnaryOperator* node) { mark(node); node->argument()->accept(this); }
+        void visit(AST::BinaryOperator* node)
+        {
+            mark(node);
+            if (node->quick() != NULL)
+                ++quickened;
+            node->left()->accept(this);
+            node->right()->accept(this);
+        }
+        void visit(AST::Return* node) { node->expr()->accept(this); }
+        void visit(AST::Continue*) {}
+        void visit(AST::Break*) {}
+        void visit(AST::Block* node)
+        {
+            foreach (AST::Node* stmt, node->values())
+                stmt->accept(this);
+        }
+        void visit(AST::FunctionDeclaration* node) { node->body()->accept(this); }
+        void visit(AST::While* node) { node->condition()->accept(this); node->body()->accept(this); }
+        void visit(AST::If* node) { node->condition()->accept(this); node->then_stmt()->accept(this); node->else_stmt()->accept(this); }
+
+        bool clear;
+        int marked;
+        int operators;
+        int quickened;
+
+    private:
+        template <typename Operator>
+        void mark(Operator* node)
+        {
+            if (node->type() == OperatorTypes::Assign || node->type() == OperatorTypes::Dot)
+                return;
+
+            ++operators;
+            if (node->operand_type() != WSTypes::Base)
+                ++marked;
+            if (clear)
+                node->set_operand_type(WSTypes::Base);
+        }
+    };
+
+    // collects the functions whose bodies are parsed, nested ones included
+    class Functions : public ASTTools::NodeVisitor
+    {
+    public:
+        void visit(AST::Noop*) {}
+        void visit(AST::Leaf*) {}
+        void visit(AST::FunctionCall*) {}
+        void visit(AST::UnaryOperator*) {}
+        void visit(AST::BinaryOperator*) {}
+        void visit(AST::Return*) {}
+        void visit(AST::Continue*) {}
+        void visit(AST::Break*) {}
+        void visit(AST::Block* node)
+        {
+            foreach (AST::Node* stmt, node->values())
+                stmt->accept(this);
+        }
+        void visit(AST::FunctionDeclaration* node)
+        {
+            if (!node->is_body_parsed())
+                return;
+            found.append(node->fnc().data());
+            node->body()->accept(this);
+        }
+        void visit(AST::While* node) { node->body()->accept(this); }
+        void visit(AST::If* node) { node->then_stmt()->accept(this); node->else_stmt()->accept(this); }
+
+        QList<WS::UserFunction*> found;
+    };
+}
+
+QString Benchmark::lexer( const QString& source, int iterations )
+{
+    QStringList report;
+    QElapsedTimer timer;
+    QVector<Token> regex_tokens, dfa_tokens;
+
+    try
+    {
+        timer.start();
+        for ( int i = 0; i < iterations; ++i )
+        {
+            IdentifierTable identifiers;
+            regex_tokens = ReferenceLexer::lex( source, identifiers );
+        }
+        qint64 regex_time = timer.nsecsElapsed();
+
+        double regex_speed = megabytes_per_second( source, iterations, regex_time );
+        report << QString("Lexer benchmark: %1 characters, %2 tokens, %3 iterations")
+                      .arg(source.size()).arg(regex_tokens.size()).arg(iterations);
+        report << QString("  regex lexer:      %1 MB/s").arg(regex_speed, 0, 'f', 2);
+
+        // DFA lexer with every character scanner this CPU supports
+        CharScan::Implementation selected = CharScan::implementation();
+        for ( int impl = CharScan::Scalar; impl <= CharScan::best_supported(); ++impl )
+        {
+            CharScan::set_implementation( static_cast<CharScan::Implementation>(impl) );
+
+            timer.start();
+            for ( int i = 0; i < iterations; ++i )
+            {
+                IdentifierTable identifiers;
+                dfa_tokens = Lexer::lex( source, identifiers );
+            }
+            double dfa_speed = megabytes_per_second( source, iterations, timer.nsecsElapsed() );
+
+            report << QString("  DFA lexer %1: %2 MB/s (%3x), token streams %4")
+                          .arg(QString(CharScan::to_string(CharScan::implementation())), -6)
+                          .arg(dfa_speed, 0, 'f', 2)
+                          .arg(regex_speed > 0 ? dfa_speed / regex_speed : 0.0, 0, 'f', 1)
+                          .arg(same_tokens(regex_tokens, dfa_tokens) ? "match" : "DIFFER");
+        }
+        CharScan::set_implementation( selected );
+
+        // the same in parallel mode, regardless of source size
+        int threshold = Lexer::get_parallel_threshold();
+        Lexer::set_parallel_threshold( 0 );
+
+        timer.start();
+        for ( int i = 0; i < iterations; ++i )
+        {
+            IdentifierTable identifiers;
+            dfa_tokens = Lexer::lex( source, identifiers );
+        }
+        double parallel_speed = megabytes_per_second( source, iterations, timer.nsecsElapsed() );
+
+        Lexer::set_parallel_threshold( threshold );
+
+        report << QString("  DFA lexer, %1 threads: %2 MB/s (%3x), token streams %4")
+                      .arg(QThread::idealThreadCount())
+                      .arg(parallel_speed, 0, 'f', 2)
+                      .arg(regex_speed > 0 ? parallel_speed / regex_speed : 0.0, 0, 'f', 1)
+                      .arg(same_tokens(regex_tokens, dfa_tokens) ? "match" : "DIFFER");
+    }
+    catch ( const LexError& e )
+    {
+        report << QString("Lexer benchmark failed: %1").arg(e.what());
+    }
+
+    return report.join("\n");
+}
+
+QString Benchmark::incremental( const QString& source, int iterations )
+{
+    QStringList report;
+    QElapsedTimer timer;
+
+    timer.start();
+    for ( int i = 0; i < iterations; ++i )
+    {
+        Program* program = Parser::parse( source );
+        if ( program == NULL )
+            return "Incremental parsing benchmark failed: source doesn't parse";
+        delete program;
+    }
+    qint64 full_time = timer.nsecsElapsed() / iterations;
+
+    // every iteration toggles a space at the start of the line in the middle of source
+    int middle = source.indexOf( QChar('\n'), source.size() / 2 ) + 1;
+    QString edited = source;
+    edited.insert( middle, QChar(' ') );
+
+    IncrementalParser parser;
+    parser.update( source );
+
+    qint64 update_time = 0;
+    int parsed = 0;
+    int reused = 0;
+
+    for ( int i = 0; i < iterations; ++i )
+    {
+        timer.start();
+        Program* program = parser.update( i % 2 == 0 ? edited : source );
+        update_time += timer.nsecsElapsed();
+
+        if ( program == NULL )
+            return "Incremental parsing benchmark failed: edited source doesn't parse";
+
+        parsed += parser.parsed_statements();
+        reused += parser.reused_statements();
+    }
+    update_time /= iterations;
+
+    report << QString("Incremental parsing benchmark: %1 characters, %2 iterations").arg(source.size()).arg(iterations);
+    report << QString("  full parse:         %1 ms").arg(full_time / 1e6, 0, 'f', 3);
+    report << QString("  incremental update: %1 ms (%2x), %3 statements parsed, %4 reused per update")
+                  .arg(update_time / 1e6, 0, 'f', 3)
+                  .arg(update_time > 0 ? double(full_time) / update_time : 0.0, 0, 'f', 1)
+                  .arg(double(parsed) / iterations, 0, 'f', 1)
+                  .arg(double(reused) / iterations, 0, 'f', 1);
+
+    return report.join("\n");
+}
+
+QString Benchmark::parser( const QString& source, int iterations )
+{
+    QStringList report;
+    QElapsedTimer timer;
+
+    try
+    {
+        IdentifierTable identifiers;
+        QVector<Token> tokens = Lexer::lex( source, identifiers );
+        QString printed[2];
+        qint64 time[2] = { 0, 0 };
+
+        // 0: precedence climbing, 1: reference recursive descent through every level;
+        // interleaved, so that both see the same machine
+        for ( int i = 0; i < iterations; ++i )
+        {
+            for ( int recursive = 0; recursive < 2; ++recursive )
+            {
+                Program program;
+                program.identifiers() = identifiers;
+
+                timer.start();
+                AST::Block* root = recursive == 1 ? ReferenceParser::parse( tokens, program )
+                                                    : Parser::_parse_tokens( tokens, program );
+                time[recursive] += timer.nsecsElapsed();
+
+                if ( i == 0 )
+                {
+                    ASTTools::PrintNodeVisitor printer;
+                    printed[recursive] = printer.print( root );
+                }
+            }
+        }
+
+        report << QString("Parser benchmark: %1 characters, %2 tokens, %3 iterations").arg(source.size()).arg(tokens.size()).arg(iterations);
+        report << QString("  recursive levels:    %1 ms, %2 MB/s").arg(time[1] / 1e6 / iterations, 0, 'f', 3)
+                      .arg(megabytes_per_second( source, iterations, time[1] ), 0, 'f', 2);
+        report << QString("  precedence climbing: %1 ms, %2 MB/s (%3x), trees %4").arg(time[0] / 1e6 / iterations, 0, 'f', 3)
+                      .arg(megabytes_per_second( source, iterations, time[0] ), 0, 'f', 2)
+                      .arg(time[0] > 0 ? double(time[1]) / time[0] : 0.0, 0, 'f', 1)
+                      .arg(printed[0] == printed[1] ? "match" : "DIFFER");
+    }
+    catch ( const LexError& e )
+    {
+        report << QString("Parser benchmark failed: %1").arg(e.what());
+    }
+    catch ( const ParseError& e )
+    {
+        report << QString("Parser benchmark failed: %1").arg(e.what());
+    }
+
+    return report.join("\n");
+}
+
+QString Benchmark::flat_ast( const QString& source, int iterations )
+{
+    QStringList report;
+    QElapsedTimer timer;
+
+    QScopedPointer<Program> program( Parser::parse( source ) );
+    if ( program.isNull() )
+        return "Flat AST benchmark failed: source doesn't parse";
+
+    timer.start();
+    Flat::Tree tree;
+    for ( int i = 0; i < iterations; ++i )
+        tree = Flat::Tree::from_ast( program->root() );
+    qint64 convert_time = timer.nsecsElapsed() / iterations;
+
+    int pointer_count = 0;
+    timer.start();
+    for ( int i = 0; i < iterations; ++i )
+    {
+        OperatorCounter counter;
+        program->root()->accept( &counter );
+        pointer_count = counter.count;
+    }
+    qint64 pointer_time = timer.nsecsElapsed() / iterations;
+
+    // preorder layout: every node is visited by a linear scan
+    int flat_count = 0;
+    timer.start();
+    for ( int i = 0; i < iterations; ++i )
+    {
+        flat_count = 0;
+        for ( int node = 0; node < tree.size(); ++node )
+            if ( tree.kind( node ) == Flat::Kinds::BinaryOperator )
+                ++flat_count;
+    }
+    qint64 flat_time = timer.nsecsElapsed() / iterations;
+
+    ASTTools::PrintNodeVisitor printer;
+    QString printed = printer.print( program->root() );
+    Flat::VisitorAdapter adapter( tree );
+    bool same = printed == printer.print( adapter.root() );
+
+    QString checked = "passes";
+    try
+    {
+        Checker checker( adapter.root() );
+        checker.run();
+    }
+    catch ( const CheckerError& e )
+    {
+        checked = QString("fails: %1").arg(e.what());
+    }
+
+    report << QString("Flat AST benchmark: %1 characters, %2 nodes, %3 iterations").arg(source.size()).arg(tree.size()).arg(iterations);
+    report << QString("  memory:    pointer tree %1 KB, flat tree %2 KB (%3x)")
+                  .arg(program->arena().allocated() / 1024.0, 0, 'f', 1)
+                  .arg(tree.memory() / 1024.0, 0, 'f', 1)
+                  .arg(tree.memory() > 0 ? double(program->arena().allocated()) / tree.memory() : 0.0, 0, 'f', 1);
+    report << QString("  traversal: pointer tree %1 ms, flat tree %2 ms (%3x), %4 operators %5")
+                  .arg(pointer_time / 1e6, 0, 'f', 3)
+                  .arg(flat_time / 1e6, 0, 'f', 3)
+                  .arg(flat_time > 0 ? double(pointer_time) / flat_time : 0.0, 0, 'f', 1)
+                  .arg(flat_count)
+                  .arg(flat_count == pointer_count ? "match" : "DIFFER");
+    report << QString("  conversion %1 ms, expanded tree %2, checker %3")
+                  .arg(convert_time / 1e6, 0, 'f', 3).arg(same ? "matches" : "DIFFERS").arg(checked);
+
+    return report.join("\n");
+}
+
+QString Benchmark::lazy_functions( const QString& source, int iterations )
+{
+    QStringList report;
+    QElapsedTimer timer;
+    size_t memory[2] = { 0, 0 };
+    qint64 time[2] = { 0, 0 };
+
+    // 0: eager, 1: lazy; interleaved, so that both see the same machine
+    for ( int i = 0; i < iterations; ++i )
+    {
+        for ( int lazy = 0; lazy < 2; ++lazy )
+        {
+            timer.start();
+            QScopedPointer<Program> program( Parser::parse( source, lazy == 1 ) );
+            time[lazy] += timer.nsecsElapsed();
+
+            if ( program.isNull() )
+                return "Lazy function parsing benchmark failed: source doesn't parse";
+            memory[lazy] = program->arena().allocated();
+        }
+    }
+
+    QScopedPointer<Program> eager( Parser::parse( source ) );
+    QScopedPointer<Program> lazy( Parser::parse( source, true ) );
+    OperatorCounter eager_counter, lazy_counter;
+    eager->root()->accept( &eager_counter );
+
+    // visiting a deferred body parses it
+    QString forced = "match";
+    timer.start();
+    try
+    {
+        lazy->root()->accept( &lazy_counter );
+        if ( lazy_counter.count != eager_counter.count )
+            forced = "DIFFER";
+    }
+    catch ( const std::exception& e )
+    {
+        forced = QString("fail: %1").arg(e.what());
+    }
+    qint64 force_time = timer.nsecsElapsed();
+
+    report << QString("Lazy function parsing benchmark: %1 characters, %2 iterations").arg(source.size()).arg(iterations);
+    report << QString("  eager startup: %1 ms, %2 KB of tree").arg(time[0] / 1e6 / iterations, 0, 'f', 3)
+                  .arg(memory[0] / 1024.0, 0, 'f', 1);
+    report << QString("  lazy startup:  %1 ms (%2x), %3 KB of tree").arg(time[1] / 1e6 / iterations, 0, 'f', 3)
+                  .arg(time[1] > 0 ? double(time[0]) / time[1] : 0.0, 0, 'f', 1)
+                  .arg(memory[1] / 1024.0, 0, 'f', 1);
+    report << QString("  parsing every deferred body afterwards: %1 ms, trees %2").arg(force_time / 1e6, 0, 'f', 3).arg(forced);
+
+    return report.join("\n");
+}
+
+QString Benchmark::compiled( const QString& source, int iterations )
+{
+    QStringList report;
+    QElapsedTimer timer;
+
+    const QString source_path = QDir::tempPath() + QDir::separator() + "vtscript_benchmark.txt";
+    const QString compiled_path = QDir::tempPath() + QDir::separator() + "vtscript_benchmark" + CompiledScript::extension;
+
+    {
+        QFile file( source_path );
+        if ( !file.open( QIODevice::WriteOnly ) || file.write( source.toUtf8() ) < 0 )
+            return "Compiled script benchmark failed: can't write " + source_path;
+    }
+
+    timer.start();
+    bool compiled = CompiledScript::compile( source, compiled_path );
+    qint64 compile_time = timer.nsecsElapsed();
+    if ( !compiled )
+        return "Compiled script benchmark failed: source doesn't compile";
+
+    // 0: read and parse everything, 1: stream and defer function bodies as exec does, 2: load .vtsc
+    qint64 time[3] = { 0, 0, 0 };
+    QString printed[3];
+
+    for ( int i = 0; i < iterations; ++i )
+    {
+        for ( int mode = 0; mode < 3; ++mode )
+        {
+            QScopedPointer<Program> program;
+            timer.start();
+
+            if ( mode == 2 )
+            {
+                program.reset( CompiledScript::load( compiled_path ) );
+            }
+            else
+            {
+                QFile file( source_path );
+                if ( file.open( QIODevice::ReadOnly | QIODevice::Text ) )
+                    program.reset( mode == 0 ? Parser::parse( QTextStream( &file ).readAll() ) : Parser::parse( &file, true ) );
+            }
+
+            time[mode] += timer.nsecsElapsed();
+
+            if ( program.isNull() )
+                return "Compiled script benchmark failed: script doesn't load";
+
+            // printing parses deferred bodies, outside of the timed part
+            if ( i == 0 )
+            {
+                ASTTools::PrintNodeVisitor printer;
+                printed[mode] = printer.print( program->root() );
+            }
+        }
+    }
+
+    report << QString("Compiled script benchmark: %1 characters, %2 iterations, warm file cache").arg(source.size()).arg(iterations);
+    report << QString("  compiling:          %1 ms, %2 KB source, %3 KB .vtsc").arg(compile_time / 1e6, 0, 'f', 3)
+                  .arg(QFileInfo( source_path ).size() / 1024.0, 0, 'f', 1)
+                  .arg(QFileInfo( compiled_path ).size() / 1024.0, 0, 'f', 1);
+    report << QString("  source, eager:      %1 ms").arg(time[0] / 1e6 / iterations, 0, 'f', 3);
+    report << QString("  source, as exec:    %1 ms").arg(time[1] / 1e6 / iterations, 0, 'f', 3);
+    report << QString("  .vtsc:              %1 ms (%2x eager, %3x exec), trees %4")
+                  .arg(time[2] / 1e6 / iterations, 0, 'f', 3)
+                  .arg(time[2] > 0 ? double(time[0]) / time[2] : 0.0, 0, 'f', 1)
+                  .arg(time[2] > 0 ? double(time[1]) / time[2] : 0.0, 0, 'f', 1)
+                  .arg(printed[0] == printed[2] && printed[1] == printed[2] ? "match" : "DIFFER");
+
+    QFile::remove( source_path );
+    QFile::remove( compiled_path );
+
+    return report.join("\n");
+}
+
+QString Benchmark::program_cache( const QString& source, int iterations )
+{
+    QStringList report;
+    QElapsedTimer timer;
+
+    const QString path = QDir::tempPath() + QDir::separator() + "vtscript_benchmark.txt";
+    {
+        QFile file( path );
+        if ( !file.open( QIODevice::WriteOnly ) || file.write( source.toUtf8() ) < 0 )
+            return "Program cache benchmark failed: can't write " + path;
+    }
+
+    timer.start();
+    for ( int i = 0; i < iterations; ++i )
+    {
+        Program* program = ProgramCache::load( path );
+        if ( program == NULL )
+            return "Program cache benchmark failed: script doesn't load";
+        delete program;
+    }
+    qint64 uncached_time = timer.nsecsElapsed() / iterations;
+
+    ProgramCache& cache = ProgramCache::instance();
+    const quint64 hits = cache.hits();
+    const quint64 misses = cache.misses();
+
+    timer.start();
+    for ( int i = 0; i < iterations; ++i )
+    {
+        Program* program = cache.acquire( path );
+        if ( program == NULL )
+            return "Program cache benchmark failed: script doesn't load";
+        cache.release( program );
+    }
+    qint64 cached_time = timer.nsecsElapsed() / iterations;
+
+    report << QString("Program cache benchmark: %1 characters, %2 loads").arg(source.size()).arg(iterations);
+    report << QString("  without cache: %1 ms per load").arg(uncached_time / 1e6, 0, 'f', 3);
+    report << QString("  with cache:    %1 ms per load (%2x), %3 hits, %4 misses, %5 KB cached")
+                  .arg(cached_time / 1e6, 0, 'f', 3)
+                  .arg(cached_time > 0 ? double(uncached_time) / cached_time : 0.0, 0, 'f', 1)
+                  .arg(cache.hits() - hits).arg(cache.misses() - misses)
+                  .arg(cache.memory() / 1024.0, 0, 'f', 1);
+
+    QFile::remove( path );
+
+    return report.join("\n");
+}
+
+QString Benchmark::interpreter( const QString& source, int iterations )
+{
+    QStringList report;
+    QElapsedTimer timer;
+
+    QScopedPointer<Program> program( Parser::parse( source ) );
+    if ( program.isNull() )
+        return "Interpreter benchmark failed: script doesn't parse";
+
+    timer.start();
+    for ( int i = 0; i < iterations; ++i )
+        Resolver::resolve( *program );
+    qint64 resolve_time = timer.nsecsElapsed() / iterations;
+
+    timer.start();
+    for ( int i = 0; i < iterations; ++i )
+    {
+        // runs in this thread, the script's errors are reported by the interpreter
+        Interpreter interpreter( program.data(), false );
+        interpreter.run();
+    }
+    qint64 run_time = timer.nsecsElapsed() / iterations;
+
+    report << QString("Interpreter benchmark: %1 characters, %2 runs").arg(source.size()).arg(iterations);
+    report << QString("  resolving names: %1 ms").arg(resolve_time / 1e6, 0, 'f', 3);
+    report << QString("  running:         %1 ms per run").arg(run_time / 1e6, 0, 'f', 3);
+
+    return report.join("\n");
+}
+
+QString Benchmark::constant_folding( const QString& source, int iterations )
+{
+    QStringList report;
+    QElapsedTimer timer;
+    qint64 time[2];
+    int operators[2];
+
+    for ( int optimize = 0; optimize < 2; ++optimize )
+    {
+        QScopedPointer<Program> program( Parser::parse( source, false, optimize == 1 ) );
+        if ( program.isNull() )
+            return "Constant folding benchmark failed: script doesn't parse";
+
+        OperatorCounter counter;
+        program->root()->accept( &counter );
+        operators[optimize] = counter.count;
+
+        timer.start();
+        for ( int i = 0; i < iterations; ++i )
+        {
+            Interpreter interpreter( program.data(), false );
+            interpreter.run();
+        }
+        time[optimize] = timer.nsecsElapsed() / iterations;
+    }
+
+    report << QString("Constant folding benchmark: %1 characters, %2 runs").arg(source.size()).arg(iterations);
+    report << QString("  as written: %1 ms per run, %2 binary operators").arg(time[0] / 1e6, 0, 'f', 3).arg(operators[0]);
+    report << QString("  optimized:  %1 ms per run (%2x), %3 binary operators")
+                  .arg(time[1] / 1e6, 0, 'f', 3)
+                  .arg(time[1] > 0 ? double(time[0]) / time[1] : 0.0, 0, 'f', 2)
+                  .arg(operators[1]);
+
+    return report.join("\n");
+}
+
+QString Benchmark::type_inference( const QString& source, int iterations )
+{
+    QStringList report;
+    QElapsedTimer timer;
+    qint64 time[2];
+
+    QScopedPointer<Program> program( Parser::parse( source ) );
+    if ( program.isNull() )
+        return "Type inference benchmark failed: script doesn't parse";
+
+    timer.start();
+    for ( int i = 0; i < iterations; ++i )
+        TypeInference::infer( *program );
+    qint64 infer_time = timer.nsecsElapsed() / iterations;
+
+    TypeMarks counter( false );
+    program->root()->accept( &counter );
+
+    // typed first, then with every mark taken away
+    for ( int typed = 1; typed >= 0; --typed )
+    {
+        if ( !typed )
+        {
+            TypeMarks clear( true );
+            program->root()->accept( &clear );
+        }
+
+        timer.start();
+        for ( int i = 0; i < iterations; ++i )
+        {
+            Interpreter interpreter( program.data(), false );
+            interpreter.run();
+        }
+        time[typed] = timer.nsecsElapsed() / iterations;
+    }
+
+    report << QString("Type inference benchmark: %1 characters, %2 runs").arg(source.size()).arg(iterations);
+    report << QString("  %1 of %2 operators typed, inference %3 ms").arg(counter.marked).arg(counter.operators).arg(infer_time / 1e6, 0, 'f', 3);
+    report << QString("  generic operators: %1 ms per run").arg(time[0] / 1e6, 0, 'f', 3);
+    report << QString("  typed fast paths:  %1 ms per run (%2x)")
+                  .arg(time[1] / 1e6, 0, 'f', 3)
+                  .arg(time[1] > 0 ? double(time[0]) / time[1] : 0.0, 0, 'f', 2);
+
+    return report.join("\n");
+}
+
+QString Benchmark::inlining( const QString& source, int iterations )
+{
+    QStringList report;
+    QElapsedTimer timer;
+    qint64 time[2];
+    int inlined = 0;
+
+    for ( int inline_functions = 0; inline_functions < 2; ++inline_functions )
+    {
+        QScopedPointer<Program> program( Parser::parse( source, false, true, inline_functions == 1 ) );
+        if ( program.isNull() )
+            return "Inlining benchmark failed: script doesn't parse";
+
+        if ( inline_functions )
+            inlined = program->inlined_calls();
+
+        timer.start();
+        for ( int i = 0; i < iterations; ++i )
+        {
+            Interpreter interpreter( program.data(), false );
+            interpreter.run();
+        }
+        time[inline_functions] = timer.nsecsElapsed() / iterations;
+    }
+
+    report << QString("Inlining benchmark: %1 characters, %2 runs").arg(source.size()).arg(iterations);
+    report << QString("  calls:   %1 ms per run").arg(time[0] / 1e6, 0, 'f', 3);
+    report << QString("  inlined: %1 ms per run (%2x), %3 call sites inlined")
+                  .arg(time[1] / 1e6, 0, 'f', 3)
+                  .arg(time[1] > 0 ? double(time[0]) / time[1] : 0.0, 0, 'f', 2)
+                  .arg(inlined);
+
+    return report.join("\n");
+}
+
+QString Benchmark::loop_invariants( const QString& source, int iterations )
+{
+    QStringList report;
+    QElapsedTimer timer;
+    qint64 time[2];
+    int marked = 0;
+
+    for ( int hoist = 0; hoist < 2; ++hoist )
+    {
+        // the pipeline of Parser::parse, with or without LoopInvariants
+        QScopedPointer<Program> program( Parser::parse( source, false, false ) );
+        if ( program.isNull() )
+            return "Loop invariants benchmark failed: script doesn't parse";
+
+        Optimizer::optimize( *program );
+        if ( hoist )
+            marked = LoopInvariants::hoist( *program );
+        TypeInference::infer( *program );
+
+        timer.start();
+        for ( int i = 0; i < iterations; ++i )
+        {
+            Interpreter interpreter( program.data(), false );
+            interpreter.run();
+        }
+        time[hoist] = timer.nsecsElapsed() / iterations;
+    }
+
+    report << QString("Loop invariants benchmark: %1 characters, %2 runs").arg(source.size()).arg(iterations);
+    report << QString("  evaluated every time: %1 ms per run").arg(time[0] / 1e6, 0, 'f', 3);
+    report << QString("  invariants kept:      %1 ms per run (%2x), %3 expressions")
+                  .arg(time[1] / 1e6, 0, 'f', 3)
+                  .arg(time[1] > 0 ? double(time[0]) / time[1] : 0.0, 0, 'f', 2)
+                  .arg(marked);
+
+    return report.join("\n");
+}
+
+QString Benchmark::ir( const QString& source, int iterations )
+{
+    QStringList report;
+    QElapsedTimer timer;
+
+    // the tree as Resolver leaves it, the IR passes do the folding
+    QScopedPointer<Program> program( Parser::parse( source, false, false ) );
+    if ( program.isNull() )
+        return "IR benchmark failed: script doesn't parse";
+
+    Functions functions;
+    program->root()->accept( &functions );
+
+    QList<IR::Function*> lowered;
+    qint64 build_time = 0;
+    qint64 optimize_time = 0;
+    int before = 0;
+    int after = 0;
+    int skipped = 0;
+
+    for ( int i = 0; i < iterations; ++i )
+    {
+        qDeleteAll( lowered );
+        lowered.clear();
+        skipped = 0;
+
+        timer.start();
+        lowered.append( IRBuilder::build( *program ) );
+        foreach ( WS::UserFunction* fnc, functions.found )
+            lowered.append( IRBuilder::build( *fnc ) );
+        build_time += timer.nsecsElapsed();
+
+        before = 0;
+        foreach ( IR::Function* function, lowered )
+            before += function != NULL ? function->instruction_count() : 0;
+
+        timer.start();
+        foreach ( IR::Function* function, lowered )
+        {
+            if ( function != NULL )
+                IROptimizer::optimize( *function );
+        }
+        optimize_time += timer.nsecsElapsed();
+
+        after = 0;
+        foreach ( IR::Function* function, lowered )
+        {
+            if ( function != NULL )
+                after += function->instruction_count();
+            else
+                ++skipped;
+        }
+    }
+
+    report << QString("IR benchmark: %1 characters, %2 functions and the top level, %3 runs")
+                  .arg(source.size()).arg(functions.found.size()).arg(iterations);
+    report << QString("  build:    %1 ms per run, %2 instructions").arg(build_time / iterations / 1e6, 0, 'f', 3).arg(before);
+    report << QString("  optimize: %1 ms per run, %2 instructions (%3 removed)")
+                  .arg(optimize_time / iterations / 1e6, 0, 'f', 3).arg(after).arg(before - after);
+    if ( skipped > 0 )
+        report << QString("  %1 not lowered: 'break' or 'continue' outside a loop").arg(skipped);
+
+    foreach ( IR::Function* function, lowered )
+    {
+        if ( function != NULL )
+            report << "" << function->to_string();
+    }
+    qDeleteAll( lowered );
+
+    return report.join("\n");
+}
+
+QString Benchmark::bytecode( const QString& source, int iterations )
+{
+    QStringList report;
+    QElapsedTimer timer;
+    qint64 time[2];
+
+    QScopedPointer<Program> program( Parser::parse( source ) );
+    if ( program.isNull() )
+        return "Bytecode benchmark failed: script doesn't parse";
+
+    timer.start();
+    int instructions = 0;
+    for ( int i = 0; i < iterations; ++i )
+    {
+        QScopedPointer<Bytecode::Chunk> chunk( BytecodeCompiler::compile_program( *program ) );
+        if ( chunk.isNull() )
+            return "Bytecode benchmark failed: the top level of the script doesn't compile";
+        instructions = chunk->code.size();
+    }
+    qint64 compile_time = timer.nsecsElapsed() / iterations;
+
+    // every run compiles what it runs again, the chunks belong to the interpreter
+    for ( int engine = 0; engine < 2; ++engine )
+    {
+        timer.start();
+        for ( int i = 0; i < iterations; ++i )
+        {
+            Interpreter interpreter( program.data(), false, Engine(engine) );
+            interpreter.run();
+        }
+        time[engine] = timer.nsecsElapsed() / iterations;
+    }
+
+    report << QString("Bytecode benchmark: %1 characters, %2 runs").arg(source.size()).arg(iterations);
+    report << QString("  top level: %1 ints of bytecode, compiled in %2 ms").arg(instructions).arg(compile_time / 1e6, 0, 'f', 3);
+    report << QString("  tree walker: %1 ms per run").arg(time[Engines::TreeWalker] / 1e6, 0, 'f', 3);
+    report << QString("  bytecode:    %1 ms per run (%2x)")
+                  .arg(time[Engines::BytecodeVM] / 1e6, 0, 'f', 3)
+                  .arg(time[Engines::BytecodeVM] > 0 ? double(time[Engines::TreeWalker]) / time[Engines::BytecodeVM] : 0.0, 0, 'f', 2);
+
+    return report.join("\n");
+}
+
+QString Benchmark::closures( const QString& source, int iterations )
+{
+    QStringList report;
+    QElapsedTimer timer;
+    qint64 time[2];
+
+    QScopedPointer<Program> program( Parser::parse( source ) );
+    if ( program.isNull() )
+        return "Closures benchmark failed: script doesn't parse";
+
+    // closures belong to the interpreter they call into
+    qint64 compile_time = 0;
+    {
+        Interpreter interpreter( program.data(), false, Engines::ClosureTree );
+        timer.start();
+        for ( int i = 0; i < iterations; ++i )
+        {
+            QScopedPointer<Closures::Statement> statement( ClosureCompiler::compile_program( &interpreter, *program ) );
+            if ( statement.isNull() )
+                return "Closures benchmark failed: the top level of the script doesn't compile";
+        }
+        compile_time = timer.nsecsElapsed() / iterations;
+    }
+
+    // every run compiles what it runs again
+    const Engine engines[2] = { Engines::TreeWalker, Engines::ClosureTree };
+    for ( int engine = 0; engine < 2; ++engine )
+    {
+        timer.start();
+        for ( int i = 0; i < iterations; ++i )
+        {
+            Interpreter interpreter( program.data(), false, engines[engine] );
+            interpreter.run();
+        }
+        time[engine] = timer.nsecsElapsed() / iterations;
+    }
+
+    report << QString("Closures benchmark: %1 characters, %2 runs").arg(source.size()).arg(iterations);
+    report << QString("  top level compiled in %1 ms").arg(compile_time / 1e6, 0, 'f', 3);
+    report << QString("  tree walker: %1 ms per run").arg(time[0] / 1e6, 0, 'f', 3);
+    report << QString("  closures:    %1 ms per run (%2x)")
+                  .arg(time[1] / 1e6, 0, 'f', 3)
+                  .arg(time[1] > 0 ? double(time[0]) / time[1] : 0.0, 0, 'f', 2);
+
+    return report.join("\n");
+}
+
+QString Benchmark::jit( const QString& source, int iterations )
+{
+    QStringList report;
+    QElapsedTimer timer;
+    qint64 time[2];
+    int compiled = 0;
+
+    QScopedPointer<Program> program( Parser::parse( source ) );
+    if ( program.isNull() )
+        return "JIT benchmark failed: script doesn't parse";
+
+    // every run warms up and compiles again
+    const Engine engines[2] = { Engines::BytecodeVM, Engines::BaselineJIT };
+    for ( int engine = 0; engine < 2; ++engine )
+    {
+        timer.start();
+        for ( int i = 0; i < iterations; ++i )
+        {
+            Interpreter interpreter( program.data(), false, engines[engine] );
+            interpreter.run();
+            compiled = interpreter.compiled_functions();
+        }
+        time[engine] = timer.nsecsElapsed() / iterations;
+    }
+
+    report << QString("JIT benchmark: %1 characters, %2 runs").arg(source.size()).arg(iterations);
+    report << QString("  bytecode VM: %1 ms per run").arg(time[0] / 1e6, 0, 'f', 3);
+    report << QString("  JIT:         %1 ms per run (%2x), %3 functions compiled")
+                  .arg(time[1] / 1e6, 0, 'f', 3)
+                  .arg(time[1] > 0 ? double(time[0]) / time[1] : 0.0, 0, 'f', 2)
+                  .arg(compiled);
+
+    return report.join("\n");
+}
+
+QString Benchmark::native( const QString& source, int iterations )
+{
+    QStringList report;
+    QElapsedTimer timer;
+    qint64 time[2];
+    int found = 0;
+
+    // the compiler reads the script from a file, as compile_native does
+    const QString script_path = QDir::tempPath() + "/vtscript_benchmark_native.txt";
+    QFile file( script_path );
+    if ( !file.open( QIODevice::WriteOnly | QIODevice::Text ) )
+        return "Native benchmark failed: couldn't write " + script_path;
+    file.write( source.toUtf8() );
+    file.close();
+
+    QString log;
+    timer.start();
+    const bool built = AotCompiler::build( script_path, log );
+    const qint64 build_time = timer.nsecsElapsed();
+    if ( !built )
+        return "Native benchmark failed: " + log;
+
+    // every run loads the script again, as exec does when it isn't cached
+    for ( int with_native = 0; with_native < 2; ++with_native )
+    {
+        timer.start();
+        for ( int i = 0; i < iterations; ++i )
+        {
+            Program* program = ProgramCache::load( script_path );
+            if ( program == NULL )
+                return "Native benchmark failed: script doesn't load";
+
+            Interpreter interpreter( program );
+            if ( with_native )
+                interpreter.load_native_code( script_path );
+            interpreter.run();
+            found = interpreter.native_functions();
+        }
+        time[with_native] = timer.nsecsElapsed() / iterations;
+    }
+
+    report << QString("Native benchmark: %1 characters, %2 runs").arg(source.size()).arg(iterations);
+    report << QString("  build:        %1 ms").arg(build_time / 1e6, 0, 'f', 3);
+    report << QString("  tree walker:  %1 ms per run").arg(time[0] / 1e6, 0, 'f', 3);
+    report << QString("  native code:  %1 ms per run (%2x), %3 functions")
+                  .arg(time[1] / 1e6, 0, 'f', 3)
+                  .arg(time[1] > 0 ? double(time[0]) / time[1] : 0.0, 0, 'f', 2)
+                  .arg(found);
+
+    return report.join("\n");
+}
+
+QString Benchmark::quickening( const QString& source, int iterations )
+{
+    QStringList report;
+    QElapsedTimer timer;
+    qint64 time[2];
+
+    QScopedPointer<Program> program( Parser::parse( source ) );
+    if ( program.isNull() )
+        return "Quickening benchmark failed: script doesn't parse";
+
+    // every operator is left to the run-time feedback
+    TypeMarks clear( true );
+    program->root()->accept( &clear );
+
+    // the nodes keep what they learned from one run to the next, as a cached program does
+    for ( int quicken = 0; quicken < 2; ++quicken )
+    {
+        timer.start();
+        for ( int i = 0; i < iterations; ++i )
+        {
+            Interpreter interpreter( program.data(), false );
+            interpreter.set_quickening( quicken == 1 );
+            interpreter.run();
+        }
+        time[quicken] = timer.nsecsElapsed() / iterations;
+    }
+
+    TypeMarks counter( false );
+    program->root()->accept( &counter );
+
+    report << QString("Quickening benchmark: %1 characters, %2 runs").arg(source.size()).arg(iterations);
+    report << QString("  %1 of %2 operators quickened").arg(counter.quickened).arg(counter.operators);
+    report << QString("  generic operators: %1 ms per run").arg(time[0] / 1e6, 0, 'f', 3);
+    report << QString("  quickened:         %1 ms per run (%2x)")
+                  .arg(time[1] / 1e6, 0, 'f', 3)
+                  .arg(time[1] > 0 ? double(time[0]) / time[1] : 0.0, 0, 'f', 2);
+
+    return report.join("\n");
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <QString>
+
+namespace VTScript
+{
+    /*
+        Throughput measurements of the script engine, run by VTScriptBench (Bench.pro);
+        the application doesn't contain them. Every function returns a human readable report.
+    */
+    namespace Benchmark
+    {
+        // regex lexer vs Lexer, in MB/s of UTF-16 source
+        QString lexer( const QString& source, int iterations = 10 );
+
+        // precedence climbing vs the reference parser with one function per precedence level, lexing excluded
+        QString parser( const QString& source, int iterations = 10 );
+
+        // full parse vs IncrementalParser update after a one character edit in the middle of source
+        QString incremental( const QString& source, int iterations = 10 );
+
+        // pointer tree vs Flat::Tree: memory, full traversal, conversion
+        QString flat_ast( const QString& source, int iterations = 10 );
+
+        // startup (lex, parse, check) with every function body parsed vs bodies deferred to the first call
+        QString lazy_functions( const QString& source, int iterations = 10 );
+
+        // loading a script from its source file the way exec does vs from a .vtsc file, files written to the temp directory
+        QString compiled( const QString& source, int iterations = 10 );
+
+        // exec loading a script file again and again without and with ProgramCache
+        QString program_cache( const QString& source, int iterations = 10 );
+
+        // running a script (its output included) after Resolver has bound its names, and the resolver pass itself
+        QString interpreter( const QString& source, int iterations = 5 );
+
+        // running a script (its output included) as written vs after Optimizer folded and propagated its constants
+        QString constant_folding( const QString& source, int iterations = 5 );
+
+        // running a script (its output included) with operators on generic WS methods vs on TypeInference's fast paths
+        QString type_inference( const QString& source, int iterations = 5 );
+
+        // running a script (its output included) with untyped operators on generic WS methods vs quickened from the types seen at run time
+        QString quickening( const QString& source, int iterations = 5 );
+
+        // running a script (its output included) with every call made vs with small functions inlined by Inliner
+        QString inlining( const QString& source, int iterations = 5 );
+
+        // running a script (its output included) with loop invariant expressions evaluated on every iteration vs kept by LoopInvariants
+        QString loop_invariants( const QString& source, int iterations = 5 );
+
+        // lowering the script and its functions to IR and running IROptimizer; the report ends with the optimized IR
+        QString ir( const QString& source, int iterations = 10 );
+
+        // running a script (its output included) on the tree walker vs compiled to bytecode for the stack VM
+        QString bytecode( const QString& source, int iterations = 5 );
+
+        // running a script (its output included) on the tree walker vs turned into closures by ClosureCompiler
+        QString closures( const QString& source, int iterations = 5 );
+
+        // running a script (its output included) on the bytecode VM vs with hot functions compiled to machine code
+        QString jit( const QString& source, int iterations = 5 );
+
+        // building native code of a script's functions, and running it (its output included) on the tree walker vs with them
+        QString native( const QString& source, int iterations = 5 );
+    };
+};
@@ -0,0 +1,92 @@
+#include "Benchmark.h"
+#include "Errors.h"
+
+#include <QFile>
+#include <QIODevice>
+#include <QTextStream>
+#include <QString>
+
+#include <cstdio>
+
+using namespace VTScript;
+
+namespace
+{
+    typedef QString (*Run)( const QString& source );
+
+    struct Entry
+    {
+        const char* name;
+        Run run;
+        const char* description;
+    };
+
+    // the benchmarks by name, with the iteration counts Benchmark.h gives them
+    const Entry benchmarks[] =
+    {
+        { "lexer",       []( const QString& s ) -> QString { return Benchmark::lexer( s ); },            "regex lexer vs Lexer" },
+        { "parser",      []( const QString& s ) -> QString { return Benchmark::parser( s ); },           "precedence climbing vs one function per level" },
+        { "incremental", []( const QString& s ) -> QString { return Benchmark::incremental( s ); },      "full parse vs IncrementalParser after an edit" },
+        { "flat",        []( const QString& s ) -> QString { return Benchmark::flat_ast( s ); },         "pointer tree vs Flat::Tree" },
+        { "lazy",        []( const QString& s ) -> QString { return Benchmark::lazy_functions( s ); },   "function bodies parsed up front vs on the first call" },
+        { "compiled",    []( const QString& s ) -> QString { return Benchmark::compiled( s ); },         "loading the source vs a .vtsc file" },
+        { "cache",       []( const QString& s ) -> QString { return Benchmark::program_cache( s ); },    "exec loading a script again and again without and with ProgramCache" },
+        { "interpreter", []( const QString& s ) -> QString { return Benchmark::interpreter( s ); },      "running after Resolver bound the names, and the pass itself" },
+        { "fold",        []( const QString& s ) -> QString { return Benchmark::constant_folding( s ); }, "as written vs after Optimizer" },
+        { "types",       []( const QString& s ) -> QString { return Benchmark::type_inference( s ); },   "generic operators vs TypeInference's fast paths" },
+        { "quicken",     []( const QString& s ) -> QString { return Benchmark::quickening( s ); },       "generic operators vs quickened from run-time types" },
+        { "inline",      []( const QString& s ) -> QString { return Benchmark::inlining( s ); },         "every call made vs small functions inlined" },
+        { "invariants",  []( const QString& s ) -> QString { return Benchmark::loop_invariants( s ); },  "loop invariants evaluated every time vs kept" },
+        { "ir",          []( const QString& s ) -> QString { return Benchmark::ir( s ); },               "lowering to IR and IROptimizer, with the IR" },
+        { "bytecode",    []( const QString& s ) -> QString { return Benchmark::bytecode( s ); },         "tree walker vs bytecode VM" },
+        { "closures",    []( const QString& s ) -> QString { return Benchmark::closures( s ); },         "tree walker vs closures" },
+        { "jit",         []( const QString& s ) -> QString { return Benchmark::jit( s ); },              "bytecode VM vs baseline JIT" },
+        { "native",      []( const QString& s ) -> QString { return Benchmark::native( s ); },           "tree walker vs native code of compile_native" },
+    };
+
+    int usage()
+    {
+        std::fputs( "Usage: VTScriptBench <benchmark> <script_path>\nBenchmarks:\n", stderr );
+        for ( size_t i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); ++i )
+            std::fprintf( stderr, "  %-12s %s\n", benchmarks[i].name, benchmarks[i].description );
+        return 2;
+    }
+}
+
+int main( int argc, char* argv[] )
+{
+    if ( argc != 3 )
+        return usage();
+
+    const QString name = QString::fromLocal8Bit( argv[1] );
+    const QString path = QString::fromLocal8Bit( argv[2] );
+
+    Run run = NULL;
+    for ( size_t i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); ++i )
+    {
+        if ( name == benchmarks[i].name )
+            run = benchmarks[i].run;
+    }
+    if ( run == NULL )
+        return usage();
+
+    QFile file( path );
+    if ( !file.open( QIODevice::ReadOnly | QIODevice::Text ) )
+    {
+        std::fprintf( stderr, "Couldn't open file: %s\n", argv[2] );
+        return 1;
+    }
+    const QString source = QTextStream( &file ).readAll();
+
+    try
+    {
+        std::puts( run( source ).toLocal8Bit().constData() );
+    }
+    catch ( const std::exception& e )
+    {
+        std::fprintf( stderr, "Benchmark failed: %s\n", e.what() );
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,135 @@
+#include "ReferenceLexer.h"
+#include "Lexer.h"
+#include "Errors.h"
+
+#include <QHash>
+#include <QSet>
+#include <QRegExp>
+
+using namespace VTScript;
+
+namespace
+{
+    struct Rules
+    {
+        Rules()
+        {
+            keywords << "while" << "if" << "else" << "def" << "true" << "false"
+                << "return" << "break" << "continue" << "or" << "and" << "not" << "None";
+
+            regexps[Token::Identifier] = QRegExp( "^(" "[_A-Za-z][_A-Za-z0-9]*"
+                                                   "|" "operator.+(?=\\()"
+                                                   ")" );
+            regexps[Token::Rational] = QRegExp( "^\\d*\\.\\d+" );
+            regexps[Token::Integral] = QRegExp( "^\\d+" );
+            regexps[Token::Literal] = QRegExp( "^("    "\"[^\"\\r\\n]*\""
+                                                   "|" "\'[^\'\\r\\n]*\'"
+                                               ")" );
+
+            regexps[Token::Operator] = QRegExp( "^("    "="
+                                                    "|" "<"
+                                                    "|" ">"
+                                                    "|" "<="
+                                                    "|" ">="
+                                                    "|" "=="
+                                                    "|" "!="
+                                                    "|" "\\+"
+                                                    "|" "-"
+                                                    "|" "\\*"
+                                                    "|" "/"
+                                                    "|" "%"
+                                                    "|" "\\("
+                                                    "|" "\\)"
+                                                    "|" "\\{"
+                                                    "|" "\\}"
+                                                    "|" "\\["
+                                                    "|" "\\]"
+                                                    "|" ";"
+                                                    "|" "\\."
+                                                    "|" ","
+                                                ")" );
+
+            regexps[Token::Whitespace] = QRegExp( "^[ \t]*" );
+            regexps[Token::Newline] = QRegExp( "^(\\n|\\r\\n)" );
+            regexps[Token::Comment] = QRegExp( "^//[^\\n\\r]*" );
+        }
+
+        QSet<QString> keywords;
+        QHash<Token::Type, QRegExp> regexps;
+    };
+}
+
+QVector<Token> ReferenceLexer::lex( const QString& source, IdentifierTable& identifiers )
+{
+    // the regexes are compiled on the first use, not when the benchmark starts
+    static Rules rules;
+
+    QVector<Token> tokens;
+    ulong line = 1;
+    int position = 0;
+
+    tokens << Token(Token::Operator, &Lexer::script_begin, line, TokenCodes::LeftBrace);
+
+    while ( position < source.size() )
+    {
+        int max_len = 0;
+        Token::Type type;
+
+        for ( QHash<Token::Type, QRegExp>::iterator it = rules.regexps.begin(); it != rules.regexps.end(); ++it )
+        {
+            if ( -1 != it.value().indexIn( source, position, QRegExp::CaretAtOffset ) )
+            {
+                int len = it.value().matchedLength();
+
+                if ( len > max_len )
+                {
+                    max_len = len;
+                    type = it.key();
+                }
+            }
+        }
+
+        if ( max_len == 0 )
+        {
+            throw LexError( QString("Couldn't match any token in line %1").arg(line) );
+        }
+
+        if ( type == Token::Comment || type == Token::Whitespace )
+        {
+            //skip
+        }
+        else if ( type == Token::Newline )
+        {
+            line++;
+        }
+        else
+        {
+            if ( type == Token::Literal )
+            {
+                tokens << Token( type, &source, position + 1, max_len - 2, line );
+            }
+            else
+            {
+                if ( type == Token::Identifier && rules.keywords.contains( rules.regexps[type].cap( 0 ) ) )
+                    type = Token::Keyword;
+
+                const QChar* text = source.constData() + position;
+                int id = 0;
+                if ( type == Token::Identifier )
+                    id = identifiers.intern( text, max_len );
+                else if ( type == Token::Keyword )
+                    id = TokenCodes::keyword_code( text, max_len );
+                else if ( type == Token::Operator )
+                    id = TokenCodes::operator_code( text, max_len );
+
+                tokens << Token( type, &source, position, max_len, line, id );
+            }
+        }
+
+        position += max_len;
+    }
+
+    tokens << Token(Token::Operator, &Lexer::script_end, line, TokenCodes::RightBrace);
+    tokens << Token(Token::Eof, &Lexer::eof, line);
+    return tokens;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "Token.h"
+#include "Identifiers.h"
+
+#include <QString>
+#include <QVector>
+
+namespace VTScript
+{
+    /*
+        The lexer the engine had before Lexer: at every position each token type's regex
+        is tried and the longest match wins. Makes the same tokens, kept here to benchmark
+        Lexer against; the application doesn't contain it.
+    */
+    class ReferenceLexer
+    {
+    public:
+        // throws LexError
+        static QVector<Token> lex( const QString& source, IdentifierTable& identifiers );
+    };
+
+}
@@ -0,0 +1,501 @@
+#include "ReferenceParser.h"
+#include "Errors.h"
+
+#include <QVarLengthArray>
+
+using namespace VTScript;
+using namespace AST;
+
+// levels with a grammar of their own, see below
+template<> Expression* ReferenceParser::parse_expression<9>( PARSE_ARGUMENTS );
+template<> Expression* ReferenceParser::parse_expression<2>( PARSE_ARGUMENTS );
+template<> Expression* ReferenceParser::parse_expression<1>( PARSE_ARGUMENTS );
+template<> Expression* ReferenceParser::parse_expression_subtree<1>( Expression* left_branch, PARSE_ARGUMENTS );
+
+Block* ReferenceParser::parse( const QVector<Token>& tokens, Program& program )
+{
+    TokenStream tstream( tokens );
+    Flags flags( Flags::NoSemicolon );
+
+    try
+    {
+        //main block is just a list of statements (block without curly braces)
+        return parse_block( tstream, flags, program );
+    }
+    catch ( const ParseError& e )
+    {
+        throw ParseError( QString("Parser: Error in token: %1 ;  %2").arg(tstream.current().to_string()).arg(e.what()) );
+    }
+}
+
+/*
+    Statements are the same as in Parser, see there for the grammar.
+*/
+Node* ReferenceParser::parse_statement( TokenStream& tstream, Flags flags, Program& program )
+{
+    if ( tstream.is_at(TokenCodes::Def) )
+        return parse_function_declaration(tstream, flags, program);
+
+    else if ( tstream.is_at(TokenCodes::While) )
+        return parse_while(tstream, flags, program);
+
+    else if ( tstream.is_at(TokenCodes::If) )
+        return parse_if(tstream, flags, program);
+
+    else if ( tstream.is_at(TokenCodes::LeftBrace) )
+        return parse_block(tstream, flags, program);
+
+    else if ( tstream.is_at(TokenCodes::Return) )
+        return parse_return(tstream, flags, program);
+
+    else if ( tstream.is_at(TokenCodes::Break) )
+        return parse_break(tstream, flags, program);
+
+    else if ( tstream.is_at(TokenCodes::Continue) )
+        return parse_continue(tstream, flags, program);
+
+    else
+    {
+        Expression* expr = parse_expression_root(tstream, flags, program);
+        tstream.match( TokenCodes::Semicolon, flags.is_set(Flags::NoSemicolon) );
+        return expr;
+    }
+}
+
+Block* ReferenceParser::parse_block( TokenStream& tstream, Flags flags, Program& program )
+{
+    ulong line = tstream.current().line();
+    QVarLengthArray<Node*, 16> statements;
+
+    tstream.match( TokenCodes::LeftBrace );
+
+    while ( true )
+    {
+        if (tstream.is_at(TokenCodes::RightBrace))
+            break;
+
+        statements.append( parse_statement( tstream, flags, program ) );
+    }
+
+    tstream.match( TokenCodes::RightBrace );
+
+    return program.arena().create<Block>(line, NodeList<Node>::copy(program.arena(), statements));
+}
+
+FunctionDeclaration* ReferenceParser::parse_function_declaration( TokenStream& tstream, Flags flags, Program& program )
+{
+    ulong line = tstream.current().line();
+
+    QString name;
+    QStringList params;
+
+    tstream.match(TokenCodes::Def);
+    tstream.match(Token::Identifier);
+    name = program.identifiers().name(tstream.previous().symbol());
+    tstream.match(TokenCodes::LeftParen);
+
+    while ( true )
+    {
+        if (tstream.is_at(TokenCodes::RightParen))
+            break;
+
+        tstream.match(Token::Identifier);
+        params << program.identifiers().name(tstream.previous().symbol());
+
+        if (tstream.is_at(TokenCodes::RightParen))
+            break;
+
+        tstream.match(TokenCodes::Comma);
+    }
+
+    tstream.match( TokenCodes::RightParen );
+
+    Block* body = parse_block(tstream, flags, program);
+
+    return program.arena().create<FunctionDeclaration>(line, name, params, body);
+}
+
+While* ReferenceParser::parse_while( TokenStream& tstream, Flags flags, Program& program )
+{
+    ulong line = tstream.current().line();
+
+    tstream.match(TokenCodes::While);
+    tstream.match(TokenCodes::LeftParen);
+    Expression* cond = parse_expression_root(tstream, flags, program);
+    tstream.match(TokenCodes::RightParen);
+    Node* body = parse_statement(tstream, flags, program);
+
+    return program.arena().create<While>(line, cond, body);
+}
+
+If* ReferenceParser::parse_if( TokenStream& tstream, Flags flags, Program& program )
+{
+    ulong line = tstream.current().line();
+
+    tstream.match(TokenCodes::If);
+    tstream.match(TokenCodes::LeftParen);
+    Expression* cond = parse_expression_root(tstream, flags, program);
+    tstream.match(TokenCodes::RightParen);
+    Node* then_ = parse_statement(tstream, flags, program);
+    Node* else_ = NULL;
+
+    if ( tstream.is_at(TokenCodes::Else) )
+    {
+        tstream.advance();
+        else_ = parse_statement(tstream, flags, program);
+    }
+    else
+        else_ = program.arena().create<Noop>(line);
+
+    return program.arena().create<If>(line, cond, then_, else_);
+}
+
+Return* ReferenceParser::parse_return( TokenStream& tstream, Flags flags, Program& program )
+{
+    ulong line = tstream.current().line();
+
+    tstream.match(TokenCodes::Return);
+    Expression* expr = parse_expression_root(tstream, flags, program);
+    tstream.match( TokenCodes::Semicolon, flags.is_set(Flags::NoSemicolon) );
+
+    return program.arena().create<Return>(line, expr);
+}
+
+Break* ReferenceParser::parse_break( TokenStream& tstream, Flags flags, Program& program )
+{
+    ulong line = tstream.current().line();
+
+    tstream.match(TokenCodes::Break);
+    tstream.match( TokenCodes::Semicolon, flags.is_set(Flags::NoSemicolon) );
+
+    return program.arena().create<Break>(line);
+}
+
+Continue* ReferenceParser::parse_continue( TokenStream& tstream, Flags flags, Program& program )
+{
+    ulong line = tstream.current().line();
+
+    tstream.match(TokenCodes::Continue);
+    tstream.match( TokenCodes::Semicolon, flags.is_set(Flags::NoSemicolon) );
+
+    return program.arena().create<Continue>(line);
+}
+
+/*
+    Precedence levels are the ones listed in Parser.
+*/
+Expression* ReferenceParser::parse_expression_root( TokenStream& tstream, Flags flags, Program& program )
+{
+    return parse_expression<9>( tstream, flags, program );
+}
+
+
+/*
+    LVL_IX -> LVL_VIII "=" LVL_IX
+
+        Luckily, we can leave this as it is.
+
+*/
+template<>
+Expression* ReferenceParser::parse_expression<9>( TokenStream& tstream, Flags flags, Program& program )
+{
+    Expression* left_branch = parse_expression<8>( tstream, flags, program );
+    if ( tstream.is_at(TokenCodes::Assign) )
+    {
+        OperatorType type = Parser::statics.binary_oper_type[TokenCodes::Assign];
+        ulong line = tstream.current().line();
+
+        tstream.advance();
+
+        Leaf* name = dynamic_cast<Leaf*>(left_branch);
+
+        if (name == NULL || !name->is_identifier())
+            throw ParseError("Not a valid lvalue for assignment");
+
+        Expression* right = parse_expression<9>(tstream, flags, program);
+        return program.arena().create<BinaryOperator>( line, left_branch, right, type );
+    }
+    else
+    {
+        return left_branch;
+    }
+}
+
+
+/*
+Left-recursive version:
+    LVL_III -> LVL_III "*" LVL_II
+             | LVL_III "/" LVL_II
+             | LVL_III "%" LVL_II
+             | LVL_II
+
+    LVL_IV -> LVL_IV "+" LVL_III
+            | LVL_IV "-" LVL_III
+            | LVL_III
+
+    LVL_V -> LVL_V ">" LVL_IV
+           | LVL_V "<" LVL_IV
+           | LVL_V ">=" LVL_IV
+           | LVL_V "<=" LVL_IV
+           | LVL_IV
+
+    LVL_VI -> LVL_VI "==" LVL_V
+            | LVL_VI "!=" LVL_V
+            | LVL_V
+
+    LVL_VII -> LVL_VII "and" LVL_VI
+             | LVL_VI
+
+    LVL_VIII -> LVL_VIII "or" LVL_VII
+              | LVL_VII
+
+   Sadly, we must convert this version to right-recursive to be able to implement it in top-down parser
+
+Right-recursive version:
+    LVL_III -> LVL_II SUB_LVL_III
+
+    SUB_LVL_III -> "*" LVL_II SUB_LVL_III
+                 | "/" LVL_II SUB_LVL_III
+                 | "%" LVL_II SUB_LVL_III
+                 | e
+
+     and so on ...
+
+        * Left branch becomes a child of right branch (left-to-right association)
+*/
+template<int precedence>
+Expression* ReferenceParser::parse_expression( TokenStream& tstream, Flags flags, Program& program )
+{
+    Expression* left_branch = parse_expression<precedence-1>( tstream, flags, program );
+    Expression* root = parse_expression_subtree<precedence>( left_branch, tstream, flags, program );
+
+    if ( root == NULL )
+        root = left_branch;
+
+    return root;
+}
+
+// SUB_LVL_PRECEDENCE
+template<int precedence>
+Expression* ReferenceParser::parse_expression_subtree( AST::Expression* left_branch, TokenStream& tstream, Flags flags, Program& program )
+{
+    Expression* result;
+    TokenCode code = tstream.current().code();
+    if ( Parser::statics.binary_precedence[code] == precedence )
+    {
+        OperatorType type = Parser::statics.binary_oper_type[code];
+        ulong line = tstream.current().line();
+
+        tstream.advance();
+        Expression* right = parse_expression<precedence-1>(tstream, flags, program);
+        result = program.arena().create<BinaryOperator>( line, left_branch, right, type );
+    }
+    else
+        return NULL;
+
+    // Parse next "same-level" expression in chain
+    Expression* root = parse_expression_subtree<precedence>( result, tstream, flags, program );
+
+    if ( root == NULL )
+        root = result;
+
+    return root;
+}
+
+
+/*
+    LVL_II -> not LVL_II
+            | + LVL_II
+            | - LVL_II
+            | LVL_I
+
+    Luckily, we can leave this as it is.
+
+     * (right-to-left association)
+*/
+template<>
+Expression* ReferenceParser::parse_expression<2>( TokenStream& tstream, Flags flags, Program& program )
+{
+    OperatorType type = Parser::statics.unary_oper_type[tstream.current().code()];
+    if ( type != OperatorTypes::Error )
+    {
+        ulong line = tstream.current().line();
+
+        tstream.advance();
+        Expression* arg = parse_expression<2>(tstream, flags, program);
+        return program.arena().create<UnaryOperator>(line, arg, type);
+    }
+
+    return parse_expression<1>(tstream, flags, program);   //fall-through
+}
+
+
+/*
+Left-recursive version:
+    LVL_I -> LVL_I "(" EXPRESSION "," EXPRESSION "," ... ")"
+           | LVL_I "[" EXPRESSION "]"
+           | LVL_I "." LVL_0
+           | LVL_0
+
+   Sadly, we must convert this version to right-recursive to be able to implement it in top-down parser
+
+Right-recursive version:
+    LVL_I -> LVL_0 SUB_LVL_I
+
+    SUB_LVL_I -> "(" EXPRESSION "," EXPRESSION "," ... ")" SUB_LVL_I    // unary operator
+               | "[" EXPRESSION "]" SUB_LVL_I                           // unary operator
+               | "." LVL_0 SUB_LVL_I                                    // binary operator
+               | e                                                      // empty token
+
+        * Left branch becomes a child of right branch (left-to-right association)
+*/
+template<>
+Expression* ReferenceParser::parse_expression<1>( TokenStream& tstream, Flags flags, Program& program )
+{
+    Expression* left_branch = parse_expression_leaf( tstream, flags, program );
+    Expression* root = parse_expression_subtree<1>( left_branch, tstream, flags, program );
+
+    if ( root == NULL )
+        root = left_branch;
+
+    return root;
+}
+
+// SUB_LVL_I
+template<>
+Expression* ReferenceParser::parse_expression_subtree<1>( AST::Expression* left_branch, TokenStream& tstream, Flags flags, Program& program )
+{
+    Expression* result;
+    ulong line = tstream.current().line();
+
+    if (tstream.is_at(TokenCodes::LeftParen))             // function call
+    {
+        NodeList<Expression> args = parse_call_arguments(tstream, flags, program);
+        result = program.arena().create<FunctionCall>(line, left_branch, args);
+    }
+    else if (tstream.is_at(TokenCodes::LeftBracket))        // Subscription
+    {
+        OperatorType type = Parser::statics.binary_oper_type[TokenCodes::LeftBracket];
+        tstream.match(TokenCodes::LeftBracket);
+        Expression* right = parse_expression_root(tstream, flags, program);
+        tstream.match(TokenCodes::RightBracket);
+        result = program.arena().create<BinaryOperator>(line, left_branch, right, type);
+    }
+    else if (tstream.is_at(TokenCodes::Dot))        // Element selection
+    {
+        OperatorType type = Parser::statics.binary_oper_type[TokenCodes::Dot];
+        tstream.match(TokenCodes::Dot);
+        Expression* right = parse_expression_root(tstream, flags, program);
+        result = program.arena().create<BinaryOperator>(line, left_branch, right, type);
+    }
+    else                                        // e
+        return NULL;
+
+    // Parse next "same-level" expression in chain (SUB_LVL_I)
+    Expression* root = parse_expression_subtree<1>( result, tstream, flags, program );
+
+    if ( root == NULL )
+        root = result;
+
+    return root;
+}
+
+NodeList<Expression> ReferenceParser::parse_call_arguments( TokenStream& tstream, Flags flags, Program& program )
+{
+    tstream.match(TokenCodes::LeftParen);
+    QVarLengthArray<Expression*, 8> args;
+
+    while ( true )
+    {
+        if (tstream.is_at(TokenCodes::RightParen))
+            break;
+
+        args.append(parse_expression_root(tstream, flags, program));
+
+        if (tstream.is_at(TokenCodes::RightParen))
+            break;
+
+        tstream.match(TokenCodes::Comma);
+    }
+
+    tstream.match(TokenCodes::RightParen);
+    return NodeList<Expression>::copy(program.arena(), args);
+}
+
+/*
+    LVL_0, the same as in Parser
+*/
+Expression* ReferenceParser::parse_expression_leaf( TokenStream& tstream, Flags flags, Program& program )
+{
+    if ( tstream.is_at(TokenCodes::LeftParen) )
+    {
+        tstream.match(TokenCodes::LeftParen);
+        Expression* expr = parse_expression_root( tstream, flags, program );
+        tstream.match(TokenCodes::RightParen);
+        return expr;
+    }
+    else if ( tstream.is_at(Token::Identifier) ||
+              tstream.is_at(Token::Integral) ||
+              tstream.is_at(Token::Rational) ||
+              tstream.is_at(Token::Literal) ||
+              tstream.is_at(TokenCodes::True) ||
+              tstream.is_at(TokenCodes::False) ||
+              tstream.is_at(TokenCodes::None))
+    {
+        ulong line = tstream.current().line();
+        QString name;
+        WS::SP_Object object;
+
+        switch (tstream.current().type())
+        {
+        case Token::Identifier:
+            {
+                name = program.identifiers().name(tstream.current().symbol());
+            }
+            break;
+        case Token::Rational:
+            {
+                bool ok;
+                double d = tstream.current().text().toDouble(&ok);
+                if (ok)
+                    object = WS::SP_Object(new WS::Rational(d));
+                else
+                    throw ParseError(QString("Line %1: Error interpreting rational number: '%2'").arg(line).arg(tstream.current().data()));
+            }
+            break;
+        case Token::Integral:
+            {
+                bool ok;
+                long long l = tstream.current().text().toLongLong(&ok);
+                if (ok)
+                    object = WS::SP_Object(new WS::Integral(l));
+                else
+                    throw ParseError(QString("Line %1: Error interpreting integral number: '%2'").arg(line).arg(tstream.current().data()));
+            }
+            break;
+        case Token::Literal:
+            {
+                object = WS::SP_Object(new WS::String(tstream.current().data()));
+            }
+            break;
+        case Token::Keyword:
+            {
+                if (tstream.is_at(TokenCodes::True))
+                    object = WS::SP_Object(new WS::Bool(true));
+                else if (tstream.is_at(TokenCodes::False))
+                    object = WS::SP_Object(new WS::Bool(false));
+                else if (tstream.is_at(TokenCodes::None))
+                    object = WS::SP_Object(new WS::None());
+            }
+            break;
+        default:
+            break;
+        }
+
+        tstream.advance();
+        return program.arena().create<Leaf>(line, name, object);
+    }
+
+    throw ParseError( QString("Unexpected token \"%1\" while parsing expression leaf")
+                          .arg( tstream.current().to_string() ) );
+}
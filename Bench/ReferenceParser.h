@@ -0,0 +1,38 @@
+#pragma once
+
+#include "ScriptParser.h"
+
+namespace VTScript
+{
+    /*
+        The parser the engine had before precedence climbing: plain recursive descent with
+        one function per precedence level, so every leaf goes through all of them.
+        Builds the same trees as Parser (functions are always parsed eagerly), kept here to
+        benchmark Parser::parse_operators against; the application doesn't contain it.
+    */
+    class ReferenceParser
+    {
+    public:
+        // throws ParseError; parses lexed 'tokens' into 'program' without checking them
+        static AST::Block* parse( const QVector<Token>& tokens, Program& program );
+
+    private:
+        static AST::Node* parse_statement( PARSE_ARGUMENTS );
+        static AST::Block* parse_block( PARSE_ARGUMENTS );
+        static AST::FunctionDeclaration* parse_function_declaration( PARSE_ARGUMENTS );
+        static AST::While* parse_while( PARSE_ARGUMENTS );
+        static AST::If* parse_if( PARSE_ARGUMENTS );
+        static AST::Return* parse_return( PARSE_ARGUMENTS );
+        static AST::Break* parse_break( PARSE_ARGUMENTS );
+        static AST::Continue* parse_continue( PARSE_ARGUMENTS );
+
+        static AST::Expression* parse_expression_root( PARSE_ARGUMENTS );
+        template<int precedence>
+        static AST::Expression* parse_expression( PARSE_ARGUMENTS );
+        template<int precedence>
+        static AST::Expression* parse_expression_subtree( AST::Expression* left_branch, PARSE_ARGUMENTS );
+        static AST::NodeList<AST::Expression> parse_call_arguments( PARSE_ARGUMENTS );
+        static AST::Expression* parse_expression_leaf( PARSE_ARGUMENTS );
+    };
+
+}
@@ -1,67 +1,69 @@
 #include "Highlighter.h"
  
+#include "ScriptEngine/Lexer.h"
+
 #include <QtGui>
 
+using namespace VTScript;
+
 
 Highlighter::Highlighter(QTextDocument *parent)
     : QSyntaxHighlighter(parent)
 {
-    HighlightingRule rule;
-
     keywordFormat.setForeground(Qt::darkBlue);
     keywordFormat.setFontWeight(QFont::Bold);
-    QStringList keywordPatterns;
-    keywordPatterns << "\\bwhile\\b" << "\\bif\\b" << "\\belse\\b"
-                    << "\\breturn\\b" << "\\bbreak\\b" << "\\bcontinue\\b"
-                    << "\\bdef\\b" << "\\band\\b" << "\\bor\\b"
-                    << "\\bnot\\b" << "\\btrue\\b" << "\\bfalse\\b" << "\\bNone\\b";
-    foreach (const QString &pattern, keywordPatterns) {
-        rule.pattern = QRegExp(pattern);
-        rule.format = keywordFormat;
-        highlightingRules.append(rule);
-    }
 
     singleLineCommentFormat.setForeground(Qt::red);
-    rule.pattern = QRegExp("//[^\\n\\r]*");
-    rule.format = singleLineCommentFormat;
-    highlightingRules.append(rule);
 
-    
     doubleFormat.setForeground(Qt::darkCyan);
-    rule.pattern = QRegExp("\\b\\d*\\.\\d+\\b");
-    rule.format = doubleFormat;
-    highlightingRules.append(rule);
 
     intFormat.setForeground(Qt::darkCyan);
-    rule.pattern = QRegExp("\\b\\d+\\b");
-    rule.format = intFormat;
-    highlightingRules.append(rule);
-
 
     quotationFormat.setForeground(Qt::darkGreen);
-    rule.pattern = QRegExp("(" "\"[^\"\\r\\n]*\""
-                           "|" "\'[^\'\\r\\n]*\'"
-                           ")");
-    rule.format = quotationFormat;
-    highlightingRules.append(rule);
 
     functionFormat.setFontItalic(true);
     functionFormat.setForeground(Qt::blue);
-    rule.pattern = QRegExp("\\b(?:def )[_A-Za-z][_A-Za-z0-9]*\\(?=\\()");
-    rule.format = functionFormat;
-    highlightingRules.append(rule);
-
 }
 
+/*
+    Uses the engine lexer, so highlighting follows the real grammar and costs one linear
+    pass over the block. The only thing carried between blocks is a "def" that ended
+    the previous line; QSyntaxHighlighter rehighlights the next block when it changes.
+*/
 void Highlighter::highlightBlock(const QString &text)
 {
-    foreach (const HighlightingRule &rule, highlightingRules) {
-        QRegExp expression(rule.pattern);
-        int index = expression.indexIn(text);
-        while (index >= 0) {
-            int length = expression.matchedLength();
-            setFormat(index, length, rule.format);
-            index = expression.indexIn(text, index + length);
+    Lexer::lex_line(text, tokens);
+
+    bool after_def = (previousBlockState() == AfterDef);
+
+    foreach (const Token &token, tokens) {
+        switch (token.type()) {
+        case Token::Keyword:
+            setFormat(token.position(), token.size(), keywordFormat);
+            after_def = (token.code() == TokenCodes::Def);
+            continue;
+        case Token::Identifier:
+            if (after_def)
+                setFormat(token.position(), token.size(), functionFormat);
+            break;
+        case Token::Integral:
+            setFormat(token.position(), token.size(), intFormat);
+            break;
+        case Token::Rational:
+            setFormat(token.position(), token.size(), doubleFormat);
+            break;
+        case Token::Literal:
+            // with the quotes
+            setFormat(token.position() - 1, token.size() + 2, quotationFormat);
+            break;
+        case Token::Comment:
+            setFormat(token.position(), token.size(), singleLineCommentFormat);
+            continue;
+        default:
+            break;
         }
+        after_def = false;
     }
+
+    setCurrentBlockState(after_def ? AfterDef : Normal);
 }
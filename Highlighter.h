@@ -1,9 +1,12 @@
  #ifndef HIGHLIGHTER_H
  #define HIGHLIGHTER_H
 
+ #include "ScriptEngine/Token.h"
+
  #include <QSyntaxHighlighter>
 
  #include <QHash>
+ #include <QVector>
  #include <QTextCharFormat>
 
  class QTextDocument;
@@ -19,15 +22,14 @@
      void highlightBlock(const QString &text);
 
  private:
-     struct HighlightingRule
+     // block state, carried to the next line
+     enum State
      {
-         QRegExp pattern;
-         QTextCharFormat format;
+         Normal = 0,
+         AfterDef    // line ended with "def", function name comes next
      };
-     QVector<HighlightingRule> highlightingRules;
 
-     QRegExp commentStartExpression;
-     QRegExp commentEndExpression;
+     QVector<VTScript::Token> tokens;    // reused for every block
 
      QTextCharFormat keywordFormat;
      QTextCharFormat classFormat;
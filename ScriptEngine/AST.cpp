@@ -20,6 +20,48 @@ void While               ::accept(ASTTools::NodeVisitor* visitor) { visitor->vis
 void If                  ::accept(ASTTools::NodeVisitor* visitor) { visitor->visit(this); }
 
 
+void BinaryOperator::record_types(VTScript::WSType left, VTScript::WSType right)
+{
+    if (_deoptimizations >= max_deoptimizations)
+        return;
+
+    if (left != right || left != _seen_type)
+    {
+        _seen_type = left == right ? left : VTScript::WSTypes::Base;
+        _seen_count = 0;
+    }
+
+    if (_seen_type == VTScript::WSTypes::Base)
+        return;
+
+    if (++_seen_count >= quicken_after)
+    {
+        _quick = VTScript::TypedOperators::binary_for(_type, _seen_type);
+        _seen_count = 0;
+
+        // no fast path for the operator and the type: the node stays generic for the rest of the run
+        if (_quick == NULL)
+            _deoptimizations = max_deoptimizations;
+    }
+}
+
+void BinaryOperator::deoptimize()
+{
+    _quick = NULL;
+    _seen_type = VTScript::WSTypes::Base;
+    _seen_count = 0;
+    ++_deoptimizations;
+}
+
+void BinaryOperator::forget_types()
+{
+    _quick = NULL;
+    _seen_type = VTScript::WSTypes::Base;
+    _seen_count = 0;
+    _deoptimizations = 0;
+}
+
+
 QString PrintNodeVisitor::print(Node* root)
 {
     result_string_list.clear();
@@ -36,7 +78,7 @@ void PrintNodeVisitor::visit(AST::Noop* /*node*/)
 
 void PrintNodeVisitor::visit(AST::Leaf* node)
 {
-    result_string_list << QString(indents.top() * TAB_SIZE, ' ') << node->name();
+    result_string_list << QString(indents.top() * TAB_SIZE, ' ') << ( node->is_identifier() ? node->name() : node->object()->__str__() );
 }
 
 //  <indent>  <function_name>(<arg1>, <arg2>, ...)
@@ -175,3 +217,239 @@ void PrintNodeVisitor::visit(AST::If* node)
     node->_else->accept(this);
     indents.pop();
 }
+
+
+void ShiftLinesVisitor::shift(Node* root)
+{
+    if (delta != 0)
+        root->accept(this);
+}
+
+void ShiftLinesVisitor::visit(AST::Noop* node)
+{
+    node->set_line(node->line() + delta);
+}
+
+void ShiftLinesVisitor::visit(AST::Leaf* node)
+{
+    node->set_line(node->line() + delta);
+}
+
+void ShiftLinesVisitor::visit(AST::FunctionCall* node)
+{
+    node->set_line(node->line() + delta);
+    node->function_object()->accept(this);
+
+    foreach ( Expression* arg, node->arguments_expressions() )
+        arg->accept(this);
+}
+
+void ShiftLinesVisitor::visit(AST::UnaryOperator* node)
+{
+    node->set_line(node->line() + delta);
+    node->argument()->accept(this);
+}
+
+void ShiftLinesVisitor::visit(AST::BinaryOperator* node)
+{
+    node->set_line(node->line() + delta);
+    node->left()->accept(this);
+    node->right()->accept(this);
+}
+
+void ShiftLinesVisitor::visit(AST::Return* node)
+{
+    node->set_line(node->line() + delta);
+    node->expr()->accept(this);
+}
+
+void ShiftLinesVisitor::visit(AST::Continue* node)
+{
+    node->set_line(node->line() + delta);
+}
+
+void ShiftLinesVisitor::visit(AST::Break* node)
+{
+    node->set_line(node->line() + delta);
+}
+
+void ShiftLinesVisitor::visit(AST::Block* node)
+{
+    node->set_line(node->line() + delta);
+
+    foreach (Node* stmt, node->_statements)
+        stmt->accept(this);
+}
+
+void ShiftLinesVisitor::visit(AST::FunctionDeclaration* node)
+{
+    node->set_line(node->line() + delta);
+    node->body()->accept(this);
+}
+
+void ShiftLinesVisitor::visit(AST::While* node)
+{
+    node->set_line(node->line() + delta);
+    node->_condition->accept(this);
+    node->_body->accept(this);
+}
+
+void ShiftLinesVisitor::visit(AST::If* node)
+{
+    node->set_line(node->line() + delta);
+    node->_condition->accept(this);
+    node->_then->accept(this);
+    node->_else->accept(this);
+}
+
+
+void ForgetTypesVisitor::forget(Node* root)
+{
+    root->accept(this);
+}
+
+void ForgetTypesVisitor::visit(AST::Noop* /*node*/)
+{
+}
+
+void ForgetTypesVisitor::visit(AST::Leaf* /*node*/)
+{
+}
+
+void ForgetTypesVisitor::visit(AST::FunctionCall* node)
+{
+    node->function_object()->accept(this);
+
+    foreach ( Expression* arg, node->arguments_expressions() )
+        arg->accept(this);
+
+    if (node->inlined() != NULL)
+        node->inlined()->body->accept(this);
+}
+
+void ForgetTypesVisitor::visit(AST::UnaryOperator* node)
+{
+    node->argument()->accept(this);
+}
+
+void ForgetTypesVisitor::visit(AST::BinaryOperator* node)
+{
+    node->forget_types();
+    node->left()->accept(this);
+    node->right()->accept(this);
+}
+
+void ForgetTypesVisitor::visit(AST::Return* node)
+{
+    node->expr()->accept(this);
+}
+
+void ForgetTypesVisitor::visit(AST::Continue* /*node*/)
+{
+}
+
+void ForgetTypesVisitor::visit(AST::Break* /*node*/)
+{
+}
+
+void ForgetTypesVisitor::visit(AST::Block* node)
+{
+    foreach (Node* stmt, node->_statements)
+        stmt->accept(this);
+}
+
+void ForgetTypesVisitor::visit(AST::FunctionDeclaration* node)
+{
+    // a deferred body has seen no types yet
+    if (node->is_body_parsed())
+        node->body()->accept(this);
+}
+
+void ForgetTypesVisitor::visit(AST::While* node)
+{
+    node->_condition->accept(this);
+    node->_body->accept(this);
+}
+
+void ForgetTypesVisitor::visit(AST::If* node)
+{
+    node->_condition->accept(this);
+    node->_then->accept(this);
+    node->_else->accept(this);
+}
+
+
+template <typename T>
+NodeList<T> CopyVisitor::copy_list(const NodeList<T>& nodes)
+{
+    T** array = arena.allocate_array<T*>(nodes.size());
+    for (int i = 0; i < nodes.size(); ++i)
+        array[i] = copy(nodes[i]);
+    return NodeList<T>(array, nodes.size());
+}
+
+void CopyVisitor::visit(AST::Noop* node)
+{
+    result = arena.create<Noop>(node->line());
+}
+
+void CopyVisitor::visit(AST::Leaf* node)
+{
+    result = arena.create<Leaf>(node->line(), node->name(), node->object());
+}
+
+void CopyVisitor::visit(AST::FunctionCall* node)
+{
+    Expression* fnc = copy(node->function_object());
+    result = arena.create<FunctionCall>(node->line(), fnc, copy_list(node->arguments_expressions()));
+}
+
+void CopyVisitor::visit(AST::UnaryOperator* node)
+{
+    result = arena.create<UnaryOperator>(node->line(), copy(node->argument()), node->type());
+}
+
+void CopyVisitor::visit(AST::BinaryOperator* node)
+{
+    Expression* left = copy(node->left());
+    Expression* right = copy(node->right());
+    result = arena.create<BinaryOperator>(node->line(), left, right, node->type());
+}
+
+void CopyVisitor::visit(AST::Return* node)
+{
+    result = arena.create<Return>(node->line(), copy(node->expr()));
+}
+
+void CopyVisitor::visit(AST::Continue* node)
+{
+    result = arena.create<Continue>(node->line());
+}
+
+void CopyVisitor::visit(AST::Break* node)
+{
+    result = arena.create<Break>(node->line());
+}
+
+void CopyVisitor::visit(AST::Block* node)
+{
+    result = arena.create<Block>(node->line(), copy_list(node->values()));
+}
+
+void CopyVisitor::visit(AST::FunctionDeclaration* node)
+{
+    result = arena.create<FunctionDeclaration>(node->line(), node->name(), node->parameters(), copy(node->body()));
+}
+
+void CopyVisitor::visit(AST::While* node)
+{
+    Expression* condition = copy(node->condition());
+    result = arena.create<While>(node->line(), condition, copy(node->body()));
+}
+
+void CopyVisitor::visit(AST::If* node)
+{
+    Expression* condition = copy(node->condition());
+    Node* then_stmt = copy(node->then_stmt());
+    result = arena.create<If>(node->line(), condition, then_stmt, copy(node->else_stmt()));
+}
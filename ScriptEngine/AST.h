@@ -3,6 +3,8 @@
 
 #include "Token.h"
 #include "Objects.h"
+#include "TypedOperators.h"
+#include "Arena.h"
 
 #include <QSet>
 #include <QList>
@@ -39,30 +41,122 @@ namespace VTScript
     {
         /*
             Abstract. Base for all AST nodes
+            Nodes are created in the arena of their Program (Arena::create) and freed together
+            with it, never one by one; that's why they have no virtual destructor.
         */
         class Node
         {
         public:
             Node(ulong line = 0) : _line(line) {}
-            virtual ~Node() {}
             virtual void accept(ASTTools::NodeVisitor* visitor) = 0;
 
             virtual ulong line() const { return _line; }
             virtual void set_line(ulong line) { _line = line; }
-            
+
+        protected:
+            ~Node() = default;
+
         private:
             ulong _line;
         };
 
 
+        /*
+            Child list of a node: a view of an array of node pointers in the program's arena.
+        */
+        template <typename T>
+        class NodeList
+        {
+        public:
+            typedef T* const* const_iterator;
+
+            NodeList() : _nodes(NULL), _size(0) {}
+            NodeList(T* const* nodes, int size) : _nodes(nodes), _size(size) {}
+
+            // copies 'nodes' (any container with size() and operator[]) into 'arena'
+            template <typename Container>
+            static NodeList copy(Arena& arena, const Container& nodes)
+            {
+                T** array = arena.allocate_array<T*>(nodes.size());
+                for (int i = 0; i < nodes.size(); ++i)
+                    array[i] = nodes[i];
+                return NodeList(array, nodes.size());
+            }
+
+            inline int size() const { return _size; }
+            inline bool isEmpty() const { return _size == 0; }
+            inline T* at(int i) const { return _nodes[i]; }
+            inline T* operator[](int i) const { return _nodes[i]; }
+            inline const_iterator begin() const { return _nodes; }
+            inline const_iterator end() const { return _nodes + _size; }
+
+            // for passes rewriting the tree in place; the array belongs to the program's arena
+            inline void replace(int i, T* node) const { const_cast<T**>(_nodes)[i] = node; }
+
+        private:
+            T* const* _nodes;
+            int _size;
+        };
+
+
+        /*
+            Where a variable lives at run time: slot 'slot' in the frame of the function
+            'depth' levels out from the running one. Filled in by Resolver.
+        */
+        struct Address
+        {
+            int depth;
+            int slot;
+        };
+
+
+        /*
+            Variables a name may refer to, innermost scope first. A variable exists once it
+            has been assigned, so the first address holding a value is the one; when none
+            does, a read gets the builtin of that name, if there is one.
+        */
+        struct Binding
+        {
+            Binding() : addresses(NULL), count(0), builtin(NULL) {}
+
+            const Address* addresses;
+            int count;
+            const VTScript::WS::SP_Object* builtin;
+        };
+
+
+        class Block;
+
+        /*
+            Copy of the body of the function a call is expected to call, set by Inliner.
+            The copy runs in the frame of the caller: its parameters and variables are in
+            slots [first_slot, first_slot + slot_count), emptied after every call.
+            The call is only inlined when it does call 'function'.
+        */
+        struct Inlined
+        {
+            const VTScript::WS::Function* function;
+            Block* body;
+            int first_slot;
+            int slot_count;
+            bool exclusive;     // the name can't hold another function, a call's value is the body's
+        };
+
+
         /*
             Abstract. Base for all expressions
         */
         class Expression : public Node
         {
         public:
-            Expression(ulong line) : Node(line) {}
-            virtual ~Expression() {}
+            Expression(ulong line) : Node(line), _cache_slot(-1) {}
+
+            // frame slot keeping the value of a loop invariant expression, -1 if none; see LoopInvariants
+            inline int cache_slot() const { return _cache_slot; }
+            inline void set_cache_slot(int slot) { _cache_slot = slot; }
+
+        private:
+            int _cache_slot;
         };
 
 
@@ -75,47 +169,49 @@ namespace VTScript
 
 
         /*
-        Holds either identifier ( is_identifier() == true:  data = QString data() ) 
+        Holds either identifier ( is_identifier() == true:  name = QString name() ) 
                   or object ( is_identifier() == false: obj = SP_WSObject object() )
         */
         class Leaf : public Expression
         {
         public:
-            Leaf(ulong line, VTScript::Token token, VTScript::WS::SP_Object object) : 
-                    Expression(line), _value(token), _obj(object) {}
+            Leaf(ulong line, QString name, VTScript::WS::SP_Object object) : 
+                    Expression(line), _name(name), _obj(object) {}
             void accept(ASTTools::NodeVisitor* visitor);
 
             // for interpreter
-            inline const bool is_identifier() const { return _value.type() == VTScript::Token::Identifier; }
-            inline const QString& name() const { return _value.data(); }
+            inline const bool is_identifier() const { return _obj.isNull(); }
+            inline const QString& name() const { return _name; }
             inline const VTScript::WS::SP_Object object() const { return _obj; }
+            inline const Binding& binding() const { return _binding; }
+            inline void set_binding(const Binding& binding) { _binding = binding; }
 
         private:
-            VTScript::Token _value;
+            QString _name;
             VTScript::WS::SP_Object _obj;
+            Binding _binding;
         };
 
 
         class FunctionCall : public Expression
         {
         public:
-            FunctionCall(ulong line, Expression* fnc_obj, QList<Expression*> args) : 
-                    Expression(line), _func_object(fnc_obj), _arguments(args) {}
-            ~FunctionCall()
-            {
-                delete _func_object;
-                foreach(Expression* expr, _arguments)
-                    delete expr;
-            }
+            FunctionCall(ulong line, Expression* fnc_obj, NodeList<Expression> args) : 
+                    Expression(line), _func_object(fnc_obj), _arguments(args), _inlined(NULL) {}
             void accept(ASTTools::NodeVisitor* visitor);
 
             // for interpreter
             inline Expression* function_object() const { return _func_object; }
-            inline const QList<Expression*>& arguments_expressions() const { return _arguments; }
+            inline const NodeList<Expression>& arguments_expressions() const { return _arguments; }
+            inline void set_function_object(Expression* fnc_obj) { _func_object = fnc_obj; }
+            // NULL unless Inliner copied the callee's body here
+            inline const Inlined* inlined() const { return _inlined; }
+            inline void set_inlined(const Inlined* inlined) { _inlined = inlined; }
             
         private:
             Expression* _func_object;
-            QList<Expression*> _arguments;
+            NodeList<Expression> _arguments;
+            const Inlined* _inlined;
         };
 
 
@@ -123,17 +219,22 @@ namespace VTScript
         {
         public:
             UnaryOperator( ulong line, Expression* arg, VTScript::OperatorType t ) : 
-                   Expression(line), _argument(arg), _type(t) {}
-            ~UnaryOperator() { delete _argument; }
+                   Expression(line), _argument(arg), _type(t), _operand_type(VTScript::WSTypes::Base) {}
             void accept(ASTTools::NodeVisitor* visitor);
 
             // for interpreter
             inline Expression* argument() const { return _argument; }
             inline VTScript::OperatorType type() const { return _type; }
+            // type the argument provably has, WSTypes::Base if not known; see TypeInference
+            inline VTScript::WSType operand_type() const { return _operand_type; }
+            inline void set_operand_type(VTScript::WSType type) { _operand_type = type; }
             
         public:
             Expression* _argument;
             VTScript::OperatorType _type;
+
+        private:
+            VTScript::WSType _operand_type;
         };
 
 
@@ -141,19 +242,51 @@ namespace VTScript
         {
         public:
             BinaryOperator( ulong line, Expression* left, Expression* right, VTScript::OperatorType t ) : 
-                    Expression(line), _left_branch(left), _right_branch(right), _type(t) {}
-            ~BinaryOperator() { delete _left_branch; delete _right_branch; }
+                    Expression(line), _left_branch(left), _right_branch(right), _type(t), _operand_type(VTScript::WSTypes::Base),
+                    _seen_type(VTScript::WSTypes::Base), _seen_count(0), _deoptimizations(0), _quick(NULL) {}
             void accept(ASTTools::NodeVisitor* visitor);
 
             // for interpreter
             inline Expression* right() const { return _right_branch; }
             inline Expression* left() const { return _left_branch; }
             inline VTScript::OperatorType type() const { return _type; }
-            
+            // type both operands provably have, WSTypes::Base if not known; see TypeInference
+            inline VTScript::WSType operand_type() const { return _operand_type; }
+            inline void set_operand_type(VTScript::WSType type) { _operand_type = type; }
+
+            /*
+                Type feedback of the tree walker for an operator TypeInference left untyped:
+                once both operands had one type for quicken_after visits in a row, the node is
+                quickened to the fast path of that type, which it takes while they keep it.
+                A visit with other types deoptimizes it back to the generic path and the
+                counting starts over; after max_deoptimizations, or once the type turns
+                out to have no fast path, it stays generic.
+                The feedback is of one run: Interpreter forgets it before running the tree
+                again (ASTTools::ForgetTypesVisitor), a cached program included.
+            */
+            static const int quicken_after = 8;
+            static const int max_deoptimizations = 4;
+            // fast path the node is quickened to, NULL if it's generic
+            inline VTScript::TypedOperators::Binary quick() const { return _quick; }
+            // type of both operands the node counts, or is quickened to
+            inline VTScript::WSType seen_type() const { return _seen_type; }
+            // counts a visit with operands of types 'left' and 'right', quickening the node when they've been one type long enough
+            void record_types(VTScript::WSType left, VTScript::WSType right);
+            void deoptimize();
+            // back to the state of a node that hasn't been visited
+            void forget_types();
+
         public:
             Expression* _left_branch;
             Expression* _right_branch;
             VTScript::OperatorType _type;
+
+        private:
+            VTScript::WSType _operand_type;
+            VTScript::WSType _seen_type;
+            int _seen_count;
+            int _deoptimizations;
+            VTScript::TypedOperators::Binary _quick;
         };
 
 
@@ -161,7 +294,6 @@ namespace VTScript
         {
         public:
             Return(ulong line, Expression* expr) : Node(line), _expr( expr ) {}
-            ~Return() { delete _expr; }
             void accept(ASTTools::NodeVisitor* visitor);
         
             inline Expression* expr() const { return _expr; }
@@ -190,14 +322,22 @@ namespace VTScript
         class Block : public Node
         {
         public:
-            Block(ulong line, QList<Node*> stmts) : Node(line), _statements(stmts) {}
-            ~Block() { foreach(Node* stmt, _statements) delete stmt; }
+            Block(ulong line, NodeList<Node> stmts) : Node(line), _statements(stmts), _scope_slots(NULL), _scope_slot_count(0) {}
             void accept(ASTTools::NodeVisitor* visitor);
 
-            inline const QList<Node*>& values() const { return _statements; }
+            inline const NodeList<Node>& values() const { return _statements; }
+
+            // frame slots of the variables declared in the block, emptied when it's left; see Resolver
+            inline const int* scope_slots() const { return _scope_slots; }
+            inline int scope_slot_count() const { return _scope_slot_count; }
+            inline void set_scope_slots(const int* scope_slots, int count) { _scope_slots = scope_slots; _scope_slot_count = count; }
 
         public:
-            QList<Node*> _statements;
+            NodeList<Node> _statements;
+
+        private:
+            const int* _scope_slots;
+            int _scope_slot_count;
         };
 
 
@@ -206,32 +346,50 @@ namespace VTScript
         public:
             FunctionDeclaration(ulong line, QString name, QStringList params, Block* body) :
                 Node(line), _fnc( new VTScript::WS::UserFunction(name, params, body) ) {}
-            ~FunctionDeclaration() { delete _fnc->body(); }
+            FunctionDeclaration(ulong line, QString name, QStringList params, const DeferredBody* body) :
+                Node(line), _fnc( new VTScript::WS::UserFunction(name, params, body) ) {}
             void accept(ASTTools::NodeVisitor* visitor);
 
             inline QSharedPointer<VTScript::WS::UserFunction> fnc() const { return _fnc; }
             inline const QString& name() const { return fnc()->name(); }
             inline const QStringList& parameters() const { return fnc()->parameters(); }
+            // parses a deferred body, see WS::UserFunction::body
             inline Block* body() const { return fnc()->body(); }
+            inline bool is_body_parsed() const { return fnc()->is_body_parsed(); }
+            // where the function is stored, like the left side of an assignment
+            inline const Binding& binding() const { return _binding; }
+            inline void set_binding(const Binding& binding) { _binding = binding; }
             
         public:
             QSharedPointer<VTScript::WS::UserFunction> _fnc;
+
+        private:
+            Binding _binding;
         };
 
 
         class While : public Node
         {
         public:
-            While(ulong line, Expression* cond, Node* body) : Node(line), _condition( cond ), _body( body ) {}
-            ~While() { delete _condition; delete _body; }
+            While(ulong line, Expression* cond, Node* body) :
+                Node(line), _condition( cond ), _body( body ), _cache_slots(NULL), _cache_slot_count(0) {}
             void accept(ASTTools::NodeVisitor* visitor);
 
             inline Expression* condition() const { return _condition; }
             inline Node* body() const { return _body; }
 
+            // cache slots of the expressions invariant in the loop, emptied when it's left; see LoopInvariants
+            inline const int* cache_slots() const { return _cache_slots; }
+            inline int cache_slot_count() const { return _cache_slot_count; }
+            inline void set_cache_slots(const int* cache_slots, int count) { _cache_slots = cache_slots; _cache_slot_count = count; }
+
         public:
             Expression* _condition;
             Node* _body;
+
+        private:
+            const int* _cache_slots;
+            int _cache_slot_count;
         };
 
         class If : public Node
@@ -239,7 +397,6 @@ namespace VTScript
         public:
             If(ulong line, Expression* cond, Node* then_, Node* else_) : 
                     Node(line), _condition( cond ), _then( then_ ), _else( else_ ) {}
-            ~If() { delete _condition; delete _then; delete _else; }
             void accept(ASTTools::NodeVisitor* visitor);
 
             inline Expression* condition() const { return _condition; }
@@ -286,6 +443,61 @@ namespace VTScript
             QStack<int> indents;
             QStringList result_string_list;
         };
+
+        /*
+            Moves a subtree by 'delta' lines; used when text above a reused subtree
+            gained or lost lines.
+        */
+        class ShiftLinesVisitor : public NodeVisitor
+        {
+        public:
+            ShiftLinesVisitor(long delta) : delta(delta) {}
+            void shift(AST::Node* root);
+
+            VISITOR_METHODS
+
+        private:
+            long delta;
+        };
+
+        /*
+            Forgets the types the tree walker saw in a subtree (AST::BinaryOperator::quick),
+            inlined copies and function bodies parsed so far included.
+        */
+        class ForgetTypesVisitor : public NodeVisitor
+        {
+        public:
+            void forget(AST::Node* root);
+
+            VISITOR_METHODS
+        };
+
+        /*
+            Copies a subtree as the parser made it into 'arena': bindings, slots and
+            whatever else the passes add are left out, so the copy can go through them
+            while the original is kept untouched. A function gets a declaration of its own.
+        */
+        class CopyVisitor : public NodeVisitor
+        {
+        public:
+            CopyVisitor(Arena& arena) : arena(arena), result(NULL) {}
+
+            template <typename T>
+            T* copy(T* node)
+            {
+                node->accept(this);
+                return static_cast<T*>(result);
+            }
+
+            VISITOR_METHODS
+
+        private:
+            template <typename T>
+            AST::NodeList<T> copy_list(const AST::NodeList<T>& nodes);
+
+            Arena& arena;
+            AST::Node* result;
+        };
     };
 
 };
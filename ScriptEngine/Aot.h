@@ -0,0 +1,98 @@
+#pragma once
+
+/*
+    What the native code AotCompiler generates and the interpreter running it share.
+
+    The generated translation unit is compiled on its own, without Qt or any header of
+    the engine, so it gets these declarations as text: they are written once, in the
+    macro below, which AotCompiler pastes at the top of every file it generates. Only
+    plain types go in here; abi_version has to change whenever anything in it does, a
+    library built with another one isn't loaded.
+*/
+#define VTSCRIPT_AOT_INTERFACE                                                                          \
+    namespace Aot                                                                                       \
+    {                                                                                                   \
+        const int abi_version = 1;                                                                      \
+                                                                                                        \
+        /* the interpreter running the code */                                                          \
+        struct Context;                                                                                 \
+                                                                                                        \
+        /* a WS::SP_Object, which is two pointers wide and all zeros when it's empty */                 \
+        struct Value                                                                                    \
+        {                                                                                               \
+            void* words[2];                                                                             \
+        };                                                                                              \
+                                                                                                        \
+        /* what the generated code can't do itself; AST nodes are passed as 'const void*' */           \
+        struct Runtime                                                                                  \
+        {                                                                                               \
+            /* see ObjectLayout */                                                                      \
+            int pointer;                                                                                \
+            int integral;                                                                               \
+            int rational;                                                                               \
+            int boolean;                                                                                \
+            const void* integral_class;                                                                 \
+            const void* rational_class;                                                                 \
+            const void* bool_class;                                                                     \
+                                                                                                        \
+            void (*copy)(Value* to, const Value* from);                                                 \
+            void (*clear)(Value* value);                                                                \
+            void (*box_integral)(Value* to, long long value);                                           \
+            void (*box_rational)(Value* to, double value);                                              \
+            void (*box_bool)(Value* to, int value);                                                     \
+            void (*none)(Value* to);                                                                    \
+            void (*constant)(Value* to, const void* leaf);                                              \
+                                                                                                        \
+            /* these throw the errors the tree walker would */                                          \
+            void (*read)(Context* context, const void* leaf, Value* to);                                \
+            void (*not_found)(Context* context, const void* leaf);                                      \
+            void (*unary)(Context* context, const void* op, const Value* argument, Value* to);          \
+            void (*binary)(Context* context, const void* op, const Value* left, const Value* right,     \
+                           Value* to);                                                                  \
+            void (*check_function)(Context* context, const void* call, const Value* function);          \
+            void (*call)(Context* context, const void* call, const Value* function,                     \
+                         const Value* const* arguments, int count, Value* to);                          \
+            void (*method)(Context* context, const void* dot, const Value* object,                      \
+                           const Value* const* arguments, int count, Value* to);                        \
+            void (*define)(Context* context, const void* declaration);                                  \
+            int (*truth)(const Value* value);                                                           \
+            void (*interrupt)(Context* context);                                                        \
+        };                                                                                              \
+                                                                                                        \
+        /* a function body: its variables are 'slots', 'nodes' the nodes it passes to the runtime */    \
+        typedef void (*Entry)(Context* context, Value* slots, const void* const* nodes, Value* result);  \
+                                                                                                        \
+        struct Function                                                                                 \
+        {                                                                                               \
+            const char* fingerprint;                                                                    \
+            Entry entry;                                                                                \
+        };                                                                                              \
+                                                                                                        \
+        struct Module                                                                                   \
+        {                                                                                               \
+            int abi_version;                                                                            \
+            int count;                                                                                  \
+            const Function* functions;                                                                  \
+        };                                                                                              \
+                                                                                                        \
+        /* the one function a library exports, as extern "C" */                                         \
+        typedef const Module* (*Load)(const Runtime* runtime);                                          \
+    }
+
+#define VTSCRIPT_AOT_TEXT(...) #__VA_ARGS__
+#define VTSCRIPT_AOT_STRINGIFY(...) VTSCRIPT_AOT_TEXT(__VA_ARGS__)
+
+namespace VTScript
+{
+    VTSCRIPT_AOT_INTERFACE
+
+    namespace Aot
+    {
+        // name of Load in a library
+        const char* const load_symbol = "vtscript_aot_module";
+
+        // the declarations above, for the generated code
+        const char* const interface_text = VTSCRIPT_AOT_STRINGIFY(VTSCRIPT_AOT_INTERFACE);
+    }
+
+};
@@ -0,0 +1,885 @@
+#include "AotCompiler.h"
+#include "Aot.h"
+#include "ProgramCache.h"
+#include "Errors.h"
+
+#include <QCryptographicHash>
+#include <QFile>
+#include <QIODevice>
+#include <QProcess>
+#include <QSet>
+
+#include <limits>
+#include <cmath>
+
+// the compiler of native code, set by VTScript.pro to the one the application is built with
+#ifndef VTSCRIPT_AOT_CXX
+#define VTSCRIPT_AOT_CXX "c++"
+#endif
+
+using namespace VTScript;
+
+namespace
+{
+    /*
+        What every generated file has after the declarations of Aot.h: the representation
+        of values in the generated code and the operations on it, written so that the C++
+        compiler can drop what a known type makes dead.
+    */
+    const char* const preamble = R"code(
+using namespace VTScript::Aot;
+
+namespace
+{
+    const Runtime* rt;
+
+    enum Type { Any, Integral, Rational, Bool };
+
+    enum Operator { Other, Plus, Minus, Mult, Div, Mod, Less, Greater, LessEq, GreaterEq, Equal, NotEqual, And, Or, Not, UnaryMinus };
+
+    // an SP_Object owned by the generated code
+    struct Ref
+    {
+        Ref() { v.words[0] = v.words[1] = 0; }
+        ~Ref() { if (v.words[0] != 0 || v.words[1] != 0) rt->clear(&v); }
+
+        Value v;
+
+    private:
+        Ref(const Ref&);
+        void operator=(const Ref&);
+    };
+
+    // the value of an expression: unboxed unless 'type' is Any, in 'ref' if 'boxed', or both
+    struct Val
+    {
+        Val() : type(Any), boxed(false), i(0), d(0), b(false) {}
+
+        Type type;
+        bool boxed;
+        long long i;
+        double d;
+        bool b;
+        Ref ref;
+    };
+
+    inline const char* object_of(const Value& value)
+    {
+        return *reinterpret_cast<const char* const*>(reinterpret_cast<const char*>(&value) + rt->pointer);
+    }
+
+    inline bool is_empty(const Value& value)
+    {
+        return object_of(value) == 0;
+    }
+
+    // the value of an Integral, a Rational or a Bool; anything else leaves 'x' as it is
+    inline void unbox(Val& x, const char* object)
+    {
+        const void* cls = *reinterpret_cast<const void* const*>(object);
+        if (cls == rt->integral_class)
+        {
+            x.type = Integral;
+            x.i = *reinterpret_cast<const long long*>(object + rt->integral);
+        }
+        else if (cls == rt->rational_class)
+        {
+            x.type = Rational;
+            x.d = *reinterpret_cast<const double*>(object + rt->rational);
+        }
+        else if (cls == rt->bool_class)
+        {
+            x.type = Bool;
+            x.b = *reinterpret_cast<const bool*>(object + rt->boolean);
+        }
+    }
+
+    inline void classify(Val& x)
+    {
+        if (x.type == Any && x.boxed)
+            unbox(x, object_of(x.ref.v));
+    }
+
+    inline void box(Val& x)
+    {
+        if (x.boxed)
+            return;
+
+        if (x.type == Integral)
+            rt->box_integral(&x.ref.v, x.i);
+        else if (x.type == Rational)
+            rt->box_rational(&x.ref.v, x.d);
+        else
+            rt->box_bool(&x.ref.v, x.b);
+        x.boxed = true;
+    }
+
+    inline void literal(Val& x, long long value) { x.type = Integral; x.i = value; }
+    inline void literal(Val& x, double value) { x.type = Rational; x.d = value; }
+    inline void literal(Val& x, bool value) { x.type = Bool; x.b = value; }
+
+    inline void constant(Val& x, const void* leaf) { rt->constant(&x.ref.v, leaf); x.boxed = true; }
+    inline void none(Val& x) { rt->none(&x.ref.v); x.boxed = true; }
+    inline void read(Context* ctx, Val& x, const void* leaf) { rt->read(ctx, leaf, &x.ref.v); x.boxed = true; }
+
+    // a variable of the running function
+    inline void local(Context* ctx, Val& x, const Value& slot, const void* leaf)
+    {
+        if (is_empty(slot))
+            rt->not_found(ctx, leaf);
+        rt->copy(&x.ref.v, &slot);
+        x.boxed = true;
+    }
+
+    // the same for an operand: numbers and bools are only read
+    inline void local_operand(Context* ctx, Val& x, const Value& slot, const void* leaf)
+    {
+        if (is_empty(slot))
+            rt->not_found(ctx, leaf);
+        unbox(x, object_of(slot));
+        if (x.type == Any)
+        {
+            rt->copy(&x.ref.v, &slot);
+            x.boxed = true;
+        }
+    }
+
+    inline void store(Value& slot, Val& x)
+    {
+        box(x);
+        rt->copy(&slot, &x.ref.v);
+    }
+
+    // the first of the candidates holding a value gets it, or the first one
+    inline void assign(Value* slots, const int* candidates, int count, Val& x)
+    {
+        box(x);
+        for (int i = 0; i < count; ++i)
+        {
+            if (!is_empty(slots[candidates[i]]))
+            {
+                rt->copy(&slots[candidates[i]], &x.ref.v);
+                return;
+            }
+        }
+        rt->copy(&slots[candidates[0]], &x.ref.v);
+    }
+
+    inline void clear(Value& slot)
+    {
+        if (slot.words[0] != 0 || slot.words[1] != 0)
+            rt->clear(&slot);
+    }
+
+    // division by 0 and -1 is left to the generic path, as TypedOperators does
+    template <Operator op>
+    inline bool integral_operator(long long a, long long b, Val& x)
+    {
+        switch (op)
+        {
+        case Plus      : literal(x, a + b); return true;
+        case Minus     : literal(x, a - b); return true;
+        case Mult      : literal(x, a * b); return true;
+        case Div       : if (b == 0 || b == -1) return false; literal(x, a / b); return true;
+        case Mod       : if (b == 0 || b == -1) return false; literal(x, a % b); return true;
+        case Less      : literal(x, a < b); return true;
+        case Greater   : literal(x, a > b); return true;
+        case LessEq    : literal(x, a <= b); return true;
+        case GreaterEq : literal(x, a >= b); return true;
+        case Equal     : literal(x, a == b); return true;
+        case NotEqual  : literal(x, a != b); return true;
+        default        : return false;
+        }
+    }
+
+    template <Operator op>
+    inline bool rational_operator(double a, double b, Val& x)
+    {
+        switch (op)
+        {
+        case Plus      : literal(x, a + b); return true;
+        case Minus     : literal(x, a - b); return true;
+        case Mult      : literal(x, a * b); return true;
+        case Div       : literal(x, a / b); return true;
+        case Less      : literal(x, a < b); return true;
+        case Greater   : literal(x, a > b); return true;
+        case LessEq    : literal(x, a <= b); return true;
+        case GreaterEq : literal(x, a >= b); return true;
+        case Equal     : literal(x, a == b); return true;
+        case NotEqual  : literal(x, a != b); return true;
+        default        : return false;
+        }
+    }
+
+    template <Operator op>
+    inline bool bool_operator(bool a, bool b, Val& x)
+    {
+        switch (op)
+        {
+        case And       : literal(x, a && b); return true;
+        case Or        : literal(x, a || b); return true;
+        case Equal     : literal(x, a == b); return true;
+        case NotEqual  : literal(x, a != b); return true;
+        default        : return false;
+        }
+    }
+
+    // 'hint' is the type TypeInference gave both operands, Any if it gave none
+    template <Operator op, Type hint>
+    inline void binary(Context* ctx, const void* node, Val& l, Val& r, Val& x)
+    {
+        classify(l);
+        classify(r);
+        if (l.type == r.type)
+        {
+            if ((hint == Any || hint == Integral) && l.type == Integral && integral_operator<op>(l.i, r.i, x))
+                return;
+            if ((hint == Any || hint == Rational) && l.type == Rational && rational_operator<op>(l.d, r.d, x))
+                return;
+            if ((hint == Any || hint == Bool) && l.type == Bool && bool_operator<op>(l.b, r.b, x))
+                return;
+        }
+
+        box(l);
+        box(r);
+        rt->binary(ctx, node, &l.ref.v, &r.ref.v, &x.ref.v);
+        x.boxed = true;
+    }
+
+    template <Operator op>
+    inline void unary(Context* ctx, const void* node, Val& a, Val& x)
+    {
+        classify(a);
+        if (op == UnaryMinus && a.type == Integral)
+            return literal(x, - a.i);
+        if (op == UnaryMinus && a.type == Rational)
+            return literal(x, - a.d);
+        if (op == Not && a.type == Bool)
+            return literal(x, ! a.b);
+
+        box(a);
+        rt->unary(ctx, node, &a.ref.v, &x.ref.v);
+        x.boxed = true;
+    }
+
+    // what __bool__ gives
+    inline bool truth(Val& x)
+    {
+        classify(x);
+        switch (x.type)
+        {
+        case Integral : return x.i != 0;
+        case Rational : return x.d != 0;
+        case Bool     : return x.b;
+        default       : return rt->truth(&x.ref.v) != 0;
+        }
+    }
+
+    inline void check_function(Context* ctx, const void* call, Val& function)
+    {
+        box(function);
+        rt->check_function(ctx, call, &function.ref.v);
+    }
+
+    inline void call(Context* ctx, const void* call, Val& function, const Value* const* arguments, int count, Val& x)
+    {
+        rt->call(ctx, call, &function.ref.v, arguments, count, &x.ref.v);
+        x.boxed = true;
+    }
+
+    inline void method(Context* ctx, const void* dot, Val& object, const Value* const* arguments, int count, Val& x)
+    {
+        box(object);
+        rt->method(ctx, dot, &object.ref.v, arguments, count, &x.ref.v);
+        x.boxed = true;
+    }
+
+    inline void return_value(Val& x, Value* result)
+    {
+        box(x);
+        rt->copy(result, &x.ref.v);
+    }
+)code";
+
+    // name of an operator in the generated code
+    QString operator_name(OperatorType type)
+    {
+        switch (type)
+        {
+        case OperatorTypes::Plus       : return "Plus";
+        case OperatorTypes::Minus      : return "Minus";
+        case OperatorTypes::Mult       : return "Mult";
+        case OperatorTypes::Div        : return "Div";
+        case OperatorTypes::Mod        : return "Mod";
+        case OperatorTypes::Less       : return "Less";
+        case OperatorTypes::Greater    : return "Greater";
+        case OperatorTypes::LessEq     : return "LessEq";
+        case OperatorTypes::GreaterEq  : return "GreaterEq";
+        case OperatorTypes::Equal      : return "Equal";
+        case OperatorTypes::NotEqual   : return "NotEqual";
+        case OperatorTypes::And        : return "And";
+        case OperatorTypes::Or         : return "Or";
+        case OperatorTypes::Not        : return "Not";
+        case OperatorTypes::UnaryMinus : return "UnaryMinus";
+        default                        : return "Other";
+        }
+    }
+
+    // type a hint of the generated code can have; Strings only have the generic path there
+    QString type_name(WSType type)
+    {
+        switch (type)
+        {
+        case WSTypes::Integral : return "Integral";
+        case WSTypes::Rational : return "Rational";
+        case WSTypes::Bool     : return "Bool";
+        default                : return "Any";
+        }
+    }
+
+    // a C++ literal of exactly 'value', empty if there's none
+    QString integral_literal(long long value)
+    {
+        if (value == std::numeric_limits<long long>::min())
+            return QString("(%1LL - 1)").arg(value + 1);
+        return QString("%1LL").arg(value);
+    }
+
+    QString rational_literal(double value)
+    {
+        if (std::isinf(value) || std::isnan(value))
+            return QString();
+
+        QString text = QString::number(value, 'g', 17);
+        if (!text.contains('.') && !text.contains('e'))
+            text += ".0";
+        return text;
+    }
+
+    // what library_path() and manifest_path() add to the name of the script
+    const char* const native_suffix = ".vts-native";
+
+    // hex Sha1 of the contents of a file, empty if it can't be read
+    QByteArray file_hash(const QString& path)
+    {
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly))
+            return QByteArray();
+
+        QCryptographicHash hash(QCryptographicHash::Sha1);
+        hash.addData(file.readAll());
+        return hash.result().toHex();
+    }
+
+    QByteArray manifest_text(const QByteArray& script_hash, const QByteArray& library_hash)
+    {
+        return "VTScript native code " + QByteArray::number(Aot::abi_version) + "\n"
+               + "script " + script_hash + "\n"
+               + "library " + library_hash + "\n";
+    }
+
+    QByteArray fingerprint_of(const QString& code)
+    {
+        // the generated file around the code is part of what it does
+        QCryptographicHash hash(QCryptographicHash::Sha1);
+        hash.addData(QByteArray(Aot::interface_text));
+        hash.addData(QByteArray(preamble));
+        hash.addData(code.toUtf8());
+        return hash.result().toHex();
+    }
+
+    // every function whose body can be parsed, nested ones included; deferred bodies are parsed
+    class Functions : public ASTTools::NodeVisitor
+    {
+    public:
+        void visit(AST::Noop*) {}
+        void visit(AST::Leaf*) {}
+        void visit(AST::FunctionCall*) {}
+        void visit(AST::UnaryOperator*) {}
+        void visit(AST::BinaryOperator*) {}
+        void visit(AST::Return*) {}
+        void visit(AST::Continue*) {}
+        void visit(AST::Break*) {}
+        void visit(AST::Block* node)
+        {
+            foreach (AST::Node* stmt, node->values())
+                stmt->accept(this);
+        }
+        void visit(AST::FunctionDeclaration* node)
+        {
+            // a body that doesn't parse is reported when it's called, as ever
+            try
+            {
+                node->body();
+            }
+            catch (const std::runtime_error&)
+            {
+                return;
+            }
+
+            found.append(node);
+            node->body()->accept(this);
+        }
+        void visit(AST::While* node) { node->body()->accept(this); }
+        void visit(AST::If* node) { node->then_stmt()->accept(this); node->else_stmt()->accept(this); }
+
+        QList<AST::FunctionDeclaration*> found;
+    };
+}
+
+
+bool AotCompiler::translate(const AST::Block* body, Translation& translation)
+{
+    AotCompiler compiler;
+
+    try
+    {
+        // the body of a function isn't a scope that's left, its variables go with the frame
+        foreach(AST::Node* stmt, body->values())
+            compiler.statement(stmt);
+    }
+    catch (const Unsupported&)
+    {
+        return false;
+    }
+
+    translation.code = compiler.lines.join("\n");
+    translation.fingerprint = fingerprint_of(translation.code);
+    translation.nodes = compiler.nodes;
+    return true;
+}
+
+QString AotCompiler::translate_program(Program& program)
+{
+    Functions functions;
+    program.root()->accept(&functions);
+
+    QStringList text;
+    text << "// Native code of a VTScript script, generated by AotCompiler; build it again instead of editing it";
+    text << "namespace VTScript";
+    text << "{";
+    text << QString(Aot::interface_text);
+    text << "}";
+    text << QString(preamble);
+
+    // functions with the same code are there once
+    QStringList table;
+    QSet<QByteArray> done;
+    foreach(AST::FunctionDeclaration* declaration, functions.found)
+    {
+        Translation translation;
+        if (!translate(declaration->body(), translation) || done.contains(translation.fingerprint))
+            continue;
+        done.insert(translation.fingerprint);
+
+        const QString name = "function_" + QString(translation.fingerprint);
+        text << QString("    // %1(%2)").arg(declaration->name()).arg(declaration->parameters().join(", "));
+        text << QString("    void %1(Context* ctx, Value* slots, const void* const* nodes, Value* result)").arg(name);
+        text << "    {";
+        text << translation.code;
+        text << "    }";
+        text << "";
+        table << QString("        { \"%1\", &%2 },").arg(QString(translation.fingerprint)).arg(name);
+    }
+
+    table << "        { 0, 0 }";
+    text << "    const Function functions[] =";
+    text << "    {";
+    text << table;
+    text << "    };";
+    text << "";
+    text << QString("    const Module module = { abi_version, %1, functions };").arg(done.size());
+    text << "}";
+    text << "";
+    text << QString("extern \"C\" const Module* %1(const Runtime* runtime)").arg(Aot::load_symbol);
+    text << "{";
+    text << "    rt = runtime;";
+    text << "    return &module;";
+    text << "}";
+    text << "";
+
+    return text.join("\n");
+}
+
+bool AotCompiler::build(const QString& script_path, QString& log)
+{
+    // a library that doesn't get built again isn't left looking current
+    QFile::remove(manifest_path(script_path));
+
+    const QByteArray script_hash = file_hash(script_path);
+
+    // loaded the way exec loads it, so the trees are the same
+    QScopedPointer<Program> program(ProgramCache::load(script_path));
+    if (script_hash.isEmpty() || program.isNull())
+    {
+        log = "Couldn't load script: " + script_path;
+        return false;
+    }
+
+    const QString source_path = script_path + native_suffix + ".cpp";
+    QFile source(source_path);
+    if (!source.open(QIODevice::WriteOnly | QIODevice::Text))
+    {
+        log = "Couldn't write file: " + source_path;
+        return false;
+    }
+    source.write(translate_program(*program).toUtf8());
+    source.close();
+
+    // integers wrap around on overflow, as they do in the interpreter
+    const QString compiler = VTSCRIPT_AOT_CXX;
+    const QString library = library_path(script_path);
+    QStringList arguments;
+    arguments << "-std=c++11" << "-O2" << "-fPIC" << "-shared" << "-fwrapv" << "-fno-strict-aliasing" << "-w"
+              << "-o" << library << source_path;
+
+    QProcess process;
+    process.setProcessChannelMode(QProcess::MergedChannels);
+    process.start(compiler, arguments);
+    const bool finished = process.waitForFinished(-1);
+    log = QString::fromLocal8Bit(process.readAll());
+
+    if (!finished || process.exitStatus() != QProcess::NormalExit || process.exitCode() != 0)
+    {
+        if (log.isEmpty())
+            log = "Couldn't run the compiler: " + compiler;
+        return false;
+    }
+
+    QFile manifest(manifest_path(script_path));
+    if (!manifest.open(QIODevice::WriteOnly | QIODevice::Text))
+    {
+        log = "Couldn't write file: " + manifest_path(script_path);
+        return false;
+    }
+    manifest.write(manifest_text(script_hash, file_hash(library)));
+    manifest.close();
+
+    return true;
+}
+
+QString AotCompiler::library_path(const QString& script_path)
+{
+    return script_path + native_suffix + ".so";
+}
+
+QString AotCompiler::manifest_path(const QString& script_path)
+{
+    return script_path + native_suffix;
+}
+
+bool AotCompiler::is_built_for(const QString& script_path, QString& error)
+{
+    error.clear();
+
+    QFile manifest(manifest_path(script_path));
+    if (!manifest.open(QIODevice::ReadOnly | QIODevice::Text))
+        return false;
+
+    const QList<QByteArray> recorded = manifest.readAll().split('\n');
+    const QList<QByteArray> current = manifest_text(file_hash(script_path), file_hash(library_path(script_path))).split('\n');
+
+    if (recorded.size() != current.size() || recorded.at(0) != current.at(0))
+        error = manifest_path(script_path) + " isn't a manifest of this version of VTScript";
+    else if (recorded.at(1) != current.at(1))
+        error = script_path + " changed since compile_native";
+    else if (recorded.at(2) != current.at(2))
+        error = library_path(script_path) + " isn't the library compile_native built";
+
+    return error.isEmpty();
+}
+
+void AotCompiler::write_line(const QString& line)
+{
+    lines << QString(4 * (indent + 1), ' ') + line;
+}
+
+QString AotCompiler::temporary()
+{
+    const QString name = QString("t%1").arg(temporaries++);
+    write_line("Val " + name + ";");
+    return name;
+}
+
+QString AotCompiler::node_ref(const AST::Node* node)
+{
+    QHash<const AST::Node*, int>::const_iterator found = node_indexes.constFind(node);
+    if (found != node_indexes.constEnd())
+        return QString("nodes[%1]").arg(found.value());
+
+    node_indexes.insert(node, nodes.size());
+    nodes.append(node);
+    return QString("nodes[%1]").arg(nodes.size() - 1);
+}
+
+QString AotCompiler::expression(AST::Node* node, bool as_operand)
+{
+    const bool outer = operand;
+    operand = as_operand;
+    node->accept(this);
+    operand = outer;
+    return result;
+}
+
+void AotCompiler::statement(AST::Node* node)
+{
+    // an else left out is a Noop; an expression statement only leaves its value, which nobody uses
+    if (dynamic_cast<AST::Noop*>(node) != NULL)
+        return;
+
+    if (dynamic_cast<AST::Expression*>(node) != NULL)
+    {
+        write_line("{");
+        ++indent;
+        expression(node, false);
+        --indent;
+        write_line("}");
+        return;
+    }
+
+    node->accept(this);
+}
+
+QString AotCompiler::condition(AST::Expression* node)
+{
+    const QString name = QString("c%1").arg(temporaries++);
+    write_line("bool " + name + ";");
+    write_line("{");
+    ++indent;
+    const QString value = expression(node, true);
+    write_line(QString("%1 = truth(%2);").arg(name).arg(value));
+    --indent;
+    write_line("}");
+    return name;
+}
+
+QString AotCompiler::arguments(const AST::NodeList<AST::Expression>& expressions)
+{
+    if (expressions.isEmpty())
+        return "0";
+
+    QStringList values;
+    foreach(AST::Expression* expr, expressions)
+    {
+        const QString value = expression(expr, false);
+        write_line("box(" + value + ");");
+        values << "&" + value + ".ref.v";
+    }
+
+    const QString name = QString("a%1").arg(temporaries++);
+    write_line(QString("const Value* const %1[] = { %2 };").arg(name).arg(values.join(", ")));
+    return name;
+}
+
+void AotCompiler::clear_scopes(int depth)
+{
+    for (int i = scopes.size() - 1; i >= depth; --i)
+    {
+        foreach(int slot, scopes.at(i))
+            write_line(QString("clear(slots[%1]);").arg(slot));
+    }
+}
+
+void AotCompiler::visit(AST::Noop* /*node*/)
+{
+    result = temporary();
+    write_line("none(" + result + ");");
+}
+
+void AotCompiler::visit(AST::Leaf* node)
+{
+    result = temporary();
+
+    if (!node->is_identifier())
+    {
+        // numbers and bools an operator takes are never boxed, other values are the literal's object
+        const WS::SP_Object object = node->object();
+        QString value;
+        if (operand && object->__type__() == WSTypes::Integral)
+            value = integral_literal(static_cast<WS::Integral*>(object.data())->value());
+        else if (operand && object->__type__() == WSTypes::Rational)
+            value = rational_literal(static_cast<WS::Rational*>(object.data())->value());
+        else if (operand && object->__type__() == WSTypes::Bool)
+            value = static_cast<WS::Bool*>(object.data())->value() ? "true" : "false";
+
+        if (value.isEmpty())
+            write_line(QString("constant(%1, %2);").arg(result).arg(node_ref(node)));
+        else
+            write_line(QString("literal(%1, %2);").arg(result).arg(value));
+        return;
+    }
+
+    const AST::Binding& binding = node->binding();
+    if (binding.count == 1 && binding.addresses[0].depth == 0 && binding.builtin == NULL)
+    {
+        // a variable of the running function and nothing else
+        write_line(QString("%1(ctx, %2, slots[%3], %4);").arg(operand ? "local_operand" : "local")
+                 .arg(result).arg(binding.addresses[0].slot).arg(node_ref(node)));
+    }
+    else
+    {
+        write_line(QString("read(ctx, %1, %2);").arg(result).arg(node_ref(node)));
+    }
+}
+
+void AotCompiler::visit(AST::FunctionCall* node)
+{
+    // the callee is checked before the arguments are evaluated
+    const QString function = expression(node->function_object(), false);
+    write_line(QString("check_function(ctx, %1, %2);").arg(node_ref(node)).arg(function));
+
+    const QString args = arguments(node->arguments_expressions());
+
+    result = temporary();
+    write_line(QString("call(ctx, %1, %2, %3, %4, %5);").arg(node_ref(node)).arg(function).arg(args)
+             .arg(node->arguments_expressions().size()).arg(result));
+}
+
+void AotCompiler::visit(AST::UnaryOperator* node)
+{
+    const QString argument = expression(node->argument(), true);
+
+    result = temporary();
+    write_line(QString("unary<%1>(ctx, %2, %3, %4);").arg(operator_name(node->type())).arg(node_ref(node))
+             .arg(argument).arg(result));
+}
+
+void AotCompiler::visit(AST::BinaryOperator* node)
+{
+    if (node->type() == OperatorTypes::Assign)
+    {
+        AST::Leaf* name = static_cast<AST::Leaf*>(node->left());
+        result = expression(node->right(), false);
+
+        // the value is the value of the assignment too
+        const AST::Binding& binding = name->binding();
+        if (binding.count == 1)
+        {
+            write_line(QString("store(slots[%1], %2);").arg(binding.addresses[0].slot).arg(result));
+        }
+        else
+        {
+            QStringList candidates;
+            for (int i = 0; i < binding.count; ++i)
+                candidates << QString::number(binding.addresses[i].slot);
+
+            const QString candidate_slots = QString("s%1").arg(temporaries++);
+            write_line(QString("static const int %1[] = { %2 };").arg(candidate_slots).arg(candidates.join(", ")));
+            write_line(QString("assign(slots, %1, %2, %3);").arg(candidate_slots).arg(binding.count).arg(result));
+        }
+    }
+    else if (node->type() == OperatorTypes::Dot)
+    {
+        const QString object = expression(node->left(), false);
+
+        AST::FunctionCall* method = static_cast<AST::FunctionCall*>(node->right());
+        const QString args = arguments(method->arguments_expressions());
+
+        result = temporary();
+        write_line(QString("method(ctx, %1, %2, %3, %4, %5);").arg(node_ref(node)).arg(object).arg(args)
+                 .arg(method->arguments_expressions().size()).arg(result));
+    }
+    else
+    {
+        const QString left = expression(node->left(), true);
+        const QString right = expression(node->right(), true);
+
+        result = temporary();
+        write_line(QString("binary<%1, %2>(ctx, %3, %4, %5, %6);").arg(operator_name(node->type()))
+                 .arg(type_name(node->operand_type())).arg(node_ref(node)).arg(left).arg(right).arg(result));
+    }
+}
+
+void AotCompiler::visit(AST::Return* node)
+{
+    write_line("{");
+    ++indent;
+    const QString value = expression(node->expr(), false);
+    write_line(QString("return_value(%1, result);").arg(value));
+    write_line("return;");
+    --indent;
+    write_line("}");
+}
+
+void AotCompiler::visit(AST::Continue* /*node*/)
+{
+    if (loops.isEmpty())
+        throw Unsupported();
+
+    clear_scopes(loops.top());
+    write_line("continue;");
+}
+
+void AotCompiler::visit(AST::Break* /*node*/)
+{
+    if (loops.isEmpty())
+        throw Unsupported();
+
+    clear_scopes(loops.top());
+    write_line("break;");
+}
+
+void AotCompiler::visit(AST::Block* node)
+{
+    QVector<int> scope;
+    for (int i = 0; i < node->scope_slot_count(); ++i)
+        scope.append(node->scope_slots()[i]);
+
+    write_line("{");
+    ++indent;
+    scopes.append(scope);
+    foreach(AST::Node* stmt, node->values())
+        statement(stmt);
+    scopes.removeLast();
+    --indent;
+    write_line("}");
+
+    // variables of the block go away with it
+    foreach(int slot, scope)
+        write_line(QString("clear(slots[%1]);").arg(slot));
+}
+
+void AotCompiler::visit(AST::FunctionDeclaration* node)
+{
+    write_line(QString("rt->define(ctx, %1);").arg(node_ref(node)));
+}
+
+void AotCompiler::visit(AST::While* node)
+{
+    write_line("for (;;)");
+    write_line("{");
+    ++indent;
+    write_line("rt->interrupt(ctx);");
+    const QString value = condition(node->condition());
+    write_line(QString("if (!%1)").arg(value));
+    write_line("    break;");
+
+    loops.push(scopes.size());
+    statement(node->body());
+    loops.pop();
+
+    --indent;
+    write_line("}");
+}
+
+void AotCompiler::visit(AST::If* node)
+{
+    const QString value = condition(node->condition());
+
+    write_line(QString("if (%1)").arg(value));
+    write_line("{");
+    ++indent;
+    statement(node->then_stmt());
+    --indent;
+    write_line("}");
+
+    if (dynamic_cast<AST::Noop*>(node->else_stmt()) == NULL)
+    {
+        write_line("else");
+        write_line("{");
+        ++indent;
+        statement(node->else_stmt());
+        --indent;
+        write_line("}");
+    }
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "AST.h"
+#include "Program.h"
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QVector>
+#include <QHash>
+#include <QStack>
+
+namespace VTScript
+{
+    /*
+        Ahead-of-time compiler: translates the checked bodies of the functions of a script
+        to a C++ translation unit and builds it into a shared library with the compiler
+        the application was built with (VTSCRIPT_AOT_CXX, c++ if it isn't defined).
+        Interpreter calls a function of the library in place of walking the body, see
+        NativeLibrary.
+
+        Next to the library a manifest keeps the hashes of the script and of the library
+        it was built into. A library is only loaded while both still match, so no file
+        compile_native didn't build for exactly this script is ever opened.
+
+        The generated code does what the tree walker does, statement by statement, on the
+        frame slots of the interpreter. Integers, doubles and bools stay unboxed in C++
+        variables between operators and conditions, with the results TypedOperators gives;
+        an operator TypeInference typed only looks for its type. Everything else (calls,
+        methods, variables of other frames, the generic operators, the errors) goes
+        through Aot::Runtime to the interpreter.
+
+        A function of the library is known by a hash of its generated code, so it only
+        runs for a body that translates to exactly that code, as this version of the
+        engine translates it.
+        Inliner's copies and LoopInvariants' caches are not used, and bodies with 'break'
+        or 'continue' outside a loop aren't translated, as in the other engines.
+    */
+    class AotCompiler : public ASTTools::NodeVisitor
+    {
+    public:
+        // one function body in C++
+        struct Translation
+        {
+            QString code;                       // statements of the C++ function
+            QByteArray fingerprint;             // hash of 'code', in hex
+            QVector<const void*> nodes;         // AST nodes the code passes to the runtime, by index
+        };
+
+        // false if the body can't be translated
+        static bool translate(const AST::Block* body, Translation& translation);
+
+        // the translation unit of all functions of a program, nested ones included; parses deferred bodies
+        static QString translate_program(Program& program);
+
+        // builds the library of a script (source or .vtsc) at library_path(), keeping the C++ next to it,
+        // and writes its manifest; returns false with what went wrong in 'log'
+        static bool build(const QString& script_path, QString& log);
+
+        // where the library of a script and its manifest are: next to it, its whole name with a suffix of its own
+        static QString library_path(const QString& script_path);
+        static QString manifest_path(const QString& script_path);
+
+        // whether the library of a script is the one build() made for it as it is now; false with
+        // nothing in 'error' if there's no manifest, with the reason if it doesn't match
+        static bool is_built_for(const QString& script_path, QString& error);
+
+        VISITOR_METHODS
+
+    private:
+        // 'break' or 'continue' outside a loop; Checker lets some through
+        struct Unsupported {};
+
+        AotCompiler() : indent(1), temporaries(0), operand(false) {}
+
+        // emits the code of an expression, returns the name of the Val holding its value;
+        // an operand of an operator or a condition may leave numbers and bools unboxed
+        QString expression(AST::Node* node, bool as_operand);
+        void statement(AST::Node* node);
+        // emits the code of a condition, returns the name of the bool holding it
+        QString condition(AST::Expression* node);
+        // evaluates arguments into boxed Vals, returns the name of the array pointing to them, "0" if none
+        QString arguments(const AST::NodeList<AST::Expression>& expressions);
+        // empties the variables of the blocks from the innermost one out to 'depth'
+        void clear_scopes(int depth);
+
+        void write_line(const QString& line);
+        QString temporary();
+        // "nodes[i]" for the index of 'node' in the table passed to the runtime
+        QString node_ref(const AST::Node* node);
+
+        QStringList lines;
+        int indent;
+        int temporaries;
+        QHash<const AST::Node*, int> node_indexes;
+        QVector<const void*> nodes;
+        QVector<QVector<int> > scopes;      // variables of the blocks around the statement emitted
+        QStack<int> loops;                  // number of scopes outside each loop around it
+        bool operand;                       // the expression visited is an operand
+        QString result;                     // Val of the last expression visited
+    };
+
+};
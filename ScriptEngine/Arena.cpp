@@ -0,0 +1,62 @@
+#include "Arena.h"
+
+#include <cstdlib>
+
+using namespace VTScript;
+
+Arena::Arena() : _current( NULL ), _end( NULL ), _blocks( NULL ), _cleanups( NULL ), _allocated( 0 )
+{
+}
+
+Arena::~Arena()
+{
+    for ( Cleanup* cleanup = _cleanups; cleanup != NULL; cleanup = cleanup->next )
+        cleanup->destroy( cleanup->object );
+
+    while ( _blocks != NULL )
+    {
+        BlockHeader* next = _blocks->next;
+        std::free( _blocks );
+        _blocks = next;
+    }
+}
+
+/*
+    Allocations bigger than a quarter of a block get a block of their own, the current
+    block is kept for the small ones that follow.
+*/
+void* Arena::allocate_slow( size_t size, size_t alignment )
+{
+    const size_t header = ( sizeof(BlockHeader) + alignment - 1 ) & ~( alignment - 1 );
+    const bool dedicated = size > block_size / 4;
+    const size_t capacity = dedicated ? header + size : qMax( size_t( block_size ), header + size );
+
+    BlockHeader* block = static_cast<BlockHeader*>( std::malloc( capacity ) );
+    if ( block == NULL )
+        throw std::bad_alloc();
+
+    char* begin = reinterpret_cast<char*>( block ) + header;
+    _allocated += size;
+
+    if ( dedicated && _blocks != NULL )
+    {
+        block->next = _blocks->next;
+        _blocks->next = block;
+        return begin;
+    }
+
+    block->next = _blocks;
+    _blocks = block;
+    _current = begin + size;
+    _end = reinterpret_cast<char*>( block ) + capacity;
+    return begin;
+}
+
+void Arena::register_destructor( void* object, void (*destroy)( void* ) )
+{
+    Cleanup* cleanup = static_cast<Cleanup*>( allocate( sizeof(Cleanup), Q_ALIGNOF(Cleanup) ) );
+    cleanup->destroy = destroy;
+    cleanup->object = object;
+    cleanup->next = _cleanups;
+    _cleanups = cleanup;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <QtGlobal>
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace VTScript
+{
+    /*
+        Bump allocator. Memory is taken from big blocks in allocation order and is only
+        given back when the arena is destroyed, all of it at once. Objects that need their
+        destructor run (they hold QStrings, shared pointers, ...) are remembered in a list
+        kept in the arena itself and destroyed, newest first, just before the blocks are
+        freed; trivially destructible objects cost nothing at teardown.
+    */
+    class Arena
+    {
+    public:
+        Arena();
+        ~Arena();
+
+        // returns uninitialized memory; alignment has to be a power of two
+        void* allocate( size_t size, size_t alignment = default_alignment )
+        {
+            quintptr begin = ( reinterpret_cast<quintptr>( _current ) + alignment - 1 ) & ~quintptr( alignment - 1 );
+            if ( begin + size > reinterpret_cast<quintptr>( _end ) )
+                return allocate_slow( size, alignment );
+
+            _allocated += begin + size - reinterpret_cast<quintptr>( _current );
+            _current = reinterpret_cast<char*>( begin + size );
+            return reinterpret_cast<void*>( begin );
+        }
+
+        template <typename T, typename... Args>
+        T* create( Args&&... args )
+        {
+            T* object = new ( allocate( sizeof(T), Q_ALIGNOF(T) ) ) T( std::forward<Args>(args)... );
+            if ( !std::is_trivially_destructible<T>::value )
+                register_destructor( object, &destroy<T> );
+            return object;
+        }
+
+        // uninitialized array of 'count' elements, for trivially destructible types only
+        template <typename T>
+        T* allocate_array( int count )
+        {
+            static_assert( std::is_trivially_destructible<T>::value, "destructors of array elements are never run" );
+            return count > 0 ? static_cast<T*>( allocate( sizeof(T) * count, Q_ALIGNOF(T) ) ) : NULL;
+        }
+
+        static const size_t default_alignment = 16;
+
+        // bytes handed out so far, including alignment padding
+        size_t allocated() const { return _allocated; }
+
+    private:
+        Q_DISABLE_COPY(Arena)
+
+        struct BlockHeader
+        {
+            BlockHeader* next;
+        };
+
+        struct Cleanup
+        {
+            void (*destroy)( void* );
+            void* object;
+            Cleanup* next;
+        };
+
+        template <typename T>
+        static void destroy( void* object ) { static_cast<T*>( object )->~T(); }
+
+        void register_destructor( void* object, void (*destroy)( void* ) );
+
+        // starts a new block that fits 'size' bytes aligned to 'alignment'
+        void* allocate_slow( size_t size, size_t alignment );
+
+        static const size_t block_size = 64 * 1024;
+
+        char* _current;
+        char* _end;
+        BlockHeader* _blocks;
+        Cleanup* _cleanups;
+        size_t _allocated;
+    };
+
+};
@@ -2,13 +2,64 @@
 
 #include "Interpreter.h"
 #include "ScriptParser.h"
+#include "CompiledScript.h"
+#include "ProgramCache.h"
+#include "AotCompiler.h"
 
 #include <QDebug>
 #include <QIODevice>
 #include <QFile>
+#include <QScopedPointer>
 
 using namespace VTScript;
 
+namespace
+{
+    QString read_script(const QString& filename)
+    {
+        QFile file( filename );
+        if ( !file.open(QIODevice::ReadOnly | QIODevice::Text) )
+            throw InterpretError("Couldn't open file: " + filename);
+
+        return QTextStream(&file).readAll();
+    }
+
+    /* Gives a program acquired from ProgramCache back when it goes out of scope */
+    class CachedProgram
+    {
+    public:
+        CachedProgram(VTScript::ProgramCache& cache, VTScript::Program* program) : cache(cache), program(program) {}
+        ~CachedProgram() { cache.release(program); }
+
+    private:
+        Q_DISABLE_COPY(CachedProgram)
+
+        VTScript::ProgramCache& cache;
+        VTScript::Program* program;
+    };
+
+    QHash<QString, WS::SP_Object> init_table_built_in()
+    {
+        QHash<QString, WS::SP_Object> table;
+        table["print"] = WS::SP_Object(new Builtin::print());
+        table["help"] = WS::SP_Object(new Builtin::help());
+        table["int"] = WS::SP_Object(new Builtin::_int());
+        table["double"] = WS::SP_Object(new Builtin::_double());
+        table["bool"] = WS::SP_Object(new Builtin::_bool());
+        table["exec"] = WS::SP_Object(new Builtin::exec());
+        table["compile"] = WS::SP_Object(new Builtin::compile());
+        table["compile_native"] = WS::SP_Object(new Builtin::compile_native());
+        return table;
+    }
+}
+
+const QHash<QString, WS::SP_Object>& Builtin::table()
+{
+    // never changes once built, so resolved names may point into it
+    static const QHash<QString, WS::SP_Object> table_built_in = init_table_built_in();
+    return table_built_in;
+}
+
 WS::SP_Object Builtin::print::operator()(WS::ObjectList& args)
 {
     QStringList l;
@@ -50,19 +101,52 @@ WS::SP_Object Builtin::exec::operator()(WS::ObjectList& args)
     WS::check<WS::String>(args);
 
     QString filename = args.at<WS::String>(0)->value();
-    QFile file( filename );
-    if ( !file.open(QIODevice::ReadOnly | QIODevice::Text) )
-        throw InterpretError("Couldn't open file: " + filename);
 
-    QString script = QTextStream(&file).readAll();
-    
-    VTScript::AST::Node* ast = VTScript::Parser::parse( script );
-    if (ast == NULL)
-        throw InterpretError("Couldn't parse script: " + filename);
+    // scripts run again and again are loaded only once
+    VTScript::ProgramCache& cache = VTScript::ProgramCache::instance();
+    VTScript::Program* program = cache.acquire( filename );
+    if (program == NULL)
+        throw InterpretError("Couldn't load script: " + filename);
+    // released after the interpreter is deleted, also when running the script throws
+    CachedProgram cached( cache, program );
 
-    QThread* running_script = new VTScript::Interpreter(ast);
+    // the script runs on the engine of the one calling exec
+    VTScript::Interpreter* caller = VTScript::Interpreter::current();
+    VTScript::Engine engine = caller != NULL ? caller->used_engine() : VTScript::Engines::TreeWalker;
+
+    QScopedPointer<VTScript::Interpreter> running_script( new VTScript::Interpreter(program, false, engine) );
+    if ( caller != NULL )
+        running_script->set_quickening( caller->is_quickening() );
+    // functions built by compile_native run in native code
+    running_script->load_native_code( filename );
     running_script->start();
     running_script->wait();
 
     return WS::SP_Object( new WS::None() );
-}
\ No newline at end of file
+}
+
+WS::SP_Object Builtin::compile::operator()(WS::ObjectList& args)
+{
+    WS::check<WS::String, WS::String>(args);
+
+    QString script = read_script( args.at<WS::String>(0)->value() );
+    QString compiled = args.at<WS::String>(1)->value();
+
+    if ( !VTScript::CompiledScript::compile( script, compiled ) )
+        throw InterpretError("Couldn't compile script: " + args.at<WS::String>(0)->value());
+
+    return WS::SP_Object( new WS::None() );
+}
+
+WS::SP_Object Builtin::compile_native::operator()(WS::ObjectList& args)
+{
+    WS::check<WS::String>(args);
+
+    QString script = args.at<WS::String>(0)->value();
+    QString log;
+
+    if ( !VTScript::AotCompiler::build( script, log ) )
+        throw InterpretError("Couldn't build native code of script: " + script + "\n" + log);
+
+    return WS::SP_Object( new WS::None() );
+}
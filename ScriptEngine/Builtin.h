@@ -43,8 +43,25 @@ namespace VTScript
         {
             exec() { _num_args = 1; }
             WS::SP_Object operator()(WS::ObjectList& args);
-            QString __repr__() const { return "exec(script_path) : executes another script; no return value ; built-in"; }
+            QString __repr__() const { return "exec(script_path) : executes another script, source or .vtsc; no return value ; built-in"; }
         };
 
+        struct compile : public WS::Function
+        {
+            compile() { _num_args = 2; }
+            WS::SP_Object operator()(WS::ObjectList& args);
+            QString __repr__() const { return "compile(script_path, compiled_path) : precompiles a script for exec into a .vtsc file; no return value ; built-in"; }
+        };
+
+        struct compile_native : public WS::Function
+        {
+            compile_native() { _num_args = 1; }
+            WS::SP_Object operator()(WS::ObjectList& args);
+            QString __repr__() const { return "compile_native(script_path) : builds native code of the functions of a script next to it, as script_path.vts-native.so, which exec uses until the script changes; no return value ; built-in"; }
+        };
+
+        // builtins by name; names a script doesn't assign resolve to these
+        const QHash<QString, WS::SP_Object>& table();
+
     };
 };
\ No newline at end of file
@@ -0,0 +1,108 @@
+#include "Bytecode.h"
+
+#include <QStringList>
+
+using namespace VTScript;
+using namespace VTScript::Bytecode;
+
+const char* Opcodes::to_string(Opcode opcode)
+{
+    switch (opcode)
+    {
+    case Constant      : return "constant";
+    case LoadLocal     : return "load_local";
+    case LoadName      : return "load_name";
+    case StoreLocal    : return "store_local";
+    case AssignName    : return "assign_name";
+    case Clear         : return "clear";
+    case Pop           : return "pop";
+    case Unary         : return "unary";
+    case Binary        : return "binary";
+    case CheckFunction : return "check_function";
+    case Call          : return "call";
+    case Method        : return "method";
+    case Define        : return "define";
+    case Jump          : return "jump";
+    case JumpIfFalse   : return "jump_if_false";
+    case Return        : return "return";
+    default            : return "`error`";
+    }
+}
+
+int Opcodes::operand_count(Opcode opcode)
+{
+    switch (opcode)
+    {
+    case LoadLocal:
+    case Unary:
+    case Binary:
+    case Method:
+        return 2;
+    case Pop:
+    case CheckFunction:
+    case Define:
+    case Return:
+        return 0;
+    default:
+        return 1;
+    }
+}
+
+ulong Chunk::line_at(int pc) const
+{
+    // the last run starting at or before pc
+    int low = 0;
+    int high = lines.size() - 1;
+    ulong line = 0;
+    while (low <= high)
+    {
+        const int middle = (low + high) / 2;
+        if (lines[middle].first <= pc)
+        {
+            line = lines[middle].second;
+            low = middle + 1;
+        }
+        else
+            high = middle - 1;
+    }
+    return line;
+}
+
+QString Chunk::disassemble() const
+{
+    QStringList result;
+    for (int pc = 0; pc < code.size(); )
+    {
+        const Opcode opcode = Opcode(code[pc]);
+        QString line = QString("%1  %2 %3").arg(pc, 5).arg(line_at(pc), 4).arg(Opcodes::to_string(opcode));
+
+        const int count = Opcodes::operand_count(opcode);
+        for (int i = 1; i <= count; ++i)
+            line += " " + QString::number(code[pc + i]);
+
+        switch (opcode)
+        {
+        case Opcodes::Constant:
+            line += "  ; " + constants[code[pc + 1]]->__repr__();
+            break;
+        case Opcodes::LoadLocal:
+            line += "  ; " + names[code[pc + 2]].text;
+            break;
+        case Opcodes::LoadName:
+        case Opcodes::AssignName:
+        case Opcodes::Method:
+            line += "  ; " + names[code[pc + 1]].text;
+            break;
+        case Opcodes::Unary:
+        case Opcodes::Binary:
+            line += "  ; " + OperatorTypes::to_string(OperatorType(code[pc + 1]));
+            break;
+        default:
+            break;
+        }
+
+        result.append(line);
+        pc += 1 + count;
+    }
+    return result.join("\n");
+}
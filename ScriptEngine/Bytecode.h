@@ -0,0 +1,73 @@
+#pragma once
+
+#include "AST.h"
+#include "Objects.h"
+
+#include <QPair>
+#include <QString>
+#include <QVector>
+
+namespace VTScript
+{
+    /*
+        Compiled form of one function body, or of the top level of a script, for the
+        bytecode loop of the interpreter (Interpreter::execute). Instructions are an
+        opcode followed by its operands, all ints; values live on an operand stack.
+    */
+    namespace Bytecode
+    {
+        namespace Opcodes
+        {
+            // operands in brackets; pushes and pops of the operand stack after the colon
+            enum Opcode
+            {
+                Constant,       // [constant] : pushes it
+                LoadLocal,      // [slot, name] : pushes the variable, a name with one candidate in the running frame and no builtin
+                LoadName,       // [name] : pushes what the name refers to, see AST::Binding
+                StoreLocal,     // [slot] : assigns the top to a name with one candidate, leaves it on the stack
+                AssignName,     // [name] : assigns the top to the name, leaves it on the stack
+                Clear,          // [slot] : empties the variable, for a block being left
+                Pop,            // : pops one value
+                Unary,          // [operator, operand type] : pops the argument, pushes the result
+                Binary,         // [operator, operand type] : pops the right then the left operand, pushes the result
+                CheckFunction,  // : throws if the top isn't a function, before its arguments are evaluated
+                Call,           // [argument count] : pops the arguments and the function, pushes the result
+                Method,         // [name, argument count] : pops the arguments and the object, pushes the result
+                Define,         // : the top is a function being declared, binds it to the interpreter
+                Jump,           // [target]
+                JumpIfFalse,    // [target] : pops the condition, jumps unless its __bool__ is true
+                Return          // : pops the value returned
+            };
+
+            const char* to_string(Opcode opcode);
+            // number of ints after the opcode
+            int operand_count(Opcode opcode);
+        }
+
+        typedef Opcodes::Opcode Opcode;
+
+        struct Chunk
+        {
+            Chunk() : stack_size(0) {}
+
+            // line of the node the instruction at 'pc' was compiled from
+            ulong line_at(int pc) const;
+            QString disassemble() const;
+
+            // an identifier or a method name where it's used
+            struct Name
+            {
+                QString text;
+                AST::Binding binding;               // none for a method
+                ulong line;
+            };
+
+            QVector<int> code;
+            QVector<WS::SP_Object> constants;
+            QVector<Name> names;
+            QVector<QPair<int, ulong> > lines;      // first pc of every run of instructions from one line
+            int stack_size;                         // most values on the operand stack at once
+        };
+    }
+
+};
@@ -0,0 +1,258 @@
+#include "BytecodeCompiler.h"
+
+using namespace VTScript;
+using namespace VTScript::Bytecode;
+
+Chunk* BytecodeCompiler::compile_function(const AST::Block* body)
+{
+    return compile(body->values(), NULL);
+}
+
+Chunk* BytecodeCompiler::compile_program(const Program& program)
+{
+    return compile(program.root()->values(), program.root());
+}
+
+Chunk* BytecodeCompiler::compile(const AST::NodeList<AST::Node>& statements, AST::Block* scope)
+{
+    Chunk* chunk = new Chunk();
+    BytecodeCompiler compiler(chunk);
+
+    try
+    {
+        foreach(AST::Node* stmt, statements)
+            compiler.statement(stmt);
+    }
+    catch (const Unsupported&)
+    {
+        delete chunk;
+        return NULL;
+    }
+
+    const ulong line = scope != NULL ? scope->line() : 0;
+    if (scope != NULL)
+        compiler.leave(scope, line);
+
+    // falling off the end returns None
+    compiler.write_op(Opcodes::Constant, compiler.constant(WS::SP_Object(new WS::None())), line, 1);
+    compiler.write_op(Opcodes::Return, line, -1);
+    return chunk;
+}
+
+void BytecodeCompiler::write_op(Opcode opcode, ulong line, int effect)
+{
+    if (chunk->lines.isEmpty() || chunk->lines.last().second != line)
+        chunk->lines.append(qMakePair(chunk->code.size(), line));
+
+    chunk->code.append(opcode);
+    depth += effect;
+    if (depth > chunk->stack_size)
+        chunk->stack_size = depth;
+}
+
+void BytecodeCompiler::write_op(Opcode opcode, int operand, ulong line, int effect)
+{
+    write_op(opcode, line, effect);
+    chunk->code.append(operand);
+}
+
+int BytecodeCompiler::write_jump(Opcode opcode, ulong line, int effect)
+{
+    write_op(opcode, -1, line, effect);
+    return chunk->code.size() - 1;
+}
+
+void BytecodeCompiler::patch(int jump, int target)
+{
+    chunk->code[jump] = target;
+}
+
+void BytecodeCompiler::statement(AST::Node* node)
+{
+    // an expression statement leaves its value, which nobody uses; an else left out is a Noop
+    if (dynamic_cast<AST::Noop*>(node) != NULL)
+        return;
+
+    node->accept(this);
+    if (dynamic_cast<AST::Expression*>(node) != NULL)
+        write_op(Opcodes::Pop, node->line(), -1);
+}
+
+int BytecodeCompiler::constant(const WS::SP_Object& object)
+{
+    chunk->constants.append(object);
+    return chunk->constants.size() - 1;
+}
+
+int BytecodeCompiler::name(const QString& text, const AST::Binding& binding, ulong line)
+{
+    Chunk::Name name = { text, binding, line };
+    chunk->names.append(name);
+    return chunk->names.size() - 1;
+}
+
+void BytecodeCompiler::assign(const AST::Binding& binding, const QString& text, ulong line)
+{
+    // only a name that may be a variable of more than one block needs the search
+    if (binding.count == 1)
+        write_op(Opcodes::StoreLocal, binding.addresses[0].slot, line, 0);
+    else
+        write_op(Opcodes::AssignName, name(text, binding, line), line, 0);
+}
+
+void BytecodeCompiler::leave(AST::Block* block, ulong line)
+{
+    for (int i = 0; i < block->scope_slot_count(); ++i)
+        write_op(Opcodes::Clear, block->scope_slots()[i], line, 0);
+}
+
+void BytecodeCompiler::visit(AST::Noop* node)
+{
+    write_op(Opcodes::Constant, constant(WS::SP_Object(new WS::None())), node->line(), 1);
+}
+
+void BytecodeCompiler::visit(AST::Leaf* node)
+{
+    if (!node->is_identifier())
+    {
+        write_op(Opcodes::Constant, constant(node->object()), node->line(), 1);
+        return;
+    }
+
+    const AST::Binding& binding = node->binding();
+    if (binding.count == 1 && binding.addresses[0].depth == 0 && binding.builtin == NULL)
+    {
+        write_op(Opcodes::LoadLocal, binding.addresses[0].slot, node->line(), 1);
+        chunk->code.append(name(node->name(), binding, node->line()));
+        return;
+    }
+
+    write_op(Opcodes::LoadName, name(node->name(), binding, node->line()), node->line(), 1);
+}
+
+void BytecodeCompiler::visit(AST::FunctionCall* node)
+{
+    node->function_object()->accept(this);
+    write_op(Opcodes::CheckFunction, node->line(), 0);
+
+    const AST::NodeList<AST::Expression>& args = node->arguments_expressions();
+    foreach(AST::Expression* expr, args)
+        expr->accept(this);
+
+    write_op(Opcodes::Call, args.size(), node->line(), -args.size());
+}
+
+void BytecodeCompiler::visit(AST::UnaryOperator* node)
+{
+    node->argument()->accept(this);
+    write_op(Opcodes::Unary, node->type(), node->line(), 0);
+    chunk->code.append(node->operand_type());
+}
+
+void BytecodeCompiler::visit(AST::BinaryOperator* node)
+{
+    if (node->type() == OperatorTypes::Assign)
+    {
+        AST::Leaf* target = static_cast<AST::Leaf*>(node->left());
+        node->right()->accept(this);
+        assign(target->binding(), target->name(), node->line());
+    }
+    else if (node->type() == OperatorTypes::Dot)
+    {
+        node->left()->accept(this);
+
+        AST::FunctionCall* method = static_cast<AST::FunctionCall*>(node->right());
+        const AST::NodeList<AST::Expression>& args = method->arguments_expressions();
+        foreach(AST::Expression* expr, args)
+            expr->accept(this);
+
+        const QString& method_name = static_cast<AST::Leaf*>(method->function_object())->name();
+        write_op(Opcodes::Method, name(method_name, AST::Binding(), node->line()), node->line(), -args.size());
+        chunk->code.append(args.size());
+    }
+    else
+    {
+        node->left()->accept(this);
+        node->right()->accept(this);
+        write_op(Opcodes::Binary, node->type(), node->line(), -1);
+        chunk->code.append(node->operand_type());
+    }
+}
+
+void BytecodeCompiler::visit(AST::Return* node)
+{
+    node->expr()->accept(this);
+    write_op(Opcodes::Return, node->line(), -1);
+}
+
+void BytecodeCompiler::visit(AST::Continue* node)
+{
+    if (loops.isEmpty())
+        throw Unsupported();
+
+    for (int i = blocks.size() - 1; i >= loops.top().blocks; --i)
+        leave(blocks[i], node->line());
+    write_op(Opcodes::Jump, loops.top().head, node->line(), 0);
+}
+
+void BytecodeCompiler::visit(AST::Break* node)
+{
+    if (loops.isEmpty())
+        throw Unsupported();
+
+    for (int i = blocks.size() - 1; i >= loops.top().blocks; --i)
+        leave(blocks[i], node->line());
+    loops.top().breaks.append(write_jump(Opcodes::Jump, node->line(), 0));
+}
+
+void BytecodeCompiler::visit(AST::Block* node)
+{
+    blocks.push(node);
+
+    foreach(AST::Node* stmt, node->values())
+        statement(stmt);
+
+    // variables of the block go away with it
+    leave(node, node->line());
+    blocks.pop();
+}
+
+void BytecodeCompiler::visit(AST::FunctionDeclaration* node)
+{
+    write_op(Opcodes::Constant, constant(node->fnc()), node->line(), 1);
+    write_op(Opcodes::Define, node->line(), 0);
+    assign(node->binding(), node->name(), node->line());
+    write_op(Opcodes::Pop, node->line(), -1);
+}
+
+void BytecodeCompiler::visit(AST::While* node)
+{
+    Loop loop;
+    loop.head = chunk->code.size();
+    loop.blocks = blocks.size();
+
+    node->condition()->accept(this);
+    const int exit = write_jump(Opcodes::JumpIfFalse, node->line(), -1);
+
+    loops.push(loop);
+    statement(node->body());
+    write_op(Opcodes::Jump, loop.head, node->line(), 0);
+    loop = loops.pop();
+
+    patch(exit, chunk->code.size());
+    foreach(int jump, loop.breaks)
+        patch(jump, chunk->code.size());
+}
+
+void BytecodeCompiler::visit(AST::If* node)
+{
+    node->condition()->accept(this);
+    const int otherwise = write_jump(Opcodes::JumpIfFalse, node->line(), -1);
+
+    statement(node->then_stmt());
+    const int end = write_jump(Opcodes::Jump, node->line(), 0);
+
+    patch(otherwise, chunk->code.size());
+    statement(node->else_stmt());
+    patch(end, chunk->code.size());
+}
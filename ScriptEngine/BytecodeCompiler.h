@@ -0,0 +1,70 @@
+#pragma once
+
+#include "AST.h"
+#include "Bytecode.h"
+#include "Program.h"
+
+#include <QList>
+#include <QStack>
+
+namespace VTScript
+{
+    /*
+        Compiles a resolved function body, or the top level of a script, to bytecode
+        for Interpreter::execute. It does what the tree walker does, in the same order:
+        the function of a call is checked before its arguments are evaluated, blocks
+        empty their variables when they are left, 'break' and 'continue' included.
+
+        Needs Resolver's bindings; uses TypeInference's operand types for the fast paths
+        of operators. Inliner's copies and LoopInvariants' caches are not used, the
+        calls and expressions they stand for are compiled as written.
+    */
+    class BytecodeCompiler : public ASTTools::NodeVisitor
+    {
+    public:
+        // the statements of a function body; NULL if they have 'break' or 'continue' outside a loop
+        static Bytecode::Chunk* compile_function(const AST::Block* body);
+
+        // the top level of a resolved program, its outermost block included; NULL as above
+        static Bytecode::Chunk* compile_program(const Program& program);
+
+        VISITOR_METHODS
+
+    private:
+        // where 'continue' jumps to, the jumps of 'break' to patch, and how many blocks were open around the loop
+        struct Loop
+        {
+            int head;
+            QList<int> breaks;
+            int blocks;
+        };
+
+        // 'break' or 'continue' outside a loop; Checker lets some through
+        struct Unsupported {};
+
+        BytecodeCompiler(Bytecode::Chunk* chunk) : chunk(chunk), depth(0) {}
+
+        // the statements, then emptying the variables of 'scope' if there is one, then returning None
+        static Bytecode::Chunk* compile(const AST::NodeList<AST::Node>& statements, AST::Block* scope);
+
+        // appends an opcode that changes the depth of the operand stack by 'effect'
+        void write_op(Bytecode::Opcode opcode, ulong line, int effect);
+        void write_op(Bytecode::Opcode opcode, int operand, ulong line, int effect);
+        // a jump whose target is set by patch(), returns where its target goes
+        int write_jump(Bytecode::Opcode opcode, ulong line, int effect);
+        void patch(int jump, int target);
+
+        void statement(AST::Node* node);
+        int constant(const WS::SP_Object& object);
+        int name(const QString& text, const AST::Binding& binding, ulong line);
+        void assign(const AST::Binding& binding, const QString& text, ulong line);
+        // empties the variables of a block being left
+        void leave(AST::Block* block, ulong line);
+
+        Bytecode::Chunk* chunk;
+        int depth;                      // values on the operand stack at this point
+        QStack<Loop> loops;
+        QStack<AST::Block*> blocks;     // blocks open around the node visited
+    };
+
+};
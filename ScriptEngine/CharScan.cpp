@@ -0,0 +1,281 @@
+#include "CharScan.h"
+
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+#   define CHARSCAN_X86
+#   define CHARSCAN_TARGET_SSE2 __attribute__((target("sse2")))
+#   define CHARSCAN_TARGET_AVX2 __attribute__((target("avx2")))
+#   include <immintrin.h>
+#elif defined(_MSC_VER) && ( defined(_M_X64) || defined(_M_IX86) )
+#   define CHARSCAN_X86
+#   define CHARSCAN_TARGET_SSE2
+#   define CHARSCAN_TARGET_AVX2
+#   include <intrin.h>
+#   include <immintrin.h>
+#endif
+
+using namespace VTScript;
+
+namespace
+{
+    /*
+        Character classes. Each provides a scalar predicate and, on x86, vector predicates
+        that set a 16-bit lane to 0xFFFF for characters inside the class.
+    */
+
+    inline bool in_range( ushort c, ushort lo, ushort hi ) { return static_cast<ushort>(c - lo) <= hi - lo; }
+
+#ifdef CHARSCAN_X86
+    CHARSCAN_TARGET_SSE2 inline __m128i in_range_sse2( __m128i c, short lo, short hi )
+    {
+        __m128i offset = _mm_sub_epi16( c, _mm_set1_epi16(lo) );
+        return _mm_cmpeq_epi16( _mm_subs_epu16( offset, _mm_set1_epi16(hi - lo) ), _mm_setzero_si128() );
+    }
+
+    CHARSCAN_TARGET_AVX2 inline __m256i in_range_avx2( __m256i c, short lo, short hi )
+    {
+        __m256i offset = _mm256_sub_epi16( c, _mm256_set1_epi16(lo) );
+        return _mm256_cmpeq_epi16( _mm256_subs_epu16( offset, _mm256_set1_epi16(hi - lo) ), _mm256_setzero_si256() );
+    }
+#endif
+
+    struct Whitespace
+    {
+        static inline bool match( ushort c ) { return c == ' ' || c == '\t'; }
+#ifdef CHARSCAN_X86
+        CHARSCAN_TARGET_SSE2 static inline __m128i match( __m128i c )
+        { return _mm_or_si128( _mm_cmpeq_epi16( c, _mm_set1_epi16(' ') ), _mm_cmpeq_epi16( c, _mm_set1_epi16('\t') ) ); }
+        CHARSCAN_TARGET_AVX2 static inline __m256i match( __m256i c )
+        { return _mm256_or_si256( _mm256_cmpeq_epi16( c, _mm256_set1_epi16(' ') ), _mm256_cmpeq_epi16( c, _mm256_set1_epi16('\t') ) ); }
+#endif
+    };
+
+    // letters are folded to lower case with "| 0x20", which maps no other character into [a-z]
+    struct Identifier
+    {
+        static inline bool match( ushort c ) { return in_range( c | 0x20, 'a', 'z' ) || in_range( c, '0', '9' ) || c == '_'; }
+#ifdef CHARSCAN_X86
+        CHARSCAN_TARGET_SSE2 static inline __m128i match( __m128i c )
+        {
+            __m128i letter = in_range_sse2( _mm_or_si128( c, _mm_set1_epi16(0x20) ), 'a', 'z' );
+            __m128i digit = in_range_sse2( c, '0', '9' );
+            __m128i underscore = _mm_cmpeq_epi16( c, _mm_set1_epi16('_') );
+            return _mm_or_si128( _mm_or_si128( letter, digit ), underscore );
+        }
+        CHARSCAN_TARGET_AVX2 static inline __m256i match( __m256i c )
+        {
+            __m256i letter = in_range_avx2( _mm256_or_si256( c, _mm256_set1_epi16(0x20) ), 'a', 'z' );
+            __m256i digit = in_range_avx2( c, '0', '9' );
+            __m256i underscore = _mm256_cmpeq_epi16( c, _mm256_set1_epi16('_') );
+            return _mm256_or_si256( _mm256_or_si256( letter, digit ), underscore );
+        }
+#endif
+    };
+
+    struct Digit
+    {
+        static inline bool match( ushort c ) { return in_range( c, '0', '9' ); }
+#ifdef CHARSCAN_X86
+        CHARSCAN_TARGET_SSE2 static inline __m128i match( __m128i c ) { return in_range_sse2( c, '0', '9' ); }
+        CHARSCAN_TARGET_AVX2 static inline __m256i match( __m256i c ) { return in_range_avx2( c, '0', '9' ); }
+#endif
+    };
+
+    struct NotLineEnd
+    {
+        static inline bool match( ushort c ) { return c != '\n' && c != '\r'; }
+#ifdef CHARSCAN_X86
+        CHARSCAN_TARGET_SSE2 static inline __m128i match( __m128i c )
+        {
+            __m128i end = _mm_or_si128( _mm_cmpeq_epi16( c, _mm_set1_epi16('\n') ), _mm_cmpeq_epi16( c, _mm_set1_epi16('\r') ) );
+            return _mm_xor_si128( end, _mm_set1_epi16(-1) );
+        }
+        CHARSCAN_TARGET_AVX2 static inline __m256i match( __m256i c )
+        {
+            __m256i end = _mm256_or_si256( _mm256_cmpeq_epi16( c, _mm256_set1_epi16('\n') ), _mm256_cmpeq_epi16( c, _mm256_set1_epi16('\r') ) );
+            return _mm256_xor_si256( end, _mm256_set1_epi16(-1) );
+        }
+#endif
+    };
+
+
+    inline int count_trailing_zeros( unsigned int mask )
+    {
+#if defined(_MSC_VER)
+        unsigned long index;
+        _BitScanForward( &index, mask );
+        return static_cast<int>(index);
+#else
+        return __builtin_ctz( mask );
+#endif
+    }
+
+    template <typename Class>
+    int scan_scalar( const QChar* data, int position, int size )
+    {
+        while ( position < size && Class::match( data[position].unicode() ) )
+            ++position;
+        return position;
+    }
+
+#ifdef CHARSCAN_X86
+    /*
+        16-bit lane masks of two registers are packed into bytes (0xFFFF -> 0xFF, 0 -> 0),
+        so movemask yields one bit per character.
+    */
+    template <typename Class>
+    CHARSCAN_TARGET_SSE2 int scan_sse2( const QChar* data, int position, int size )
+    {
+        while ( position + 16 <= size )
+        {
+            const __m128i* p = reinterpret_cast<const __m128i*>( data + position );
+            __m128i lo = Class::match( _mm_loadu_si128( p ) );
+            __m128i hi = Class::match( _mm_loadu_si128( p + 1 ) );
+            unsigned int outside = ~static_cast<unsigned int>( _mm_movemask_epi8( _mm_packs_epi16( lo, hi ) ) ) & 0xFFFFu;
+
+            if ( outside )
+                return position + count_trailing_zeros( outside );
+
+            position += 16;
+        }
+
+        return scan_scalar<Class>( data, position, size );
+    }
+
+    // _mm256_packs_epi16 interleaves 128-bit lanes, permute restores character order
+    template <typename Class>
+    CHARSCAN_TARGET_AVX2 int scan_avx2( const QChar* data, int position, int size )
+    {
+        while ( position + 32 <= size )
+        {
+            const __m256i* p = reinterpret_cast<const __m256i*>( data + position );
+            __m256i lo = Class::match( _mm256_loadu_si256( p ) );
+            __m256i hi = Class::match( _mm256_loadu_si256( p + 1 ) );
+            __m256i packed = _mm256_permute4x64_epi64( _mm256_packs_epi16( lo, hi ), 0xD8 );
+            unsigned int outside = ~static_cast<unsigned int>( _mm256_movemask_epi8( packed ) );
+
+            if ( outside )
+                return position + count_trailing_zeros( outside );
+
+            position += 32;
+        }
+
+        return scan_sse2<Class>( data, position, size );
+    }
+#endif
+
+    typedef int (*ScanFunction)( const QChar* data, int position, int size );
+
+    struct Scanner
+    {
+        CharScan::Implementation impl;
+        ScanFunction whitespace;
+        ScanFunction identifier;
+        ScanFunction digits;
+        ScanFunction line_end;
+    };
+
+    const Scanner scalar_scanner = { CharScan::Scalar, &scan_scalar<Whitespace>, &scan_scalar<Identifier>,
+                                     &scan_scalar<Digit>, &scan_scalar<NotLineEnd> };
+#ifdef CHARSCAN_X86
+    const Scanner sse2_scanner = { CharScan::SSE2, &scan_sse2<Whitespace>, &scan_sse2<Identifier>,
+                                   &scan_sse2<Digit>, &scan_sse2<NotLineEnd> };
+    const Scanner avx2_scanner = { CharScan::AVX2, &scan_avx2<Whitespace>, &scan_avx2<Identifier>,
+                                   &scan_avx2<Digit>, &scan_avx2<NotLineEnd> };
+#endif
+
+    bool cpu_has_sse2()
+    {
+#if defined(__x86_64__) || defined(_M_X64)
+        return true;
+#elif defined(CHARSCAN_X86) && defined(_MSC_VER)
+        int info[4];
+        __cpuid( info, 1 );
+        return ( info[3] & (1 << 26) ) != 0;
+#elif defined(CHARSCAN_X86)
+        __builtin_cpu_init();
+        return __builtin_cpu_supports( "sse2" );
+#else
+        return false;
+#endif
+    }
+
+    bool cpu_has_avx2()
+    {
+#if defined(CHARSCAN_X86) && defined(_MSC_VER)
+        int info[4];
+        __cpuid( info, 1 );
+        bool os_saves_ymm = ( info[2] & (1 << 27) ) && ( info[2] & (1 << 28) ) && ( ( _xgetbv(0) & 6 ) == 6 );
+        if ( !os_saves_ymm )
+            return false;
+        __cpuidex( info, 7, 0 );
+        return ( info[1] & (1 << 5) ) != 0;
+#elif defined(CHARSCAN_X86)
+        __builtin_cpu_init();
+        return __builtin_cpu_supports( "avx2" );
+#else
+        return false;
+#endif
+    }
+
+    const Scanner* scanner_for( CharScan::Implementation impl )
+    {
+#ifdef CHARSCAN_X86
+        if ( impl == CharScan::AVX2 && cpu_has_avx2() )
+            return &avx2_scanner;
+        if ( impl >= CharScan::SSE2 && cpu_has_sse2() )
+            return &sse2_scanner;
+#else
+        (void)impl;
+#endif
+        return &scalar_scanner;
+    }
+
+    const Scanner* active = scanner_for( CharScan::AVX2 );
+}
+
+
+int CharScan::skip_whitespace( const QChar* data, int position, int size )
+{
+    return active->whitespace( data, position, size );
+}
+
+int CharScan::skip_identifier( const QChar* data, int position, int size )
+{
+    return active->identifier( data, position, size );
+}
+
+int CharScan::skip_digits( const QChar* data, int position, int size )
+{
+    return active->digits( data, position, size );
+}
+
+int CharScan::find_line_end( const QChar* data, int position, int size )
+{
+    return active->line_end( data, position, size );
+}
+
+CharScan::Implementation CharScan::implementation()
+{
+    return active->impl;
+}
+
+CharScan::Implementation CharScan::best_supported()
+{
+    return scanner_for( AVX2 )->impl;
+}
+
+void CharScan::set_implementation( Implementation impl )
+{
+    active = scanner_for( impl );
+}
+
+const char* CharScan::to_string( Implementation impl )
+{
+    switch ( impl )
+    {
+    case Scalar : return "scalar";
+    case SSE2   : return "SSE2";
+    case AVX2   : return "AVX2";
+    default     : return "unknown";
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <QChar>
+
+namespace VTScript
+{
+    /*
+        Vectorized scanning of character runs in UTF-16 buffers, used by Lexer's hot loop.
+
+        Every function returns the index of the first character at or after 'position'
+        that does not belong to the run (or 'size' if the run reaches the end of buffer).
+        Implementation is picked at runtime: AVX2 (32 characters per step), SSE2
+        (16 characters per step) or plain scalar loop.
+    */
+    namespace CharScan
+    {
+        enum Implementation
+        {
+            Scalar,
+            SSE2,
+            AVX2
+        };
+
+        // [ \t]*
+        int skip_whitespace( const QChar* data, int position, int size );
+        // [_A-Za-z0-9]*
+        int skip_identifier( const QChar* data, int position, int size );
+        // [0-9]*
+        int skip_digits( const QChar* data, int position, int size );
+        // [^\r\n]*
+        int find_line_end( const QChar* data, int position, int size );
+
+        Implementation implementation();
+        Implementation best_supported();
+
+        // falls back to best supported implementation if 'impl' is not available on this CPU
+        void set_implementation( Implementation impl );
+
+        const char* to_string( Implementation impl );
+    };
+};
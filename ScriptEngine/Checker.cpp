@@ -7,9 +7,11 @@
 using namespace VTScript;
 
 
-Checker::Checker(AST::Node* ast_root) :
+Checker::Checker(AST::Node* ast_root, bool inside_function) :
         ast(ast_root)
 {
+    if (inside_function)
+        state_stack.push(InFunction);
 }
 
 void Checker::run()
@@ -118,7 +120,10 @@ void Checker::visit(AST::Block* node)
 void Checker::visit(AST::FunctionDeclaration* node)
 {
     state_stack.push(InFunction);
-    node->body()->accept(this);
+    // deferred bodies are checked when they get parsed
+    if (node->is_body_parsed())
+        node->body()->accept(this);
+    state_stack.pop();
 }
 
 void Checker::visit(AST::While* node)
@@ -127,6 +132,7 @@ void Checker::visit(AST::While* node)
     // condition is bool
     node->condition()->accept(this);
     node->body()->accept(this);
+    state_stack.pop();
 }
 
 void Checker::visit(AST::If* node)
@@ -136,5 +142,6 @@ void Checker::visit(AST::If* node)
     node->condition()->accept(this);
     node->then_stmt()->accept(this);
     node->else_stmt()->accept(this);
+    state_stack.pop();
 }
 
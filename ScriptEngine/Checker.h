@@ -18,7 +18,8 @@ namespace VTScript
             ReturnIsSet
         };
         
-        Checker(AST::Node* ast_root);
+        // 'inside_function' checks 'ast_root' as the body of a function
+        Checker(AST::Node* ast_root, bool inside_function = false);
         ~Checker() {}
         void run();
 
@@ -0,0 +1,439 @@
+#include "ClosureCompiler.h"
+#include "Interpreter.h"
+#include "TypedOperators.h"
+#include "Errors.h"
+
+using namespace VTScript;
+using namespace VTScript::Closures;
+
+namespace
+{
+    // the value of __bool__, without the call for a Bool
+    bool is_true(const WS::SP_Object& value)
+    {
+        if (value->__type__() == WSTypes::Bool)
+            return static_cast<WS::Bool*>(value.data())->value();
+        return value->invoke("__bool__", WS::ObjectList()).staticCast<WS::Bool>()->value();
+    }
+
+    // type of the operand if it's a literal, Base otherwise
+    WSType literal_type(AST::Expression* operand)
+    {
+        AST::Leaf* leaf = dynamic_cast<AST::Leaf*>(operand);
+        return leaf != NULL && !leaf->is_identifier() ? leaf->object()->__type__() : WSTypes::Base;
+    }
+}
+
+Statement* ClosureCompiler::compile_function(Interpreter* interpreter, const AST::Block* body)
+{
+    ClosureCompiler compiler(interpreter);
+
+    try
+    {
+        return new Statement(compiler.sequence(body->values(), NULL));
+    }
+    catch (const Unsupported&)
+    {
+        return NULL;
+    }
+}
+
+Statement* ClosureCompiler::compile_program(Interpreter* interpreter, const Program& program)
+{
+    ClosureCompiler compiler(interpreter);
+
+    try
+    {
+        return new Statement(compiler.statement(program.root()));
+    }
+    catch (const Unsupported&)
+    {
+        return NULL;
+    }
+}
+
+Expression ClosureCompiler::expression(AST::Node* node)
+{
+    node->accept(this);
+    return compiled_expression;
+}
+
+Statement ClosureCompiler::statement(AST::Node* node)
+{
+    // an expression statement only leaves its value, which nobody uses; an else left out is a Noop
+    if (dynamic_cast<AST::Noop*>(node) != NULL)
+        return [](WS::SP_Object&) -> Flow { return Next; };
+
+    if (dynamic_cast<AST::Expression*>(node) != NULL)
+    {
+        Expression value = expression(node);
+        return [value](WS::SP_Object&) -> Flow { value(); return Next; };
+    }
+
+    node->accept(this);
+    return compiled_statement;
+}
+
+Statement ClosureCompiler::sequence(const AST::NodeList<AST::Node>& statements, const AST::Block* scope)
+{
+    QVector<Statement> body;
+    foreach(AST::Node* stmt, statements)
+    {
+        if (dynamic_cast<AST::Noop*>(stmt) == NULL)
+            body.append(statement(stmt));
+    }
+
+    QVector<int> scope_slots;
+    for (int i = 0; scope != NULL && i < scope->scope_slot_count(); ++i)
+        scope_slots.append(scope->scope_slots()[i]);
+
+    if (scope_slots.isEmpty())
+    {
+        return [body](WS::SP_Object& result) -> Flow
+        {
+            for (int i = 0; i < body.size(); ++i)
+            {
+                const Flow flow = body.at(i)(result);
+                if (flow != Next)
+                    return flow;
+            }
+            return Next;
+        };
+    }
+
+    Interpreter* ctx = interpreter;
+    return [ctx, body, scope_slots](WS::SP_Object& result) -> Flow
+    {
+        Flow flow = Next;
+        for (int i = 0; i < body.size() && flow == Next; ++i)
+            flow = body.at(i)(result);
+
+        // variables of the block go away with it
+        WS::SP_Object* values = ctx->frame->values;
+        for (int i = 0; i < scope_slots.size(); ++i)
+            values[scope_slots.at(i)].clear();
+
+        return flow;
+    };
+}
+
+WS::SP_Object ClosureCompiler::invoke(Interpreter* interpreter, ulong line, const WS::SP_Object& obj,
+                                      const char* separator, const QString& method_name, const WS::ObjectList& args)
+{
+    interpreter->stack.push( QString("Line %1: ").arg(line) + obj->__repr__() + separator + method_name );
+    WS::SP_Object res = obj->invoke(method_name, args);
+    interpreter->stack.pop();
+
+    if (res == NULL)
+        res = WS::SP_Object(new WS::None());
+    return res;
+}
+
+void ClosureCompiler::visit(AST::Noop* /*node*/)
+{
+    compiled_expression = []() -> WS::SP_Object { return WS::SP_Object(new WS::None()); };
+}
+
+void ClosureCompiler::visit(AST::Leaf* node)
+{
+    if (!node->is_identifier())
+    {
+        const WS::SP_Object object = node->object();
+        compiled_expression = [object]() -> WS::SP_Object { return object; };
+        return;
+    }
+
+    Interpreter* ctx = interpreter;
+    const AST::Binding binding = node->binding();
+    const QString name = node->name();
+    const ulong line = node->line();
+
+    if (binding.count == 1 && binding.addresses[0].depth == 0 && binding.builtin == NULL)
+    {
+        // a variable of the running function and nothing else
+        const int slot = binding.addresses[0].slot;
+        compiled_expression = [ctx, slot, name, line]() -> WS::SP_Object
+        {
+            const WS::SP_Object& value = ctx->frame->values[slot];
+            if (value == NULL)
+                throw InterpretError(QString("Line %1: Identifier not found: '%2'").arg(line).arg(name));
+            return value;
+        };
+    }
+    else if (binding.count == 0 && binding.builtin != NULL)
+    {
+        const WS::SP_Object* builtin = binding.builtin;
+        compiled_expression = [builtin, name, line]() -> WS::SP_Object
+        {
+            if (*builtin == NULL)
+                throw InterpretError(QString("Line %1: Identifier not found: '%2'").arg(line).arg(name));
+            return *builtin;
+        };
+    }
+    else
+    {
+        compiled_expression = [ctx, binding, name, line]() -> WS::SP_Object
+        {
+            return ctx->read(binding, name, line);
+        };
+    }
+}
+
+void ClosureCompiler::visit(AST::FunctionCall* node)
+{
+    Expression function = expression(node->function_object());
+
+    QVector<Expression> arguments;
+    foreach(AST::Expression* expr, node->arguments_expressions())
+        arguments.append(expression(expr));
+
+    Interpreter* ctx = interpreter;
+    const ulong line = node->line();
+    compiled_expression = [ctx, function, arguments, line]() -> WS::SP_Object
+    {
+        WS::SP_Object obj = function();
+
+        // _func_object expression should yield WSFuncion descendant
+        if (obj->__type__() != WSTypes::Function)
+            throw InterpretError(QString("Line %1: Not a function: '%2'").arg(line).arg(obj->__repr__()));
+
+        QSharedPointer<WS::Function> fnc = obj.staticCast<WS::Function>();
+
+        WS::ObjectList args;
+        for (int i = 0; i < arguments.size(); ++i)
+            args.append(arguments.at(i)());
+
+        if (!fnc->check_num_arguments( args.size() ))
+            throw WrongNumberOfArgumentsError(args.size());
+
+        ctx->stack.push( QString("Line %1: ").arg(line) + fnc->__repr__() );
+        WS::SP_Object res = (*fnc)(args);
+        ctx->stack.pop();
+        if (res == NULL)
+            res = WS::SP_Object(new WS::None());
+
+        return res;
+    };
+}
+
+void ClosureCompiler::visit(AST::UnaryOperator* node)
+{
+    Expression argument = expression(node->argument());
+
+    Interpreter* ctx = interpreter;
+    const ulong line = node->line();
+    const QString method_name = OperatorTypes::to_string(node->type());
+    const WSType operand_type = node->operand_type();
+    const TypedOperators::Unary fast = TypedOperators::unary_for(node->type(), operand_type);
+
+    if (fast == NULL)
+    {
+        compiled_expression = [ctx, argument, line, method_name]() -> WS::SP_Object
+        {
+            return invoke(ctx, line, argument(), " ", method_name, WS::ObjectList());
+        };
+        return;
+    }
+
+    compiled_expression = [ctx, argument, line, method_name, operand_type, fast]() -> WS::SP_Object
+    {
+        WS::SP_Object obj = argument();
+        if (obj->__type__() == operand_type)
+        {
+            WS::SP_Object res = fast(obj.data());
+            if (res != NULL)
+                return res;
+        }
+        return invoke(ctx, line, obj, " ", method_name, WS::ObjectList());
+    };
+}
+
+void ClosureCompiler::visit(AST::BinaryOperator* node)
+{
+    Interpreter* ctx = interpreter;
+    const ulong line = node->line();
+
+    if (node->type() == OperatorTypes::Assign)
+    {
+        AST::Leaf* name = static_cast<AST::Leaf*>(node->left());
+        Expression value = expression(node->right());
+        const AST::Binding binding = name->binding();
+
+        if (binding.count == 1)
+        {
+            // the one candidate is written whether it has a value or not
+            const int slot = binding.addresses[0].slot;
+            compiled_expression = [ctx, value, slot]() -> WS::SP_Object
+            {
+                WS::SP_Object res = value();
+                ctx->frame->values[slot] = res;
+                return res;
+            };
+        }
+        else
+        {
+            compiled_expression = [ctx, value, binding]() -> WS::SP_Object
+            {
+                WS::SP_Object res = value();
+                ctx->assign(binding, res);
+                return res;
+            };
+        }
+    }
+    else if (node->type() == OperatorTypes::Dot)
+    {
+        Expression object = expression(node->left());
+
+        AST::FunctionCall* method = static_cast<AST::FunctionCall*>(node->right());
+        const QString method_name = static_cast<AST::Leaf*>(method->function_object())->name();
+
+        QVector<Expression> arguments;
+        foreach(AST::Expression* expr, method->arguments_expressions())
+            arguments.append(expression(expr));
+
+        compiled_expression = [ctx, object, arguments, line, method_name]() -> WS::SP_Object
+        {
+            WS::SP_Object obj = object();
+
+            WS::ObjectList args;
+            for (int i = 0; i < arguments.size(); ++i)
+                args.append(arguments.at(i)());
+
+            return invoke(ctx, line, obj, ".", method_name, args);
+        };
+    }
+    else
+    {
+        Expression left = expression(node->left());
+        Expression right = expression(node->right());
+        const QString method_name = OperatorTypes::to_string(node->type());
+
+        WSType operand_type = node->operand_type();
+        if (operand_type == WSTypes::Base)
+            operand_type = literal_type(node->right());
+        if (operand_type == WSTypes::Base)
+            operand_type = literal_type(node->left());
+        const TypedOperators::Binary fast = TypedOperators::binary_for(node->type(), operand_type);
+
+        if (fast == NULL)
+        {
+            compiled_expression = [ctx, left, right, line, method_name]() -> WS::SP_Object
+            {
+                WS::SP_Object obj = left();
+                WS::ObjectList args;
+                args.append(right());
+                return invoke(ctx, line, obj, ".", method_name, args);
+            };
+            return;
+        }
+
+        compiled_expression = [ctx, left, right, line, method_name, operand_type, fast]() -> WS::SP_Object
+        {
+            WS::SP_Object obj = left();
+            WS::SP_Object arg = right();
+            if (obj->__type__() == operand_type && arg->__type__() == operand_type)
+            {
+                WS::SP_Object res = fast(obj.data(), arg.data());
+                if (res != NULL)
+                    return res;
+            }
+
+            WS::ObjectList args;
+            args.append(arg);
+            return invoke(ctx, line, obj, ".", method_name, args);
+        };
+    }
+}
+
+void ClosureCompiler::visit(AST::Return* node)
+{
+    Expression value = expression(node->expr());
+    compiled_statement = [value](WS::SP_Object& result) -> Flow
+    {
+        result = value();
+        return Return;
+    };
+}
+
+void ClosureCompiler::visit(AST::Continue* /*node*/)
+{
+    if (loops == 0)
+        throw Unsupported();
+
+    compiled_statement = [](WS::SP_Object&) -> Flow { return Continue; };
+}
+
+void ClosureCompiler::visit(AST::Break* /*node*/)
+{
+    if (loops == 0)
+        throw Unsupported();
+
+    compiled_statement = [](WS::SP_Object&) -> Flow { return Break; };
+}
+
+void ClosureCompiler::visit(AST::Block* node)
+{
+    compiled_statement = sequence(node->values(), node);
+}
+
+void ClosureCompiler::visit(AST::FunctionDeclaration* node)
+{
+    Interpreter* ctx = interpreter;
+    const QSharedPointer<WS::UserFunction> fnc = node->fnc();
+    const AST::Binding binding = node->binding();
+
+    compiled_statement = [ctx, fnc, binding](WS::SP_Object&) -> Flow
+    {
+        fnc->set_interpreter(ctx);
+        ctx->assign(binding, fnc);
+        return Next;
+    };
+}
+
+void ClosureCompiler::visit(AST::While* node)
+{
+    Expression condition = expression(node->condition());
+
+    ++loops;
+    Statement body = statement(node->body());
+    --loops;
+
+    Interpreter* ctx = interpreter;
+    compiled_statement = [ctx, condition, body](WS::SP_Object& result) -> Flow
+    {
+        for (;;)
+        {
+            if (ctx->__is_terminated) throw InterruptError();
+
+            if (!is_true(condition()))
+                return Next;
+
+            const Flow flow = body(result);
+            if (flow == Break)
+                return Next;
+            if (flow == Return)
+                return Return;
+        }
+    };
+}
+
+void ClosureCompiler::visit(AST::If* node)
+{
+    Expression condition = expression(node->condition());
+    Statement then_stmt = statement(node->then_stmt());
+
+    if (dynamic_cast<AST::Noop*>(node->else_stmt()) != NULL)
+    {
+        compiled_statement = [condition, then_stmt](WS::SP_Object& result) -> Flow
+        {
+            return is_true(condition()) ? then_stmt(result) : Next;
+        };
+        return;
+    }
+
+    Statement else_stmt = statement(node->else_stmt());
+    compiled_statement = [condition, then_stmt, else_stmt](WS::SP_Object& result) -> Flow
+    {
+        return is_true(condition()) ? then_stmt(result) : else_stmt(result);
+    };
+}
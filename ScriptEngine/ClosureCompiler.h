@@ -0,0 +1,56 @@
+#pragma once
+
+#include "AST.h"
+#include "Closures.h"
+#include "Program.h"
+
+namespace VTScript
+{
+    /*
+        Turns a resolved function body, or the top level of a script, into closures for
+        Interpreter's closure engine. A closure does what the visit of its node does, in
+        the same order and with the same errors, but calls its children directly instead
+        of through accept(), and has the branches the visit would take on every run taken
+        once: the operator and its fast path, the slot of a local variable, the builtin
+        a name stands for.
+
+        Operators get TypeInference's fast paths; an operator with a literal operand gets
+        the fast path of the literal's type, taken when the other operand has it too.
+        Inliner's copies and LoopInvariants' caches are not used, the calls and
+        expressions they stand for are compiled as written.
+
+        The closures call into the interpreter they are compiled for and only run there.
+    */
+    class ClosureCompiler : public ASTTools::NodeVisitor
+    {
+    public:
+        // the statements of a function body; NULL if they have 'break' or 'continue' outside a loop
+        static Closures::Statement* compile_function(Interpreter* interpreter, const AST::Block* body);
+
+        // the top level of a resolved program, its outermost block included; NULL as above
+        static Closures::Statement* compile_program(Interpreter* interpreter, const Program& program);
+
+        VISITOR_METHODS
+
+    private:
+        // 'break' or 'continue' outside a loop; Checker lets some through
+        struct Unsupported {};
+
+        ClosureCompiler(Interpreter* interpreter) : interpreter(interpreter), loops(0) {}
+
+        Closures::Expression expression(AST::Node* node);
+        Closures::Statement statement(AST::Node* node);
+        // the statements one after another, then emptying the variables of 'scope' if there is one
+        Closures::Statement sequence(const AST::NodeList<AST::Node>& statements, const AST::Block* scope);
+
+        // the generic path of operators and methods, with the traceback line the tree walker pushes
+        static WS::SP_Object invoke(Interpreter* interpreter, ulong line, const WS::SP_Object& obj,
+                                    const char* separator, const QString& method_name, const WS::ObjectList& args);
+
+        Interpreter* interpreter;
+        int loops;                                  // loops around the node visited
+        Closures::Expression compiled_expression;   // what the last visit of an expression made
+        Closures::Statement compiled_statement;     // what the last visit of a statement made
+    };
+
+};
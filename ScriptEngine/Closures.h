@@ -0,0 +1,32 @@
+#pragma once
+
+#include "Objects.h"
+
+#include <functional>
+
+namespace VTScript
+{
+    /*
+        Compiled form of a function body, or of the top level of a script, for the closure
+        engine of the interpreter: every node becomes a C++ function object holding the
+        ones of its children, with what the tree walker looks up on every visit (the
+        operator, its fast path, the slot of a variable) chosen once. See ClosureCompiler.
+    */
+    namespace Closures
+    {
+        // how a statement ends, what the flags of the tree walker say
+        enum Flow
+        {
+            Next,
+            Break,
+            Continue,
+            Return
+        };
+
+        // evaluates to the value of an expression
+        typedef std::function<WS::SP_Object ()> Expression;
+        // runs a statement; 'result' is set to the value returned when it ends with Return
+        typedef std::function<Flow (WS::SP_Object& result)> Statement;
+    }
+
+};
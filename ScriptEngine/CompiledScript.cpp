@@ -0,0 +1,428 @@
+#include "CompiledScript.h"
+#include "ScriptParser.h"
+#include "Checker.h"
+#include "Errors.h"
+
+#include <QFile>
+#include <QScopedPointer>
+#include <QDebug>
+
+#include <cstring>
+
+using namespace VTScript;
+using namespace VTScript::Flat;
+
+const QString CompiledScript::extension( ".vtsc" );
+
+namespace
+{
+    const char magic[4] = { 'V', 'T', 'S', 'C' };
+    const quint32 byte_order_mark = 0x01020304;
+
+    inline quint64 aligned( quint64 offset ) { return ( offset + 7 ) & ~quint64( 7 ); }
+
+    bool is_expression( Kind kind )
+    {
+        return kind == Kinds::Leaf || kind == Kinds::FunctionCall || kind == Kinds::UnaryOperator || kind == Kinds::BinaryOperator;
+    }
+
+    // operators the parser makes nodes of, one operand or two
+    bool is_unary( quint8 oper )
+    {
+        return oper == OperatorTypes::Not || oper == OperatorTypes::UnaryPlus || oper == OperatorTypes::UnaryMinus;
+    }
+
+    bool is_binary( quint8 oper )
+    {
+        return oper >= OperatorTypes::Assign && oper <= OperatorTypes::Or && !is_unary( oper );
+    }
+}
+
+struct CompiledScript::Header
+{
+    char magic[4];              // "VTSC"
+    quint32 version;
+    quint32 byte_order;         // byte_order_mark, as stored by the machine that wrote the file
+    quint32 node_count;
+    quint32 child_count;
+    quint32 line_count;
+    quint32 function_count;
+    quint32 parameter_count;
+    quint32 name_count;
+    quint32 constant_count;
+    quint32 text_size;          // in UTF-16 code units
+    quint32 reserved;
+};
+
+struct CompiledScript::Span
+{
+    quint32 offset;             // into text
+    quint32 size;
+};
+
+struct CompiledScript::Constant
+{
+    quint32 type;               // WSTypes::WSType
+    quint32 reserved;
+    union
+    {
+        qint64 integral;
+        double rational;
+        quint32 boolean;
+        Span string;
+    } value;
+};
+
+
+bool CompiledScript::compile( const QString& source, const QString& path )
+{
+    QScopedPointer<Program> program( Parser::parse( source ) );
+    if ( program.isNull() )
+        return false;
+
+    try
+    {
+        QByteArray data = serialize( Tree::from_ast( program->root() ) );
+
+        QFile file( path );
+        if ( !file.open( QIODevice::WriteOnly ) || file.write( data ) != data.size() )
+            throw LoadError( "Couldn't write file: " + path );
+    }
+    catch ( const LoadError& e )
+    {
+        qDebug() << "Compiled script error:" << e.what();
+        return false;
+    }
+
+    return true;
+}
+
+namespace
+{
+    void append_section( QByteArray& out, const void* data, quint64 bytes )
+    {
+        out.append( QByteArray( int( aligned( out.size() ) - out.size() ), '\0' ) );
+        out.append( static_cast<const char*>( data ), int( bytes ) );
+    }
+}
+
+QByteArray CompiledScript::serialize( const Tree& tree )
+{
+    QVector<ushort> text;
+    QVector<Span> names;
+    QVector<Constant> constants;
+
+    for ( int i = 0; i < tree._names.size(); ++i )
+    {
+        const QString& name = tree._names.name( i );
+        Span span = { quint32( text.size() ), quint32( name.size() ) };
+        text.resize( text.size() + name.size() );
+        std::memcpy( text.data() + span.offset, name.utf16(), name.size() * sizeof(ushort) );
+        names.append( span );
+    }
+
+    foreach ( const WS::SP_Object& object, tree._constants )
+    {
+        Constant constant;
+        std::memset( &constant, 0, sizeof(constant) );
+        constant.type = object->__type__();
+
+        switch ( object->__type__() )
+        {
+        case WSTypes::Integral:
+            constant.value.integral = static_cast<WS::Integral*>( object.data() )->value();
+            break;
+        case WSTypes::Rational:
+            constant.value.rational = static_cast<WS::Rational*>( object.data() )->value();
+            break;
+        case WSTypes::Bool:
+            constant.value.boolean = static_cast<WS::Bool*>( object.data() )->value();
+            break;
+        case WSTypes::String:
+            {
+                QString value = static_cast<WS::String*>( object.data() )->value();
+                constant.value.string.offset = text.size();
+                constant.value.string.size = value.size();
+                text.resize( text.size() + value.size() );
+                std::memcpy( text.data() + constant.value.string.offset, value.utf16(), value.size() * sizeof(ushort) );
+            }
+            break;
+        case WSTypes::None:
+            break;
+        default:
+            throw LoadError( QString("Constant of type %1 can't be stored").arg( WSTypes::to_string( object->__type__() ) ) );
+        }
+
+        constants.append( constant );
+    }
+
+    Header header;
+    std::memset( &header, 0, sizeof(header) );
+    std::memcpy( header.magic, magic, sizeof(magic) );
+    header.version = version;
+    header.byte_order = byte_order_mark;
+    header.node_count = tree._nodes.size();
+    header.child_count = tree._children.size();
+    header.line_count = tree._lines.size();
+    header.function_count = tree._functions.size();
+    header.parameter_count = tree._parameters.size();
+    header.name_count = names.size();
+    header.constant_count = constants.size();
+    header.text_size = text.size();
+
+    QByteArray out;
+    append_section( out, &header, sizeof(header) );
+    append_section( out, tree._nodes.constData(), quint64( tree._nodes.size() ) * sizeof(Node) );
+    append_section( out, tree._children.constData(), quint64( tree._children.size() ) * sizeof(NodeIndex) );
+    append_section( out, tree._lines.constData(), quint64( tree._lines.size() ) * sizeof(LineRun) );
+    append_section( out, tree._functions.constData(), quint64( tree._functions.size() ) * sizeof(Function) );
+    append_section( out, tree._parameters.constData(), quint64( tree._parameters.size() ) * sizeof(quint32) );
+    append_section( out, names.constData(), quint64( names.size() ) * sizeof(Span) );
+    append_section( out, constants.constData(), quint64( constants.size() ) * sizeof(Constant) );
+    append_section( out, text.constData(), quint64( text.size() ) * sizeof(ushort) );
+    return out;
+}
+
+namespace
+{
+    // bounds checked view of the mapped file, handing out the sections in order
+    class SectionReader
+    {
+    public:
+        SectionReader( const uchar* data, qint64 size ) : data( data ), size( size ), offset( 0 ) {}
+
+        const uchar* next( quint64 count, quint64 element_size )
+        {
+            offset = aligned( offset );
+            quint64 bytes = count * element_size;
+            if ( offset > quint64( size ) || bytes > quint64( size ) - offset )
+                throw LoadError( "File is truncated" );
+
+            const uchar* section = data + offset;
+            offset += bytes;
+            return section;
+        }
+
+        template <typename T>
+        void next( QVector<T>& array, quint32 count )
+        {
+            const uchar* section = next( count, sizeof(T) );
+            array.resize( count );
+            if ( count > 0 )
+                std::memcpy( array.data(), section, quint64( count ) * sizeof(T) );
+        }
+
+    private:
+        const uchar* data;
+        qint64 size;
+        quint64 offset;
+    };
+}
+
+void CompiledScript::deserialize( const uchar* data, qint64 size, Tree& tree )
+{
+    SectionReader reader( data, size );
+
+    Header header;
+    std::memcpy( &header, reader.next( 1, sizeof(Header) ), sizeof(Header) );
+    if ( std::memcmp( header.magic, magic, sizeof(magic) ) != 0 )
+        throw LoadError( "Not a compiled script" );
+    if ( header.version != version || header.byte_order != byte_order_mark )
+        throw LoadError( QString("Compiled by an incompatible version (%1), compile the script again").arg( header.version ) );
+
+    reader.next( tree._nodes, header.node_count );
+    reader.next( tree._children, header.child_count );
+    reader.next( tree._lines, header.line_count );
+    reader.next( tree._functions, header.function_count );
+    reader.next( tree._parameters, header.parameter_count );
+    const Span* names = reinterpret_cast<const Span*>( reader.next( header.name_count, sizeof(Span) ) );
+    const Constant* constants = reinterpret_cast<const Constant*>( reader.next( header.constant_count, sizeof(Constant) ) );
+    const QChar* text = reinterpret_cast<const QChar*>( reader.next( header.text_size, sizeof(ushort) ) );
+
+    for ( quint32 i = 0; i < header.name_count; ++i )
+    {
+        if ( names[i].offset > header.text_size || names[i].size > header.text_size - names[i].offset )
+            throw LoadError( "Name out of range" );
+        if ( tree._names.intern( text + names[i].offset, names[i].size ) != int( i ) )
+            throw LoadError( "Duplicate name" );
+    }
+
+    tree._constants.reserve( header.constant_count );
+    for ( quint32 i = 0; i < header.constant_count; ++i )
+    {
+        const Constant& constant = constants[i];
+        WS::SP_Object object;
+
+        switch ( constant.type )
+        {
+        case WSTypes::Integral:
+            object = WS::SP_Object( new WS::Integral( constant.value.integral ) );
+            break;
+        case WSTypes::Rational:
+            object = WS::SP_Object( new WS::Rational( constant.value.rational ) );
+            break;
+        case WSTypes::Bool:
+            object = WS::SP_Object( new WS::Bool( constant.value.boolean != 0 ) );
+            break;
+        case WSTypes::String:
+            {
+                const Span& span = constant.value.string;
+                if ( span.offset > header.text_size || span.size > header.text_size - span.offset )
+                    throw LoadError( "String constant out of range" );
+                object = WS::SP_Object( new WS::String( QString( text + span.offset, span.size ) ) );
+            }
+            break;
+        case WSTypes::None:
+            object = WS::SP_Object( new WS::None() );
+            break;
+        default:
+            throw LoadError( "Unknown constant type" );
+        }
+
+        tree._constants.append( object );
+    }
+
+    foreach ( const Function& function, tree._functions )
+    {
+        if ( function.name >= header.name_count || function.first_parameter > header.parameter_count
+             || function.parameter_count > header.parameter_count - function.first_parameter )
+            throw LoadError( "Function out of range" );
+    }
+
+    foreach ( quint32 parameter, tree._parameters )
+    {
+        if ( parameter >= header.name_count )
+            throw LoadError( "Parameter out of range" );
+    }
+
+    if ( header.line_count == 0 || tree._lines[0].first_node != 0 )
+        throw LoadError( "Line table doesn't cover the tree" );
+
+    // children follow their parent in preorder, so to_ast can't loop
+    if ( header.node_count == 0 || tree.kind( 0 ) != Kinds::Block )
+        throw LoadError( "Program is not a block" );
+
+    QVector<quint8> parents( header.node_count, 0 );
+    for ( quint32 node = 0; node < header.node_count; ++node )
+    {
+        const Node& flat = tree._nodes[node];
+        if ( flat.kind >= Kinds::KindCount )
+            throw LoadError( QString("Node %1: unknown kind").arg( node ) );
+
+        const Kind kind = tree.kind( node );
+        if ( kind == Kinds::Leaf && ( flat.oper > 1 || flat.data >= ( flat.oper == 0 ? header.name_count : header.constant_count ) ) )
+            throw LoadError( QString("Node %1: leaf out of range").arg( node ) );
+        if ( kind == Kinds::FunctionDeclaration && flat.data >= header.function_count )
+            throw LoadError( QString("Node %1: function out of range").arg( node ) );
+        if ( kind == Kinds::FunctionCall && flat.data == 0 )
+            throw LoadError( QString("Node %1: call without a function").arg( node ) );
+
+        if ( kind == Kinds::UnaryOperator ? !is_unary( flat.oper )
+             : kind == Kinds::BinaryOperator ? !is_binary( flat.oper )
+             : kind != Kinds::Leaf && flat.oper != 0 )
+            throw LoadError( QString("Node %1: unknown operator").arg( node ) );
+
+        const quint32 count = tree.child_count( node );
+        if ( flat.children > header.child_count || count > header.child_count - flat.children )
+            throw LoadError( QString("Node %1: children out of range").arg( node ) );
+
+        for ( quint32 i = 0; i < count; ++i )
+        {
+            const NodeIndex child = tree.child( node, i );
+            if ( child <= node || child >= header.node_count )
+                throw LoadError( QString("Node %1: child out of range").arg( node ) );
+
+            // a tree, not a graph sharing nodes, so it's rebuilt in time linear in the file
+            if ( parents[child]++ != 0 )
+                throw LoadError( QString("Node %1: child with two parents").arg( node ) );
+
+            // the pointer tree expects expressions and blocks where the parser puts them
+            const Kind child_kind = tree.kind( child );
+            bool expected = true;
+            if ( kind == Kinds::FunctionDeclaration )
+                expected = child_kind == Kinds::Block;
+            else if ( kind == Kinds::FunctionCall || kind == Kinds::UnaryOperator || kind == Kinds::BinaryOperator
+                      || kind == Kinds::Return || ( ( kind == Kinds::While || kind == Kinds::If ) && i == 0 ) )
+                expected = is_expression( child_kind );
+
+            if ( !expected )
+                throw LoadError( QString("Node %1: unexpected %2 child").arg( node ).arg( Kinds::to_string( child_kind ) ) );
+        }
+    }
+
+    // what the interpreter takes for granted of assignments and method calls; every child is in range by now
+    for ( quint32 node = 0; node < header.node_count; ++node )
+    {
+        if ( tree.kind( node ) != Kinds::BinaryOperator )
+            continue;
+
+        if ( tree.oper( node ) == OperatorTypes::Assign )
+        {
+            const NodeIndex name = tree.child( node, 0 );
+            if ( tree.kind( name ) != Kinds::Leaf || !tree.is_identifier( name ) )
+                throw LoadError( QString("Node %1: assignment to something other than a name").arg( node ) );
+        }
+        else if ( tree.oper( node ) == OperatorTypes::Dot )
+        {
+            const NodeIndex method = tree.child( node, 1 );
+            if ( tree.kind( method ) != Kinds::FunctionCall )
+                throw LoadError( QString("Node %1: not a method call after the dot").arg( node ) );
+
+            const NodeIndex name = tree.child( method, 0 );
+            if ( tree.kind( name ) != Kinds::Leaf || !tree.is_identifier( name ) )
+                throw LoadError( QString("Node %1: not a method name after the dot").arg( node ) );
+        }
+    }
+}
+
+Program* CompiledScript::load( const QString& path )
+{
+    QFile file( path );
+
+    try
+    {
+        if ( !file.open( QIODevice::ReadOnly ) )
+            throw LoadError( "Couldn't open file: " + path );
+
+        const qint64 size = file.size();
+        uchar* data = size > 0 ? file.map( 0, size ) : NULL;
+        if ( data == NULL )
+            throw LoadError( "Couldn't map file: " + path );
+
+        // names and strings are copied out, the mapping isn't needed after decoding;
+        // if decoding fails, the file unmaps it when it goes away
+        Tree tree;
+        deserialize( data, size, tree );
+        file.unmap( data );
+
+        QScopedPointer<Program> program( new Program );
+        program->set_root( static_cast<AST::Block*>( tree.to_ast( *program ) ) );
+
+        // 'return', 'break' and 'continue' only where the parser allows them
+        Checker checker( program->root() );
+        checker.run();
+
+        // bindings, loop caches, inlined calls and types aren't stored
+        Parser::prepare( *program );
+        return program.take();
+    }
+    catch ( const LoadError& e )
+    {
+        qDebug() << "Compiled script error:" << e.what();
+    }
+    catch ( const CheckerError& e )
+    {
+        qDebug() << "Compiled script error:" << e.what();
+    }
+
+    return NULL;
+}
+
+bool CompiledScript::is_compiled( const QString& path )
+{
+    QFile file( path );
+    char start[sizeof(magic)];
+
+    return file.open( QIODevice::ReadOnly ) && file.read( start, sizeof(start) ) == sizeof(start)
+            && std::memcmp( start, magic, sizeof(magic) ) == 0;
+}
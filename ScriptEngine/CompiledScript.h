@@ -0,0 +1,63 @@
+#pragma once
+
+#include "Program.h"
+#include "FlatAST.h"
+
+#include <QString>
+#include <QByteArray>
+
+namespace VTScript
+{
+    /*
+        Precompiled scripts (.vtsc files): a checked program stored as its Flat::Tree.
+
+        Arrays of the tree are written byte for byte as they are in memory, so loading
+        maps the file and takes each of them with one copy instead of lexing, parsing and
+        checking the source again; only names and constants are decoded one at a time.
+        A file is only loaded by a build with the same format version and byte order as
+        the one that wrote it, anything else is rejected and has to be compiled again.
+
+        The tree is stored as Optimizer left it, constants folded and propagated. What
+        depends on the frame layout isn't stored: loading goes through Parser::prepare
+        like a parsed script does, so bindings, loop caches, inlined calls and types are
+        computed again, and Optimizer runs once more without finding anything new.
+
+        Layout, every section starts at a multiple of 8 bytes:
+            Header
+            Flat::Node      nodes[node_count]
+            NodeIndex       children[child_count]
+            Flat::LineRun   lines[line_count]
+            Flat::Function  functions[function_count]
+            quint32         parameters[parameter_count]     name ids
+            Span            names[name_count]               ranges of text
+            Constant        constants[constant_count]
+            ushort          text[text_size]                 UTF-16 of names and string constants
+    */
+    class CompiledScript
+    {
+    public:
+        static const QString extension;     // ".vtsc"
+        static const quint32 version = 1;
+
+        // parses and checks 'source', function bodies included, and writes it to 'path'; returns false on failure
+        static bool compile( const QString& source, const QString& path );
+
+        // throws LoadError if a constant can't be stored
+        static QByteArray serialize( const Flat::Tree& tree );
+
+        // maps and decodes a .vtsc file; returns NULL on failure, caller owns the program
+        static Program* load( const QString& path );
+
+        // true if 'path' starts like a .vtsc file, whatever its name
+        static bool is_compiled( const QString& path );
+
+    private:
+        struct Header;
+        struct Span;
+        struct Constant;
+
+        // throws LoadError; checks every index, so a damaged file can't make to_ast read out of bounds
+        static void deserialize( const uchar* data, qint64 size, Flat::Tree& tree );
+    };
+
+};
@@ -24,6 +24,12 @@ namespace VTScript
         CheckerError( QString msg ) : std::runtime_error( msg.toStdString() ) {}
     };
 
+    class LoadError : public std::runtime_error
+    {
+    public:
+        LoadError( QString msg ) : std::runtime_error( msg.toStdString() ) {}
+    };
+
     class InterpretError : public std::runtime_error
     {
     public:
@@ -0,0 +1,324 @@
+#include "FlatAST.h"
+
+#include <algorithm>
+
+using namespace VTScript;
+using namespace VTScript::Flat;
+
+const char* Kinds::to_string(Kind kind)
+{
+    switch (kind)
+    {
+    case Noop                : return "Noop";
+    case Leaf                : return "Leaf";
+    case FunctionCall        : return "FunctionCall";
+    case UnaryOperator       : return "UnaryOperator";
+    case BinaryOperator      : return "BinaryOperator";
+    case Return              : return "Return";
+    case Continue            : return "Continue";
+    case Break               : return "Break";
+    case Block               : return "Block";
+    case FunctionDeclaration : return "FunctionDeclaration";
+    case While               : return "While";
+    case If                  : return "If";
+    default                  : return "Unknown";
+    }
+}
+
+
+namespace VTScript
+{
+    namespace Flat
+    {
+        /*
+            Appends nodes to the tree in preorder. Children slots of a node are reserved
+            when the node is added and filled in as its children get converted.
+        */
+        class Converter : public ASTTools::NodeVisitor
+        {
+        public:
+            Converter(Tree& tree) : tree(tree), last(0) {}
+
+            NodeIndex convert(AST::Node* node) { node->accept(this); return last; }
+
+            VISITOR_METHODS
+
+        private:
+            NodeIndex add(AST::Node* node, Kind kind, int children, quint32 data = 0, quint8 oper = 0);
+            void convert_child(NodeIndex parent, int i, AST::Node* child);
+
+            Tree& tree;
+            NodeIndex last;     // node added by the last visit
+        };
+    };
+};
+
+NodeIndex Converter::add(AST::Node* node, Kind kind, int children, quint32 data, quint8 oper)
+{
+    NodeIndex index = tree._nodes.size();
+    Node flat = { static_cast<quint8>(kind), oper, 0, data, static_cast<quint32>(tree._children.size()) };
+    tree._nodes.append(flat);
+    tree._children.resize(tree._children.size() + children);
+
+    if (tree._lines.isEmpty() || tree._lines.last().line != node->line())
+    {
+        LineRun run = { index, static_cast<quint32>(node->line()) };
+        tree._lines.append(run);
+    }
+
+    return last = index;
+}
+
+void Converter::convert_child(NodeIndex parent, int i, AST::Node* child)
+{
+    NodeIndex index = convert(child);
+    tree._children[tree._nodes[parent].children + i] = index;
+    last = parent;
+}
+
+void Converter::visit(AST::Noop* node)
+{
+    add(node, Kinds::Noop, 0);
+}
+
+void Converter::visit(AST::Leaf* node)
+{
+    if (node->is_identifier())
+    {
+        add(node, Kinds::Leaf, 0, tree._names.intern(node->name()));
+    }
+    else
+    {
+        add(node, Kinds::Leaf, 0, tree._constants.size(), 1);
+        tree._constants.append(node->object());
+    }
+}
+
+void Converter::visit(AST::FunctionCall* node)
+{
+    const AST::NodeList<AST::Expression>& args = node->arguments_expressions();
+    NodeIndex index = add(node, Kinds::FunctionCall, 1 + args.size(), 1 + args.size());
+
+    convert_child(index, 0, node->function_object());
+    for (int i = 0; i < args.size(); ++i)
+        convert_child(index, 1 + i, args[i]);
+}
+
+void Converter::visit(AST::UnaryOperator* node)
+{
+    NodeIndex index = add(node, Kinds::UnaryOperator, 1, 0, node->type());
+    convert_child(index, 0, node->argument());
+}
+
+void Converter::visit(AST::BinaryOperator* node)
+{
+    NodeIndex index = add(node, Kinds::BinaryOperator, 2, 0, node->type());
+    convert_child(index, 0, node->left());
+    convert_child(index, 1, node->right());
+}
+
+void Converter::visit(AST::Return* node)
+{
+    NodeIndex index = add(node, Kinds::Return, 1);
+    convert_child(index, 0, node->expr());
+}
+
+void Converter::visit(AST::Continue* node)
+{
+    add(node, Kinds::Continue, 0);
+}
+
+void Converter::visit(AST::Break* node)
+{
+    add(node, Kinds::Break, 0);
+}
+
+void Converter::visit(AST::Block* node)
+{
+    const AST::NodeList<AST::Node>& statements = node->values();
+    NodeIndex index = add(node, Kinds::Block, statements.size(), statements.size());
+
+    for (int i = 0; i < statements.size(); ++i)
+        convert_child(index, i, statements[i]);
+}
+
+void Converter::visit(AST::FunctionDeclaration* node)
+{
+    Function function = { static_cast<quint32>(tree._names.intern(node->name())),
+                          static_cast<quint32>(tree._parameters.size()),
+                          static_cast<quint32>(node->parameters().size()) };
+    foreach (const QString& parameter, node->parameters())
+        tree._parameters.append(tree._names.intern(parameter));
+
+    NodeIndex index = add(node, Kinds::FunctionDeclaration, 1, tree._functions.size());
+    tree._functions.append(function);
+    convert_child(index, 0, node->body());
+}
+
+void Converter::visit(AST::While* node)
+{
+    NodeIndex index = add(node, Kinds::While, 2);
+    convert_child(index, 0, node->condition());
+    convert_child(index, 1, node->body());
+}
+
+void Converter::visit(AST::If* node)
+{
+    NodeIndex index = add(node, Kinds::If, 3);
+    convert_child(index, 0, node->condition());
+    convert_child(index, 1, node->then_stmt());
+    convert_child(index, 2, node->else_stmt());
+}
+
+
+Tree Tree::from_ast(AST::Node* root)
+{
+    Tree tree;
+    Converter converter(tree);
+    converter.convert(root);
+    return tree;
+}
+
+ulong Tree::line(NodeIndex node) const
+{
+    // last run starting at or before 'node'
+    int lo = 0;
+    int hi = _lines.size() - 1;
+
+    while (lo < hi)
+    {
+        int mid = (lo + hi + 1) / 2;
+        if (_lines[mid].first_node <= node)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+
+    return _lines[lo].line;
+}
+
+int Tree::child_count(NodeIndex node) const
+{
+    switch (kind(node))
+    {
+    case Kinds::FunctionCall:
+    case Kinds::Block:
+        return _nodes[node].data;
+    case Kinds::UnaryOperator:
+    case Kinds::Return:
+    case Kinds::FunctionDeclaration:
+        return 1;
+    case Kinds::BinaryOperator:
+    case Kinds::While:
+        return 2;
+    case Kinds::If:
+        return 3;
+    default:
+        return 0;
+    }
+}
+
+QStringList Tree::function_parameters(NodeIndex node) const
+{
+    const Function& fnc = function(node);
+    QStringList parameters;
+
+    for (quint32 i = 0; i < fnc.parameter_count; ++i)
+        parameters << _names.name(_parameters[fnc.first_parameter + i]);
+
+    return parameters;
+}
+
+size_t Tree::memory() const
+{
+    size_t names = 0;
+    for (int i = 0; i < _names.size(); ++i)
+        names += _names.name(i).size() * sizeof(QChar);
+
+    return _nodes.size() * sizeof(Node) + _children.size() * sizeof(NodeIndex) + _lines.size() * sizeof(LineRun)
+            + _functions.size() * sizeof(Function) + _parameters.size() * sizeof(quint32)
+            + _constants.size() * sizeof(WS::SP_Object) + names;
+}
+
+AST::Node* Tree::to_ast(Program& program) const
+{
+    return isEmpty() ? NULL : to_ast(program, root());
+}
+
+AST::Node* Tree::to_ast(Program& program, NodeIndex node) const
+{
+    Arena& arena = program.arena();
+    const ulong node_line = line(node);
+
+    switch (kind(node))
+    {
+    case Kinds::Leaf:
+        if (is_identifier(node))
+            return arena.create<AST::Leaf>(node_line, program.identifiers().name(program.identifiers().intern(name(node))), WS::SP_Object());
+        else
+            return arena.create<AST::Leaf>(node_line, QString(), constant(node));
+
+    case Kinds::FunctionCall:
+        {
+            const int count = child_count(node) - 1;
+            AST::Expression** args = arena.allocate_array<AST::Expression*>(count);
+            for (int i = 0; i < count; ++i)
+                args[i] = static_cast<AST::Expression*>(to_ast(program, child(node, 1 + i)));
+
+            AST::Expression* fnc = static_cast<AST::Expression*>(to_ast(program, child(node, 0)));
+            return arena.create<AST::FunctionCall>(node_line, fnc, AST::NodeList<AST::Expression>(args, count));
+        }
+
+    case Kinds::UnaryOperator:
+        return arena.create<AST::UnaryOperator>(node_line, static_cast<AST::Expression*>(to_ast(program, child(node, 0))), oper(node));
+
+    case Kinds::BinaryOperator:
+        {
+            AST::Expression* left = static_cast<AST::Expression*>(to_ast(program, child(node, 0)));
+            AST::Expression* right = static_cast<AST::Expression*>(to_ast(program, child(node, 1)));
+            return arena.create<AST::BinaryOperator>(node_line, left, right, oper(node));
+        }
+
+    case Kinds::Return:
+        return arena.create<AST::Return>(node_line, static_cast<AST::Expression*>(to_ast(program, child(node, 0))));
+
+    case Kinds::Continue:
+        return arena.create<AST::Continue>(node_line);
+
+    case Kinds::Break:
+        return arena.create<AST::Break>(node_line);
+
+    case Kinds::Block:
+        {
+            const int count = child_count(node);
+            AST::Node** statements = arena.allocate_array<AST::Node*>(count);
+            for (int i = 0; i < count; ++i)
+                statements[i] = to_ast(program, child(node, i));
+
+            return arena.create<AST::Block>(node_line, AST::NodeList<AST::Node>(statements, count));
+        }
+
+    case Kinds::FunctionDeclaration:
+        {
+            AST::Block* body = static_cast<AST::Block*>(to_ast(program, child(node, 0)));
+            return arena.create<AST::FunctionDeclaration>(node_line, function_name(node), function_parameters(node), body);
+        }
+
+    case Kinds::While:
+        {
+            AST::Expression* condition = static_cast<AST::Expression*>(to_ast(program, child(node, 0)));
+            return arena.create<AST::While>(node_line, condition, to_ast(program, child(node, 1)));
+        }
+
+    case Kinds::If:
+        {
+            AST::Expression* condition = static_cast<AST::Expression*>(to_ast(program, child(node, 0)));
+            AST::Node* then_ = to_ast(program, child(node, 1));
+            return arena.create<AST::If>(node_line, condition, then_, to_ast(program, child(node, 2)));
+        }
+
+    case Kinds::Noop:
+    default:
+        return arena.create<AST::Noop>(node_line);
+    }
+}
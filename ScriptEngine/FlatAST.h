@@ -0,0 +1,141 @@
+#pragma once
+
+#include "AST.h"
+#include "Program.h"
+#include "Identifiers.h"
+
+#include <QVector>
+#include <QString>
+
+namespace VTScript
+{
+    class CompiledScript;
+
+    /*
+        Compact encoding of an AST: nodes are 12 byte records in one array, in preorder,
+        children are 32-bit indices into a second array, line numbers are kept as runs
+        in a side table. Nothing is a pointer, so a tree is a handful of contiguous
+        arrays, and visiting every node is a linear scan of one of them.
+    */
+    namespace Flat
+    {
+        namespace Kinds
+        {
+            enum Kind
+            {
+                Noop = 0,
+                Leaf,
+                FunctionCall,           // children: function object, arguments...
+                UnaryOperator,          // children: argument
+                BinaryOperator,         // children: left, right
+                Return,                 // children: expression
+                Continue,
+                Break,
+                Block,                  // children: statements...
+                FunctionDeclaration,    // children: body
+                While,                  // children: condition, body
+                If,                     // children: condition, then, else
+                KindCount
+            };
+
+            const char* to_string(Kind kind);
+        };
+        typedef Kinds::Kind Kind;
+
+        typedef quint32 NodeIndex;
+
+        struct Node
+        {
+            quint8 kind;        // Kind
+            quint8 oper;        // OperatorType of operators, 1 for leaves holding a constant
+            quint16 reserved;
+            quint32 data;       // leaf: name id or constant index; declaration: function index;
+                                // block, call: number of children
+            quint32 children;   // index of the first child in Tree::children
+        };
+
+        struct Function
+        {
+            quint32 name;               // name id
+            quint32 first_parameter;    // index of the first parameter in Tree::parameters
+            quint32 parameter_count;
+        };
+
+        struct LineRun
+        {
+            quint32 first_node;         // run covers nodes up to the next run
+            quint32 line;
+        };
+
+        class Tree
+        {
+        public:
+            Tree() {}
+
+            // converts a pointer tree
+            static Tree from_ast(AST::Node* root);
+
+            // rebuilds the pointer tree in 'program's arena
+            AST::Node* to_ast(Program& program) const;
+
+            inline NodeIndex root() const { return 0; }
+            inline int size() const { return _nodes.size(); }
+            inline bool isEmpty() const { return _nodes.isEmpty(); }
+
+            inline Kind kind(NodeIndex node) const { return static_cast<Kind>(_nodes[node].kind); }
+            inline OperatorType oper(NodeIndex node) const { return static_cast<OperatorType>(_nodes[node].oper); }
+            ulong line(NodeIndex node) const;
+
+            int child_count(NodeIndex node) const;
+            inline NodeIndex child(NodeIndex node, int i) const { return _children[_nodes[node].children + i]; }
+
+            // leaves
+            inline bool is_identifier(NodeIndex node) const { return _nodes[node].oper == 0; }
+            inline const QString& name(NodeIndex node) const { return _names.name(_nodes[node].data); }
+            inline const WS::SP_Object& constant(NodeIndex node) const { return _constants[_nodes[node].data]; }
+
+            // function declarations
+            inline const QString& function_name(NodeIndex node) const { return _names.name(function(node).name); }
+            QStringList function_parameters(NodeIndex node) const;
+
+            // bytes taken by the tree itself, without the constant objects
+            size_t memory() const;
+
+        private:
+            friend class Converter;
+            friend class VTScript::CompiledScript;
+
+            inline const Function& function(NodeIndex node) const { return _functions[_nodes[node].data]; }
+
+            AST::Node* to_ast(Program& program, NodeIndex node) const;
+
+            QVector<Node> _nodes;
+            QVector<NodeIndex> _children;
+            QVector<LineRun> _lines;
+            QVector<Function> _functions;
+            QVector<quint32> _parameters;
+            QVector<WS::SP_Object> _constants;
+            IdentifierTable _names;
+        };
+
+        /*
+            Lets visitors written for the pointer tree (Checker, PrintNodeVisitor) run on a
+            flat tree: it's expanded into a scratch arena that lives as long as the adapter.
+        */
+        class VisitorAdapter
+        {
+        public:
+            VisitorAdapter(const Tree& tree) : _root(tree.to_ast(_scratch)) {}
+
+            inline AST::Node* root() const { return _root; }
+            inline void accept(ASTTools::NodeVisitor* visitor) { _root->accept(visitor); }
+
+        private:
+            Q_DISABLE_COPY(VisitorAdapter)
+
+            Program _scratch;
+            AST::Node* _root;
+        };
+    };
+
+};
@@ -0,0 +1,342 @@
+#include "IR.h"
+
+#include <QHash>
+#include <QSet>
+#include <QStringList>
+
+using namespace VTScript;
+using namespace VTScript::IR;
+
+namespace
+{
+    QString value_name(const Instruction* instruction)
+    {
+        return QString("v%1").arg(instruction->id);
+    }
+
+    QString block_name(const Block* block)
+    {
+        return QString("b%1").arg(block->id);
+    }
+
+    QString operand_list(const QVector<Instruction*>& operands, int first)
+    {
+        QStringList names;
+        for (int i = first; i < operands.size(); ++i)
+            names.append(value_name(operands[i]));
+        return names.join(", ");
+    }
+
+    QString instruction_text(const Instruction* instruction)
+    {
+        const char* opcode = Opcodes::to_string(instruction->opcode);
+
+        switch (instruction->opcode)
+        {
+        case Opcodes::Constant:
+            return QString("%1 %2").arg(opcode).arg(instruction->object->__repr__());
+        case Opcodes::Parameter:
+            return QString("%1 %2").arg(opcode).arg(instruction->index);
+        case Opcodes::Undefined:
+            return opcode;
+        case Opcodes::Load:
+            return QString("%1 %2:%3").arg(opcode).arg(instruction->depth).arg(instruction->slot);
+        case Opcodes::Read:
+            return QString("%1 %2 [%3]%4").arg(opcode).arg(instruction->name).arg(operand_list(instruction->operands, 0))
+                    .arg(instruction->builtin != NULL ? " builtin" : "");
+        case Opcodes::Assign:
+            return QString("%1 %2 %3 [%4]").arg(opcode).arg(instruction->index).arg(value_name(instruction->operands[0]))
+                    .arg(operand_list(instruction->operands, 1));
+        case Opcodes::Unary:
+        case Opcodes::Binary:
+            return QString("%1 %2 %3").arg(opcode).arg(OperatorTypes::to_string(instruction->oper))
+                    .arg(operand_list(instruction->operands, 0));
+        case Opcodes::Call:
+            return QString("%1 %2(%3)").arg(opcode).arg(value_name(instruction->operands[0]))
+                    .arg(operand_list(instruction->operands, 1));
+        case Opcodes::Method:
+            return QString("%1 %2.%3(%4)").arg(opcode).arg(value_name(instruction->operands[0])).arg(instruction->name)
+                    .arg(operand_list(instruction->operands, 1));
+        case Opcodes::Store:
+            return QString("%1 %2 %3").arg(opcode).arg(instruction->slot).arg(value_name(instruction->operands[0]));
+        case Opcodes::Jump:
+            return QString("%1 %2").arg(opcode).arg(block_name(instruction->block->successors[0]));
+        case Opcodes::Branch:
+            return QString("%1 %2 ? %3 : %4").arg(opcode).arg(value_name(instruction->operands[0]))
+                    .arg(block_name(instruction->block->successors[0])).arg(block_name(instruction->block->successors[1]));
+        default:
+            return QString("%1 %2").arg(opcode).arg(operand_list(instruction->operands, 0));
+        }
+    }
+}
+
+
+const char* Opcodes::to_string(Opcode opcode)
+{
+    switch (opcode)
+    {
+    case Constant  : return "constant";
+    case Parameter : return "parameter";
+    case Undefined : return "undefined";
+    case Phi       : return "phi";
+    case Load      : return "load";
+    case Read      : return "read";
+    case Assign    : return "assign";
+    case Unary     : return "unary";
+    case Binary    : return "binary";
+    case Call      : return "call";
+    case Method    : return "method";
+    case Store     : return "store";
+    case Jump      : return "jump";
+    case Branch    : return "branch";
+    case Return    : return "return";
+    default        : return "`error`";
+    }
+}
+
+Instruction* Instruction::resolved()
+{
+    Instruction* result = this;
+    while (result->replacement != NULL)
+        result = result->replacement;
+    return result;
+}
+
+Instruction* Block::terminator() const
+{
+    if (instructions.isEmpty() || !instructions.last()->is_terminator())
+        return NULL;
+    return instructions.last();
+}
+
+
+Function::Function(const QString& name, int level, int parameter_count, int slot_count) :
+    _name(name), _level(level), _parameter_count(parameter_count), _slot_count(slot_count), _next_block(0)
+{
+    create_block();
+}
+
+Instruction* Function::append(Block* block, Opcode opcode, ulong line)
+{
+    Instruction* instruction = _arena.create<Instruction>(opcode, line);
+    instruction->block = block;
+    block->instructions.append(instruction);
+    return instruction;
+}
+
+Instruction* Function::prepend_phi(Block* block, ulong line)
+{
+    Instruction* instruction = _arena.create<Instruction>(Opcodes::Phi, line);
+    instruction->block = block;
+    block->instructions.prepend(instruction);
+    return instruction;
+}
+
+Block* Function::create_block()
+{
+    Block* block = _arena.create<Block>(_next_block++);
+    _blocks.append(block);
+    return block;
+}
+
+void Function::add_edge(Block* from, Block* to)
+{
+    from->successors.append(to);
+    to->predecessors.append(from);
+}
+
+void Function::remove_edge(Block* from, Block* to)
+{
+    const int successor = from->successors.indexOf(to);
+    if (successor >= 0)
+        from->successors.removeAt(successor);
+
+    const int index = to->predecessors.indexOf(from);
+    if (index < 0)
+        return;
+
+    to->predecessors.removeAt(index);
+    foreach(Instruction* instruction, to->instructions)
+    {
+        if (instruction->opcode == Opcodes::Phi && index < instruction->operands.size())
+            instruction->operands.remove(index);
+    }
+}
+
+void Function::replace(Instruction* from, Instruction* to)
+{
+    if (from != to)
+        from->replacement = to;
+}
+
+void Function::remove(Instruction* instruction)
+{
+    instruction->removed = true;
+}
+
+void Function::compact()
+{
+    QSet<Block*> reachable;
+    foreach(Block* block, reverse_postorder())
+        reachable.insert(block);
+
+    foreach(Block* block, _blocks)
+    {
+        if (reachable.contains(block))
+            continue;
+        foreach(Block* successor, block->successors)
+        {
+            if (reachable.contains(successor))
+                remove_edge(block, successor);
+        }
+    }
+
+    QList<Block*> blocks;
+    foreach(Block* block, _blocks)
+    {
+        if (reachable.contains(block))
+            blocks.append(block);
+    }
+    _blocks = blocks;
+
+    int id = 0;
+    for (int b = 0; b < _blocks.size(); ++b)
+    {
+        Block* block = _blocks[b];
+        block->id = b;
+
+        QList<Instruction*> instructions;
+        foreach(Instruction* instruction, block->instructions)
+        {
+            if (instruction->replacement != NULL || instruction->removed)
+                continue;
+
+            for (int i = 0; i < instruction->operands.size(); ++i)
+                instruction->operands[i] = instruction->operands[i]->resolved();
+            instruction->id = instruction->is_terminator() || instruction->opcode == Opcodes::Store ? -1 : id++;
+            instructions.append(instruction);
+        }
+        block->instructions = instructions;
+    }
+    _next_block = _blocks.size();
+}
+
+QList<Block*> Function::reverse_postorder() const
+{
+    // iterative depth first search, a block is done once all its successors are
+    QList<Block*> postorder;
+    QSet<Block*> visited;
+    QList<QPair<Block*, int> > stack;
+
+    visited.insert(entry());
+    stack.append(qMakePair(entry(), 0));
+    while (!stack.isEmpty())
+    {
+        QPair<Block*, int>& top = stack.last();
+        if (top.second < top.first->successors.size())
+        {
+            Block* successor = top.first->successors[top.second++];
+            if (!visited.contains(successor))
+            {
+                visited.insert(successor);
+                stack.append(qMakePair(successor, 0));
+            }
+        }
+        else
+        {
+            postorder.append(top.first);
+            stack.removeLast();
+        }
+    }
+
+    QList<Block*> result;
+    for (int i = postorder.size() - 1; i >= 0; --i)
+        result.append(postorder[i]);
+    return result;
+}
+
+void Function::compute_dominators()
+{
+    // Cooper, Harvey, Kennedy: "A Simple, Fast Dominance Algorithm"
+    const QList<Block*> order = reverse_postorder();
+    QHash<Block*, int> number;
+    for (int i = 0; i < order.size(); ++i)
+    {
+        number.insert(order[i], i);
+        order[i]->idom = NULL;
+    }
+    entry()->idom = entry();
+
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (int i = 1; i < order.size(); ++i)
+        {
+            Block* block = order[i];
+            Block* idom = NULL;
+            foreach(Block* predecessor, block->predecessors)
+            {
+                if (!number.contains(predecessor) || predecessor->idom == NULL)
+                    continue;
+                if (idom == NULL)
+                {
+                    idom = predecessor;
+                    continue;
+                }
+
+                Block* a = predecessor;
+                Block* b = idom;
+                while (a != b)
+                {
+                    while (number.value(a) > number.value(b))
+                        a = a->idom;
+                    while (number.value(b) > number.value(a))
+                        b = b->idom;
+                }
+                idom = a;
+            }
+
+            if (idom != block->idom)
+            {
+                block->idom = idom;
+                changed = true;
+            }
+        }
+    }
+}
+
+int Function::instruction_count() const
+{
+    int count = 0;
+    foreach(const Block* block, _blocks)
+        count += block->instructions.size();
+    return count;
+}
+
+QString Function::to_string() const
+{
+    QStringList lines;
+    lines.append(QString("function %1: level %2, %3 parameters, %4 slots").arg(_name).arg(_level).arg(_parameter_count).arg(_slot_count));
+
+    foreach(const Block* block, _blocks)
+    {
+        QStringList predecessors;
+        foreach(const Block* predecessor, block->predecessors)
+            predecessors.append(block_name(predecessor));
+        lines.append(predecessors.isEmpty() ? block_name(block) + ":"
+                                            : QString("%1: <- %2").arg(block_name(block)).arg(predecessors.join(", ")));
+
+        foreach(const Instruction* instruction, block->instructions)
+        {
+            QString line = instruction_text(instruction);
+            if (!instruction->is_terminator() && instruction->opcode != Opcodes::Store)
+                line = value_name(instruction) + " = " + line;
+            if (instruction->type != WSTypes::Base)
+                line += " : " + WSTypes::to_string(instruction->type);
+            lines.append("    " + line);
+        }
+    }
+
+    return lines.join("\n");
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include "Arena.h"
+#include "Enums.h"
+#include "Objects.h"
+
+#include <QList>
+#include <QString>
+#include <QVector>
+
+namespace VTScript
+{
+    /*
+        Mid-level representation of one function, or of the top level of a script: a
+        control flow graph of basic blocks in SSA form. Every variable of the function's
+        own frame is a value defined once; variables of other frames, calls and operators
+        are instructions. Built by IRBuilder from a resolved tree, improved by IROptimizer,
+        printed by IR::Function::to_string.
+
+        It describes what the tree does, nothing runs it: the interpreter keeps walking
+        the tree.
+    */
+    namespace IR
+    {
+        namespace Opcodes
+        {
+            enum Opcode
+            {
+                // values
+                Constant,       // 'object'
+                Parameter,      // argument 'index'
+                Undefined,      // what a variable holds before it is assigned
+                Phi,            // operands: the value coming from each predecessor of the block, in their order
+                Load,           // variable 'slot' of the frame 'depth' functions out; undefined if it's unassigned or the function isn't running
+                Read,           // operands: variables a name may refer to; the first defined one, else 'builtin', else it throws
+                Assign,         // operands: value, variables a name may refer to; variable 'index' after assigning value to the name
+                Unary,          // operands: argument; operator 'oper'
+                Binary,         // operands: left, right; operator 'oper'
+                Call,           // operands: function, arguments
+                Method,         // operands: object, arguments; method 'name'
+                Store,          // operands: value; writes slot 'slot' of the frame for the functions declared in it
+
+                // terminators, the last instruction of every block
+                Jump,           // to successor 0
+                Branch,         // operands: condition; to successor 0 if its __bool__ is true, else to successor 1
+                Return          // operands: value
+            };
+
+            const char* to_string(Opcode opcode);
+        }
+
+        typedef Opcodes::Opcode Opcode;
+
+        struct Block;
+
+        struct Instruction
+        {
+            Instruction(Opcode opcode, ulong line) :
+                opcode(opcode), line(line), id(-1), block(NULL), oper(OperatorTypes::Error), index(0), depth(0), slot(0),
+                builtin(NULL), type(WSTypes::Base), replacement(NULL), removed(false) {}
+
+            bool is_terminator() const { return opcode >= Opcodes::Jump; }
+
+            // the instruction that took this one's place, followed to the end; this one if there's none
+            Instruction* resolved();
+
+            Opcode opcode;
+            ulong line;
+            int id;                         // number of the value, -1 for stores and terminators
+            Block* block;
+            QVector<Instruction*> operands;
+
+            WS::SP_Object object;           // Constant
+            OperatorType oper;              // Unary, Binary
+            int index;                      // Parameter, Assign
+            int depth;                      // Load
+            int slot;                       // Load, Store
+            QString name;                   // Read, Method
+            const WS::SP_Object* builtin;   // Read
+
+            WSType type;                    // type the value is known to have, WSTypes::Base if it isn't known
+            Instruction* replacement;       // set when the instruction is replaced with another one
+            bool removed;                   // set when the instruction is removed
+        };
+
+        struct Block
+        {
+            explicit Block(int id) : id(id), idom(NULL) {}
+
+            // the jump, branch or return ending the block, NULL while it's being built
+            Instruction* terminator() const;
+
+            int id;
+            QList<Instruction*> instructions;   // phis first
+            QList<Block*> predecessors;         // in the order of the operands of phis
+            QList<Block*> successors;
+            Block* idom;                        // immediate dominator, see Function::compute_dominators
+        };
+
+        /*
+            Owns its blocks and instructions: they are allocated from the function's
+            arena, removed ones included, and freed with it.
+        */
+        class Function
+        {
+        public:
+            Function(const QString& name, int level, int parameter_count, int slot_count);
+
+            // a new instruction at the end of 'block'
+            Instruction* append(Block* block, Opcode opcode, ulong line);
+            // a new phi at the start of 'block'
+            Instruction* prepend_phi(Block* block, ulong line);
+            Block* create_block();
+
+            void add_edge(Block* from, Block* to);
+            // removes one edge from 'from' to 'to' and the operands of the phis of 'to' it brings
+            void remove_edge(Block* from, Block* to);
+
+            // uses of 'from' are to use 'to' instead; takes effect with compact()
+            void replace(Instruction* from, Instruction* to);
+            void remove(Instruction* instruction);
+
+            /*
+                Drops blocks the entry doesn't lead to, points operands at the instructions
+                that replaced theirs, drops replaced and removed instructions and numbers
+                blocks and values again.
+            */
+            void compact();
+
+            // blocks reachable from the entry, each one before its successors except along back edges
+            QList<Block*> reverse_postorder() const;
+            // sets Block::idom of the blocks reachable from the entry
+            void compute_dominators();
+
+            int instruction_count() const;
+            QString to_string() const;
+
+            inline const QString& name() const { return _name; }
+            inline int level() const { return _level; }
+            inline int parameter_count() const { return _parameter_count; }
+            inline int slot_count() const { return _slot_count; }
+            inline Block* entry() const { return _blocks.first(); }
+            inline const QList<Block*>& blocks() const { return _blocks; }
+
+        private:
+            Q_DISABLE_COPY(Function)
+
+            Arena _arena;
+            QString _name;
+            int _level;             // number of functions around this one
+            int _parameter_count;
+            int _slot_count;        // slots of the frame, see FrameLayout
+            QList<Block*> _blocks;  // the entry first
+            int _next_block;
+        };
+    }
+
+};
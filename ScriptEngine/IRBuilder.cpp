@@ -0,0 +1,504 @@
+#include "IRBuilder.h"
+#include "Resolver.h"
+
+using namespace VTScript;
+
+namespace
+{
+    /*
+        Collects the slots of a function's frame the functions declared in it read: a
+        function nested 'n' levels deeper reaches the frame at depth 'n'.
+    */
+    class Captures : public ASTTools::NodeVisitor
+    {
+    public:
+        Captures(QSet<int>& captured) : all(false), captured(captured), nesting(0) {}
+
+        VISITOR_METHODS
+
+        bool all;       // a function declared inside isn't parsed, it may read any slot
+
+    private:
+        QSet<int>& captured;
+        int nesting;
+    };
+
+    void Captures::visit(AST::Noop* /*node*/)
+    {
+    }
+
+    void Captures::visit(AST::Leaf* node)
+    {
+        if (!node->is_identifier() || nesting == 0)
+            return;
+
+        const AST::Binding& binding = node->binding();
+        for (int i = 0; i < binding.count; ++i)
+        {
+            if (binding.addresses[i].depth == nesting)
+                captured.insert(binding.addresses[i].slot);
+        }
+    }
+
+    void Captures::visit(AST::FunctionCall* node)
+    {
+        node->function_object()->accept(this);
+
+        foreach(AST::Expression* expr, node->arguments_expressions())
+            expr->accept(this);
+    }
+
+    void Captures::visit(AST::UnaryOperator* node)
+    {
+        node->argument()->accept(this);
+    }
+
+    void Captures::visit(AST::BinaryOperator* node)
+    {
+        if (node->type() == OperatorTypes::Dot)
+        {
+            // the method name isn't a variable
+            node->left()->accept(this);
+
+            foreach(AST::Expression* expr, static_cast<AST::FunctionCall*>(node->right())->arguments_expressions())
+                expr->accept(this);
+            return;
+        }
+
+        // the left side of an assignment is written, and only in the frame of its function
+        if (node->type() != OperatorTypes::Assign)
+            node->left()->accept(this);
+        node->right()->accept(this);
+    }
+
+    void Captures::visit(AST::Return* node)
+    {
+        node->expr()->accept(this);
+    }
+
+    void Captures::visit(AST::Continue* /*node*/)
+    {
+    }
+
+    void Captures::visit(AST::Break* /*node*/)
+    {
+    }
+
+    void Captures::visit(AST::Block* node)
+    {
+        foreach(AST::Node* stmt, node->values())
+            stmt->accept(this);
+    }
+
+    void Captures::visit(AST::FunctionDeclaration* node)
+    {
+        if (!node->is_body_parsed())
+        {
+            all = true;
+            return;
+        }
+
+        ++nesting;
+        foreach(AST::Node* stmt, node->body()->values())
+            stmt->accept(this);
+        --nesting;
+    }
+
+    void Captures::visit(AST::While* node)
+    {
+        node->condition()->accept(this);
+        node->body()->accept(this);
+    }
+
+    void Captures::visit(AST::If* node)
+    {
+        node->condition()->accept(this);
+        node->then_stmt()->accept(this);
+        node->else_stmt()->accept(this);
+    }
+}
+
+
+IR::Function* IRBuilder::build(const Program& program)
+{
+    if (program.layout() == NULL)
+        return NULL;
+
+    return lower(new IR::Function("__main__", 0, 0, program.layout()->slot_count), program.root()->values());
+}
+
+IR::Function* IRBuilder::build(const WS::UserFunction& function)
+{
+    if (!function.is_body_parsed() || function.layout() == NULL)
+        return NULL;
+
+    const FrameLayout* layout = function.layout();
+    return lower(new IR::Function(function.name(), layout->level, function.parameters().size(), layout->slot_count),
+                 function.body()->values());
+}
+
+IR::Function* IRBuilder::lower(IR::Function* function, const AST::NodeList<AST::Node>& statements)
+{
+    IRBuilder builder(function);
+
+    Captures captures(builder.captured);
+    foreach(AST::Node* stmt, statements)
+        stmt->accept(&captures);
+    builder.all_captured = captures.all;
+
+    // parameters are in the frame before the body runs, everything else is unassigned
+    IR::Block* entry = function->entry();
+    builder.undefined = builder.append(IR::Opcodes::Undefined, 0);
+    for (int i = 0; i < function->parameter_count(); ++i)
+    {
+        IR::Instruction* parameter = builder.append(IR::Opcodes::Parameter, 0);
+        parameter->index = i;
+        builder.definitions[entry].insert(i, parameter);
+    }
+    builder.seal(entry);
+
+    try
+    {
+        foreach(AST::Node* stmt, statements)
+            stmt->accept(&builder);
+    }
+    catch (const Unsupported&)
+    {
+        delete function;
+        return NULL;
+    }
+
+    // falling off the end returns None
+    if (builder.current->terminator() == NULL)
+    {
+        IR::Instruction* none = builder.constant(WS::SP_Object(new WS::None()), 0);
+        builder.append(IR::Opcodes::Return, 0)->operands.append(none);
+    }
+
+    function->compact();
+    return function;
+}
+
+IR::Instruction* IRBuilder::value(AST::Node* node)
+{
+    result = NULL;
+    node->accept(this);
+    return result;
+}
+
+IR::Instruction* IRBuilder::append(IR::Opcode opcode, ulong line)
+{
+    return function->append(current, opcode, line);
+}
+
+IR::Instruction* IRBuilder::constant(const WS::SP_Object& object, ulong line)
+{
+    IR::Instruction* instruction = append(IR::Opcodes::Constant, line);
+    instruction->object = object;
+    instruction->type = object->__type__();
+    return instruction;
+}
+
+void IRBuilder::start_unreachable()
+{
+    current = function->create_block();
+    seal(current);
+}
+
+void IRBuilder::jump(IR::Block* target, ulong line)
+{
+    append(IR::Opcodes::Jump, line);
+    function->add_edge(current, target);
+}
+
+void IRBuilder::write(int slot, IR::Instruction* value, ulong line)
+{
+    definitions[current].insert(slot, value);
+
+    if (all_captured || captured.contains(slot))
+    {
+        IR::Instruction* store = append(IR::Opcodes::Store, line);
+        store->slot = slot;
+        store->operands.append(value);
+    }
+}
+
+void IRBuilder::assign(const AST::Binding& binding, IR::Instruction* value, ulong line)
+{
+    if (binding.count == 1)
+    {
+        write(binding.addresses[0].slot, value, line);
+        return;
+    }
+
+    // the first variable holding a value gets it, or the innermost one when none does
+    QVector<IR::Instruction*> operands;
+    operands.append(value);
+    for (int i = 0; i < binding.count; ++i)
+        operands.append(read(binding.addresses[i].slot, current));
+
+    QList<IR::Instruction*> values;
+    for (int i = 0; i < binding.count; ++i)
+    {
+        IR::Instruction* assigned = append(IR::Opcodes::Assign, line);
+        assigned->index = i;
+        assigned->operands = operands;
+        values.append(assigned);
+    }
+
+    for (int i = 0; i < binding.count; ++i)
+        write(binding.addresses[i].slot, values[i], line);
+}
+
+void IRBuilder::leave(AST::Block* block, ulong line)
+{
+    for (int i = 0; i < block->scope_slot_count(); ++i)
+        write(block->scope_slots()[i], undefined, line);
+}
+
+IR::Instruction* IRBuilder::read(int slot, IR::Block* block)
+{
+    QHash<int, IR::Instruction*>::const_iterator found = definitions[block].constFind(slot);
+    if (found != definitions[block].constEnd())
+        return found.value();
+
+    return read_from_predecessors(slot, block);
+}
+
+IR::Instruction* IRBuilder::read_from_predecessors(int slot, IR::Block* block)
+{
+    IR::Instruction* value;
+
+    if (!sealed.contains(block))
+    {
+        // completed when the block is sealed
+        value = function->prepend_phi(block, 0);
+        incomplete_phis[block].append(qMakePair(slot, value));
+    }
+    else if (block->predecessors.isEmpty())
+    {
+        // the entry, or a block nothing jumps to
+        value = undefined;
+    }
+    else if (block->predecessors.size() == 1)
+    {
+        value = read(slot, block->predecessors.first());
+    }
+    else
+    {
+        // the phi is the value while its operands are read, loops lead back to it
+        value = function->prepend_phi(block, 0);
+        definitions[block].insert(slot, value);
+        add_phi_operands(slot, value);
+    }
+
+    definitions[block].insert(slot, value);
+    return value;
+}
+
+void IRBuilder::add_phi_operands(int slot, IR::Instruction* phi)
+{
+    foreach(IR::Block* predecessor, phi->block->predecessors)
+        phi->operands.append(read(slot, predecessor));
+}
+
+void IRBuilder::seal(IR::Block* block)
+{
+    typedef QPair<int, IR::Instruction*> IncompletePhi;
+    foreach(const IncompletePhi& phi, incomplete_phis.take(block))
+        add_phi_operands(phi.first, phi.second);
+
+    sealed.insert(block);
+}
+
+void IRBuilder::visit(AST::Noop* node)
+{
+    result = constant(WS::SP_Object(new WS::None()), node->line());
+}
+
+void IRBuilder::visit(AST::Leaf* node)
+{
+    if (!node->is_identifier())
+    {
+        result = constant(node->object(), node->line());
+        return;
+    }
+
+    const AST::Binding& binding = node->binding();
+    QVector<IR::Instruction*> candidates;
+    for (int i = 0; i < binding.count; ++i)
+    {
+        const AST::Address& address = binding.addresses[i];
+        if (address.depth == 0)
+        {
+            candidates.append(read(address.slot, current));
+            continue;
+        }
+
+        IR::Instruction* load = append(IR::Opcodes::Load, node->line());
+        load->depth = address.depth;
+        load->slot = address.slot;
+        candidates.append(load);
+    }
+
+    result = append(IR::Opcodes::Read, node->line());
+    result->operands = candidates;
+    result->name = node->name();
+    result->builtin = binding.builtin;
+}
+
+void IRBuilder::visit(AST::FunctionCall* node)
+{
+    QVector<IR::Instruction*> operands;
+    operands.append(value(node->function_object()));
+
+    foreach(AST::Expression* expr, node->arguments_expressions())
+        operands.append(value(expr));
+
+    result = append(IR::Opcodes::Call, node->line());
+    result->operands = operands;
+}
+
+void IRBuilder::visit(AST::UnaryOperator* node)
+{
+    IR::Instruction* argument = value(node->argument());
+
+    result = append(IR::Opcodes::Unary, node->line());
+    result->oper = node->type();
+    result->operands.append(argument);
+}
+
+void IRBuilder::visit(AST::BinaryOperator* node)
+{
+    if (node->type() == OperatorTypes::Assign)
+    {
+        IR::Instruction* assigned = value(node->right());
+        assign(static_cast<AST::Leaf*>(node->left())->binding(), assigned, node->line());
+        result = assigned;
+    }
+    else if (node->type() == OperatorTypes::Dot)
+    {
+        AST::FunctionCall* method = static_cast<AST::FunctionCall*>(node->right());
+
+        QVector<IR::Instruction*> operands;
+        operands.append(value(node->left()));
+        foreach(AST::Expression* expr, method->arguments_expressions())
+            operands.append(value(expr));
+
+        result = append(IR::Opcodes::Method, node->line());
+        result->name = static_cast<AST::Leaf*>(method->function_object())->name();
+        result->operands = operands;
+    }
+    else
+    {
+        IR::Instruction* left = value(node->left());
+        IR::Instruction* right = value(node->right());
+
+        result = append(IR::Opcodes::Binary, node->line());
+        result->oper = node->type();
+        result->operands.append(left);
+        result->operands.append(right);
+    }
+}
+
+void IRBuilder::visit(AST::Return* node)
+{
+    IR::Instruction* returned = value(node->expr());
+    append(IR::Opcodes::Return, node->line())->operands.append(returned);
+    start_unreachable();
+}
+
+void IRBuilder::visit(AST::Continue* node)
+{
+    if (loops.isEmpty())
+        throw Unsupported();
+
+    for (int i = blocks.size() - 1; i >= loops.top().blocks; --i)
+        leave(blocks[i], node->line());
+    jump(loops.top().head, node->line());
+    start_unreachable();
+}
+
+void IRBuilder::visit(AST::Break* node)
+{
+    if (loops.isEmpty())
+        throw Unsupported();
+
+    for (int i = blocks.size() - 1; i >= loops.top().blocks; --i)
+        leave(blocks[i], node->line());
+    jump(loops.top().exit, node->line());
+    start_unreachable();
+}
+
+void IRBuilder::visit(AST::Block* node)
+{
+    blocks.push(node);
+
+    foreach(AST::Node* stmt, node->values())
+        stmt->accept(this);
+
+    // variables of the block go away with it
+    leave(node, node->line());
+    blocks.pop();
+}
+
+void IRBuilder::visit(AST::FunctionDeclaration* node)
+{
+    IR::Instruction* fnc = constant(node->fnc(), node->line());
+    assign(node->binding(), fnc, node->line());
+}
+
+void IRBuilder::visit(AST::While* node)
+{
+    // the head isn't sealed before the body has jumped back to it
+    IR::Block* head = function->create_block();
+    IR::Block* body = function->create_block();
+    IR::Block* exit = function->create_block();
+
+    jump(head, node->line());
+    current = head;
+
+    IR::Instruction* condition = value(node->condition());
+    append(IR::Opcodes::Branch, node->line())->operands.append(condition);
+    function->add_edge(current, body);
+    function->add_edge(current, exit);
+
+    current = body;
+    seal(body);
+
+    Loop loop = { head, exit, blocks.size() };
+    loops.push(loop);
+    node->body()->accept(this);
+    loops.pop();
+
+    jump(head, node->line());
+    seal(head);
+
+    current = exit;
+    seal(exit);
+}
+
+void IRBuilder::visit(AST::If* node)
+{
+    IR::Block* then_block = function->create_block();
+    IR::Block* else_block = function->create_block();
+    IR::Block* join = function->create_block();
+
+    IR::Instruction* condition = value(node->condition());
+    append(IR::Opcodes::Branch, node->line())->operands.append(condition);
+    function->add_edge(current, then_block);
+    function->add_edge(current, else_block);
+    seal(then_block);
+    seal(else_block);
+
+    current = then_block;
+    node->then_stmt()->accept(this);
+    jump(join, node->line());
+
+    current = else_block;
+    node->else_stmt()->accept(this);
+    jump(join, node->line());
+
+    seal(join);
+    current = join;
+}
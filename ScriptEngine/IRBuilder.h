@@ -0,0 +1,94 @@
+#pragma once
+
+#include "AST.h"
+#include "IR.h"
+#include "Program.h"
+
+#include <QHash>
+#include <QList>
+#include <QPair>
+#include <QSet>
+#include <QStack>
+
+namespace VTScript
+{
+    /*
+        Lowers a resolved function, or the top level of a script, to IR in SSA form,
+        building the SSA values while the tree is walked: a read of a variable of the
+        function's frame takes the value its block last assigned, or asks the blocks
+        before it and gets a phi where they disagree; blocks whose predecessors aren't
+        all known yet (loop heads) get their phis completed once they are (Braun et al.,
+        "Simple and Efficient Construction of Static Single Assignment Form").
+
+        A name is read with IR::Opcodes::Read over all the variables it may refer to and
+        assigned with IR::Opcodes::Assign for each of them, the blocks a statement leaves
+        empty their variables, and variables of other frames are loaded from the frame.
+        Variables that functions declared inside read are also stored to the frame
+        whenever they change, see IR::Opcodes::Store; a function whose body isn't parsed
+        yet might read any of them.
+
+        Needs Resolver's bindings. Marks of Inliner, LoopInvariants and TypeInference
+        are ignored: a call is a call and an operator an operator.
+    */
+    class IRBuilder : public ASTTools::NodeVisitor
+    {
+    public:
+        // the top level of a resolved program; NULL if it has 'break' or 'continue' outside a loop
+        static IR::Function* build(const Program& program);
+
+        // a function whose body is parsed and resolved; NULL if it isn't or the IR can't express it
+        static IR::Function* build(const WS::UserFunction& function);
+
+        VISITOR_METHODS
+
+    private:
+        // where 'continue' and 'break' of a loop jump to, and how many blocks were open around it
+        struct Loop
+        {
+            IR::Block* head;
+            IR::Block* exit;
+            int blocks;
+        };
+
+        // 'break' or 'continue' outside a loop; Checker lets some through
+        struct Unsupported {};
+
+        IRBuilder(IR::Function* function) : function(function), current(function->entry()), undefined(NULL), result(NULL), all_captured(false) {}
+
+        // lowers the statements of a body and returns the function, NULL if it can't be lowered
+        static IR::Function* lower(IR::Function* function, const AST::NodeList<AST::Node>& statements);
+
+        IR::Instruction* value(AST::Node* node);
+        IR::Instruction* append(IR::Opcode opcode, ulong line);
+        IR::Instruction* constant(const WS::SP_Object& object, ulong line);
+        // continues with a new block nothing jumps to, for statements after a jump
+        void start_unreachable();
+        void jump(IR::Block* target, ulong line);
+
+        void write(int slot, IR::Instruction* value, ulong line);
+        void assign(const AST::Binding& binding, IR::Instruction* value, ulong line);
+        // empties the variables of a block being left
+        void leave(AST::Block* block, ulong line);
+
+        IR::Instruction* read(int slot, IR::Block* block);
+        IR::Instruction* read_from_predecessors(int slot, IR::Block* block);
+        void add_phi_operands(int slot, IR::Instruction* phi);
+        // no more predecessors will be added to 'block'
+        void seal(IR::Block* block);
+
+        IR::Function* function;
+        IR::Block* current;
+        IR::Instruction* undefined;
+        IR::Instruction* result;                // value of the last expression visited
+
+        QHash<IR::Block*, QHash<int, IR::Instruction*> > definitions;  // block -> slot -> its value at the end of the block
+        QSet<IR::Block*> sealed;
+        QHash<IR::Block*, QList<QPair<int, IR::Instruction*> > > incomplete_phis;
+        QSet<int> captured;                     // slots functions declared inside read
+        bool all_captured;                      // a function declared inside isn't parsed yet
+
+        QStack<Loop> loops;
+        QStack<AST::Block*> blocks;             // blocks open around the node visited
+    };
+
+};
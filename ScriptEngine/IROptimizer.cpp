@@ -0,0 +1,765 @@
+#include "IROptimizer.h"
+#include "Builtin.h"
+#include "Errors.h"
+#include "TypeInference.h"
+
+#include <QHash>
+#include <QSet>
+#include <QStringList>
+
+using namespace VTScript;
+using namespace VTScript::IR;
+
+namespace
+{
+    // whether a variable holds a value; Unknown only while the analysis runs, for phis not reached yet
+    enum Definedness
+    {
+        Unknown,
+        Defined,
+        Unassigned,
+        Either
+    };
+
+    Definedness meet(Definedness a, Definedness b)
+    {
+        if (a == Unknown)
+            return b;
+        if (b == Unknown || a == b)
+            return a;
+        return Either;
+    }
+
+    Definedness state_of(const QHash<Instruction*, Definedness>& states, Instruction* instruction)
+    {
+        return states.value(instruction->resolved(), Either);
+    }
+
+    Definedness evaluate_state(const QHash<Instruction*, Definedness>& states, Instruction* instruction)
+    {
+        switch (instruction->opcode)
+        {
+        case Opcodes::Undefined:
+            return Unassigned;
+
+        case Opcodes::Load:
+            return Either;
+
+        case Opcodes::Phi:
+            {
+                Definedness state = Unknown;
+                foreach(Instruction* operand, instruction->operands)
+                {
+                    if (operand->resolved() != instruction)
+                        state = meet(state, states.value(operand->resolved(), Unknown));
+                }
+                return state;
+            }
+
+        case Opcodes::Assign:
+            {
+                // the assigned value when the variable is chosen, what it held otherwise
+                const Definedness old = states.value(instruction->operands[instruction->index + 1]->resolved(), Unknown);
+                return old == Defined || old == Unknown ? old : Either;
+            }
+
+        default:
+            return Defined;
+        }
+    }
+
+    // phis start out unknown and only go down, so loops settle
+    QHash<Instruction*, Definedness> definedness(Function& function)
+    {
+        QHash<Instruction*, Definedness> states;
+        foreach(Block* block, function.blocks())
+        {
+            foreach(Instruction* instruction, block->instructions)
+            {
+                const bool flowing = instruction->opcode == Opcodes::Phi || instruction->opcode == Opcodes::Assign;
+                states.insert(instruction, flowing ? Unknown : evaluate_state(states, instruction));
+            }
+        }
+
+        bool changed = true;
+        while (changed)
+        {
+            changed = false;
+            foreach(Block* block, function.reverse_postorder())
+            {
+                foreach(Instruction* instruction, block->instructions)
+                {
+                    if (instruction->opcode != Opcodes::Phi && instruction->opcode != Opcodes::Assign)
+                        continue;
+
+                    const Definedness state = meet(states.value(instruction), evaluate_state(states, instruction));
+                    if (state != states.value(instruction))
+                    {
+                        states.insert(instruction, state);
+                        changed = true;
+                    }
+                }
+            }
+        }
+
+        // a phi of nothing but itself is in a loop nothing enters
+        for (QHash<Instruction*, Definedness>::iterator state = states.begin(); state != states.end(); ++state)
+        {
+            if (state.value() == Unknown)
+                state.value() = Either;
+        }
+
+        return states;
+    }
+
+    bool is_value(const WS::SP_Object& obj)
+    {
+        switch (obj->__type__())
+        {
+        case WSTypes::None:
+        case WSTypes::Integral:
+        case WSTypes::Rational:
+        case WSTypes::String:
+        case WSTypes::Bool:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    bool is_constant_value(const Instruction* instruction)
+    {
+        return instruction->opcode == Opcodes::Constant && is_value(instruction->object);
+    }
+
+    // integer division by zero or -1 doesn't throw, it crashes; see Optimizer::evaluate
+    bool is_safe_divisor(OperatorType type, const Instruction* right)
+    {
+        if (type != OperatorTypes::Div && type != OperatorTypes::Mod)
+            return true;
+        if (!is_constant_value(right) || right->object->__type__() != WSTypes::Integral)
+            return right->type != WSTypes::Integral;
+
+        const long long value = right->object.staticCast<WS::Integral>()->value();
+        return value != 0 && value != -1;
+    }
+
+    // the value of an operator of constants, NULL when it throws or isn't safe to try
+    WS::SP_Object folded(const Instruction* instruction)
+    {
+        foreach(const Instruction* operand, instruction->operands)
+        {
+            if (!is_constant_value(operand))
+                return WS::SP_Object();
+        }
+
+        WS::ObjectList args;
+        if (instruction->opcode == Opcodes::Binary)
+        {
+            const Instruction* right = instruction->operands[1];
+            if (right->object->__type__() == WSTypes::Integral && !is_safe_divisor(instruction->oper, right))
+                return WS::SP_Object();
+            args.append(right->object);
+        }
+
+        try
+        {
+            return instruction->operands[0]->object->invoke(OperatorTypes::to_string(instruction->oper), args);
+        }
+        catch (const InterpretError&)
+        {
+            return WS::SP_Object();
+        }
+    }
+
+    void make_constant(Instruction* instruction, const WS::SP_Object& object)
+    {
+        instruction->opcode = Opcodes::Constant;
+        instruction->object = object;
+        instruction->operands.clear();
+        instruction->type = object->__type__();
+    }
+
+    // key of what an instruction computes, empty if it does more than compute a value
+    QString value_key(const Instruction* instruction)
+    {
+        QStringList key;
+        key.append(QString::number(instruction->opcode));
+
+        switch (instruction->opcode)
+        {
+        case Opcodes::Constant:
+            if (!is_value(instruction->object))
+                return QString("f%1").arg(reinterpret_cast<quintptr>(instruction->object.data()));
+            key.append(QString::number(instruction->object->__type__()));
+            // __str__ of a double has six digits
+            if (instruction->object->__type__() == WSTypes::Rational)
+                key.append(QString::number(instruction->object.staticCast<WS::Rational>()->value(), 'g', 17));
+            else
+                key.append(instruction->object->__str__());
+            return key.join(" ");
+
+        case Opcodes::Parameter:
+        case Opcodes::Assign:
+            key.append(QString::number(instruction->index));
+            break;
+
+        case Opcodes::Load:
+            key.append(QString::number(instruction->depth));
+            key.append(QString::number(instruction->slot));
+            break;
+
+        case Opcodes::Read:
+            // the name is in the error when none of the candidates is set
+            key.append(instruction->name);
+            key.append(QString::number(reinterpret_cast<quintptr>(instruction->builtin)));
+            break;
+
+        case Opcodes::Unary:
+        case Opcodes::Binary:
+            key.append(QString::number(instruction->oper));
+            break;
+
+        case Opcodes::Phi:
+            key.append(QString::number(reinterpret_cast<quintptr>(instruction->block)));
+            break;
+
+        case Opcodes::Undefined:
+            break;
+
+        default:
+            return QString();
+        }
+
+        foreach(const Instruction* operand, instruction->operands)
+            key.append(QString::number(reinterpret_cast<quintptr>(operand)));
+        return key.join(" ");
+    }
+
+    struct ValueNumbering
+    {
+        ValueNumbering(Function& function) : function(function), changed(false) {}
+
+        // numbers a block, then the blocks it immediately dominates, with what it computes known
+        void number(Block* block)
+        {
+            QStringList added;
+            foreach(Instruction* instruction, block->instructions)
+            {
+                for (int i = 0; i < instruction->operands.size(); ++i)
+                    instruction->operands[i] = instruction->operands[i]->resolved();
+
+                const QString key = value_key(instruction);
+                if (key.isEmpty())
+                    continue;
+
+                Instruction* known = table.value(key);
+                if (known != NULL)
+                {
+                    function.replace(instruction, known);
+                    changed = true;
+                }
+                else
+                {
+                    table.insert(key, instruction);
+                    added.append(key);
+                }
+            }
+
+            foreach(Block* child, children.value(block))
+                number(child);
+
+            foreach(const QString& key, added)
+                table.remove(key);
+        }
+
+        Function& function;
+        QHash<Block*, QList<Block*> > children;     // dominator tree
+        QHash<QString, Instruction*> table;
+        bool changed;
+    };
+
+    WSType join(WSType a, WSType b)
+    {
+        return a == b ? a : WSTypes::Base;
+    }
+
+    // type of what a builtin conversion returns when it doesn't throw
+    WSType conversion_result(const Instruction* callee)
+    {
+        if (callee->opcode != Opcodes::Constant)
+            return WSTypes::Base;
+
+        const QHash<QString, WS::SP_Object>& builtins = Builtin::table();
+        if (callee->object == builtins.value("int"))
+            return WSTypes::Integral;
+        if (callee->object == builtins.value("double"))
+            return WSTypes::Rational;
+        if (callee->object == builtins.value("bool"))
+            return WSTypes::Bool;
+        return WSTypes::Base;
+    }
+
+    /*
+        Type of an instruction from the types of its operands known so far; false when
+        none is known yet. A variable without a value has no type: it's never used as
+        an operand but through a read, which takes another candidate.
+    */
+    bool evaluate_type(const QHash<Instruction*, WSType>& types, const Instruction* instruction, WSType& type)
+    {
+        switch (instruction->opcode)
+        {
+        case Opcodes::Constant:
+            type = instruction->object->__type__();
+            return true;
+
+        case Opcodes::Undefined:
+            return false;
+
+        case Opcodes::Phi:
+        case Opcodes::Read:
+        case Opcodes::Assign:
+            {
+                // an assignment gives the value or leaves what its own variable held
+                QVector<Instruction*> operands = instruction->operands;
+                if (instruction->opcode == Opcodes::Assign)
+                {
+                    operands.clear();
+                    operands.append(instruction->operands[0]);
+                    operands.append(instruction->operands[instruction->index + 1]);
+                }
+
+                bool known = false;
+                foreach(Instruction* operand, operands)
+                {
+                    QHash<Instruction*, WSType>::const_iterator found = types.constFind(operand);
+                    if (found == types.constEnd())
+                        continue;
+                    type = known ? join(type, found.value()) : found.value();
+                    known = true;
+                }
+
+                if (instruction->opcode == Opcodes::Read && instruction->builtin != NULL)
+                {
+                    type = known ? join(type, WSTypes::Function) : WSTypes::Function;
+                    known = true;
+                }
+                return known;
+            }
+
+        case Opcodes::Unary:
+            {
+                QHash<Instruction*, WSType>::const_iterator argument = types.constFind(instruction->operands[0]);
+                if (argument == types.constEnd())
+                    return false;
+                type = TypeInference::unary_result(instruction->oper, argument.value());
+                return true;
+            }
+
+        case Opcodes::Binary:
+            {
+                QHash<Instruction*, WSType>::const_iterator left = types.constFind(instruction->operands[0]);
+                QHash<Instruction*, WSType>::const_iterator right = types.constFind(instruction->operands[1]);
+                if (left == types.constEnd() || right == types.constEnd())
+                    return false;
+                type = left.value() == right.value() ? TypeInference::binary_result(instruction->oper, left.value()) : WSTypes::Base;
+                return true;
+            }
+
+        case Opcodes::Call:
+            type = conversion_result(instruction->operands[0]);
+            return true;
+
+        default:
+            type = WSTypes::Base;
+            return true;
+        }
+    }
+
+    bool same_slots(const QSet<int>& a, const QSet<int>& b)
+    {
+        if (a.size() != b.size())
+            return false;
+        foreach(int slot, a)
+        {
+            if (!b.contains(slot))
+                return false;
+        }
+        return true;
+    }
+
+    // whether dropping an unused instruction leaves what the function does as it was
+    bool is_removable(const QHash<Instruction*, Definedness>& states, const Instruction* instruction)
+    {
+        switch (instruction->opcode)
+        {
+        case Opcodes::Constant:
+        case Opcodes::Parameter:
+        case Opcodes::Undefined:
+        case Opcodes::Phi:
+        case Opcodes::Load:
+        case Opcodes::Assign:
+            return true;
+
+        case Opcodes::Read:
+            {
+                if (instruction->builtin != NULL)
+                    return true;
+                foreach(Instruction* operand, instruction->operands)
+                {
+                    if (state_of(states, operand) == Defined)
+                        return true;
+                }
+                return false;
+            }
+
+        case Opcodes::Unary:
+            return TypeInference::unary_result(instruction->oper, instruction->operands[0]->type) != WSTypes::Base;
+
+        case Opcodes::Binary:
+            {
+                const WSType operands = instruction->operands[0]->type;
+                return operands == instruction->operands[1]->type
+                        && TypeInference::binary_result(instruction->oper, operands) != WSTypes::Base
+                        && (operands != WSTypes::Integral || is_safe_divisor(instruction->oper, instruction->operands[1]));
+            }
+
+        default:
+            return false;
+        }
+    }
+}
+
+
+void IROptimizer::optimize(Function& function)
+{
+    // every round removes something, a few are plenty
+    for (int round = 0; round < 8; ++round)
+    {
+        const bool simplified = simplify(function);
+        const bool numbered = number_values(function);
+        if (!simplified && !numbered)
+            break;
+    }
+
+    infer_types(function);
+    eliminate_dead_stores(function);
+    eliminate_dead_code(function);
+}
+
+bool IROptimizer::simplify(Function& function)
+{
+    const QHash<Instruction*, Definedness> states = definedness(function);
+    bool changed = false;
+
+    foreach(Block* block, function.reverse_postorder())
+    {
+        foreach(Instruction* instruction, block->instructions)
+        {
+            for (int i = 0; i < instruction->operands.size(); ++i)
+                instruction->operands[i] = instruction->operands[i]->resolved();
+
+            switch (instruction->opcode)
+            {
+            case Opcodes::Phi:
+                {
+                    Instruction* same = NULL;
+                    bool trivial = true;
+                    foreach(Instruction* operand, instruction->operands)
+                    {
+                        if (operand == instruction || operand == same)
+                            continue;
+                        if (same != NULL)
+                            trivial = false;
+                        same = operand;
+                    }
+
+                    if (trivial && same != NULL)
+                    {
+                        function.replace(instruction, same);
+                        changed = true;
+                    }
+                    break;
+                }
+
+            case Opcodes::Read:
+                {
+                    QVector<Instruction*> candidates;
+                    foreach(Instruction* operand, instruction->operands)
+                    {
+                        if (state_of(states, operand) != Unassigned)
+                            candidates.append(operand);
+                    }
+
+                    if (!candidates.isEmpty() && state_of(states, candidates.first()) == Defined)
+                    {
+                        function.replace(instruction, candidates.first());
+                        changed = true;
+                    }
+                    else if (candidates.isEmpty() && instruction->builtin != NULL)
+                    {
+                        make_constant(instruction, *instruction->builtin);
+                        changed = true;
+                    }
+                    else if (candidates.size() != instruction->operands.size())
+                    {
+                        instruction->operands = candidates;
+                        changed = true;
+                    }
+                    break;
+                }
+
+            case Opcodes::Assign:
+                {
+                    // the variable that gets the value: the first one holding a value, else the innermost
+                    int chosen = 0;
+                    for (int i = 1; i < instruction->operands.size(); ++i)
+                    {
+                        const Definedness state = state_of(states, instruction->operands[i]);
+                        if (state == Unassigned)
+                            continue;
+                        chosen = state == Defined ? i - 1 : -1;
+                        break;
+                    }
+
+                    if (chosen >= 0)
+                    {
+                        function.replace(instruction, instruction->operands[chosen == instruction->index ? 0 : instruction->index + 1]);
+                        changed = true;
+                    }
+                    break;
+                }
+
+            case Opcodes::Unary:
+            case Opcodes::Binary:
+                {
+                    const WS::SP_Object value = folded(instruction);
+                    if (value != NULL)
+                    {
+                        make_constant(instruction, value);
+                        changed = true;
+                    }
+                    break;
+                }
+
+            case Opcodes::Branch:
+                {
+                    Instruction* condition = instruction->operands[0];
+                    if (!is_constant_value(condition))
+                        break;
+
+                    WS::SP_Object truth;
+                    try
+                    {
+                        truth = condition->object->invoke("__bool__", WS::ObjectList());
+                    }
+                    catch (const InterpretError&)
+                    {
+                        break;
+                    }
+                    if (truth == NULL || truth->__type__() != WSTypes::Bool)
+                        break;
+
+                    const bool taken = truth.staticCast<WS::Bool>()->value();
+                    function.remove_edge(block, block->successors[taken ? 1 : 0]);
+                    instruction->opcode = Opcodes::Jump;
+                    instruction->operands.clear();
+                    changed = true;
+                    break;
+                }
+
+            default:
+                break;
+            }
+        }
+    }
+
+    if (changed)
+        function.compact();
+    return changed;
+}
+
+bool IROptimizer::number_values(Function& function)
+{
+    function.compute_dominators();
+
+    ValueNumbering numbering(function);
+    foreach(Block* block, function.reverse_postorder())
+    {
+        if (block->idom != NULL && block->idom != block)
+            numbering.children[block->idom].append(block);
+    }
+    numbering.number(function.entry());
+
+    if (numbering.changed)
+        function.compact();
+    return numbering.changed;
+}
+
+void IROptimizer::infer_types(Function& function)
+{
+    // types only go from unknown to one type to WSTypes::Base, so loops settle
+    QHash<Instruction*, WSType> types;
+    const QList<Block*> order = function.reverse_postorder();
+
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        foreach(Block* block, order)
+        {
+            foreach(Instruction* instruction, block->instructions)
+            {
+                WSType type = WSTypes::Base;
+                if (!evaluate_type(types, instruction, type))
+                    continue;
+
+                QHash<Instruction*, WSType>::iterator found = types.find(instruction);
+                if (found == types.end())
+                {
+                    types.insert(instruction, type);
+                    changed = true;
+                }
+                else if (join(found.value(), type) != found.value())
+                {
+                    found.value() = WSTypes::Base;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    foreach(Block* block, function.blocks())
+    {
+        foreach(Instruction* instruction, block->instructions)
+            instruction->type = types.value(instruction, WSTypes::Base);
+    }
+}
+
+bool IROptimizer::eliminate_dead_stores(Function& function)
+{
+    QSet<int> stored;
+    foreach(Block* block, function.blocks())
+    {
+        foreach(Instruction* instruction, block->instructions)
+        {
+            if (instruction->opcode == Opcodes::Store)
+                stored.insert(instruction->slot);
+        }
+    }
+    if (stored.isEmpty())
+        return false;
+
+    // slots whose stored value a call may still see, at the start of each block
+    QHash<Block*, QSet<int> > seen;
+    QList<Block*> order = function.reverse_postorder();
+    bool removed = false;
+
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        // the first pass runs until nothing changes, the second removes what no call sees
+        const bool removing = pass == 1;
+        bool changed = true;
+        while (changed)
+        {
+            changed = false;
+            for (int b = order.size() - 1; b >= 0; --b)
+            {
+                Block* block = order[b];
+                QSet<int> live;
+                foreach(Block* successor, block->successors)
+                    live.unite(seen.value(successor));
+
+                for (int i = block->instructions.size() - 1; i >= 0; --i)
+                {
+                    Instruction* instruction = block->instructions[i];
+                    switch (instruction->opcode)
+                    {
+                    case Opcodes::Store:
+                        if (removing && !live.contains(instruction->slot))
+                        {
+                            function.remove(instruction);
+                            removed = true;
+                        }
+                        live.remove(instruction->slot);
+                        break;
+
+                    case Opcodes::Call:
+                    case Opcodes::Method:
+                        live = stored;
+                        break;
+
+                    case Opcodes::Return:
+                        live.clear();
+                        break;
+
+                    default:
+                        break;
+                    }
+                }
+
+                if (!removing && !same_slots(live, seen.value(block)))
+                {
+                    seen.insert(block, live);
+                    changed = true;
+                }
+            }
+
+            if (removing)
+                break;
+        }
+    }
+
+    if (removed)
+        function.compact();
+    return removed;
+}
+
+bool IROptimizer::eliminate_dead_code(Function& function)
+{
+    const QHash<Instruction*, Definedness> states = definedness(function);
+
+    QSet<Instruction*> used;
+    QList<Instruction*> work;
+    foreach(Block* block, function.blocks())
+    {
+        foreach(Instruction* instruction, block->instructions)
+        {
+            if (!is_removable(states, instruction))
+            {
+                used.insert(instruction);
+                work.append(instruction);
+            }
+        }
+    }
+
+    while (!work.isEmpty())
+    {
+        Instruction* instruction = work.takeLast();
+        foreach(Instruction* operand, instruction->operands)
+        {
+            if (!used.contains(operand))
+            {
+                used.insert(operand);
+                work.append(operand);
+            }
+        }
+    }
+
+    bool removed = false;
+    foreach(Block* block, function.blocks())
+    {
+        foreach(Instruction* instruction, block->instructions)
+        {
+            if (!used.contains(instruction))
+            {
+                function.remove(instruction);
+                removed = true;
+            }
+        }
+    }
+
+    if (removed)
+        function.compact();
+    return removed;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "IR.h"
+
+namespace VTScript
+{
+    /*
+        Passes over the IR of one function, see IRBuilder. Each returns whether it
+        changed something and leaves the function compacted.
+
+        What is known of a variable before the passes run is whether it surely holds a
+        value, surely doesn't or may: that decides reads and assignments of names with
+        several candidate variables, as the interpreter decides them at run time.
+        Operators and calls of unknown values throw or run user code, so only what can't
+        throw is ever removed.
+    */
+    class IROptimizer
+    {
+    public:
+        // simplifies and numbers values until neither finds anything more, then types values and removes dead code
+        static void optimize(IR::Function& function);
+
+        /*
+            Folds operators of constants and branches on constants, removes phis of one
+            value, reads whose first candidate surely holds a value and assignments whose
+            target is known.
+        */
+        static bool simplify(IR::Function& function);
+
+        /*
+            Global value numbering: an instruction computing what an instruction in a
+            block dominating it computes (same opcode, same operands) is replaced with that
+            one. Common subexpressions within a block are a special case.
+        */
+        static bool number_values(IR::Function& function);
+
+        // sets IR::Instruction::type from constants, int(), double(), bool() and operators with a fast path
+        static void infer_types(IR::Function& function);
+
+        // removes stores no call can see: the slot is stored again, or the function returns, before the next call
+        static bool eliminate_dead_stores(IR::Function& function);
+
+        // removes instructions whose values aren't used and that can't throw
+        static bool eliminate_dead_code(IR::Function& function);
+    };
+
+};
@@ -0,0 +1,87 @@
+#include "Identifiers.h"
+
+#include <cstring>
+
+using namespace VTScript;
+
+namespace
+{
+    const int initial_slots = 64;
+}
+
+
+IdentifierTable::IdentifierTable() : _slots( initial_slots, -1 )
+{
+}
+
+// FNV-1a over UTF-16 code units
+uint IdentifierTable::hash( const QChar* data, int size )
+{
+    uint h = 2166136261u;
+    for ( int i = 0; i < size; ++i )
+    {
+        h ^= data[i].unicode();
+        h *= 16777619u;
+    }
+    return h;
+}
+
+int IdentifierTable::slot_of( const QChar* data, int size, uint hash ) const
+{
+    const int mask = _slots.size() - 1;
+    int slot = hash & mask;
+
+    while ( true )
+    {
+        int id = _slots.at(slot);
+        if ( id == -1 )
+            return slot;
+
+        const QString& name = _names[id];
+        if ( _hashes[id] == hash && name.size() == size
+             && ( size == 0 || memcmp( name.unicode(), data, size * sizeof(QChar) ) == 0 ) )
+            return slot;
+
+        slot = ( slot + 1 ) & mask;
+    }
+}
+
+int IdentifierTable::find( const QChar* data, int size ) const
+{
+    return _slots.at( slot_of( data, size, hash( data, size ) ) );
+}
+
+int IdentifierTable::intern( const QChar* data, int size )
+{
+    uint h = hash( data, size );
+    int slot = slot_of( data, size, h );
+
+    const int existing = _slots.at(slot);
+    if ( existing != -1 )
+        return existing;
+
+    int id = _names.size();
+    _names << QString( data, size );
+    _hashes << h;
+    _slots[slot] = id;
+
+    // keep load factor under 1/2
+    if ( 2 * _names.size() > _slots.size() )
+        grow();
+
+    return id;
+}
+
+void IdentifierTable::grow()
+{
+    _slots = QVector<int>( _slots.size() * 2, -1 );
+
+    const int mask = _slots.size() - 1;
+    for ( int id = 0; id < _names.size(); ++id )
+    {
+        int slot = _hashes[id] & mask;
+        while ( _slots[slot] != -1 )
+            slot = ( slot + 1 ) & mask;
+        _slots[slot] = id;
+    }
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <QString>
+#include <QStringRef>
+#include <QVector>
+
+namespace VTScript
+{
+    /*
+        Interns identifier names of one compilation into dense integer ids (0, 1, 2, ...
+        in order of first appearance), so that later phases compare and hash ints
+        instead of strings. Lookups take raw character ranges of the source buffer and
+        don't allocate; a QString is made only the first time a name is seen.
+    */
+    class IdentifierTable
+    {
+    public:
+        IdentifierTable();
+
+        // returns id of 'name', adding it if it's new
+        int intern( const QChar* data, int size );
+        int intern( const QStringRef& name ) { return intern( name.unicode(), name.size() ); }
+        int intern( const QString& name ) { return intern( name.unicode(), name.size() ); }
+
+        // returns -1 if 'name' was never interned
+        int find( const QChar* data, int size ) const;
+        int find( const QString& name ) const { return find( name.unicode(), name.size() ); }
+
+        const QString& name( int id ) const { return _names[id]; }
+        int size() const { return _names.size(); }
+
+    private:
+        static uint hash( const QChar* data, int size );
+
+        // index of the slot holding 'data' or of the empty slot where it belongs
+        int slot_of( const QChar* data, int size, uint hash ) const;
+        void grow();
+
+        QVector<QString> _names;
+        QVector<uint> _hashes;
+        QVector<int> _slots;    // open addressing over ids, -1 is empty; size is a power of two
+    };
+
+};
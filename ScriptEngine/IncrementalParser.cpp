@@ -0,0 +1,266 @@
+#include "IncrementalParser.h"
+#include "ScriptParser.h"
+#include "Errors.h"
+
+#include <QScopedPointer>
+#include <QDebug>
+
+using namespace VTScript;
+using namespace AST;
+
+namespace
+{
+    long count_newlines( const QChar* data, int begin, int end )
+    {
+        long count = 0;
+        for ( int i = begin; i < end; ++i )
+            if ( data[i].unicode() == '\n' )
+                ++count;
+        return count;
+    }
+}
+
+
+IncrementalParser::IncrementalParser() : _program( NULL ), _prepared( NULL ), _rebuilt_size( 0 ), _parsed( 0 ), _reused( 0 )
+{
+}
+
+IncrementalParser::~IncrementalParser()
+{
+    delete _prepared;
+    delete _program;
+}
+
+int IncrementalParser::segment_at( int position ) const
+{
+    int lo = 0;
+    int hi = _segments.size() - 1;
+
+    while ( lo < hi )
+    {
+        int mid = ( lo + hi + 1 ) / 2;
+        if ( _segments[mid].begin <= position )
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+
+    return lo;
+}
+
+bool IncrementalParser::needs_rebuild() const
+{
+    const size_t replaced = _program->arena().allocated() - _rebuilt_size;
+    return replaced > qMax( _rebuilt_size, size_t( 1 << 16 ) );
+}
+
+Program* IncrementalParser::update( const QString& text )
+{
+    const int old_size = _text.size();
+    const int new_size = text.size();
+    const QChar* old_data = _text.constData();
+    const QChar* new_data = text.constData();
+    const int common = qMin( old_size, new_size );
+
+    // edit replaced old [prefix, old_end) with new [prefix, new_end)
+    int prefix = 0;
+    while ( prefix < common && old_data[prefix] == new_data[prefix] )
+        ++prefix;
+
+    int suffix = 0;
+    while ( suffix < common - prefix && old_data[old_size - 1 - suffix] == new_data[new_size - 1 - suffix] )
+        ++suffix;
+
+    const int old_end = old_size - suffix;
+    const int new_end = new_size - suffix;
+
+    if ( _program != NULL && prefix == old_end && prefix == new_end )
+    {
+        _parsed = 0;
+        _reused = _segments.size();
+        return prepared();
+    }
+
+    const int delta = new_size - old_size;
+    const long line_delta = count_newlines( new_data, prefix, new_end ) - count_newlines( old_data, prefix, old_end );
+
+    const int n = _segments.size();
+    int first = 0;
+    int sync = n;
+
+    if ( _program != NULL && n > 0 && !needs_rebuild() )
+    {
+        // a token before the edit on the same line may reach into it, see Lexer::scan_operator_identifier
+        const int line_start = prefix > 0 ? _text.lastIndexOf( QChar('\n'), prefix - 1 ) + 1 : 0;
+        first = qMax( 0, segment_at( line_start ) - 1 );
+        sync = qMin( n, segment_at( qMax( prefix, old_end - 1 ) ) + 1 );
+    }
+
+    QString error;
+    int grow = 1;
+
+    while ( true )
+    {
+        // the whole text is parsed into a new program, statements replaced in the old one go with it
+        const bool rebuild = first == 0 && sync == n;
+        Program* program = rebuild ? new Program : _program;
+
+        if ( reparse( program, text, first, sync, delta, line_delta, error ) )
+        {
+            if ( rebuild )
+            {
+                delete _program;
+                _program = program;
+                _rebuilt_size = program->arena().allocated();
+            }
+            break;
+        }
+
+        if ( rebuild )
+        {
+            delete program;
+            qDebug() << qPrintable( error );
+            return NULL;
+        }
+
+        first = qMax( 0, first - grow );
+        sync = qMin( n, sync + grow );
+        grow *= 2;
+    }
+
+    delete _prepared;
+    _prepared = NULL;
+    _text = text;
+    return prepared();
+}
+
+Program* IncrementalParser::prepared()
+{
+    if ( _prepared != NULL )
+        return _prepared;
+
+    QScopedPointer<Program> program( new Program );
+    program->identifiers() = _program->identifiers();
+
+    ASTTools::CopyVisitor copier( program->arena() );
+    program->set_root( copier.copy( _program->root() ) );
+
+    try
+    {
+        Parser::prepare( *program );
+    }
+    catch ( const CheckerError& e )
+    {
+        qDebug() << qPrintable( QString( "Checker error: %1" ).arg( e.what() ) );
+        return NULL;
+    }
+
+    _prepared = program.take();
+    return _prepared;
+}
+
+bool IncrementalParser::reparse( Program* program, const QString& text, int first, int sync, int delta, long line_delta, QString& error )
+{
+    const int n = _segments.size();
+    const int begin = first < n ? _segments[first].begin : 0;
+    const ulong line = first < n ? _segments[first].line : 1;
+    int end = sync + 1 < n ? _segments[sync + 1].begin + delta : text.size();
+
+    if ( end > 0 && text[end - 1] != QChar('\n') )
+    {
+        end = text.indexOf( QChar('\n'), end );
+        if ( end < 0 )
+            end = text.size();
+    }
+
+    QVector<StatementStart> starts;
+    QList<Node*> statements;
+
+    try
+    {
+        statements = Parser::parse_statements( text, begin, end, line, *program, starts );
+    }
+    catch ( const LexError& e )
+    {
+        error = QString( "Lexer error: %1" ).arg( e.what() );
+        return false;
+    }
+    catch ( const ParseError& e )
+    {
+        error = QString( "Parser error: %1" ).arg( e.what() );
+        return false;
+    }
+    catch ( const CheckerError& e )
+    {
+        error = QString( "Checker error: %1" ).arg( e.what() );
+        return false;
+    }
+
+    // new statements [0, fresh) replace old [first, sync); the ones from 'fresh' on reparse statement 'sync' and later
+    const int parsed = statements.size();
+    int fresh = parsed;
+    if ( sync < n )
+    {
+        const int sync_position = _segments[sync].begin + delta;
+        fresh = 0;
+        while ( fresh < parsed && starts[fresh].position < sync_position )
+            ++fresh;
+
+        if ( fresh == parsed || starts[fresh].position != sync_position )
+        {
+            error = "Reparsed statements didn't get in sync";
+            return false;
+        }
+    }
+
+    const QVector<Node*>& old_statements = _statements;
+    QVector<Node*> new_statements;
+    QVector<Segment> new_segments;
+    new_statements.reserve( n - ( sync - first ) + fresh );
+    new_segments.reserve( n - ( sync - first ) + fresh );
+
+    for ( int i = 0; i < first; ++i )
+    {
+        new_statements << old_statements[i];
+        new_segments << _segments[i];
+    }
+
+    for ( int i = 0; i < fresh; ++i )
+    {
+        Segment segment = { starts[i].position, starts[i].line };
+        if ( new_segments.isEmpty() )
+        {
+            segment.begin = 0;
+            segment.line = 1;
+        }
+        new_statements << statements[i];
+        new_segments << segment;
+    }
+
+    ASTTools::ShiftLinesVisitor shift_lines( line_delta );
+    for ( int i = sync; i < n; ++i )
+    {
+        Segment segment = _segments[i];
+        segment.begin += delta;
+        segment.line += line_delta;
+        if ( new_segments.isEmpty() )
+        {
+            segment.begin = 0;
+            segment.line = 1;
+        }
+
+        shift_lines.shift( old_statements[i] );
+        new_statements << old_statements[i];
+        new_segments << segment;
+    }
+
+    if ( program->root() == NULL )
+        program->set_root( program->arena().create<Block>( 1, NodeList<Node>() ) );
+
+    _statements = new_statements;
+    program->root()->_statements = NodeList<Node>( _statements.constData(), _statements.size() );
+    _segments = new_segments;
+    _parsed = parsed;
+    _reused = n - ( sync - first );
+    return true;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "AST.h"
+#include "Program.h"
+
+#include <QString>
+#include <QVector>
+
+namespace VTScript
+{
+    /*
+        Keeps the AST of a document that is being edited (scripting console) and brings
+        it up to date by re-lexing and re-parsing only the top level statements an edit
+        touched.
+
+        The document is split into segments, one per top level statement, each reaching
+        up to the first character of the next one. The edited range is found by comparing
+        the new text with the previous one. The segments it touches (counting from the start
+        of the line the edit begins in), the one before them and the first untouched one
+        after them are reparsed. The result is accepted if one
+        of the new statements starts exactly where that untouched segment does: the parser
+        looks only one token ahead, so from there on it would produce the old statements
+        again, and those are kept. Otherwise the reparsed range grows on both sides,
+        doubling every time, up to the whole document. The reparsed text is extended to
+        the end of its last line, because the lexer may look that far ahead for an
+        "operator...(" identifier; that's also why the edit counts from the line start.
+
+        Reused statements below an edit that added or removed lines get their line numbers
+        shifted in place.
+
+        Statements live in the arena of one Program, so the ones an edit replaces stay
+        allocated. Once they take more memory than the program had after it was last
+        built from scratch, the whole document is parsed into a fresh program instead.
+
+        Only lexing and parsing are incremental. Bindings, propagated constants, loop
+        caches and inlined calls of any statement depend on the rest of the document, so
+        the program handed out is a copy of all the statements in a program of its own,
+        put through the passes Parser::parse runs (Parser::prepare); that part costs as much as the whole
+        document does, on every update that changes the text.
+    */
+    class IncrementalParser
+    {
+    public:
+        IncrementalParser();
+        ~IncrementalParser();
+
+        /*
+            Returns the program for 'text', or NULL (reporting the error) if it doesn't parse;
+            the last program that did parse is kept to compare the next text with.
+            Program is owned by IncrementalParser and stays valid until the next update
+            that changes the text.
+        */
+        Program* update( const QString& text );
+
+        // statements parsed and reused by the last successful update
+        int parsed_statements() const { return _parsed; }
+        int reused_statements() const { return _reused; }
+
+    private:
+        struct Segment
+        {
+            int begin;      // first character; 0 for the first segment
+            ulong line;     // line of 'begin'
+        };
+
+        // index of the segment holding character 'position'
+        int segment_at( int position ) const;
+
+        // the parsed statements copied and put through the passes, NULL (reporting the error) if they can't be
+        Program* prepared();
+
+        /*
+            Reparses segments [first, sync] of the new 'text' into 'program'; segment 'sync'
+            (if there is one) is the untouched one new statements have to get in sync with.
+            Segments from 'sync' on moved by 'delta' characters and 'line_delta' lines.
+            Returns false and sets 'error' if the range doesn't parse or doesn't get in sync.
+        */
+        bool reparse( Program* program, const QString& text, int first, int sync, int delta, long line_delta, QString& error );
+
+        // true if statements replaced since the last full parse take too much of the arena
+        bool needs_rebuild() const;
+
+        QString _text;                      // text of _program
+        QVector<Segment> _segments;         // one per statement of _program
+        QVector<AST::Node*> _statements;    // statements of _program, its root block views them
+        Program* _program;                  // statements as parsed, never resolved
+        Program* _prepared;                 // the program handed out, NULL until prepared() makes it
+        size_t _rebuilt_size;               // bytes allocated by the last full parse
+        int _parsed;
+        int _reused;
+    };
+
+};
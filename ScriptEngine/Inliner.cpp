@@ -0,0 +1,545 @@
+#include "Inliner.h"
+#include "Resolver.h"
+
+#include <QHash>
+#include <QPair>
+#include <QVector>
+
+#include <assert.h>
+
+using namespace VTScript;
+
+namespace
+{
+    // slot 'second' in frames of function 'first'
+    typedef QPair<const FrameLayout*, int> Location;
+
+    /*
+        Counts the writes to every slot of every frame and finds the function declaration
+        writing it, if one does.
+    */
+    class Writes : public ASTTools::NodeVisitor
+    {
+    public:
+        Writes(const FrameLayout* function) : function(function) {}
+
+        VISITOR_METHODS
+
+        QHash<Location, int> counts;
+        QHash<Location, AST::FunctionDeclaration*> declarations;    // NULL where several do
+
+    private:
+        void count(const AST::Binding& binding, AST::FunctionDeclaration* declaration)
+        {
+            for (int i = 0; i < binding.count; ++i)
+            {
+                const Location location(function, binding.addresses[i].slot);
+                ++counts[location];
+
+                if (declaration != NULL)
+                    declarations.insert(location, declarations.contains(location) ? NULL : declaration);
+            }
+        }
+
+        const FrameLayout* function;
+    };
+
+    void Writes::visit(AST::Noop* /*node*/)
+    {
+    }
+
+    void Writes::visit(AST::Leaf* /*node*/)
+    {
+    }
+
+    void Writes::visit(AST::FunctionCall* node)
+    {
+        node->function_object()->accept(this);
+
+        foreach(AST::Expression* expr, node->arguments_expressions())
+            expr->accept(this);
+    }
+
+    void Writes::visit(AST::UnaryOperator* node)
+    {
+        node->argument()->accept(this);
+    }
+
+    void Writes::visit(AST::BinaryOperator* node)
+    {
+        if (node->type() == OperatorTypes::Assign)
+            count(static_cast<AST::Leaf*>(node->left())->binding(), NULL);
+        else
+            node->left()->accept(this);
+
+        node->right()->accept(this);
+    }
+
+    void Writes::visit(AST::Return* node)
+    {
+        node->expr()->accept(this);
+    }
+
+    void Writes::visit(AST::Continue* /*node*/)
+    {
+    }
+
+    void Writes::visit(AST::Break* /*node*/)
+    {
+    }
+
+    void Writes::visit(AST::Block* node)
+    {
+        foreach(AST::Node* stmt, node->values())
+            stmt->accept(this);
+    }
+
+    void Writes::visit(AST::FunctionDeclaration* node)
+    {
+        count(node->binding(), node);
+
+        if (!node->is_body_parsed())
+            return;
+
+        const FrameLayout* outer = function;
+        function = node->fnc()->layout();
+        node->body()->accept(this);
+        function = outer;
+    }
+
+    void Writes::visit(AST::While* node)
+    {
+        node->condition()->accept(this);
+        node->body()->accept(this);
+    }
+
+    void Writes::visit(AST::If* node)
+    {
+        node->condition()->accept(this);
+        node->then_stmt()->accept(this);
+        node->else_stmt()->accept(this);
+    }
+
+
+    /*
+        Size of a function body and whether it can run in another frame: its names may
+        only be bound to its own frame, to the top level (depth 'level') and to builtins.
+        'self' is the slot of the function at the top level, -1 if it's declared elsewhere.
+    */
+    class Inlinable : public ASTTools::NodeVisitor
+    {
+    public:
+        Inlinable(int level, int self) : size(0), ok(true), level(level), self(self) {}
+
+        VISITOR_METHODS
+
+        int size;
+        bool ok;
+
+    private:
+        void check(const AST::Binding& binding)
+        {
+            for (int i = 0; i < binding.count; ++i)
+            {
+                const AST::Address& address = binding.addresses[i];
+                if (address.depth != 0 && (address.depth != level || address.slot == self))
+                    ok = false;
+            }
+        }
+
+        int level;
+        int self;
+    };
+
+    void Inlinable::visit(AST::Noop* /*node*/)
+    {
+        ++size;
+    }
+
+    void Inlinable::visit(AST::Leaf* node)
+    {
+        ++size;
+        check(node->binding());
+    }
+
+    void Inlinable::visit(AST::FunctionCall* node)
+    {
+        ++size;
+        node->function_object()->accept(this);
+
+        foreach(AST::Expression* expr, node->arguments_expressions())
+            expr->accept(this);
+    }
+
+    void Inlinable::visit(AST::UnaryOperator* node)
+    {
+        ++size;
+        node->argument()->accept(this);
+    }
+
+    void Inlinable::visit(AST::BinaryOperator* node)
+    {
+        ++size;
+        node->left()->accept(this);
+        node->right()->accept(this);
+    }
+
+    void Inlinable::visit(AST::Return* node)
+    {
+        ++size;
+        node->expr()->accept(this);
+    }
+
+    void Inlinable::visit(AST::Continue* /*node*/)
+    {
+        ++size;
+    }
+
+    void Inlinable::visit(AST::Break* /*node*/)
+    {
+        ++size;
+    }
+
+    void Inlinable::visit(AST::Block* node)
+    {
+        ++size;
+        foreach(AST::Node* stmt, node->values())
+            stmt->accept(this);
+    }
+
+    void Inlinable::visit(AST::FunctionDeclaration* /*node*/)
+    {
+        ok = false;
+    }
+
+    void Inlinable::visit(AST::While* node)
+    {
+        ++size;
+        node->condition()->accept(this);
+        node->body()->accept(this);
+    }
+
+    void Inlinable::visit(AST::If* node)
+    {
+        ++size;
+        node->condition()->accept(this);
+        node->then_stmt()->accept(this);
+        node->else_stmt()->accept(this);
+    }
+
+
+    /*
+        Copies a body Inlinable accepted into the frame of a function 'caller_level'
+        levels deep: slots of the body's own frame, LoopInvariants' caches included,
+        move up by 'base', variables of the top level stay where they are.
+    */
+    class Copier : public ASTTools::NodeVisitor
+    {
+    public:
+        Copier(Program& program, int base, int caller_level) :
+            program(program), base(base), caller_level(caller_level), result(NULL) {}
+
+        VISITOR_METHODS
+
+        template <typename T>
+        T* copy(T* node)
+        {
+            node->accept(this);
+            return static_cast<T*>(result);
+        }
+
+    private:
+        AST::Binding moved(const AST::Binding& binding)
+        {
+            AST::Address* addresses = program.arena().allocate_array<AST::Address>(binding.count);
+            for (int i = 0; i < binding.count; ++i)
+            {
+                const AST::Address& address = binding.addresses[i];
+                addresses[i].depth = address.depth == 0 ? 0 : caller_level;
+                addresses[i].slot = address.depth == 0 ? address.slot + base : address.slot;
+            }
+
+            AST::Binding copy = binding;
+            copy.addresses = addresses;
+            return copy;
+        }
+
+        template <typename T>
+        T* cached(T* node, const AST::Expression* original)
+        {
+            if (original->cache_slot() >= 0)
+                node->set_cache_slot(original->cache_slot() + base);
+            return node;
+        }
+
+        template <typename T>
+        AST::NodeList<T> copy_list(const AST::NodeList<T>& nodes)
+        {
+            QVector<T*> copies;
+            foreach(T* node, nodes)
+                copies.append(copy(node));
+            return AST::NodeList<T>::copy(program.arena(), copies);
+        }
+
+        Program& program;
+        int base;
+        int caller_level;
+        AST::Node* result;
+    };
+
+    void Copier::visit(AST::Noop* node)
+    {
+        result = program.arena().create<AST::Noop>(node->line());
+    }
+
+    void Copier::visit(AST::Leaf* node)
+    {
+        AST::Leaf* leaf = program.arena().create<AST::Leaf>(node->line(), node->name(), node->object());
+        leaf->set_binding(moved(node->binding()));
+        result = leaf;
+    }
+
+    void Copier::visit(AST::FunctionCall* node)
+    {
+        AST::Expression* fnc = copy(node->function_object());
+        result = cached(program.arena().create<AST::FunctionCall>(node->line(), fnc, copy_list(node->arguments_expressions())), node);
+    }
+
+    void Copier::visit(AST::UnaryOperator* node)
+    {
+        result = cached(program.arena().create<AST::UnaryOperator>(node->line(), copy(node->argument()), node->type()), node);
+    }
+
+    void Copier::visit(AST::BinaryOperator* node)
+    {
+        AST::Expression* left = copy(node->left());
+        AST::Expression* right = copy(node->right());
+        result = cached(program.arena().create<AST::BinaryOperator>(node->line(), left, right, node->type()), node);
+    }
+
+    void Copier::visit(AST::Return* node)
+    {
+        result = program.arena().create<AST::Return>(node->line(), copy(node->expr()));
+    }
+
+    void Copier::visit(AST::Continue* node)
+    {
+        result = program.arena().create<AST::Continue>(node->line());
+    }
+
+    void Copier::visit(AST::Break* node)
+    {
+        result = program.arena().create<AST::Break>(node->line());
+    }
+
+    void Copier::visit(AST::Block* node)
+    {
+        AST::Block* block = program.arena().create<AST::Block>(node->line(), copy_list(node->values()));
+
+        int* scope_slots = program.arena().allocate_array<int>(node->scope_slot_count());
+        for (int i = 0; i < node->scope_slot_count(); ++i)
+            scope_slots[i] = node->scope_slots()[i] + base;
+        block->set_scope_slots(scope_slots, node->scope_slot_count());
+
+        result = block;
+    }
+
+    void Copier::visit(AST::FunctionDeclaration* /*node*/)
+    {
+        // Inlinable doesn't let nested functions through
+        assert(false);
+    }
+
+    void Copier::visit(AST::While* node)
+    {
+        AST::Expression* condition = copy(node->condition());
+        AST::While* loop = program.arena().create<AST::While>(node->line(), condition, copy(node->body()));
+
+        int* cache_slots = program.arena().allocate_array<int>(node->cache_slot_count());
+        for (int i = 0; i < node->cache_slot_count(); ++i)
+            cache_slots[i] = node->cache_slots()[i] + base;
+        loop->set_cache_slots(cache_slots, node->cache_slot_count());
+
+        result = loop;
+    }
+
+    void Copier::visit(AST::If* node)
+    {
+        AST::Expression* condition = copy(node->condition());
+        AST::Node* then_stmt = copy(node->then_stmt());
+        result = program.arena().create<AST::If>(node->line(), condition, then_stmt, copy(node->else_stmt()));
+    }
+
+
+    /*
+        Walks every call in the program and inlines those it can.
+    */
+    class CallSites : public ASTTools::NodeVisitor
+    {
+    public:
+        CallSites(Program& program, const Writes& writes, int max_size) :
+            inlined(0), program(program), writes(writes), max_size(max_size), function(program.layout()) {}
+
+        VISITOR_METHODS
+
+        int inlined;
+
+    private:
+        void inline_call(AST::FunctionCall* node);
+        bool is_inlinable(AST::FunctionDeclaration* declaration, const Location& location);
+
+        Program& program;
+        const Writes& writes;
+        int max_size;
+        FrameLayout* function;
+        QHash<AST::FunctionDeclaration*, bool> inlinable;
+    };
+
+    void CallSites::visit(AST::Noop* /*node*/)
+    {
+    }
+
+    void CallSites::visit(AST::Leaf* /*node*/)
+    {
+    }
+
+    void CallSites::visit(AST::FunctionCall* node)
+    {
+        node->function_object()->accept(this);
+
+        foreach(AST::Expression* expr, node->arguments_expressions())
+            expr->accept(this);
+
+        inline_call(node);
+    }
+
+    void CallSites::visit(AST::UnaryOperator* node)
+    {
+        node->argument()->accept(this);
+    }
+
+    void CallSites::visit(AST::BinaryOperator* node)
+    {
+        if (node->type() == OperatorTypes::Dot)
+        {
+            // the method name isn't a function
+            node->left()->accept(this);
+
+            foreach(AST::Expression* expr, static_cast<AST::FunctionCall*>(node->right())->arguments_expressions())
+                expr->accept(this);
+        }
+        else
+        {
+            node->left()->accept(this);
+            node->right()->accept(this);
+        }
+    }
+
+    void CallSites::visit(AST::Return* node)
+    {
+        node->expr()->accept(this);
+    }
+
+    void CallSites::visit(AST::Continue* /*node*/)
+    {
+    }
+
+    void CallSites::visit(AST::Break* /*node*/)
+    {
+    }
+
+    void CallSites::visit(AST::Block* node)
+    {
+        foreach(AST::Node* stmt, node->values())
+            stmt->accept(this);
+    }
+
+    void CallSites::visit(AST::FunctionDeclaration* node)
+    {
+        // deferred bodies aren't inlined into
+        if (!node->is_body_parsed())
+            return;
+
+        FrameLayout* outer = function;
+        function = node->fnc()->layout();
+        node->body()->accept(this);
+        function = outer;
+    }
+
+    void CallSites::visit(AST::While* node)
+    {
+        node->condition()->accept(this);
+        node->body()->accept(this);
+    }
+
+    void CallSites::visit(AST::If* node)
+    {
+        node->condition()->accept(this);
+        node->then_stmt()->accept(this);
+        node->else_stmt()->accept(this);
+    }
+
+    bool CallSites::is_inlinable(AST::FunctionDeclaration* declaration, const Location& location)
+    {
+        QHash<AST::FunctionDeclaration*, bool>::const_iterator known = inlinable.constFind(declaration);
+        if (known != inlinable.constEnd())
+            return known.value();
+
+        Inlinable check(declaration->fnc()->layout()->level, location.first->level == 0 ? location.second : -1);
+        foreach(AST::Node* stmt, declaration->body()->values())
+            stmt->accept(&check);
+
+        const bool result = check.ok && check.size <= max_size;
+        inlinable.insert(declaration, result);
+        return result;
+    }
+
+    void CallSites::inline_call(AST::FunctionCall* node)
+    {
+        // a call of a name that may only be in one slot
+        AST::Leaf* name = dynamic_cast<AST::Leaf*>(node->function_object());
+        if (name == NULL || !name->is_identifier() || name->binding().count != 1)
+            return;
+
+        const AST::Address& address = name->binding().addresses[0];
+        const FrameLayout* frame = function;
+        for (int depth = 0; depth < address.depth && frame->parent != NULL; ++depth)
+            frame = frame->parent;
+
+        // ... that one function declaration writes
+        const Location location(frame, address.slot);
+        AST::FunctionDeclaration* declaration = writes.declarations.value(location);
+        if (declaration == NULL || !declaration->is_body_parsed() || declaration->fnc()->layout() == function
+                || declaration->parameters().size() != node->arguments_expressions().size()
+                || !is_inlinable(declaration, location))
+            return;
+
+        const FrameLayout* callee = declaration->fnc()->layout();
+
+        AST::Inlined* inlined_call = program.arena().create<AST::Inlined>();
+        inlined_call->function = declaration->fnc().data();
+        inlined_call->first_slot = function->slot_count;
+        inlined_call->slot_count = callee->slot_count;
+        inlined_call->exclusive = writes.counts.value(location) == 1 && name->binding().builtin == NULL;
+
+        Copier copier(program, inlined_call->first_slot, function->level);
+        inlined_call->body = copier.copy(declaration->body());
+
+        function->slot_count += callee->slot_count;
+        node->set_inlined(inlined_call);
+        ++inlined;
+    }
+}
+
+
+int Inliner::inline_calls(Program& program, int max_size)
+{
+    Writes writes(program.layout());
+    program.root()->accept(&writes);
+
+    CallSites call_sites(program, writes, max_size);
+    program.root()->accept(&call_sites);
+
+    program.set_inlined_calls(call_sites.inlined);
+    return call_sites.inlined;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "AST.h"
+#include "Program.h"
+
+namespace VTScript
+{
+    /*
+        Inlines calls of small functions: a call whose name can only be bound to one
+        function declaration gets a copy of that function's body, addressed in the frame
+        of the caller (AST::Inlined). The interpreter runs the copy instead of calling
+        when the name does hold that function at run time, and calls as usual when it
+        doesn't, so what the name holds is still checked on every call.
+
+        A function is inlined when its body is parsed and has at most 'max_size' nodes,
+        and when it uses nothing but its own variables, variables of the top level and
+        builtins: no nested functions, no variables of enclosing functions, no call of
+        itself. The copy isn't inlined into further.
+
+        Needs Resolver's bindings; runs after Optimizer so that sizes are of folded
+        bodies, after LoopInvariants, whose caches are copied with the body, and before
+        TypeInference, which types the copy with the arguments' types.
+        Resolving the program again drops the copies.
+    */
+    class Inliner
+    {
+    public:
+        static const int default_max_size = 32;
+
+        // inlines in a resolved program, function bodies parsed so far included; returns the number of calls inlined
+        static int inline_calls(Program& program, int max_size = default_max_size);
+    };
+
+};
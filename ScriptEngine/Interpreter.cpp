@@ -1,6 +1,12 @@
 #include "Interpreter.h"
 #include "Errors.h"
 #include "Builtin.h"
+#include "TypedOperators.h"
+#include "Bytecode.h"
+#include "BytecodeCompiler.h"
+#include "ClosureCompiler.h"
+#include "JitCompiler.h"
+#include "NativeLibrary.h"
 
 #include <QDebug>
 #include <assert.h>
@@ -9,55 +15,49 @@ using namespace VTScript;
 
 namespace
 {
-    SymbolTableManager::SymbolTable init_table_built_in()
-    {
-        SymbolTableManager::SymbolTable table;
-        table["print"] = WS::SP_Object(new Builtin::print());
-        table["help"] = WS::SP_Object(new Builtin::help());
-        table["int"] = WS::SP_Object(new Builtin::_int());
-        table["double"] = WS::SP_Object(new Builtin::_double());
-        table["bool"] = WS::SP_Object(new Builtin::_bool());
-        table["exec"] = WS::SP_Object(new Builtin::exec());
-        return table;
-    }
-}
+    // slots in a block of the SlotStack, a frame that needs more gets a block of its own
+    const int slot_block_size = 4096;
 
-SymbolTableManager::SymbolTable SymbolTableManager::table_built_in = init_table_built_in();
+    // see Interpreter::current
+    thread_local Interpreter* running_interpreter = NULL;
 
-
-WS::SP_Object SymbolTableManager::get_var(QString identifier) const
-{
-    for (int i = _tables.size() - 1; i >= 0; --i)
+    // makes an interpreter the one running on this thread until it goes out of scope; a run()
+    // nested in another one on the same thread gives it back to the outer interpreter
+    struct RunningInterpreter
     {
-        WS::SP_Object obj = _tables.at(i)[identifier];
-        if (obj != NULL)
-            return obj;
-    }
-    return WS::SP_Object();
-}
+        RunningInterpreter(Interpreter* interpreter) : caller(running_interpreter) { running_interpreter = interpreter; }
+        ~RunningInterpreter() { running_interpreter = caller; }
 
-void SymbolTableManager::modify_var(QString identifier, WS::SP_Object value)
-{
-    for (int i = _tables.size() - 1; i > read_only_threshold; --i)
+        Interpreter* caller;
+    };
+
+    // values a loop invariant cache may hand out again: none of them can be changed
+    bool is_value(const WS::SP_Object& obj)
     {
-        WS::SP_Object& obj = _tables[i][identifier];
-        if (obj != NULL)
+        switch (obj->__type__())
         {
-            obj = value;
-            return;
+        case WSTypes::None:
+        case WSTypes::Integral:
+        case WSTypes::Rational:
+        case WSTypes::String:
+        case WSTypes::Bool:
+            return true;
+        default:
+            return false;
         }
     }
-    add_var(identifier, value);
 }
 
-void SymbolTableManager::add_var(QString identifier, WS::SP_Object value)
-{
-    _tables.top()[identifier] = value;
-}
-
-
-Interpreter::Interpreter(AST::Node* ast_root) :
-        ast(ast_root),
+Interpreter::Interpreter(Program* program, bool owns_program, Engine engine) :
+        program(program),
+        ast(program->root()),
+        owns_program(owns_program),
+        engine(engine),
+        jit_compiled(0),
+        native(NULL),
+        quickening(true),
+        frame(NULL),
+        top_frame(NULL),
         __return_value(),
         __is_set_break(false),
         __is_set_continue(false),
@@ -67,15 +67,53 @@ Interpreter::Interpreter(AST::Node* ast_root) :
 {
 }
 
+Interpreter::~Interpreter()
+{
+    qDeleteAll(chunks);
+    qDeleteAll(closures);
+    qDeleteAll(profiles);
+    delete native;
+    if (owns_program)
+        delete program;
+}
+
+Interpreter* Interpreter::current()
+{
+    return running_interpreter;
+}
+
 void Interpreter::run()
 {
     qDebug() << "Interpreter:";
+    assert(program->layout() != NULL);  // see Resolver
+    RunningInterpreter on_this_thread(this);
+    Frame top(program->layout(), NULL, NULL, slot_stack);
+    Running running(frame, &top);
+    top_frame = &top;
+
+    // types seen by an earlier run of the program (ProgramCache, the console) don't hold for this one
+    if (quickening)
+        ASTTools::ForgetTypesVisitor().forget(program->root());
+
     try
     {
         stack.push("__main__");
-        ast->accept(this);
+        const bool bytecode = engine == Engines::BytecodeVM || engine == Engines::BaselineJIT;
+        const Bytecode::Chunk* chunk = bytecode ? compiled(program->root()) : NULL;
+        const Closures::Statement* statement = engine == Engines::ClosureTree ? closure(program->root()) : NULL;
+        WS::SP_Object result;
+        if (chunk != NULL)
+            execute(*chunk);
+        else if (statement != NULL)
+            (*statement)(result);
+        else
+            ast->accept(this);
         stack.pop();
         qDebug() << "Done";
+        if (engine == Engines::BaselineJIT)
+            qDebug() << "JIT:" << jit_compiled << "functions compiled";
+        if (native != NULL)
+            qDebug() << "Native code:" << native->found() << "functions";
     }
     catch (const InterpretError& e)
     {
@@ -88,9 +126,152 @@ void Interpreter::run()
         qDebug() << "Script stopped";
     }
 
+    top_frame = NULL;
     __is_finished = true;
 }
 
+Interpreter::SlotStack::~SlotStack()
+{
+    for (int i = 0; i < blocks.size(); ++i)
+        delete[] blocks[i].values;
+}
+
+WS::SP_Object* Interpreter::SlotStack::push(int count)
+{
+    if (count == 0)
+        return NULL;
+
+    if (top < blocks.size() && blocks[top].size - blocks[top].used >= count)
+    {
+        Block& block = blocks[top];
+        WS::SP_Object* values = block.values + block.used;
+        block.used += count;
+        return values;
+    }
+
+    // the frame doesn't fit, it starts the next block
+    if (top < blocks.size() && blocks[top].used > 0)
+        ++top;
+    if (top == blocks.size())
+    {
+        Block block = { NULL, 0, 0 };
+        blocks.append(block);
+    }
+
+    Block& block = blocks[top];
+    if (block.size < count)
+    {
+        delete[] block.values;
+        block.size = qMax(count, slot_block_size);
+        block.values = new WS::SP_Object[block.size];
+    }
+    block.used = count;
+    return block.values;
+}
+
+void Interpreter::SlotStack::pop(WS::SP_Object* values, int count)
+{
+    if (count == 0)
+        return;
+
+    for (int i = 0; i < count; ++i)
+        values[i].clear();
+
+    Block& block = blocks[top];
+    block.used -= count;
+    if (block.used == 0 && top > 0)
+        --top;
+}
+
+Interpreter::Frame* Interpreter::frame_at(int depth, ulong line) const
+{
+    if (depth == 0)
+        return frame;
+
+    // the top level is always there, even for a function called after its enclosing one returned
+    if (depth == frame->layout->level)
+        return top_frame;
+
+    Frame* f = frame;
+    for (; depth > 0 && f != NULL; --depth)
+        f = f->link;
+
+    if (f == NULL)
+        throw InterpretError(QString("Line %1: Variable of a function that isn't running").arg(line));
+
+    return f;
+}
+
+Interpreter::Frame* Interpreter::enclosing_frame(const FrameLayout* layout) const
+{
+    if (layout->parent == top_frame->layout)
+        return top_frame;
+
+    // the latest call of the enclosing function; a recursive call has the same one as the call before
+    for (Frame* f = frame; f != NULL; f = f->caller)
+    {
+        if (f->layout == layout->parent)
+            return f;
+        if (f->layout == layout)
+            return f->link;
+    }
+
+    return NULL;
+}
+
+WS::SP_Object Interpreter::read(const AST::Binding& binding, const QString& name, ulong line) const
+{
+    WS::SP_Object value;
+
+    for (int i = 0; i < binding.count && value == NULL; ++i)
+    {
+        const AST::Address& address = binding.addresses[i];
+        value = frame_at(address.depth, line)->values[address.slot];
+    }
+
+    if (value == NULL && binding.builtin != NULL)
+        value = *binding.builtin;
+
+    if (value == NULL)
+        throw InterpretError(QString("Line %1: Identifier not found: '%2'").arg(line).arg(name));
+
+    return value;
+}
+
+void Interpreter::assign(const AST::Binding& binding, const WS::SP_Object& value)
+{
+    // an existing variable of the blocks around, innermost first, or a new one in the innermost block
+    WS::SP_Object* values = frame->values;
+
+    for (int i = 0; i < binding.count; ++i)
+    {
+        WS::SP_Object& variable = values[binding.addresses[i].slot];
+        if (variable != NULL)
+        {
+            variable = value;
+            return;
+        }
+    }
+
+    values[binding.addresses[0].slot] = value;
+}
+
+bool Interpreter::cached(AST::Expression* node)
+{
+    const WS::SP_Object& value = frame->values[node->cache_slot()];
+    if (value == NULL)
+        return false;
+
+    __return_value = value;
+    return true;
+}
+
+void Interpreter::keep(AST::Expression* node, const WS::SP_Object& value)
+{
+    if (is_value(value))
+        frame->values[node->cache_slot()] = value;
+}
+
 void Interpreter::visit(AST::Noop* /*node*/)
 {
     if (__is_terminated) throw InterruptError();
@@ -106,11 +287,7 @@ void Interpreter::visit(AST::Leaf* node)
 
     if (node->is_identifier())
     {
-        WS::SP_Object obj = symbol_table_manager.get_var(node->name());
-        if (obj != NULL)
-            return_value = obj;
-        else
-            throw InterpretError(QString("Line %1: Identifier not found: '%2'").arg(node->line()).arg(node->name()));
+        return_value = read(node->binding(), node->name(), node->line());
     }
     else
     {
@@ -127,6 +304,9 @@ void Interpreter::visit(AST::FunctionCall* node)
 {
     if (__is_terminated) throw InterruptError();
 
+    if (node->cache_slot() >= 0 && cached(node))
+        return;
+
     node->function_object()->accept(this);
     WS::SP_Object obj = __return_value;
 
@@ -135,6 +315,13 @@ void Interpreter::visit(AST::FunctionCall* node)
         throw InterpretError(QString("Line %1: Not a function: '%2'").arg(node->line()).arg(obj->__repr__()));
 
     QSharedPointer<WS::Function> fnc = obj.staticCast<WS::Function>();
+
+    if (node->inlined() != NULL && fnc.data() == node->inlined()->function)
+    {
+        __return_value = exec_inlined(node);
+        return;
+    }
+
     WS::ObjectList args;
 
     foreach(AST::Expression* expr, node->arguments_expressions())
@@ -146,11 +333,20 @@ void Interpreter::visit(AST::FunctionCall* node)
     if (!fnc->check_num_arguments( args.size() ))
         throw WrongNumberOfArgumentsError(args.size());
 
+    // builtins may take their arguments out of the list
+    bool invariant = node->cache_slot() >= 0;
+    foreach(const WS::SP_Object& arg, args.values())
+        invariant = invariant && is_value(arg);
+
     stack.push( QString("Line %1: ").arg(node->line()) + fnc->__repr__() );
     WS::SP_Object res = (*fnc)(args);
     stack.pop();
     if (res == NULL)
         res = WS::SP_Object(new WS::None());
+
+    if (invariant)
+        keep(node, res);
+
     __return_value = res;
 }
 
@@ -158,16 +354,31 @@ void Interpreter::visit(AST::UnaryOperator* node)
 {
     if (__is_terminated) throw InterruptError();
 
+    if (node->cache_slot() >= 0 && cached(node))
+        return;
+
     node->argument()->accept(this);
     WS::SP_Object obj = __return_value;
-    QString method_name = OperatorTypes::to_string(node->type());
+    WS::SP_Object res;
 
-    stack.push( QString("Line %1: ").arg(node->line()) + obj->__repr__() + " " + method_name );
-    WS::SP_Object res = obj->invoke(method_name, WS::ObjectList()); 
-    stack.pop();
+    // operand types are checked anyway, it's cheap next to the generic path
+    if (node->operand_type() != WSTypes::Base && obj->__type__() == node->operand_type())
+        res = TypedOperators::unary(node->type(), node->operand_type(), obj.data());
 
     if (res == NULL)
-        res = WS::SP_Object(new WS::None());
+    {
+        QString method_name = OperatorTypes::to_string(node->type());
+
+        stack.push( QString("Line %1: ").arg(node->line()) + obj->__repr__() + " " + method_name );
+        res = obj->invoke(method_name, WS::ObjectList()); 
+        stack.pop();
+
+        if (res == NULL)
+            res = WS::SP_Object(new WS::None());
+    }
+
+    if (node->cache_slot() >= 0 && is_value(obj))
+        keep(node, res);
 
     __return_value = res;
 }
@@ -180,7 +391,7 @@ void Interpreter::visit(AST::BinaryOperator* node)
     {
         AST::Leaf* name = static_cast<AST::Leaf*>(node->left());
         node->right()->accept(this);
-        symbol_table_manager.modify_var(name->name(), __return_value);
+        assign(name->binding(), __return_value);
         // __return_value is propagated further
     }
     else if (node->type() == OperatorTypes::Dot)
@@ -211,19 +422,48 @@ void Interpreter::visit(AST::BinaryOperator* node)
     }
     else
     {
+        if (node->cache_slot() >= 0 && cached(node))
+            return;
+
         node->left()->accept(this);
         WS::SP_Object obj = __return_value;
 
         WS::ObjectList args;
         node->right()->accept(this);
-        args.append(__return_value);
+        WS::SP_Object right = __return_value;
+        args.append(right);
+        WS::SP_Object res;
 
-        stack.push( QString("Line %1: ").arg(node->line()) + obj->__repr__() + "." + OperatorTypes::to_string(node->type()) );
-        WS::SP_Object res = obj->invoke(OperatorTypes::to_string(node->type()), args); 
-        stack.pop();
+        if (node->operand_type() != WSTypes::Base)
+        {
+            if (obj->__type__() == node->operand_type() && right->__type__() == node->operand_type())
+                res = TypedOperators::binary(node->type(), node->operand_type(), obj.data(), right.data());
+        }
+        else if (quickening && node->quick() != NULL)
+        {
+            // quickened by the types seen so far; other types send it back to the generic path
+            if (obj->__type__() == node->seen_type() && right->__type__() == node->seen_type())
+                res = node->quick()(obj.data(), right.data());
+            else
+                node->deoptimize();
+        }
+        else if (quickening)
+        {
+            node->record_types(obj->__type__(), right->__type__());
+        }
 
         if (res == NULL)
-            res = WS::SP_Object(new WS::None());
+        {
+            stack.push( QString("Line %1: ").arg(node->line()) + obj->__repr__() + "." + OperatorTypes::to_string(node->type()) );
+            res = obj->invoke(OperatorTypes::to_string(node->type()), args); 
+            stack.pop();
+
+            if (res == NULL)
+                res = WS::SP_Object(new WS::None());
+        }
+
+        if (node->cache_slot() >= 0 && is_value(obj) && is_value(right))
+            keep(node, res);
 
         __return_value = res;
     }
@@ -256,8 +496,6 @@ void Interpreter::visit(AST::Block* node)
 {
     if (__is_terminated) throw InterruptError();
 
-    symbol_table_manager.push();
-
     foreach(AST::Node* stmt, node->values())
     {
         stmt->accept(this);
@@ -265,7 +503,10 @@ void Interpreter::visit(AST::Block* node)
             break;
     }
 
-    symbol_table_manager.pop();
+    // variables of the block go away with it
+    WS::SP_Object* values = frame->values;
+    for (int i = 0; i < node->scope_slot_count(); ++i)
+        values[node->scope_slots()[i]].clear();
 }
 
 void Interpreter::visit(AST::FunctionDeclaration* node)
@@ -273,7 +514,7 @@ void Interpreter::visit(AST::FunctionDeclaration* node)
     if (__is_terminated) throw InterruptError();
 
     node->fnc()->set_interpreter(this);
-    symbol_table_manager.modify_var(node->name(), node->fnc());
+    assign(node->binding(), node->fnc());
 }
 
 void Interpreter::visit(AST::While* node)
@@ -300,6 +541,11 @@ void Interpreter::visit(AST::While* node)
             break;
         }
     }
+
+    // invariant values are evaluated again the next time the loop runs
+    WS::SP_Object* values = frame->values;
+    for (int i = 0; i < node->cache_slot_count(); ++i)
+        values[node->cache_slots()[i]].clear();
 }
 
 void Interpreter::visit(AST::If* node)
@@ -316,32 +562,442 @@ void Interpreter::visit(AST::If* node)
         node->else_stmt()->accept(this);
 }
 
+WS::SP_Object Interpreter::exec_inlined(AST::FunctionCall* node)
+{
+    const AST::Inlined* inlined = node->inlined();
+
+    // parameters take the first slots of the copy
+    const AST::NodeList<AST::Expression>& args = node->arguments_expressions();
+    for (int i = 0; i < args.size(); ++i)
+    {
+        args[i]->accept(this);
+        frame->values[inlined->first_slot + i] = __return_value;
+    }
+
+    // the call is only on the stack when something goes wrong in it
+    const int depth = stack.size();
+    WS::SP_Object ret;
+
+    try
+    {
+        foreach(AST::Node* stmt, inlined->body->values())
+        {
+            stmt->accept(this);
+            if (__is_set_return)
+            {
+                ret = __return_value;
+                __is_set_return = false;
+                break;
+            }
+        }
+    }
+    catch (const InterpretError&)
+    {
+        stack.insert(depth, QString("Line %1: ").arg(node->line()) + inlined->function->__repr__());
+        throw;
+    }
+
+    // the variables of the call go away with it
+    WS::SP_Object* values = frame->values;
+    for (int i = 0; i < inlined->slot_count; ++i)
+        values[inlined->first_slot + i].clear();
+
+    if (ret == NULL)
+        ret = WS::SP_Object(new WS::None());
+
+    return ret;
+}
+
 WS::SP_Object Interpreter::exec_user_fnc(WS::UserFunction* fnc, WS::ObjectList args)
 {
     if (__is_terminated) throw InterruptError();
 
+    // a deferred body is parsed on the first call, its errors surface as run-time errors
+    AST::Block* body = NULL;
+    try
+    {
+        body = fnc->body();
+    }
+    catch (const LexError& e)
+    {
+        throw InterpretError(QString("In function '%1': Lexer error: %2").arg(fnc->name()).arg(e.what()));
+    }
+    catch (const ParseError& e)
+    {
+        throw InterpretError(QString("In function '%1': Parser error: %2").arg(fnc->name()).arg(e.what()));
+    }
+    catch (const CheckerError& e)
+    {
+        throw InterpretError(QString("In function '%1': Checker error: %2").arg(fnc->name()).arg(e.what()));
+    }
+
     WS::SP_Object ret;
-    symbol_table_manager.push_fnc();
+    const FrameLayout* layout = fnc->layout();
+    Frame callee(layout, enclosing_frame(layout), frame, slot_stack);
 
-    const QStringList& params = fnc->parameters();
-    
-    for ( int i = 0; i < params.size(); ++i )
+    // parameters take the first slots
+    for ( int i = 0; i < args.size(); ++i )
     {
-        symbol_table_manager.modify_var(params.at(i), args.at(i));
+        callee.values[i] = args.at(i);
     }
 
-    foreach(AST::Node* stmt, fnc->body()->values())
+    Running running(frame, &callee);
+
+    const NativeLibrary::Function* native_code = native != NULL ? native->find(body) : NULL;
+    const bool bytecode = native_code == NULL && (engine == Engines::BytecodeVM || engine == Engines::BaselineJIT);
+    const Bytecode::Chunk* chunk = bytecode ? compiled(body) : NULL;
+    const Closures::Statement* statement = native_code == NULL && engine == Engines::ClosureTree ? closure(body) : NULL;
+    if (native_code != NULL)
     {
-        stmt->accept(this);
-        if (__is_set_return)
+        // 'ret' is only set by a return
+        NativeLibrary::run(this, *native_code, ret);
+    }
+    else if (chunk != NULL)
+    {
+        ret = execute(*chunk, profile(chunk));
+    }
+    else if (statement != NULL)
+    {
+        // 'ret' is only set by a return
+        (*statement)(ret);
+    }
+    else
+    {
+        foreach(AST::Node* stmt, body->values())
         {
-            ret = __return_value;
-            __is_set_return = false;
-            break;
+            stmt->accept(this);
+            if (__is_set_return)
+            {
+                ret = __return_value;
+                __is_set_return = false;
+                break;
+            }
         }
     }
 
-    symbol_table_manager.pop();
-
     return ret;
 }
+
+const Bytecode::Chunk* Interpreter::compiled(const AST::Block* body)
+{
+    QHash<const AST::Block*, Bytecode::Chunk*>::const_iterator found = chunks.constFind(body);
+    if (found != chunks.constEnd())
+        return found.value();
+
+    Bytecode::Chunk* chunk = body == program->root() ? BytecodeCompiler::compile_program(*program)
+                                                     : BytecodeCompiler::compile_function(body);
+    chunks.insert(body, chunk);
+    return chunk;
+}
+
+const Closures::Statement* Interpreter::closure(const AST::Block* body)
+{
+    QHash<const AST::Block*, Closures::Statement*>::const_iterator found = closures.constFind(body);
+    if (found != closures.constEnd())
+        return found.value();
+
+    Closures::Statement* statement = body == program->root() ? ClosureCompiler::compile_program(this, *program)
+                                                             : ClosureCompiler::compile_function(this, body);
+    closures.insert(body, statement);
+    return statement;
+}
+
+bool Interpreter::load_native_code(const QString& script_path)
+{
+    QString error;
+    NativeLibrary* library = NativeLibrary::load(script_path, error);
+    if (library == NULL)
+    {
+        if (!error.isEmpty())
+            qDebug() << "Native code not used:" << qPrintable(error);
+        return false;
+    }
+
+    delete native;
+    native = library;
+    return true;
+}
+
+int Interpreter::native_functions() const
+{
+    return native != NULL ? native->found() : 0;
+}
+
+Jit::Profile* Interpreter::profile(const Bytecode::Chunk* chunk)
+{
+    if (engine != Engines::BaselineJIT)
+        return NULL;
+
+    Jit::Profile*& profile = profiles[chunk];
+    if (profile == NULL)
+        profile = new Jit::Profile();
+    return profile;
+}
+
+bool Interpreter::has_machine_code(Jit::Profile& profile, const Bytecode::Chunk& chunk)
+{
+    if (!profile.compiled)
+    {
+        profile.compiled = true;
+        profile.code = JitCompiler::compile(this, chunk);
+        if (profile.code != NULL)
+            ++jit_compiled;
+    }
+    return profile.code != NULL;
+}
+
+/*
+    The loop of the bytecode engine: the same work the visits do, for one body at a
+    time. Calls go through the function object as they do in the tree walker, so a
+    user-defined function gets its own execute() from exec_user_fnc. Opcodes are
+    dispatched through a table of label addresses where the compiler has computed
+    gotos (GCC, Clang), so every instruction jumps straight to the next one's code;
+    elsewhere through a switch.
+*/
+WS::SP_Object Interpreter::execute(const Bytecode::Chunk& chunk, Jit::Profile* profile)
+{
+    if (__is_terminated) throw InterruptError();
+
+    const int* code = chunk.code.constData();
+    const WS::SP_Object* constants = chunk.constants.constData();
+    WS::SP_Object* values = frame->values;
+
+    QVector<WS::SP_Object> operands(chunk.stack_size);
+    WS::SP_Object* sp = operands.data();        // one past the top
+    int pc = 0;
+
+    if (profile != NULL && ++profile->count >= Jit::hot_threshold && has_machine_code(*profile, chunk))
+        return JitCompiler::run(this, *profile->code, chunk, sp, 0);
+
+#if defined(__GNUC__)
+    // in the order of Bytecode::Opcodes::Opcode
+    static const void* const labels[] =
+    {
+        &&op_Constant, &&op_LoadLocal, &&op_LoadName, &&op_StoreLocal, &&op_AssignName, &&op_Clear, &&op_Pop,
+        &&op_Unary, &&op_Binary, &&op_CheckFunction, &&op_Call, &&op_Method, &&op_Define,
+        &&op_Jump, &&op_JumpIfFalse, &&op_Return
+    };
+#define OPCODE(name) op_##name:
+#define DISPATCH() goto *labels[code[pc++]]
+    DISPATCH();
+#else
+#define OPCODE(name) case Bytecode::Opcodes::name:
+#define DISPATCH() continue
+    for (;;) switch (code[pc++])
+    {
+#endif
+
+    OPCODE(Constant)
+    {
+        *sp++ = constants[code[pc++]];
+        DISPATCH();
+    }
+
+    OPCODE(LoadLocal)
+    {
+        const WS::SP_Object& value = values[code[pc]];
+        if (value == NULL)
+        {
+            const Bytecode::Chunk::Name& name = chunk.names[code[pc + 1]];
+            throw InterpretError(QString("Line %1: Identifier not found: '%2'").arg(name.line).arg(name.text));
+        }
+        *sp++ = value;
+        pc += 2;
+        DISPATCH();
+    }
+
+    OPCODE(LoadName)
+    {
+        const Bytecode::Chunk::Name& name = chunk.names[code[pc++]];
+        *sp++ = read(name.binding, name.text, name.line);
+        DISPATCH();
+    }
+
+    OPCODE(StoreLocal)
+    {
+        values[code[pc++]] = sp[-1];
+        DISPATCH();
+    }
+
+    OPCODE(AssignName)
+    {
+        assign(chunk.names[code[pc++]].binding, sp[-1]);
+        DISPATCH();
+    }
+
+    OPCODE(Clear)
+    {
+        values[code[pc++]].clear();
+        DISPATCH();
+    }
+
+    OPCODE(Pop)
+    {
+        (--sp)->clear();
+        DISPATCH();
+    }
+
+    OPCODE(Unary)
+    {
+        const int at = pc - 1;
+        const OperatorType type = OperatorType(code[pc]);
+        const WSType operand_type = WSType(code[pc + 1]);
+        pc += 2;
+
+        WS::SP_Object& obj = sp[-1];
+        WS::SP_Object res;
+        if (operand_type != WSTypes::Base && obj->__type__() == operand_type)
+            res = TypedOperators::unary(type, operand_type, obj.data());
+
+        if (res == NULL)
+        {
+            QString method_name = OperatorTypes::to_string(type);
+
+            stack.push( QString("Line %1: ").arg(chunk.line_at(at)) + obj->__repr__() + " " + method_name );
+            res = obj->invoke(method_name, WS::ObjectList());
+            stack.pop();
+
+            if (res == NULL)
+                res = WS::SP_Object(new WS::None());
+        }
+
+        obj = res;
+        DISPATCH();
+    }
+
+    OPCODE(Binary)
+    {
+        const int at = pc - 1;
+        const OperatorType type = OperatorType(code[pc]);
+        const WSType operand_type = WSType(code[pc + 1]);
+        pc += 2;
+
+        WS::SP_Object& obj = sp[-2];
+        WS::SP_Object& right = sp[-1];
+        WS::SP_Object res;
+        if (operand_type != WSTypes::Base && obj->__type__() == operand_type && right->__type__() == operand_type)
+            res = TypedOperators::binary(type, operand_type, obj.data(), right.data());
+
+        if (res == NULL)
+        {
+            WS::ObjectList args;
+            args.append(right);
+
+            stack.push( QString("Line %1: ").arg(chunk.line_at(at)) + obj->__repr__() + "." + OperatorTypes::to_string(type) );
+            res = obj->invoke(OperatorTypes::to_string(type), args);
+            stack.pop();
+
+            if (res == NULL)
+                res = WS::SP_Object(new WS::None());
+        }
+
+        obj = res;
+        (--sp)->clear();
+        DISPATCH();
+    }
+
+    OPCODE(CheckFunction)
+    {
+        // _func_object expression should yield WSFuncion descendant
+        const WS::SP_Object& obj = sp[-1];
+        if (obj->__type__() != WSTypes::Function)
+            throw InterpretError(QString("Line %1: Not a function: '%2'").arg(chunk.line_at(pc - 1)).arg(obj->__repr__()));
+        DISPATCH();
+    }
+
+    OPCODE(Call)
+    {
+        const int at = pc - 1;
+        const int count = code[pc++];
+        WS::SP_Object* base = sp - count - 1;
+        QSharedPointer<WS::Function> fnc = base->staticCast<WS::Function>();
+
+        WS::ObjectList args;
+        for (int i = 1; i <= count; ++i)
+            args.append(base[i]);
+
+        if (!fnc->check_num_arguments( args.size() ))
+            throw WrongNumberOfArgumentsError(args.size());
+
+        stack.push( QString("Line %1: ").arg(chunk.line_at(at)) + fnc->__repr__() );
+        WS::SP_Object res = (*fnc)(args);
+        stack.pop();
+        if (res == NULL)
+            res = WS::SP_Object(new WS::None());
+
+        while (sp != base + 1)
+            (--sp)->clear();
+        *base = res;
+        DISPATCH();
+    }
+
+    OPCODE(Method)
+    {
+        const int at = pc - 1;
+        const QString& method_name = chunk.names[code[pc]].text;
+        const int count = code[pc + 1];
+        pc += 2;
+        WS::SP_Object* base = sp - count - 1;
+        WS::SP_Object obj = *base;
+
+        WS::ObjectList args;
+        for (int i = 1; i <= count; ++i)
+            args.append(base[i]);
+
+        stack.push( QString("Line %1: ").arg(chunk.line_at(at)) + obj->__repr__() + "." + method_name );
+        WS::SP_Object res = obj->invoke(method_name, args);
+        stack.pop();
+
+        if (res == NULL)
+            res = WS::SP_Object(new WS::None());
+
+        while (sp != base + 1)
+            (--sp)->clear();
+        *base = res;
+        DISPATCH();
+    }
+
+    OPCODE(Define)
+    {
+        static_cast<WS::UserFunction*>(sp[-1].data())->set_interpreter(this);
+        DISPATCH();
+    }
+
+    OPCODE(Jump)
+    {
+        if (__is_terminated) throw InterruptError();
+
+        // a loop that got hot goes on in machine code from its next iteration; statements leave the stack empty
+        const int target = code[pc];
+        if (profile != NULL && target < pc && ++profile->count >= Jit::hot_threshold
+                && sp == operands.data() && has_machine_code(*profile, chunk))
+            return JitCompiler::run(this, *profile->code, chunk, sp, target);
+
+        pc = target;
+        DISPATCH();
+    }
+
+    OPCODE(JumpIfFalse)
+    {
+        WS::SP_Object cond_expr = *--sp;
+        sp->clear();
+        QSharedPointer<WS::Bool> condition = cond_expr->invoke("__bool__", WS::ObjectList()).staticCast<WS::Bool>();
+
+        if (condition->value())
+            ++pc;
+        else
+            pc = code[pc];
+        DISPATCH();
+    }
+
+    OPCODE(Return)
+    {
+        return *--sp;
+    }
+
+#if !defined(__GNUC__)
+    }
+#endif
+#undef OPCODE
+#undef DISPATCH
+}
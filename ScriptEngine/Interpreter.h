@@ -1,7 +1,10 @@
 #pragma once
 
 #include "AST.h"
+#include "Program.h"
 #include "Objects.h"
+#include "Resolver.h"
+#include "Closures.h"
 
 #include <QSharedPointer>
 #include <QThread>
@@ -12,52 +15,171 @@
 
 namespace VTScript
 {
-    class SymbolTableManager
+    namespace Bytecode
     {
-    public:
-        typedef QHash< QString, WS::SP_Object > SymbolTable;
-
-        SymbolTableManager() : read_only_threshold(0) { _tables.push(table_built_in); }
-
-        WS::SP_Object get_var(QString identifier) const;
-
-        // adds to local scope if not found
-        void modify_var(QString identifier, WS::SP_Object value);
-        inline void modify_var(QString identifier, WS::Object* value) { modify_var(identifier, WS::SP_Object(value)); }
+        struct Chunk;
+    }
 
-        void push() { _tables.push(SymbolTable()); }
-        void pop() { _tables.pop(); }
-
-        void push_fnc() { read_only_threshold = _tables.size() - 1; _tables.push(SymbolTable()); }
-
-    private:
-        void add_var(QString identifier, WS::SP_Object value);
+    namespace Jit
+    {
+        struct Profile;
+    }
 
-    private:
-        QStack<SymbolTable> _tables;
-        int read_only_threshold;
+    namespace Engines
+    {
+        // how Interpreter runs a program
+        enum Engine
+        {
+            TreeWalker,     // visits the nodes of the tree
+            BytecodeVM,     // compiles the top level and every function body on its first call, see BytecodeCompiler
+            ClosureTree,    // the same with closures, see ClosureCompiler
+            BaselineJIT     // BytecodeVM, and function bodies that get hot are compiled to machine code, see JitCompiler;
+                            // only on x86-64 Linux, elsewhere it's BytecodeVM
+        };
+    }
 
-        static SymbolTable table_built_in;
-    };
+    typedef Engines::Engine Engine;
 
+    class NativeLibrary;
 
     class Interpreter : public ASTTools::NodeVisitor, public QThread
     {
+        friend class ClosureCompiler;
+        friend class JitCompiler;
+        friend class NativeLibrary;
+
     public:
-        Interpreter(AST::Node* ast_root);
-        ~Interpreter() { delete ast; }
+        // deletes the program when done unless 'owns_program' is false
+        Interpreter(Program* program, bool owns_program = true, Engine engine = Engines::TreeWalker);
+        ~Interpreter();
         void run();
 
         bool is_finished() { return __is_finished; }
         void stop() { __is_terminated = true; }
+        // function bodies BaselineJIT compiled to machine code so far
+        int compiled_functions() const { return jit_compiled; }
+        // on any engine, function bodies found in the library AotCompiler built for the script at
+        // 'script_path' run in native code; false if it hasn't been built for the script as it is or can't be used
+        bool load_native_code(const QString& script_path);
+        // function bodies that ran in native code so far
+        int native_functions() const;
+        // whether the tree walker quickens operators TypeInference left untyped, see AST::BinaryOperator::quick
+        void set_quickening(bool on) { quickening = on; }
+        bool is_quickening() const { return quickening; }
+        Engine used_engine() const { return engine; }
+        // the interpreter the calling thread is running a program on, NULL if none; builtins run scripts as it does
+        static Interpreter* current();
 
         VISITOR_METHODS
 
         WS::SP_Object exec_user_fnc(WS::UserFunction* fnc, WS::ObjectList args);
 
     private:
+        /*
+            Where the frames keep their variables. A call takes the slots of its frame from
+            the top and gives them back emptied when it returns, so calls don't allocate:
+            the blocks the slots are in are kept for the next calls, and never move.
+        */
+        class SlotStack
+        {
+        public:
+            SlotStack() : top(0) {}
+            ~SlotStack();
+
+            WS::SP_Object* push(int count);
+            // empties the slots the frame that pushed last took
+            void pop(WS::SP_Object* values, int count);
+
+        private:
+            SlotStack(const SlotStack&);
+            SlotStack& operator=(const SlotStack&);
+
+            struct Block
+            {
+                WS::SP_Object* values;
+                int size;
+                int used;
+            };
+
+            QVector<Block> blocks;
+            int top;                    // the block frames are pushed to
+        };
+
+        /*
+            Variables of a running function, or of the top level, in the slots Resolver
+            gave them. 'link' is the frame of the function it's declared in, 'caller' the
+            frame it was called from.
+        */
+        struct Frame
+        {
+            Frame(const FrameLayout* layout, Frame* link, Frame* caller, SlotStack& storage) :
+                layout(layout), link(link), caller(caller), values(storage.push(layout->slot_count)),
+                count(layout->slot_count), storage(storage) {}
+            ~Frame() { storage.pop(values, count); }
+
+            const FrameLayout* layout;
+            Frame* link;
+            Frame* caller;
+            WS::SP_Object* values;
+
+        private:
+            Frame(const Frame&);
+            Frame& operator=(const Frame&);
+
+            int count;
+            SlotStack& storage;
+        };
+
+        // makes a frame the running one until it goes out of scope, however the call ends
+        struct Running
+        {
+            Running(Frame*& frame, Frame* callee) : frame(frame), caller(frame) { frame = callee; }
+            ~Running() { frame = caller; }
+
+            Frame*& frame;
+            Frame* caller;
+        };
+
+        // frame of the function 'depth' levels out from the running one
+        Frame* frame_at(int depth, ulong line) const;
+        // frame a call of a function with 'layout' links to; NULL if its enclosing function isn't running
+        Frame* enclosing_frame(const FrameLayout* layout) const;
+        // what a name refers to; throws if it's none
+        WS::SP_Object read(const AST::Binding& binding, const QString& name, ulong line) const;
+        void assign(const AST::Binding& binding, const WS::SP_Object& value);
+        // the value kept in the cache slot of a loop invariant 'node' as __return_value; false if there's none yet
+        bool cached(AST::Expression* node);
+        // keeps 'value' of a loop invariant 'node' if it can't change
+        void keep(AST::Expression* node, const WS::SP_Object& value);
+        // runs the copy of the callee's body Inliner put in 'node', in the running frame
+        WS::SP_Object exec_inlined(AST::FunctionCall* node);
+
+        // bytecode of a body, compiled on first use; NULL if it can't be compiled and has to be walked
+        const Bytecode::Chunk* compiled(const AST::Block* body);
+        // runs bytecode in the running frame, returns what it returns; counts the calls and loop
+        // iterations of a function body into its 'profile' and goes on in machine code once it's hot
+        WS::SP_Object execute(const Bytecode::Chunk& chunk, Jit::Profile* profile = NULL);
+        // profile of a function body on BaselineJIT, NULL on the other engines
+        Jit::Profile* profile(const Bytecode::Chunk* chunk);
+        // whether the body has machine code, compiling it the first time it's asked
+        bool has_machine_code(Jit::Profile& profile, const Bytecode::Chunk& chunk);
+        // closures of a body, compiled on first use; NULL if it can't be compiled and has to be walked
+        const Closures::Statement* closure(const AST::Block* body);
+
+    private:
+        Program* program;
         AST::Node* ast;
-        SymbolTableManager symbol_table_manager;
+        bool owns_program;
+        Engine engine;
+        QHash<const AST::Block*, Bytecode::Chunk*> chunks;
+        QHash<const AST::Block*, Closures::Statement*> closures;
+        QHash<const Bytecode::Chunk*, Jit::Profile*> profiles;
+        int jit_compiled;
+        NativeLibrary* native;
+        bool quickening;
+        SlotStack slot_stack;
+        Frame* frame;
+        Frame* top_frame;
         QStack<QString> stack;
 
         WS::SP_Object __return_value;
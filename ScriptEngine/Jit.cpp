@@ -0,0 +1,50 @@
+#include "Jit.h"
+
+#include <string.h>
+
+#ifdef VTSCRIPT_JIT
+#include <sys/mman.h>
+#endif
+
+using namespace VTScript;
+using namespace VTScript::Jit;
+
+Code::Code(const char* code, int size, const QHash<int, int>& entries) :
+        memory(NULL),
+        size(size_t(size)),
+        entries(entries)
+{
+#ifdef VTSCRIPT_JIT
+    // written while it's writable, run once it's executable, never both
+    void* pages = mmap(NULL, this->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (pages == MAP_FAILED)
+        return;
+
+    memcpy(pages, code, this->size);
+    if (mprotect(pages, this->size, PROT_READ | PROT_EXEC) != 0)
+    {
+        munmap(pages, this->size);
+        return;
+    }
+
+    memory = pages;
+#else
+    (void)code;
+#endif
+}
+
+Code::~Code()
+{
+#ifdef VTSCRIPT_JIT
+    if (memory != NULL)
+        munmap(memory, size);
+#endif
+}
+
+const void* Code::entry(int pc) const
+{
+    QHash<int, int>::const_iterator found = entries.constFind(pc);
+    if (memory == NULL || found == entries.constEnd())
+        return NULL;
+    return static_cast<const char*>(memory) + found.value();
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <QHash>
+
+#include <stddef.h>
+
+// machine code is only made for x86-64 Linux (System V calling convention, mmap)
+#if defined(__x86_64__) && defined(__linux__)
+#define VTSCRIPT_JIT
+#endif
+
+namespace VTScript
+{
+    /*
+        Baseline JIT of the bytecode engine: the bytecode of a function body that got
+        hot is translated instruction by instruction to x86-64 machine code, see
+        JitCompiler. Calls and loop iterations are counted per function body by
+        Interpreter::execute.
+    */
+    namespace Jit
+    {
+        // calls and loop iterations of a function body after which it is compiled
+        const int hot_threshold = 1000;
+
+        // executable memory holding the machine code of one function body
+        class Code
+        {
+        public:
+            Code(const char* code, int size, const QHash<int, int>& entries);
+            ~Code();
+
+            // whether the machine code could be made executable
+            bool is_valid() const { return memory != NULL; }
+            // where in the code the instruction at bytecode 'pc' starts, NULL if it isn't an entry
+            const void* entry(int pc) const;
+            const void* start() const { return memory; }
+
+        private:
+            Code(const Code&);
+            Code& operator=(const Code&);
+
+            void* memory;
+            size_t size;
+            QHash<int, int> entries;    // bytecode pc of the start and of every loop head, to offset in the code
+        };
+
+        // what Interpreter knows about a function body running on the bytecode engine
+        struct Profile
+        {
+            Profile() : count(0), code(NULL), compiled(false) {}
+            ~Profile() { delete code; }
+
+            int count;          // calls and loop iterations so far
+            Code* code;         // NULL until compiled, or if it couldn't be
+            bool compiled;      // compiling was tried
+        };
+    }
+
+};
@@ -0,0 +1,693 @@
+#include "JitCompiler.h"
+#include "Interpreter.h"
+#include "TypedOperators.h"
+#include "ObjectLayout.h"
+#include "Errors.h"
+
+#include <QSet>
+
+using namespace VTScript;
+using namespace VTScript::Bytecode;
+
+typedef Jit::X86Assembler Asm;
+
+namespace
+{
+    const ObjectLayout& layout()
+    {
+        return ObjectLayout::measured();
+    }
+
+    template <typename Function>
+    const void* address(Function function)
+    {
+        return reinterpret_cast<const void*>(function);
+    }
+
+    bool has_integral_path(OperatorType type)
+    {
+        switch (type)
+        {
+        case OperatorTypes::Plus:
+        case OperatorTypes::Minus:
+        case OperatorTypes::Mult:
+        case OperatorTypes::Div:
+        case OperatorTypes::Mod:
+        case OperatorTypes::Less:
+        case OperatorTypes::Greater:
+        case OperatorTypes::LessEq:
+        case OperatorTypes::GreaterEq:
+        case OperatorTypes::Equal:
+        case OperatorTypes::NotEqual:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    bool has_rational_path(OperatorType type)
+    {
+        return type != OperatorTypes::Mod && has_integral_path(type);
+    }
+
+    const int value_size = int(sizeof(WS::SP_Object));
+}
+
+
+Jit::Code* JitCompiler::compile(Interpreter* interpreter, const Chunk& chunk)
+{
+#ifdef VTSCRIPT_JIT
+    if (!layout().valid)
+        return NULL;
+
+    JitCompiler compiler(interpreter, chunk);
+    Asm& masm = compiler.masm;
+
+    // labels of all instructions; loop heads, the targets of jumps back, are entries too
+    QSet<int> heads;
+    compiler.labels.fill(-1, chunk.code.size());
+    for (int pc = 0; pc < chunk.code.size(); pc += 1 + Opcodes::operand_count(Opcode(chunk.code[pc])))
+    {
+        compiler.labels[pc] = masm.new_label();
+        if (chunk.code[pc] == Opcodes::Jump && chunk.code[pc + 1] <= pc)
+            heads.insert(chunk.code[pc + 1]);
+    }
+
+    compiler.error_exit = masm.new_label();
+    compiler.interrupted = masm.new_label();
+    compiler.returned = masm.new_label();
+
+    compiler.prologue();
+    for (int pc = 0; pc < chunk.code.size(); pc += 1 + Opcodes::operand_count(Opcode(chunk.code[pc])))
+    {
+        masm.bind(compiler.labels[pc]);
+        compiler.instruction(pc);
+    }
+    compiler.epilogue();
+    masm.resolve();
+
+    QHash<int, int> entries;
+    entries.insert(0, masm.offset(compiler.labels[0]));
+    foreach(int head, heads)
+        entries.insert(head, masm.offset(compiler.labels[head]));
+
+    Jit::Code* code = new Jit::Code(masm.code().constData(), masm.size(), entries);
+    if (!code->is_valid())
+    {
+        delete code;
+        return NULL;
+    }
+    return code;
+#else
+    (void)interpreter;
+    (void)chunk;
+    return NULL;
+#endif
+}
+
+WS::SP_Object JitCompiler::run(Interpreter* interpreter, const Jit::Code& code, const Chunk& chunk,
+                               WS::SP_Object* operands, int pc)
+{
+    State state = { interpreter, &chunk, WS::SP_Object(), std::exception_ptr() };
+    Entry entry = reinterpret_cast<Entry>(const_cast<void*>(code.start()));
+
+    if (entry(&state, operands, interpreter->frame->values, code.entry(pc)) != 0)
+        std::rethrow_exception(state.error);
+
+    return state.result;
+}
+
+void JitCompiler::prologue()
+{
+    // rbx: state, r12: top of the operand stack, r13: variables; r14 keeps the stack aligned
+    masm.push(Asm::rbp);
+    masm.mov(Asm::rbp, Asm::rsp);
+    masm.push(Asm::rbx);
+    masm.push(Asm::r12);
+    masm.push(Asm::r13);
+    masm.push(Asm::r14);
+
+    masm.mov(Asm::rbx, Asm::rdi);
+    masm.mov(Asm::r12, Asm::rsi);
+    masm.mov(Asm::r13, Asm::rdx);
+    masm.jmp(Asm::rcx);
+}
+
+void JitCompiler::epilogue()
+{
+    const Asm::Label leave = masm.new_label();
+
+    masm.bind(interrupted);
+    masm.mov(Asm::rdi, Asm::rbx);
+    masm.call(address(&JitCompiler::interrupt));
+
+    masm.bind(error_exit);
+    masm.mov_32(Asm::rax, 1);
+    masm.jmp(leave);
+
+    masm.bind(returned);
+    masm.mov_32(Asm::rax, 0);
+
+    masm.bind(leave);
+    masm.pop(Asm::r14);
+    masm.pop(Asm::r13);
+    masm.pop(Asm::r12);
+    masm.pop(Asm::rbx);
+    masm.pop(Asm::rbp);
+    masm.ret();
+}
+
+void JitCompiler::check_status()
+{
+    masm.test_32(Asm::rax, Asm::rax);
+    masm.j(Asm::NotEqual, error_exit);
+}
+
+void JitCompiler::instruction(int pc)
+{
+    const int* code = chunk.code.constData();
+    const int top = -value_size;
+
+    switch (code[pc])
+    {
+    case Opcodes::Constant:
+        masm.mov(Asm::rdi, Asm::r12);
+        masm.mov(Asm::rsi, qint64(&chunk.constants.at(code[pc + 1])));
+        masm.call(address(&JitCompiler::copy));
+        masm.add(Asm::r12, value_size);
+        break;
+
+    case Opcodes::LoadLocal:
+        masm.mov(Asm::rdi, Asm::rbx);
+        masm.mov(Asm::rsi, Asm::r12);
+        masm.lea(Asm::rdx, Asm::r13, code[pc + 1] * value_size);
+        masm.mov_32(Asm::rcx, code[pc + 2]);
+        masm.call(address(&JitCompiler::load_local));
+        check_status();
+        masm.add(Asm::r12, value_size);
+        break;
+
+    case Opcodes::LoadName:
+        masm.mov(Asm::rdi, Asm::rbx);
+        masm.mov(Asm::rsi, Asm::r12);
+        masm.mov_32(Asm::rdx, code[pc + 1]);
+        masm.call(address(&JitCompiler::load_name));
+        check_status();
+        masm.add(Asm::r12, value_size);
+        break;
+
+    case Opcodes::StoreLocal:
+        masm.lea(Asm::rdi, Asm::r13, code[pc + 1] * value_size);
+        masm.lea(Asm::rsi, Asm::r12, top);
+        masm.call(address(&JitCompiler::copy));
+        break;
+
+    case Opcodes::AssignName:
+        masm.mov(Asm::rdi, Asm::rbx);
+        masm.lea(Asm::rsi, Asm::r12, top);
+        masm.mov_32(Asm::rdx, code[pc + 1]);
+        masm.call(address(&JitCompiler::assign_name));
+        break;
+
+    case Opcodes::Clear:
+        masm.lea(Asm::rdi, Asm::r13, code[pc + 1] * value_size);
+        masm.call(address(&JitCompiler::clear));
+        break;
+
+    case Opcodes::Pop:
+        masm.sub(Asm::r12, value_size);
+        masm.mov(Asm::rdi, Asm::r12);
+        masm.call(address(&JitCompiler::clear));
+        break;
+
+    case Opcodes::Unary:
+        masm.mov(Asm::rdi, Asm::rbx);
+        masm.lea(Asm::rsi, Asm::r12, top);
+        masm.mov_32(Asm::rdx, code[pc + 1]);
+        masm.mov_32(Asm::rcx, code[pc + 2]);
+        masm.mov_32(Asm::r8, pc);
+        masm.call(address(&JitCompiler::unary));
+        check_status();
+        break;
+
+    case Opcodes::Binary:
+        binary_operator(pc, OperatorType(code[pc + 1]), WSType(code[pc + 2]));
+        break;
+
+    case Opcodes::CheckFunction:
+        masm.mov(Asm::rdi, Asm::rbx);
+        masm.lea(Asm::rsi, Asm::r12, top);
+        masm.mov_32(Asm::rdx, pc);
+        masm.call(address(&JitCompiler::check_function));
+        check_status();
+        break;
+
+    case Opcodes::Call:
+        masm.mov(Asm::rdi, Asm::rbx);
+        masm.lea(Asm::rsi, Asm::r12, -(code[pc + 1] + 1) * value_size);
+        masm.mov_32(Asm::rdx, code[pc + 1]);
+        masm.mov_32(Asm::rcx, pc);
+        masm.call(address(&JitCompiler::call));
+        check_status();
+        masm.sub(Asm::r12, code[pc + 1] * value_size);
+        break;
+
+    case Opcodes::Method:
+        masm.mov(Asm::rdi, Asm::rbx);
+        masm.lea(Asm::rsi, Asm::r12, -(code[pc + 2] + 1) * value_size);
+        masm.mov_32(Asm::rdx, code[pc + 1]);
+        masm.mov_32(Asm::rcx, code[pc + 2]);
+        masm.mov_32(Asm::r8, pc);
+        masm.call(address(&JitCompiler::method));
+        check_status();
+        masm.sub(Asm::r12, code[pc + 2] * value_size);
+        break;
+
+    case Opcodes::Define:
+        masm.mov(Asm::rdi, Asm::rbx);
+        masm.lea(Asm::rsi, Asm::r12, top);
+        masm.call(address(&JitCompiler::define));
+        break;
+
+    case Opcodes::Jump:
+        // a jump back closes a loop, where the script may be stopped
+        if (code[pc + 1] <= pc)
+        {
+            masm.mov(Asm::rax, qint64(&interpreter->__is_terminated));
+            masm.cmp_8(Asm::rax, 0, 0);
+            masm.j(Asm::NotEqual, interrupted);
+        }
+        masm.jmp(labels[code[pc + 1]]);
+        break;
+
+    case Opcodes::JumpIfFalse:
+        masm.mov(Asm::rdi, Asm::rbx);
+        masm.lea(Asm::rsi, Asm::r12, top);
+        masm.call(address(&JitCompiler::condition));
+        masm.sub(Asm::r12, value_size);
+        masm.test_32(Asm::rax, Asm::rax);
+        masm.j(Asm::Sign, error_exit);
+        masm.j(Asm::Equal, labels[code[pc + 1]]);
+        break;
+
+    case Opcodes::Return:
+        masm.mov(Asm::rdi, Asm::rbx);
+        masm.lea(Asm::rsi, Asm::r12, top);
+        masm.call(address(&JitCompiler::return_value));
+        masm.jmp(returned);
+        break;
+    }
+}
+
+void JitCompiler::binary_operator(int pc, OperatorType type, WSType operands)
+{
+    const bool integers = (operands == WSTypes::Integral || operands == WSTypes::Base) && has_integral_path(type);
+    const bool doubles = (operands == WSTypes::Rational || operands == WSTypes::Base) && has_rational_path(type);
+
+    const Asm::Label generic = masm.new_label();
+    const Asm::Label done = masm.new_label();
+
+    if (integers || doubles)
+    {
+        // rax, rcx: the operands, rdx: the class of the left one
+        masm.load(Asm::rax, Asm::r12, -2 * value_size + layout().pointer);
+        masm.load(Asm::rcx, Asm::r12, -value_size + layout().pointer);
+        masm.load(Asm::rdx, Asm::rax, 0);
+
+        if (integers)
+        {
+            const Asm::Label not_integers = doubles ? masm.new_label() : generic;
+            masm.mov(Asm::r11, qint64(layout().integral_class));
+            masm.cmp(Asm::rdx, Asm::r11);
+            masm.j(Asm::NotEqual, not_integers);
+            masm.cmp(Asm::r11, Asm::rcx, 0);
+            masm.j(Asm::NotEqual, generic);
+            integral(type, generic);
+            masm.jmp(done);
+
+            if (doubles)
+                masm.bind(not_integers);
+        }
+
+        if (doubles)
+        {
+            masm.mov(Asm::r11, qint64(layout().rational_class));
+            masm.cmp(Asm::rdx, Asm::r11);
+            masm.j(Asm::NotEqual, generic);
+            masm.cmp(Asm::r11, Asm::rcx, 0);
+            masm.j(Asm::NotEqual, generic);
+            rational(type);
+            masm.jmp(done);
+        }
+    }
+
+    masm.bind(generic);
+    masm.mov(Asm::rdi, Asm::rbx);
+    masm.lea(Asm::rsi, Asm::r12, -2 * value_size);
+    masm.mov_32(Asm::rdx, type);
+    masm.mov_32(Asm::rcx, operands);
+    masm.mov_32(Asm::r8, pc);
+    masm.call(address(&JitCompiler::binary));
+    check_status();
+
+    masm.bind(done);
+    masm.sub(Asm::r12, value_size);
+}
+
+void JitCompiler::integral(OperatorType type, Asm::Label generic)
+{
+    masm.load(Asm::rax, Asm::rax, layout().integral);
+    masm.load(Asm::rcx, Asm::rcx, layout().integral);
+
+    Asm::Condition condition = Asm::Equal;
+    switch (type)
+    {
+    case OperatorTypes::Plus  : masm.add(Asm::rax, Asm::rcx); break;
+    case OperatorTypes::Minus : masm.sub(Asm::rax, Asm::rcx); break;
+    case OperatorTypes::Mult  : masm.imul(Asm::rax, Asm::rcx); break;
+
+    case OperatorTypes::Div:
+    case OperatorTypes::Mod:
+        // idiv traps on these, the generic path does what it does
+        masm.test(Asm::rcx, Asm::rcx);
+        masm.j(Asm::Equal, generic);
+        masm.cmp(Asm::rcx, -1);
+        masm.j(Asm::Equal, generic);
+        masm.cqo();
+        masm.idiv(Asm::rcx);
+        if (type == OperatorTypes::Mod)
+            masm.mov(Asm::rax, Asm::rdx);
+        break;
+
+    default:
+        switch (type)
+        {
+        case OperatorTypes::Less      : condition = Asm::Less; break;
+        case OperatorTypes::Greater   : condition = Asm::Greater; break;
+        case OperatorTypes::LessEq    : condition = Asm::LessEqual; break;
+        case OperatorTypes::GreaterEq : condition = Asm::GreaterEqual; break;
+        case OperatorTypes::NotEqual  : condition = Asm::NotEqual; break;
+        default                       : condition = Asm::Equal; break;
+        }
+        masm.cmp(Asm::rax, Asm::rcx);
+        masm.set(condition, Asm::rax);
+        masm.mov(Asm::rsi, Asm::rax);
+        masm.lea(Asm::rdi, Asm::r12, -2 * value_size);
+        masm.call(address(&JitCompiler::box_bool));
+        return;
+    }
+
+    masm.mov(Asm::rsi, Asm::rax);
+    masm.lea(Asm::rdi, Asm::r12, -2 * value_size);
+    masm.call(address(&JitCompiler::box_integral));
+}
+
+void JitCompiler::rational(OperatorType type)
+{
+    masm.movsd(Asm::xmm0, Asm::rax, layout().rational);
+    masm.movsd(Asm::xmm1, Asm::rcx, layout().rational);
+
+    switch (type)
+    {
+    case OperatorTypes::Plus  : masm.addsd(Asm::xmm0, Asm::xmm1); break;
+    case OperatorTypes::Minus : masm.subsd(Asm::xmm0, Asm::xmm1); break;
+    case OperatorTypes::Mult  : masm.mulsd(Asm::xmm0, Asm::xmm1); break;
+    case OperatorTypes::Div   : masm.divsd(Asm::xmm0, Asm::xmm1); break;
+
+    default:
+        // an unordered comparison (NaN) sets ZF, PF and CF: only != is true then
+        switch (type)
+        {
+        case OperatorTypes::Less:
+            masm.ucomisd(Asm::xmm1, Asm::xmm0);
+            masm.set(Asm::Above, Asm::rax);
+            break;
+        case OperatorTypes::Greater:
+            masm.ucomisd(Asm::xmm0, Asm::xmm1);
+            masm.set(Asm::Above, Asm::rax);
+            break;
+        case OperatorTypes::LessEq:
+            masm.ucomisd(Asm::xmm1, Asm::xmm0);
+            masm.set(Asm::AboveEqual, Asm::rax);
+            break;
+        case OperatorTypes::GreaterEq:
+            masm.ucomisd(Asm::xmm0, Asm::xmm1);
+            masm.set(Asm::AboveEqual, Asm::rax);
+            break;
+        case OperatorTypes::NotEqual:
+            masm.ucomisd(Asm::xmm0, Asm::xmm1);
+            masm.set(Asm::NotEqual, Asm::rax);
+            masm.set(Asm::Parity, Asm::rcx);
+            masm.or_32(Asm::rax, Asm::rcx);
+            break;
+        default:
+            masm.ucomisd(Asm::xmm0, Asm::xmm1);
+            masm.set(Asm::Equal, Asm::rax);
+            masm.set(Asm::NoParity, Asm::rcx);
+            masm.and_32(Asm::rax, Asm::rcx);
+            break;
+        }
+        masm.mov(Asm::rsi, Asm::rax);
+        masm.lea(Asm::rdi, Asm::r12, -2 * value_size);
+        masm.call(address(&JitCompiler::box_bool));
+        return;
+    }
+
+    masm.lea(Asm::rdi, Asm::r12, -2 * value_size);
+    masm.call(address(&JitCompiler::box_rational));
+}
+
+void JitCompiler::copy(WS::SP_Object* to, const WS::SP_Object* from)
+{
+    *to = *from;
+}
+
+void JitCompiler::clear(WS::SP_Object* obj)
+{
+    obj->clear();
+}
+
+int JitCompiler::load_local(State* state, WS::SP_Object* to, const WS::SP_Object* variable, int name)
+{
+    if (*variable == NULL)
+    {
+        const Chunk::Name& identifier = state->chunk->names[name];
+        state->error = std::make_exception_ptr(InterpretError(
+                QString("Line %1: Identifier not found: '%2'").arg(identifier.line).arg(identifier.text)));
+        return 1;
+    }
+
+    *to = *variable;
+    return 0;
+}
+
+int JitCompiler::load_name(State* state, WS::SP_Object* to, int name)
+{
+    try
+    {
+        const Chunk::Name& identifier = state->chunk->names[name];
+        *to = state->interpreter->read(identifier.binding, identifier.text, identifier.line);
+        return 0;
+    }
+    catch (...)
+    {
+        state->error = std::current_exception();
+        return 1;
+    }
+}
+
+void JitCompiler::assign_name(State* state, const WS::SP_Object* value, int name)
+{
+    state->interpreter->assign(state->chunk->names[name].binding, *value);
+}
+
+int JitCompiler::unary(State* state, WS::SP_Object* argument, int type, int operand, int pc)
+{
+    try
+    {
+        WS::SP_Object& obj = *argument;
+        WS::SP_Object res;
+        if (operand != WSTypes::Base && obj->__type__() == operand)
+            res = TypedOperators::unary(OperatorType(type), WSType(operand), obj.data());
+
+        if (res == NULL)
+        {
+            QString method_name = OperatorTypes::to_string(OperatorType(type));
+
+            state->interpreter->stack.push( QString("Line %1: ").arg(state->chunk->line_at(pc)) + obj->__repr__() + " " + method_name );
+            res = obj->invoke(method_name, WS::ObjectList());
+            state->interpreter->stack.pop();
+
+            if (res == NULL)
+                res = WS::SP_Object(new WS::None());
+        }
+
+        obj = res;
+        return 0;
+    }
+    catch (...)
+    {
+        state->error = std::current_exception();
+        return 1;
+    }
+}
+
+int JitCompiler::binary(State* state, WS::SP_Object* left, int type, int operands, int pc)
+{
+    try
+    {
+        WS::SP_Object& obj = left[0];
+        WS::SP_Object& right = left[1];
+        WS::SP_Object res;
+        if (operands != WSTypes::Base && obj->__type__() == operands && right->__type__() == operands)
+            res = TypedOperators::binary(OperatorType(type), WSType(operands), obj.data(), right.data());
+
+        if (res == NULL)
+        {
+            WS::ObjectList args;
+            args.append(right);
+
+            const QString method_name = OperatorTypes::to_string(OperatorType(type));
+            state->interpreter->stack.push( QString("Line %1: ").arg(state->chunk->line_at(pc)) + obj->__repr__() + "." + method_name );
+            res = obj->invoke(method_name, args);
+            state->interpreter->stack.pop();
+
+            if (res == NULL)
+                res = WS::SP_Object(new WS::None());
+        }
+
+        obj = res;
+        right.clear();
+        return 0;
+    }
+    catch (...)
+    {
+        state->error = std::current_exception();
+        return 1;
+    }
+}
+
+void JitCompiler::box_integral(WS::SP_Object* left, qint64 value)
+{
+    left[0] = WS::SP_Object(new WS::Integral(value));
+    left[1].clear();
+}
+
+void JitCompiler::box_rational(WS::SP_Object* left, double value)
+{
+    left[0] = WS::SP_Object(new WS::Rational(value));
+    left[1].clear();
+}
+
+void JitCompiler::box_bool(WS::SP_Object* left, int value)
+{
+    left[0] = WS::SP_Object(new WS::Bool(value != 0));
+    left[1].clear();
+}
+
+int JitCompiler::check_function(State* state, WS::SP_Object* function, int pc)
+{
+    const WS::SP_Object& obj = *function;
+    if (obj->__type__() == WSTypes::Function)
+        return 0;
+
+    state->error = std::make_exception_ptr(InterpretError(
+            QString("Line %1: Not a function: '%2'").arg(state->chunk->line_at(pc)).arg(obj->__repr__())));
+    return 1;
+}
+
+int JitCompiler::call(State* state, WS::SP_Object* function, int count, int pc)
+{
+    try
+    {
+        QSharedPointer<WS::Function> fnc = function->staticCast<WS::Function>();
+
+        WS::ObjectList args;
+        for (int i = 1; i <= count; ++i)
+            args.append(function[i]);
+
+        if (!fnc->check_num_arguments( args.size() ))
+            throw WrongNumberOfArgumentsError(args.size());
+
+        state->interpreter->stack.push( QString("Line %1: ").arg(state->chunk->line_at(pc)) + fnc->__repr__() );
+        WS::SP_Object res = (*fnc)(args);
+        state->interpreter->stack.pop();
+        if (res == NULL)
+            res = WS::SP_Object(new WS::None());
+
+        for (int i = 1; i <= count; ++i)
+            function[i].clear();
+        *function = res;
+        return 0;
+    }
+    catch (...)
+    {
+        state->error = std::current_exception();
+        return 1;
+    }
+}
+
+int JitCompiler::method(State* state, WS::SP_Object* obj, int name, int count, int pc)
+{
+    try
+    {
+        const QString& method_name = state->chunk->names[name].text;
+
+        WS::ObjectList args;
+        for (int i = 1; i <= count; ++i)
+            args.append(obj[i]);
+
+        state->interpreter->stack.push( QString("Line %1: ").arg(state->chunk->line_at(pc)) + (*obj)->__repr__() + "." + method_name );
+        WS::SP_Object res = (*obj)->invoke(method_name, args);
+        state->interpreter->stack.pop();
+
+        if (res == NULL)
+            res = WS::SP_Object(new WS::None());
+
+        for (int i = 1; i <= count; ++i)
+            obj[i].clear();
+        *obj = res;
+        return 0;
+    }
+    catch (...)
+    {
+        state->error = std::current_exception();
+        return 1;
+    }
+}
+
+void JitCompiler::define(State* state, WS::SP_Object* function)
+{
+    static_cast<WS::UserFunction*>(function->data())->set_interpreter(state->interpreter);
+}
+
+int JitCompiler::condition(State* state, WS::SP_Object* value)
+{
+    WS::SP_Object cond_expr = *value;
+    value->clear();
+
+    // what __bool__ of a Bool gives, without the call
+    if (cond_expr->__type__() == WSTypes::Bool)
+        return static_cast<WS::Bool*>(cond_expr.data())->value() ? 1 : 0;
+
+    try
+    {
+        return cond_expr->invoke("__bool__", WS::ObjectList()).staticCast<WS::Bool>()->value() ? 1 : 0;
+    }
+    catch (...)
+    {
+        state->error = std::current_exception();
+        return -1;
+    }
+}
+
+void JitCompiler::return_value(State* state, WS::SP_Object* value)
+{
+    state->result = *value;
+    value->clear();
+}
+
+void JitCompiler::interrupt(State* state)
+{
+    state->error = std::make_exception_ptr(InterruptError());
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "Bytecode.h"
+#include "Jit.h"
+#include "X86Assembler.h"
+
+#include <exception>
+
+namespace VTScript
+{
+    /*
+        Translates the bytecode of a function body to x86-64 machine code, one template
+        per instruction, with no dispatch left between them. The operand stack and the
+        variables stay where the bytecode loop keeps them; what the loop does in C++ is
+        done by calling the functions below it, which do exactly that.
+
+        Binary operators on integers and doubles are done in registers when both
+        operands are Integral, or both Rational: the guards compare the classes of the
+        operands, the result is boxed by one call. Anything else, and integer division
+        by 0 or -1, goes to the generic path. Operators TypeInference typed get only the
+        guard of their type, untyped ones both.
+
+        The called functions never throw across the machine code, which has no unwind
+        information: they keep the exception and return an error, the machine code
+        returns, run() throws it again.
+    */
+    class JitCompiler
+    {
+    public:
+        // machine code of a function body, NULL on another platform or if its memory couldn't be had
+        static Jit::Code* compile(Interpreter* interpreter, const Bytecode::Chunk& chunk);
+
+        // runs the machine code of 'chunk' in the running frame from the instruction at 'pc', which
+        // has to be an entry, with the operand stack empty at 'operands'; returns what it returns
+        static WS::SP_Object run(Interpreter* interpreter, const Jit::Code& code, const Bytecode::Chunk& chunk,
+                                 WS::SP_Object* operands, int pc);
+
+    private:
+        // what the called functions need to know
+        struct State
+        {
+            Interpreter* interpreter;
+            const Bytecode::Chunk* chunk;
+            WS::SP_Object result;               // of Return
+            std::exception_ptr error;           // thrown by a called function
+        };
+
+        // (state, operand stack, variables, where to start); 0 when it returned, 1 when something threw
+        typedef int (*Entry)(State* state, WS::SP_Object* operands, WS::SP_Object* values, const void* start);
+
+        JitCompiler(Interpreter* interpreter, const Bytecode::Chunk& chunk) : interpreter(interpreter), chunk(chunk) {}
+
+        void prologue();
+        // the exits: returned, error, interrupted
+        void epilogue();
+        void instruction(int pc);
+        void binary_operator(int pc, OperatorType type, WSType operands);
+        // the register part of an integer or a double operator, after the guards; integral()
+        // leaves division by 0 and -1 to 'generic'
+        void integral(OperatorType type, Jit::X86Assembler::Label generic);
+        void rational(OperatorType type);
+        // jumps to the error exit unless the called function returned 0
+        void check_status();
+
+        // the called functions; those returning int return 0, or 1 if something threw
+        static void copy(WS::SP_Object* to, const WS::SP_Object* from);
+        static void clear(WS::SP_Object* obj);
+        static int load_local(State* state, WS::SP_Object* to, const WS::SP_Object* variable, int name);
+        static int load_name(State* state, WS::SP_Object* to, int name);
+        static void assign_name(State* state, const WS::SP_Object* value, int name);
+        static int unary(State* state, WS::SP_Object* argument, int type, int operand, int pc);
+        static int binary(State* state, WS::SP_Object* left, int type, int operands, int pc);
+        static void box_integral(WS::SP_Object* left, qint64 value);
+        static void box_rational(WS::SP_Object* left, double value);
+        static void box_bool(WS::SP_Object* left, int value);
+        static int check_function(State* state, WS::SP_Object* function, int pc);
+        static int call(State* state, WS::SP_Object* function, int count, int pc);
+        static int method(State* state, WS::SP_Object* obj, int name, int count, int pc);
+        static void define(State* state, WS::SP_Object* function);
+        // 1 if it's true, 0 if not, -1 if __bool__ threw; empties the operand
+        static int condition(State* state, WS::SP_Object* value);
+        static void return_value(State* state, WS::SP_Object* value);
+        static void interrupt(State* state);
+
+        Interpreter* interpreter;
+        const Bytecode::Chunk& chunk;
+        Jit::X86Assembler masm;
+        QVector<Jit::X86Assembler::Label> labels;   // of every bytecode pc an instruction starts at
+        Jit::X86Assembler::Label returned;
+        Jit::X86Assembler::Label error_exit;
+        Jit::X86Assembler::Label interrupted;
+    };
+
+};
@@ -0,0 +1,463 @@
+#include "Lexer.h"
+#include "Errors.h"
+#include "CharScan.h"
+
+#include <QThread>
+#include <QtConcurrentMap>
+
+using namespace VTScript;
+
+const Lexer::CharTable Lexer::table;
+const QString Lexer::script_begin( "{" );
+const QString Lexer::script_end( "}" );
+const QString Lexer::eof( "" );
+int Lexer::parallel_threshold = 1 << 20;
+
+namespace
+{
+    // below this chunks are not worth a thread
+    const int min_chunk_size = 1 << 16;
+}
+
+
+Lexer::CharTable::CharTable()
+{
+    for ( int i = 0; i < 128; ++i )
+    {
+        classes[i] = Invalid;
+        codes[i] = TokenCodes::Nothing;
+        eq_codes[i] = TokenCodes::Nothing;
+    }
+
+    for ( int c = 'a'; c <= 'z'; ++c )
+        classes[c] = Letter;
+    for ( int c = 'A'; c <= 'Z'; ++c )
+        classes[c] = Letter;
+    for ( int c = '0'; c <= '9'; ++c )
+        classes[c] = Digit;
+
+    classes['_'] = Letter;
+    classes[' '] = Space;
+    classes['\t'] = Space;
+    classes['\n'] = LineFeed;
+    classes['\r'] = CarriageReturn;
+    classes['.'] = Dot;
+    classes['"'] = Quote;
+    classes['\''] = Quote;
+    classes['/'] = Slash;
+
+    const char* compare = "=<>!";
+    for ( const char* c = compare; *c; ++c )
+        classes[static_cast<int>(*c)] = Compare;
+
+    const char* single = "+-*%(){}[];,";
+    for ( const char* c = single; *c; ++c )
+        classes[static_cast<int>(*c)] = Single;
+
+    const char* operators = "=<>+-*/%(){}[];.,";
+    for ( const char* c = operators; *c; ++c )
+    {
+        QChar text[2] = { QChar(*c), QChar('=') };
+        codes[static_cast<int>(*c)] = TokenCodes::operator_code( text, 1 );
+    }
+    for ( const char* c = compare; *c; ++c )
+    {
+        QChar text[2] = { QChar(*c), QChar('=') };
+        eq_codes[static_cast<int>(*c)] = TokenCodes::operator_code( text, 2 );
+    }
+}
+
+/*
+    Regex lexer used "operator.+(?=\()" for this: "operator" followed by at least one character,
+    up to the last "(" it can find. Tokens never span lines, so the search stops at line end.
+*/
+int Lexer::scan_operator_identifier( const QChar* data, int start, int size )
+{
+    static const char prefix[] = "operator";
+    static const int prefix_len = sizeof(prefix) - 1;
+
+    if ( size - start <= prefix_len )
+        return -1;
+
+    for ( int i = 0; i < prefix_len; ++i )
+        if ( data[start + i].unicode() != static_cast<ushort>(prefix[i]) )
+            return -1;
+
+    int end = -1;
+    for ( int i = start + prefix_len; i < size; ++i )
+    {
+        ushort c = data[i].unicode();
+        if ( c == '\n' || c == '\r' )
+            break;
+        if ( c == '(' && i > start + prefix_len )
+            end = i;
+    }
+
+    return end;
+}
+
+QVector<Token> Lexer::lex( const QString& source, IdentifierTable& identifiers )
+{
+    QVector<Token> tokens;
+    ulong line = 1;
+
+    tokens << Token(Token::Operator, &script_begin, line, TokenCodes::LeftBrace);
+
+    if ( parallel_threshold >= 0 && source.size() >= parallel_threshold && QThread::idealThreadCount() > 1 )
+        line = lex_parallel( source, tokens, identifiers );
+    else
+        line = lex_range( source, 0, source.size(), line, tokens, identifiers );
+
+    tokens << Token(Token::Operator, &script_end, line, TokenCodes::RightBrace);
+    tokens << Token(Token::Eof, &eof, line);
+    return tokens;
+}
+
+QVector<Token> Lexer::lex( const QString& source, int begin, int end, ulong line, IdentifierTable& identifiers )
+{
+    QVector<Token> tokens;
+
+    tokens << Token(Token::Operator, &script_begin, line, TokenCodes::LeftBrace);
+    line = lex_range( source, begin, end, line, tokens, identifiers );
+    tokens << Token(Token::Operator, &script_end, line, TokenCodes::RightBrace);
+    tokens << Token(Token::Eof, &eof, line);
+    return tokens;
+}
+
+/*
+    Chunks end right after a '\n', so each of them starts at the beginning of a line.
+    Every chunk is lexed as if it started at line 0, then its tokens are shifted by the number
+    of newlines in all preceding chunks.
+    Identifiers are interned into a table per chunk; merging chunks in order re-interns
+    them into the shared table, so ids come out the same as with serial lexing.
+*/
+ulong Lexer::lex_parallel( const QString& source, QVector<Token>& tokens, IdentifierTable& identifiers )
+{
+    const int size = source.size();
+    const int threads = QThread::idealThreadCount();
+    const int chunk_size = qMax( min_chunk_size, size / threads + 1 );
+
+    QVector<Chunk> chunks;
+    int begin = 0;
+
+    while ( begin < size )
+    {
+        int end = size;
+        if ( begin + chunk_size < size )
+        {
+            int newline = source.indexOf( QChar('\n'), begin + chunk_size );
+            if ( newline != -1 )
+                end = newline + 1;
+        }
+
+        Chunk chunk = { &source, begin, end, QVector<Token>(), IdentifierTable(), 0, false };
+        chunks << chunk;
+        begin = end;
+    }
+
+    if ( chunks.size() < 2 )
+        return lex_range( source, 0, size, 1, tokens, identifiers );
+
+    QtConcurrent::blockingMap( chunks, &Lexer::lex_chunk );
+
+    int total = 0;
+    for ( int i = 0; i < chunks.size(); ++i )
+    {
+        // relex serially so that error reports the right line
+        if ( chunks[i].failed )
+            return lex_range( source, 0, size, 1, tokens, identifiers );
+        total += chunks[i].tokens.size();
+    }
+
+    tokens.reserve( tokens.size() + total );
+
+    ulong line = 1;
+    for ( int i = 0; i < chunks.size(); ++i )
+    {
+        const QVector<Token>& chunk_tokens = chunks[i].tokens;
+        const IdentifierTable& chunk_identifiers = chunks[i].identifiers;
+        QVector<int> symbols( chunk_identifiers.size(), -1 );
+
+        for ( int j = 0; j < chunk_tokens.size(); ++j )
+        {
+            tokens << chunk_tokens[j];
+            tokens.last().set_line( chunk_tokens[j].line() + line );
+
+            int symbol = chunk_tokens[j].symbol();
+            if ( symbol != -1 )
+            {
+                if ( symbols[symbol] == -1 )
+                    symbols[symbol] = identifiers.intern( chunk_identifiers.name(symbol) );
+                tokens.last().set_symbol( symbols[symbol] );
+            }
+        }
+        line += chunks[i].newlines;
+    }
+
+    return line;
+}
+
+void Lexer::lex_chunk( Chunk& chunk )
+{
+    try
+    {
+        chunk.newlines = lex_range( *chunk.source, chunk.begin, chunk.end, 0, chunk.tokens, chunk.identifiers );
+    }
+    catch ( const LexError& )
+    {
+        chunk.failed = true;
+    }
+}
+
+void Lexer::lex_line( const QString& line, QVector<Token>& tokens )
+{
+    tokens.clear();
+    scan<Highlight>( line, 0, line.size(), 1, tokens, NULL );
+}
+
+/*
+    In Highlight mode errors don't throw but become Error tokens (a single character,
+    or the rest of the line for unterminated literal), comments are kept as Comment tokens
+    and identifiers aren't interned. 'mode' is a template argument, so Compile mode
+    doesn't pay for any of this.
+*/
+template <Lexer::Mode mode>
+ulong Lexer::scan( const QString& source, int begin, int end, ulong line,
+                   QVector<Token>& tokens, IdentifierTable* identifiers )
+{
+    const QChar* data = source.constData();
+    const int size = end;
+    int position = begin;
+
+    while ( position < size )
+    {
+        const int start = position;
+        const ushort c = data[position].unicode();
+        const ushort next = ( position + 1 < size ) ? data[position + 1].unicode() : 0;
+
+        switch ( char_class(c) )
+        {
+        case Space:
+            position = CharScan::skip_whitespace( data, position + 1, size );
+            break;
+
+        case LineFeed:
+            ++position;
+            ++line;
+            break;
+
+        case CarriageReturn:
+            if ( next != '\n' )
+            {
+                if ( mode == Highlight )
+                {
+                    ++position;
+                    tokens << Token( Token::Error, &source, start, 1, line );
+                    break;
+                }
+                throw LexError( QString("Couldn't match any token in line %1").arg(line) );
+            }
+            position += 2;
+            ++line;
+            break;
+
+        case Letter:
+            {
+                position = CharScan::skip_identifier( data, position + 1, size );
+
+                int operator_end = scan_operator_identifier( data, start, size );
+                if ( operator_end > position )
+                    position = operator_end;
+
+                const int length = position - start;
+                TokenCode keyword = TokenCodes::keyword_code( data + start, length );
+                if ( keyword != TokenCodes::Nothing )
+                    tokens << Token( Token::Keyword, &source, start, length, line, keyword );
+                else if ( mode == Highlight )
+                    tokens << Token( Token::Identifier, &source, start, length, line );
+                else
+                    tokens << Token( Token::Identifier, &source, start, length, line, identifiers->intern( data + start, length ) );
+            }
+            break;
+
+        case Digit:
+            {
+                position = CharScan::skip_digits( data, position + 1, size );
+
+                Token::Type type = Token::Integral;
+                if ( position + 1 < size && data[position].unicode() == '.' && is_digit( data[position + 1].unicode() ) )
+                {
+                    type = Token::Rational;
+                    position = CharScan::skip_digits( data, position + 2, size );
+                }
+
+                tokens << Token( type, &source, start, position - start, line );
+            }
+            break;
+
+        case Dot:
+            if ( is_digit(next) )
+            {
+                position = CharScan::skip_digits( data, position + 2, size );
+                tokens << Token( Token::Rational, &source, start, position - start, line );
+            }
+            else
+            {
+                ++position;
+                tokens << Token( Token::Operator, &source, start, 1, line, TokenCodes::Dot );
+            }
+            break;
+
+        case Quote:
+            {
+                ++position;
+                while ( position < size )
+                {
+                    ushort q = data[position].unicode();
+                    if ( q == c || q == '\n' || q == '\r' )
+                        break;
+                    ++position;
+                }
+
+                if ( position == size || data[position].unicode() != c )
+                {
+                    if ( mode == Highlight )
+                    {
+                        tokens << Token( Token::Error, &source, start, position - start, line );
+                        break;
+                    }
+                    throw LexError( QString("Couldn't match any token in line %1").arg(line) );
+                }
+
+                ++position;
+                tokens << Token( Token::Literal, &source, start + 1, position - start - 2, line );
+            }
+            break;
+
+        case Slash:
+            if ( next == '/' )
+            {
+                position = CharScan::find_line_end( data, position + 2, size );
+                if ( mode == Highlight )
+                    tokens << Token( Token::Comment, &source, start, position - start, line );
+            }
+            else
+            {
+                ++position;
+                tokens << Token( Token::Operator, &source, start, 1, line, TokenCodes::Div );
+            }
+            break;
+
+        case Compare:
+            if ( next == '=' )
+            {
+                position += 2;
+                tokens << Token( Token::Operator, &source, start, 2, line, table.eq_codes[c] );
+            }
+            else if ( c == '!' )
+            {
+                if ( mode == Highlight )
+                {
+                    ++position;
+                    tokens << Token( Token::Error, &source, start, 1, line );
+                    break;
+                }
+                throw LexError( QString("Couldn't match any token in line %1").arg(line) );
+            }
+            else
+            {
+                ++position;
+                tokens << Token( Token::Operator, &source, start, 1, line, table.codes[c] );
+            }
+            break;
+
+        case Single:
+            ++position;
+            tokens << Token( Token::Operator, &source, start, 1, line, table.codes[c] );
+            break;
+
+        case Invalid:
+        default:
+            if ( mode == Highlight )
+            {
+                ++position;
+                tokens << Token( Token::Error, &source, start, 1, line );
+                break;
+            }
+            throw LexError( QString("Couldn't match any token in line %1").arg(line) );
+        }
+    }
+
+    return line;
+}
+
+
+StreamLexer::StreamLexer( QIODevice* device, IdentifierTable& identifiers, int chunk_size ) :
+    stream( device ), identifiers( identifiers ), chunk_size( chunk_size ),
+    state( Initial ), line( 1 ), current_buffer( 0 )
+{
+}
+
+bool StreamLexer::read_chunk( QString& buffer )
+{
+    const int start = buffer.size();
+    buffer += pending;
+    pending.clear();
+
+    while ( !stream.atEnd() )
+    {
+        buffer += stream.read( chunk_size );
+
+        int newline = buffer.lastIndexOf( QChar('\n') );
+        if ( newline >= start )
+        {
+            pending = buffer.mid( newline + 1 );
+            buffer.truncate( newline + 1 );
+            return true;
+        }
+    }
+
+    return buffer.size() > start;
+}
+
+bool StreamLexer::next_batch( QVector<Token>& tokens )
+{
+    if ( state == Finished )
+        return false;
+
+    tokens.clear();
+
+    if ( state == Initial )
+    {
+        tokens << Token( Token::Operator, &Lexer::script_begin, line, TokenCodes::LeftBrace );
+        state = Reading;
+        return true;
+    }
+
+    /*
+        Chunks with only whitespace and comments don't make a batch, they are kept in
+        front of the next chunk instead: the buffers of consecutive batches always cover
+        the source without gaps, see Parser::skip_function_body.
+    */
+    QString& buffer = buffers[1 - current_buffer];
+    buffer.clear();
+
+    while ( tokens.isEmpty() )
+    {
+        const int lexed = buffer.size();
+
+        if ( !read_chunk( buffer ) )
+        {
+            tokens << Token( Token::Operator, &Lexer::script_end, line, TokenCodes::RightBrace );
+            tokens << Token( Token::Eof, &Lexer::eof, line );
+            state = Finished;
+            break;
+        }
+
+        line = Lexer::lex_range( buffer, lexed, buffer.size(), line, tokens, identifiers );
+        if ( !tokens.isEmpty() )
+            current_buffer = 1 - current_buffer;
+    }
+
+    return true;
+}
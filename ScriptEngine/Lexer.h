@@ -0,0 +1,163 @@
+#pragma once
+
+#include "Token.h"
+#include "Identifiers.h"
+
+#include <QString>
+#include <QVector>
+#include <QTextStream>
+
+namespace VTScript
+{
+    /*
+        Single pass lexer.
+
+        Every character is classified once through a lookup table and the token kind
+        is decided by a hand-coded DFA (switch over the class of the first character),
+        so the cost is linear in the size of the source and independent of the number
+        of token types. Long runs (whitespace, identifiers, numbers, comments) are
+        skipped with vectorized CharScan routines.
+        Produces exactly the same token stream as the regex lexer did:
+            - leading "{" and trailing "}" + EOF tokens around the script
+            - whitespace, newlines and comments are dropped, newlines bump line counter
+            - literal quotes are stripped
+            - keywords are recognized among identifiers
+            - operators and keywords get their TokenCode, identifiers are interned
+            - "operator<anything>(" is lexed as a single identifier
+
+        No token spans a newline, so sources bigger than parallel threshold are split
+        at line boundaries and the chunks are lexed concurrently.
+    */
+    class Lexer
+    {
+    public:
+        // throws LexError; tokens reference 'source', it has to outlive them
+        static QVector<Token> lex( const QString& source, IdentifierTable& identifiers );
+        // lexes only source[begin, end) that starts at 'line', wrapped the same way as whole source
+        static QVector<Token> lex( const QString& source, int begin, int end, ulong line, IdentifierTable& identifiers );
+
+        /*
+            Lexes one line for syntax highlighting into 'tokens': never throws, keeps comments,
+            turns what doesn't lex into Error tokens; identifiers aren't interned.
+        */
+        static void lex_line( const QString& line, QVector<Token>& tokens );
+
+        // sources of at least 'chars' characters are lexed in parallel; negative value disables it
+        static void set_parallel_threshold( int chars ) { parallel_threshold = chars; }
+        static int get_parallel_threshold() { return parallel_threshold; }
+
+        // text of the tokens that don't come from source
+        static const QString script_begin;
+        static const QString script_end;
+        static const QString eof;
+
+    private:
+        friend class StreamLexer;
+
+        struct Chunk
+        {
+            const QString* source;
+            int begin;
+            int end;
+            QVector<Token> tokens;
+            IdentifierTable identifiers;    // chunk-local ids, remapped when chunks are merged
+            ulong newlines;
+            bool failed;
+        };
+
+        enum Mode
+        {
+            Compile,
+            Highlight
+        };
+
+        // lexes [begin, end) appending to 'tokens'; returns line number at 'end'
+        template <Mode mode>
+        static ulong scan( const QString& source, int begin, int end, ulong line,
+                           QVector<Token>& tokens, IdentifierTable* identifiers );
+
+        // throws LexError
+        static ulong lex_range( const QString& source, int begin, int end, ulong line,
+                                QVector<Token>& tokens, IdentifierTable& identifiers )
+        { return scan<Compile>( source, begin, end, line, tokens, &identifiers ); }
+
+        // returns line number at the end of source
+        static ulong lex_parallel( const QString& source, QVector<Token>& tokens, IdentifierTable& identifiers );
+        static void lex_chunk( Chunk& chunk );
+
+        enum CharClass
+        {
+            Invalid = 0,
+            Space,          // ' ' '\t'
+            LineFeed,       // '\n'
+            CarriageReturn, // '\r'
+            Letter,         // [_A-Za-z]
+            Digit,          // [0-9]
+            Dot,            // '.'
+            Quote,          // '"' '\''
+            Slash,          // '/'
+            Compare,        // '=' '<' '>' '!', may be followed by '='
+            Single          // single character operators
+        };
+
+        struct CharTable
+        {
+            CharTable();
+            unsigned char classes[128];
+            unsigned char codes[128];       // TokenCode of single character operators
+            unsigned char eq_codes[128];    // TokenCode of the operator followed by '='
+        };
+
+        static inline CharClass char_class( ushort c )
+        { return c < 128 ? static_cast<CharClass>( table.classes[c] ) : Invalid; }
+
+        static inline bool is_digit( ushort c ) { return c >= '0' && c <= '9'; }
+
+        // returns end of "operator...(" identifier starting at 'start' or -1 if there is none
+        static int scan_operator_identifier( const QChar* data, int start, int size );
+
+        static const CharTable table;
+        static int parallel_threshold;
+    };
+
+    /*
+        Lexes a device a chunk at a time, for sources too big to keep in memory together
+        with all of their tokens. Chunks are cut after a newline (tokens never span lines)
+        and every call to next_batch() returns the tokens of the next non-empty chunk,
+        wrapped in the same "{" ... "}" EOF tokens as Lexer::lex() produces.
+
+        Tokens of a batch reference a buffer that stays valid until the batch after
+        the next one is read.
+    */
+    class StreamLexer
+    {
+    public:
+        StreamLexer( QIODevice* device, IdentifierTable& identifiers, int chunk_size = default_chunk_size );
+
+        // throws LexError; replaces 'tokens' with the next batch, returns false if there are no more
+        bool next_batch( QVector<Token>& tokens );
+
+        static const int default_chunk_size = 1 << 16;
+
+    private:
+        // appends next chunk ending with a newline (or at end of device) to 'buffer'
+        bool read_chunk( QString& buffer );
+
+        enum State
+        {
+            Initial,
+            Reading,
+            Finished
+        };
+
+        QTextStream stream;
+        IdentifierTable& identifiers;
+        const int chunk_size;
+        State state;
+        ulong line;
+        QString buffers[2];     // batches alternate between them
+        int current_buffer;
+        QString pending;        // read, but after the last newline of previous chunk
+    };
+
+};
@@ -0,0 +1,319 @@
+#include "LoopInvariants.h"
+#include "Builtin.h"
+
+using namespace VTScript;
+
+namespace
+{
+    // a call of a builtin whose value only depends on its arguments
+    bool is_pure_call(AST::FunctionCall* node)
+    {
+        AST::Leaf* fnc = dynamic_cast<AST::Leaf*>(node->function_object());
+        if (fnc == NULL || !fnc->is_identifier() || fnc->binding().count != 0 || fnc->binding().builtin == NULL)
+            return false;
+
+        const QHash<QString, WS::SP_Object>& builtins = Builtin::table();
+        const WS::SP_Object* builtin = fnc->binding().builtin;
+        return builtin == &builtins.constFind("int").value() || builtin == &builtins.constFind("double").value()
+                || builtin == &builtins.constFind("bool").value();
+    }
+
+    /*
+        Collects the slots of the function's frame a loop writes: assigned variables,
+        declared functions and variables of blocks, which are emptied on every exit.
+        Nested functions write their own frames only.
+    */
+    class LoopWrites : public ASTTools::NodeVisitor
+    {
+    public:
+        LoopWrites(QSet<int>& written) : written(written) {}
+
+        VISITOR_METHODS
+
+    private:
+        void write(const AST::Binding& binding)
+        {
+            for (int i = 0; i < binding.count; ++i)
+                written.insert(binding.addresses[i].slot);
+        }
+
+        QSet<int>& written;
+    };
+
+    void LoopWrites::visit(AST::Noop* /*node*/)
+    {
+    }
+
+    void LoopWrites::visit(AST::Leaf* /*node*/)
+    {
+    }
+
+    void LoopWrites::visit(AST::FunctionCall* node)
+    {
+        node->function_object()->accept(this);
+
+        foreach(AST::Expression* expr, node->arguments_expressions())
+            expr->accept(this);
+    }
+
+    void LoopWrites::visit(AST::UnaryOperator* node)
+    {
+        node->argument()->accept(this);
+    }
+
+    void LoopWrites::visit(AST::BinaryOperator* node)
+    {
+        if (node->type() == OperatorTypes::Assign)
+            write(static_cast<AST::Leaf*>(node->left())->binding());
+        else
+            node->left()->accept(this);
+
+        node->right()->accept(this);
+    }
+
+    void LoopWrites::visit(AST::Return* node)
+    {
+        node->expr()->accept(this);
+    }
+
+    void LoopWrites::visit(AST::Continue* /*node*/)
+    {
+    }
+
+    void LoopWrites::visit(AST::Break* /*node*/)
+    {
+    }
+
+    void LoopWrites::visit(AST::Block* node)
+    {
+        for (int i = 0; i < node->scope_slot_count(); ++i)
+            written.insert(node->scope_slots()[i]);
+
+        foreach(AST::Node* stmt, node->values())
+            stmt->accept(this);
+    }
+
+    void LoopWrites::visit(AST::FunctionDeclaration* node)
+    {
+        write(node->binding());
+    }
+
+    void LoopWrites::visit(AST::While* node)
+    {
+        node->condition()->accept(this);
+        node->body()->accept(this);
+    }
+
+    void LoopWrites::visit(AST::If* node)
+    {
+        node->condition()->accept(this);
+        node->then_stmt()->accept(this);
+        node->else_stmt()->accept(this);
+    }
+
+
+    /*
+        Whether an expression has no side effects and reads none of 'written'.
+        Variables of other frames can't change while the function runs a loop.
+    */
+    class Invariance : public ASTTools::NodeVisitor
+    {
+    public:
+        Invariance(const QSet<int>& written) : invariant(true), written(written) {}
+
+        VISITOR_METHODS
+
+        bool invariant;
+
+    private:
+        const QSet<int>& written;
+    };
+
+    void Invariance::visit(AST::Noop* /*node*/)
+    {
+    }
+
+    void Invariance::visit(AST::Leaf* node)
+    {
+        const AST::Binding& binding = node->binding();
+        for (int i = 0; i < binding.count; ++i)
+        {
+            if (binding.addresses[i].depth == 0 && written.contains(binding.addresses[i].slot))
+                invariant = false;
+        }
+    }
+
+    void Invariance::visit(AST::FunctionCall* node)
+    {
+        if (!is_pure_call(node))
+        {
+            invariant = false;
+            return;
+        }
+
+        foreach(AST::Expression* expr, node->arguments_expressions())
+            expr->accept(this);
+    }
+
+    void Invariance::visit(AST::UnaryOperator* node)
+    {
+        node->argument()->accept(this);
+    }
+
+    void Invariance::visit(AST::BinaryOperator* node)
+    {
+        if (node->type() == OperatorTypes::Assign || node->type() == OperatorTypes::Dot)
+        {
+            invariant = false;
+            return;
+        }
+
+        node->left()->accept(this);
+        node->right()->accept(this);
+    }
+
+    // statements aren't expressions
+    void Invariance::visit(AST::Return* /*node*/) { invariant = false; }
+    void Invariance::visit(AST::Continue* /*node*/) { invariant = false; }
+    void Invariance::visit(AST::Break* /*node*/) { invariant = false; }
+    void Invariance::visit(AST::Block* /*node*/) { invariant = false; }
+    void Invariance::visit(AST::FunctionDeclaration* /*node*/) { invariant = false; }
+    void Invariance::visit(AST::While* /*node*/) { invariant = false; }
+    void Invariance::visit(AST::If* /*node*/) { invariant = false; }
+}
+
+
+int LoopInvariants::hoist(Program& program)
+{
+    LoopInvariants hoister(program, program.layout());
+    program.root()->accept(&hoister);
+    return hoister.marked;
+}
+
+int LoopInvariants::hoist_body(Program& program, FrameLayout& layout, AST::Block* body)
+{
+    LoopInvariants hoister(program, &layout);
+    foreach(AST::Node* stmt, body->values())
+        stmt->accept(&hoister);
+    return hoister.marked;
+}
+
+bool LoopInvariants::hoisted(AST::Expression* node)
+{
+    for (int i = 0; i < loops.size(); ++i)
+    {
+        Invariance invariance(loops[i].written);
+        node->accept(&invariance);
+        if (!invariance.invariant)
+            continue;
+
+        const int slot = function->slot_count++;
+        node->set_cache_slot(slot);
+        loops[i].caches.append(slot);
+        ++marked;
+        return true;
+    }
+
+    return false;
+}
+
+void LoopInvariants::visit(AST::Noop* /*node*/)
+{
+}
+
+void LoopInvariants::visit(AST::Leaf* /*node*/)
+{
+}
+
+void LoopInvariants::visit(AST::FunctionCall* node)
+{
+    if (hoisted(node))
+        return;
+
+    node->function_object()->accept(this);
+
+    foreach(AST::Expression* expr, node->arguments_expressions())
+        expr->accept(this);
+}
+
+void LoopInvariants::visit(AST::UnaryOperator* node)
+{
+    if (!hoisted(node))
+        node->argument()->accept(this);
+}
+
+void LoopInvariants::visit(AST::BinaryOperator* node)
+{
+    if (node->type() == OperatorTypes::Assign)
+    {
+        node->right()->accept(this);
+    }
+    else if (node->type() == OperatorTypes::Dot)
+    {
+        // the method name isn't a variable
+        node->left()->accept(this);
+
+        foreach(AST::Expression* expr, static_cast<AST::FunctionCall*>(node->right())->arguments_expressions())
+            expr->accept(this);
+    }
+    else if (!hoisted(node))
+    {
+        node->left()->accept(this);
+        node->right()->accept(this);
+    }
+}
+
+void LoopInvariants::visit(AST::Return* node)
+{
+    node->expr()->accept(this);
+}
+
+void LoopInvariants::visit(AST::Continue* /*node*/)
+{
+}
+
+void LoopInvariants::visit(AST::Break* /*node*/)
+{
+}
+
+void LoopInvariants::visit(AST::Block* node)
+{
+    foreach(AST::Node* stmt, node->values())
+        stmt->accept(this);
+}
+
+void LoopInvariants::visit(AST::FunctionDeclaration* node)
+{
+    // deferred bodies are marked when they get parsed
+    if (!node->is_body_parsed())
+        return;
+
+    LoopInvariants hoister(program, node->fnc()->layout());
+    foreach(AST::Node* stmt, node->body()->values())
+        stmt->accept(&hoister);
+    marked += hoister.marked;
+}
+
+void LoopInvariants::visit(AST::While* node)
+{
+    loops.append(Loop());
+    LoopWrites writes(loops.last().written);
+    node->condition()->accept(&writes);
+    node->body()->accept(&writes);
+
+    node->condition()->accept(this);
+    node->body()->accept(this);
+
+    const Loop loop = loops.takeLast();
+    int* cache_slots = program.arena().allocate_array<int>(loop.caches.size());
+    for (int i = 0; i < loop.caches.size(); ++i)
+        cache_slots[i] = loop.caches[i];
+    node->set_cache_slots(cache_slots, loop.caches.size());
+}
+
+void LoopInvariants::visit(AST::If* node)
+{
+    node->condition()->accept(this);
+    node->then_stmt()->accept(this);
+    node->else_stmt()->accept(this);
+}
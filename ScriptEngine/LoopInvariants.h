@@ -0,0 +1,63 @@
+#pragma once
+
+#include "AST.h"
+#include "Program.h"
+#include "Resolver.h"
+
+#include <QList>
+#include <QSet>
+#include <QVector>
+
+namespace VTScript
+{
+    /*
+        Loop invariant code motion. An expression in the condition or the body of a while
+        loop is invariant when it has no side effects (operators other than assignment and
+        method calls, calls of int(), double() and bool() when they are the builtins) and
+        the loop writes none of the variables it reads: no assignment, no function
+        declaration and no block of the loop empties them.
+
+        Every maximal invariant expression gets a slot in the frame of its function
+        (AST::Expression::cache_slot), given to the outermost loop it's invariant in.
+        The interpreter keeps the value there the first time the expression is
+        evaluated and hands it out again until the loop is left, when the slots are
+        emptied (AST::While::cache_slots). So the expression is evaluated once per run of
+        the loop, where it was written: it isn't evaluated at all when the loop doesn't
+        get to it, and its errors are reported as before.
+
+        Only values that can't change are kept: None, numbers, strings and booleans, as
+        results of operands of those types. A list read in the loop may be changed by a
+        method call without being assigned to.
+
+        Needs Resolver's bindings.
+    */
+    class LoopInvariants : public ASTTools::NodeVisitor
+    {
+    public:
+        // marks the loops of a resolved program, function bodies parsed so far included; returns the number of expressions marked
+        static int hoist(Program& program);
+
+        // a deferred body once it's resolved, see WS::UserFunction::body
+        static int hoist_body(Program& program, FrameLayout& layout, AST::Block* body);
+
+        VISITOR_METHODS
+
+    private:
+        struct Loop
+        {
+            QSet<int> written;      // slots of the function's frame the loop writes
+            QVector<int> caches;    // cache slots of the expressions invariant in the loop
+        };
+
+        LoopInvariants(Program& program, FrameLayout* function) : program(program), function(function), marked(0) {}
+
+        // marks 'node' for the outermost loop it's invariant in; false if there's none
+        bool hoisted(AST::Expression* node);
+
+        Program& program;
+        FrameLayout* function;
+        QList<Loop> loops;          // loops around the node visited, outermost first
+        int marked;
+    };
+
+};
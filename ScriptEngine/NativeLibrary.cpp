@@ -0,0 +1,310 @@
+#include "NativeLibrary.h"
+#include "AotCompiler.h"
+#include "Interpreter.h"
+#include "TypedOperators.h"
+#include "ObjectLayout.h"
+#include "Errors.h"
+
+#include <QScopedPointer>
+
+using namespace VTScript;
+
+static_assert(sizeof(Aot::Value) == sizeof(WS::SP_Object), "Aot::Value has to be the size of an SP_Object");
+
+namespace
+{
+    inline WS::SP_Object& object(Aot::Value* value)
+    {
+        return *reinterpret_cast<WS::SP_Object*>(value);
+    }
+
+    inline const WS::SP_Object& object(const Aot::Value* value)
+    {
+        return *reinterpret_cast<const WS::SP_Object*>(value);
+    }
+
+    inline Interpreter* interpreter(Aot::Context* context)
+    {
+        return reinterpret_cast<Interpreter*>(context);
+    }
+}
+
+
+NativeLibrary* NativeLibrary::load(const QString& script_path, QString& error)
+{
+    // loading a library runs its code, so nothing is loaded unless the manifest vouches for it
+    if (!AotCompiler::is_built_for(script_path, error))
+        return NULL;
+    const QString path = AotCompiler::library_path(script_path);
+
+    if (!ObjectLayout::measured().valid)
+    {
+        error = "Objects aren't laid out the way native code expects";
+        return NULL;
+    }
+
+    QScopedPointer<NativeLibrary> native(new NativeLibrary());
+    native->library.setFileName(path);
+    if (!native->library.load())
+    {
+        error = native->library.errorString();
+        return NULL;
+    }
+
+    Aot::Load load = reinterpret_cast<Aot::Load>(native->library.resolve(Aot::load_symbol));
+    const Aot::Module* module = load != NULL ? load(runtime()) : NULL;
+    if (module == NULL || module->abi_version != Aot::abi_version)
+    {
+        error = path + " isn't a library of this version of VTScript";
+        native->library.unload();
+        return NULL;
+    }
+
+    for (int i = 0; i < module->count; ++i)
+        native->entries.insert(QByteArray(module->functions[i].fingerprint), module->functions[i].entry);
+
+    return native.take();
+}
+
+NativeLibrary::~NativeLibrary()
+{
+    qDeleteAll(functions);
+    library.unload();
+}
+
+const NativeLibrary::Function* NativeLibrary::find(const AST::Block* body)
+{
+    QHash<const AST::Block*, Function*>::const_iterator found = functions.constFind(body);
+    if (found != functions.constEnd())
+        return found.value();
+
+    Function* function = NULL;
+    AotCompiler::Translation translation;
+    if (AotCompiler::translate(body, translation))
+    {
+        QHash<QByteArray, Aot::Entry>::const_iterator entry = entries.constFind(translation.fingerprint);
+        if (entry != entries.constEnd())
+        {
+            function = new Function();
+            function->entry = entry.value();
+            function->nodes = translation.nodes;
+            ++found_count;
+        }
+    }
+
+    functions.insert(body, function);
+    return function;
+}
+
+void NativeLibrary::run(Interpreter* interpreter, const Function& function, WS::SP_Object& result)
+{
+    function.entry(reinterpret_cast<Aot::Context*>(interpreter),
+                   reinterpret_cast<Aot::Value*>(interpreter->frame->values),
+                   function.nodes.data(), reinterpret_cast<Aot::Value*>(&result));
+}
+
+const Aot::Runtime* NativeLibrary::runtime()
+{
+    static Aot::Runtime runtime;
+    static bool done = false;
+    if (done)
+        return &runtime;
+
+    const ObjectLayout& layout = ObjectLayout::measured();
+    runtime.pointer = layout.pointer;
+    runtime.integral = layout.integral;
+    runtime.rational = layout.rational;
+    runtime.boolean = layout.boolean;
+    runtime.integral_class = layout.integral_class;
+    runtime.rational_class = layout.rational_class;
+    runtime.bool_class = layout.bool_class;
+
+    runtime.copy = &copy;
+    runtime.clear = &clear;
+    runtime.box_integral = &box_integral;
+    runtime.box_rational = &box_rational;
+    runtime.box_bool = &box_bool;
+    runtime.none = &none;
+    runtime.constant = &constant;
+    runtime.read = &read;
+    runtime.not_found = &not_found;
+    runtime.unary = &unary;
+    runtime.binary = &binary;
+    runtime.check_function = &check_function;
+    runtime.call = &call;
+    runtime.method = &method;
+    runtime.define = &define;
+    runtime.truth = &truth;
+    runtime.interrupt = &interrupt;
+
+    done = true;
+    return &runtime;
+}
+
+void NativeLibrary::copy(Aot::Value* to, const Aot::Value* from)
+{
+    object(to) = object(from);
+}
+
+void NativeLibrary::clear(Aot::Value* value)
+{
+    object(value).clear();
+}
+
+void NativeLibrary::box_integral(Aot::Value* to, long long value)
+{
+    object(to) = WS::SP_Object(new WS::Integral(value));
+}
+
+void NativeLibrary::box_rational(Aot::Value* to, double value)
+{
+    object(to) = WS::SP_Object(new WS::Rational(value));
+}
+
+void NativeLibrary::box_bool(Aot::Value* to, int value)
+{
+    object(to) = WS::SP_Object(new WS::Bool(value != 0));
+}
+
+void NativeLibrary::none(Aot::Value* to)
+{
+    object(to) = WS::SP_Object(new WS::None());
+}
+
+void NativeLibrary::constant(Aot::Value* to, const void* leaf)
+{
+    object(to) = static_cast<const AST::Leaf*>(leaf)->object();
+}
+
+void NativeLibrary::read(Aot::Context* context, const void* leaf, Aot::Value* to)
+{
+    const AST::Leaf* node = static_cast<const AST::Leaf*>(leaf);
+    object(to) = interpreter(context)->read(node->binding(), node->name(), node->line());
+}
+
+void NativeLibrary::not_found(Aot::Context* /*context*/, const void* leaf)
+{
+    const AST::Leaf* node = static_cast<const AST::Leaf*>(leaf);
+    throw InterpretError(QString("Line %1: Identifier not found: '%2'").arg(node->line()).arg(node->name()));
+}
+
+void NativeLibrary::unary(Aot::Context* context, const void* op, const Aot::Value* argument, Aot::Value* to)
+{
+    const AST::UnaryOperator* node = static_cast<const AST::UnaryOperator*>(op);
+    const WS::SP_Object& obj = object(argument);
+    Interpreter* ctx = interpreter(context);
+
+    const QString method_name = OperatorTypes::to_string(node->type());
+    ctx->stack.push( QString("Line %1: ").arg(node->line()) + obj->__repr__() + " " + method_name );
+    WS::SP_Object res = obj->invoke(method_name, WS::ObjectList());
+    ctx->stack.pop();
+
+    if (res == NULL)
+        res = WS::SP_Object(new WS::None());
+    object(to) = res;
+}
+
+void NativeLibrary::binary(Aot::Context* context, const void* op, const Aot::Value* left, const Aot::Value* right,
+                           Aot::Value* to)
+{
+    const AST::BinaryOperator* node = static_cast<const AST::BinaryOperator*>(op);
+    const WS::SP_Object& obj = object(left);
+    const WS::SP_Object& arg = object(right);
+    Interpreter* ctx = interpreter(context);
+
+    // Strings, and what the native code left to the generic path
+    WS::SP_Object res;
+    if (node->operand_type() != WSTypes::Base && obj->__type__() == node->operand_type()
+            && arg->__type__() == node->operand_type())
+        res = TypedOperators::binary(node->type(), node->operand_type(), obj.data(), arg.data());
+
+    if (res == NULL)
+    {
+        WS::ObjectList args;
+        args.append(arg);
+
+        const QString method_name = OperatorTypes::to_string(node->type());
+        ctx->stack.push( QString("Line %1: ").arg(node->line()) + obj->__repr__() + "." + method_name );
+        res = obj->invoke(method_name, args);
+        ctx->stack.pop();
+
+        if (res == NULL)
+            res = WS::SP_Object(new WS::None());
+    }
+
+    object(to) = res;
+}
+
+void NativeLibrary::check_function(Aot::Context* /*context*/, const void* call, const Aot::Value* function)
+{
+    const WS::SP_Object& obj = object(function);
+    if (obj->__type__() != WSTypes::Function)
+    {
+        const AST::FunctionCall* node = static_cast<const AST::FunctionCall*>(call);
+        throw InterpretError(QString("Line %1: Not a function: '%2'").arg(node->line()).arg(obj->__repr__()));
+    }
+}
+
+void NativeLibrary::call(Aot::Context* context, const void* call, const Aot::Value* function,
+                         const Aot::Value* const* arguments, int count, Aot::Value* to)
+{
+    const AST::FunctionCall* node = static_cast<const AST::FunctionCall*>(call);
+    QSharedPointer<WS::Function> fnc = object(function).staticCast<WS::Function>();
+    Interpreter* ctx = interpreter(context);
+
+    WS::ObjectList args;
+    for (int i = 0; i < count; ++i)
+        args.append(object(arguments[i]));
+
+    if (!fnc->check_num_arguments( args.size() ))
+        throw WrongNumberOfArgumentsError(args.size());
+
+    ctx->stack.push( QString("Line %1: ").arg(node->line()) + fnc->__repr__() );
+    WS::SP_Object res = (*fnc)(args);
+    ctx->stack.pop();
+
+    if (res == NULL)
+        res = WS::SP_Object(new WS::None());
+    object(to) = res;
+}
+
+void NativeLibrary::method(Aot::Context* context, const void* dot, const Aot::Value* object_value,
+                           const Aot::Value* const* arguments, int count, Aot::Value* to)
+{
+    const AST::BinaryOperator* node = static_cast<const AST::BinaryOperator*>(dot);
+    const AST::FunctionCall* called = static_cast<const AST::FunctionCall*>(node->right());
+    const QString method_name = static_cast<AST::Leaf*>(called->function_object())->name();
+    const WS::SP_Object& obj = object(object_value);
+    Interpreter* ctx = interpreter(context);
+
+    WS::ObjectList args;
+    for (int i = 0; i < count; ++i)
+        args.append(object(arguments[i]));
+
+    ctx->stack.push( QString("Line %1: ").arg(node->line()) + obj->__repr__() + "." + method_name );
+    WS::SP_Object res = obj->invoke(method_name, args);
+    ctx->stack.pop();
+
+    if (res == NULL)
+        res = WS::SP_Object(new WS::None());
+    object(to) = res;
+}
+
+void NativeLibrary::define(Aot::Context* context, const void* declaration)
+{
+    const AST::FunctionDeclaration* node = static_cast<const AST::FunctionDeclaration*>(declaration);
+    Interpreter* ctx = interpreter(context);
+
+    node->fnc()->set_interpreter(ctx);
+    ctx->assign(node->binding(), node->fnc());
+}
+
+int NativeLibrary::truth(const Aot::Value* value)
+{
+    return object(value)->invoke("__bool__", WS::ObjectList()).staticCast<WS::Bool>()->value() ? 1 : 0;
+}
+
+void NativeLibrary::interrupt(Aot::Context* context)
+{
+    if (interpreter(context)->__is_terminated) throw InterruptError();
+}
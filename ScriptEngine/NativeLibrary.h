@@ -0,0 +1,82 @@
+#pragma once
+
+#include "AST.h"
+#include "Aot.h"
+#include "Objects.h"
+
+#include <QLibrary>
+#include <QHash>
+#include <QVector>
+#include <QByteArray>
+#include <QString>
+
+namespace VTScript
+{
+    class Interpreter;
+
+    /*
+        A library AotCompiler built, loaded for one interpreter. A function body runs in
+        native code when the library has a function with the fingerprint of its
+        translation; the functions below Aot::Runtime points to are what the native code
+        calls back, and they do what the tree walker does, errors and trace included.
+        Exceptions go through the native code, which is ordinary C++ built with them.
+    */
+    class NativeLibrary
+    {
+    public:
+        // native code of one function body
+        struct Function
+        {
+            Aot::Entry entry;
+            QVector<const void*> nodes;     // see AotCompiler::Translation
+        };
+
+        // the library of the script at 'script_path'; NULL with nothing in 'error' if it hasn't been built,
+        // NULL with the reason if it isn't the one AotCompiler::build made for the script as it is or can't be used
+        static NativeLibrary* load(const QString& script_path, QString& error);
+        ~NativeLibrary();
+
+        // native code of a body, NULL if the library hasn't got its translation
+        const Function* find(const AST::Block* body);
+        // function bodies found in the library so far
+        int found() const { return found_count; }
+
+        // runs native code in the running frame of the interpreter; 'result' is only set by a return
+        static void run(Interpreter* interpreter, const Function& function, WS::SP_Object& result);
+
+    private:
+        NativeLibrary() : found_count(0) {}
+        NativeLibrary(const NativeLibrary&);
+        NativeLibrary& operator=(const NativeLibrary&);
+
+        static const Aot::Runtime* runtime();
+
+        // the functions of Aot::Runtime
+        static void copy(Aot::Value* to, const Aot::Value* from);
+        static void clear(Aot::Value* value);
+        static void box_integral(Aot::Value* to, long long value);
+        static void box_rational(Aot::Value* to, double value);
+        static void box_bool(Aot::Value* to, int value);
+        static void none(Aot::Value* to);
+        static void constant(Aot::Value* to, const void* leaf);
+        static void read(Aot::Context* context, const void* leaf, Aot::Value* to);
+        static void not_found(Aot::Context* context, const void* leaf);
+        static void unary(Aot::Context* context, const void* op, const Aot::Value* argument, Aot::Value* to);
+        static void binary(Aot::Context* context, const void* op, const Aot::Value* left, const Aot::Value* right,
+                           Aot::Value* to);
+        static void check_function(Aot::Context* context, const void* call, const Aot::Value* function);
+        static void call(Aot::Context* context, const void* call, const Aot::Value* function,
+                         const Aot::Value* const* arguments, int count, Aot::Value* to);
+        static void method(Aot::Context* context, const void* dot, const Aot::Value* object,
+                           const Aot::Value* const* arguments, int count, Aot::Value* to);
+        static void define(Aot::Context* context, const void* declaration);
+        static int truth(const Aot::Value* value);
+        static void interrupt(Aot::Context* context);
+
+        QLibrary library;
+        QHash<QByteArray, Aot::Entry> entries;                  // of the library, by fingerprint
+        QHash<const AST::Block*, Function*> functions;          // NULL for a body that isn't in it
+        int found_count;
+    };
+
+};
@@ -0,0 +1,102 @@
+#include "ObjectLayout.h"
+#include "Objects.h"
+
+#include <string.h>
+#include <new>
+
+using namespace VTScript;
+
+namespace
+{
+    // offset of 'size' bytes equal to 'value' in [begin, end), -1 if there's none or more than one
+    int find(const char* begin, const char* end, const void* value, size_t size)
+    {
+        int found = -1;
+        for (const char* at = begin; at + size <= end; at += size)
+        {
+            if (memcmp(at, value, size) == 0)
+            {
+                if (found >= 0)
+                    return -1;
+                found = int(at - begin);
+            }
+        }
+        return found;
+    }
+
+    // offset of the value from the Object* of an object whose value is 'value'
+    template <typename T, typename Value>
+    int value_offset(Value value)
+    {
+        T sample(value);
+        const WS::Object* obj = &sample;
+        const char* begin = static_cast<const char*>(dynamic_cast<const void*>(obj));
+        const int found = find(begin, begin + sizeof(T), &value, sizeof(Value));
+        return found < 0 ? -1 : int(begin + found - reinterpret_cast<const char*>(obj));
+    }
+
+    // the one byte in which a true and a false Bool differ, -1 if it isn't one; they're made in
+    // zeroed memory so that the padding around the value is the same
+    int bool_offset()
+    {
+        union Storage { char bytes[sizeof(WS::Bool)]; double align_double; void* align_pointer; long long align_integer; };
+        Storage yes_storage, no_storage;
+        memset(&yes_storage, 0, sizeof(Storage));
+        memset(&no_storage, 0, sizeof(Storage));
+
+        WS::Bool* yes = new (&yes_storage) WS::Bool(true);
+        WS::Bool* no = new (&no_storage) WS::Bool(false);
+        const WS::Object* obj = yes;
+        const char* a = static_cast<const char*>(dynamic_cast<const void*>(obj));
+        const char* b = static_cast<const char*>(dynamic_cast<const void*>(static_cast<const WS::Object*>(no)));
+
+        int found = -1;
+        for (size_t at = 0; at < sizeof(WS::Bool) && found != -2; ++at)
+        {
+            if (a[at] == b[at])
+                continue;
+            found = found >= 0 || a[at] != 1 || b[at] != 0 ? -2 : int(at);
+        }
+        const int offset = found < 0 ? -1 : int(a + found - reinterpret_cast<const char*>(obj));
+
+        yes->~Bool();
+        no->~Bool();
+        return offset;
+    }
+
+    template <typename T>
+    const void* class_of(const T& sample)
+    {
+        return *reinterpret_cast<const void* const*>(static_cast<const WS::Object*>(&sample));
+    }
+}
+
+const ObjectLayout& ObjectLayout::measured()
+{
+    static const ObjectLayout layout;
+    return layout;
+}
+
+ObjectLayout::ObjectLayout()
+{
+    WS::SP_Object sample(new WS::None());
+    const WS::Object* raw = sample.data();
+    const char* begin = reinterpret_cast<const char*>(&sample);
+    pointer = find(begin, begin + sizeof(WS::SP_Object), &raw, sizeof(raw));
+
+    integral = value_offset<WS::Integral>(qint64(0x0123456789ABCDEFLL));
+    rational = value_offset<WS::Rational>(-1.0 / 3.0);
+    boolean = bool_offset();
+
+    integral_class = class_of(WS::Integral(0));
+    rational_class = class_of(WS::Rational(0.0));
+    bool_class = class_of(WS::Bool(false));
+
+    // an empty SP_Object has to be two pointers of zeros, the native code makes them so
+    const WS::SP_Object empty;
+    const void* const zeros[2] = { NULL, NULL };
+    const bool zero_when_empty = sizeof(empty) == sizeof(zeros) && memcmp(&empty, zeros, sizeof(zeros)) == 0;
+
+    valid = pointer >= 0 && integral >= 0 && rational >= 0 && boolean >= 0 && zero_when_empty
+            && integral_class != rational_class && integral_class != bool_class && rational_class != bool_class;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+namespace VTScript
+{
+    /*
+        Where code that isn't compiled together with Objects.h finds things in the objects
+        it looks into, measured on sample objects rather than assumed: the Object pointer
+        in an SP_Object, the vtable pointers that tell an Integral, a Rational and a Bool,
+        and their values. Used by the machine code of JitCompiler and the native code of
+        AotCompiler; neither is used when 'valid' is false.
+    */
+    struct ObjectLayout
+    {
+        // measured the first time it's asked for
+        static const ObjectLayout& measured();
+
+        bool valid;
+        int pointer;                    // offset of the Object* in an SP_Object
+        int integral;                   // offset of the value from the Object* of an Integral
+        int rational;                   // the same for a Rational
+        int boolean;                    // the same for a Bool, one byte
+        const void* integral_class;     // vtable pointer of an Integral
+        const void* rational_class;
+        const void* bool_class;
+
+    private:
+        ObjectLayout();
+    };
+
+};
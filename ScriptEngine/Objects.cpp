@@ -1,5 +1,10 @@
 #include "Objects.h"
 #include "Interpreter.h"
+#include "ScriptParser.h"
+#include "Resolver.h"
+#include "Optimizer.h"
+#include "LoopInvariants.h"
+#include "TypeInference.h"
 
 using namespace VTScript;
 using namespace VTScript::WS;
@@ -173,3 +178,18 @@ SP_Object UserFunction::operator()(ObjectList& args)
 {
     return _ctx->exec_user_fnc(this, args);
 }
+
+AST::Block* UserFunction::body() const
+{
+    if (_body == NULL)
+    {
+        AST::Block* body = Parser::parse_function_body(*_deferred);
+        Resolver::resolve_body(_deferred->program, *_layout, _parameters, body);
+        Optimizer::optimize_body(_deferred->program, body, _parameters.size());
+        LoopInvariants::hoist_body(_deferred->program, *_layout, body);
+        TypeInference::infer_body(body, _parameters.size());
+        _body = body;
+    }
+
+    return _body;
+}
@@ -29,6 +29,8 @@ namespace VTScript
 {
     // forward declarations
     class Interpreter;
+    struct DeferredBody;
+    struct FrameLayout;
     namespace AST
     {
         class Block;
@@ -384,7 +386,12 @@ namespace VTScript
         {
         public:
             UserFunction(QString name, QStringList parameters, AST::Block* body) :
-                                    _ctx(NULL), _name(name), _parameters(parameters), _body(body)
+                                    _ctx(NULL), _name(name), _parameters(parameters), _body(body), _deferred(NULL), _layout(NULL)
+            {
+                _num_args = parameters.size();
+            }
+            UserFunction(QString name, QStringList parameters, const DeferredBody* deferred) :
+                                    _ctx(NULL), _name(name), _parameters(parameters), _body(NULL), _deferred(deferred), _layout(NULL)
             {
                 _num_args = parameters.size();
             }
@@ -394,7 +401,13 @@ namespace VTScript
 
             inline const QString& name() const { return _name; }
             inline const QStringList& parameters() const { return _parameters; }
-            inline AST::Block* body() const { return _body; }
+            // a deferred body is parsed on first use; throws LexError, ParseError, CheckerError
+            AST::Block* body() const;
+            inline bool is_body_parsed() const { return _body != NULL; }
+
+            // frame of the function, set by Resolver; a deferred body is resolved together with its parsing
+            inline FrameLayout* layout() const { return _layout; }
+            inline void set_layout(FrameLayout* layout) { _layout = layout; }
 
             inline const void set_interpreter(Interpreter* ctx) { _ctx = ctx; }
 
@@ -402,7 +415,9 @@ namespace VTScript
             Interpreter* _ctx;
             QString _name;
             QStringList _parameters;
-            AST::Block* _body;
+            mutable AST::Block* _body;
+            const DeferredBody* _deferred;
+            FrameLayout* _layout;
         };
 
         inline void check_num(const ObjectList& list, int num)
@@ -0,0 +1,303 @@
+#include "Optimizer.h"
+#include "Objects.h"
+#include "Errors.h"
+
+using namespace VTScript;
+
+namespace
+{
+    /*
+        Counts the writes to every slot of a function's frame. Nested functions write
+        to their own frames only.
+    */
+    class WriteCounter : public ASTTools::NodeVisitor
+    {
+    public:
+        WriteCounter(QHash<int, int>& writes) : writes(writes) {}
+
+        VISITOR_METHODS
+
+    private:
+        void count(const AST::Binding& binding)
+        {
+            for (int i = 0; i < binding.count; ++i)
+                ++writes[binding.addresses[i].slot];
+        }
+
+        QHash<int, int>& writes;
+    };
+
+    void WriteCounter::visit(AST::Noop* /*node*/)
+    {
+    }
+
+    void WriteCounter::visit(AST::Leaf* /*node*/)
+    {
+    }
+
+    void WriteCounter::visit(AST::FunctionCall* node)
+    {
+        node->function_object()->accept(this);
+
+        foreach(AST::Expression* expr, node->arguments_expressions())
+            expr->accept(this);
+    }
+
+    void WriteCounter::visit(AST::UnaryOperator* node)
+    {
+        node->argument()->accept(this);
+    }
+
+    void WriteCounter::visit(AST::BinaryOperator* node)
+    {
+        if (node->type() == OperatorTypes::Assign)
+            count(static_cast<AST::Leaf*>(node->left())->binding());
+        else
+            node->left()->accept(this);
+
+        node->right()->accept(this);
+    }
+
+    void WriteCounter::visit(AST::Return* node)
+    {
+        node->expr()->accept(this);
+    }
+
+    void WriteCounter::visit(AST::Continue* /*node*/)
+    {
+    }
+
+    void WriteCounter::visit(AST::Break* /*node*/)
+    {
+    }
+
+    void WriteCounter::visit(AST::Block* node)
+    {
+        foreach(AST::Node* stmt, node->values())
+            stmt->accept(this);
+    }
+
+    void WriteCounter::visit(AST::FunctionDeclaration* node)
+    {
+        count(node->binding());
+    }
+
+    void WriteCounter::visit(AST::While* node)
+    {
+        node->condition()->accept(this);
+        node->body()->accept(this);
+    }
+
+    void WriteCounter::visit(AST::If* node)
+    {
+        node->condition()->accept(this);
+        node->then_stmt()->accept(this);
+        node->else_stmt()->accept(this);
+    }
+}
+
+
+void Optimizer::optimize(Program& program)
+{
+    Optimizer optimizer(program, true);
+    optimizer.optimize_function(program.root()->values(), 0);
+}
+
+void Optimizer::optimize_body(Program& program, AST::Block* body, int parameter_count)
+{
+    Optimizer optimizer(program, true);
+    optimizer.optimize_function(body->values(), parameter_count);
+}
+
+void Optimizer::fold(Program& program, AST::Node* statement)
+{
+    Optimizer optimizer(program, false);
+    statement->accept(&optimizer);
+}
+
+void Optimizer::optimize_function(const AST::NodeList<AST::Node>& statements, int parameter_count)
+{
+    // arguments go to the first slots
+    for (int slot = 0; slot < parameter_count; ++slot)
+        ++writes[slot];
+
+    WriteCounter counter(writes);
+    foreach(AST::Node* stmt, statements)
+        stmt->accept(&counter);
+
+    optimize_statements(statements);
+}
+
+AST::Leaf* Optimizer::constant(AST::Expression* node)
+{
+    AST::Leaf* leaf = dynamic_cast<AST::Leaf*>(node);
+    return leaf != NULL && !leaf->is_identifier() ? leaf : NULL;
+}
+
+AST::Expression* Optimizer::optimized(AST::Expression* node)
+{
+    folded = NULL;
+    node->accept(this);
+
+    AST::Expression* result = folded != NULL ? folded : node;
+    folded = NULL;
+    return result;
+}
+
+AST::Leaf* Optimizer::evaluate(AST::Expression* node, AST::Leaf* left, OperatorType type, AST::Leaf* right)
+{
+    WS::ObjectList args;
+    if (right != NULL)
+    {
+        // integer division by zero doesn't throw, it crashes
+        if ((type == OperatorTypes::Div || type == OperatorTypes::Mod) && right->object()->__type__() == WSTypes::Integral
+                && (right->object().staticCast<WS::Integral>()->value() == 0 || right->object().staticCast<WS::Integral>()->value() == -1))
+            return NULL;
+
+        args.append(right->object());
+    }
+
+    WS::SP_Object result;
+    try
+    {
+        result = left->object()->invoke(OperatorTypes::to_string(type), args);
+    }
+    catch (const InterpretError&)
+    {
+        return NULL;
+    }
+
+    if (result == NULL)
+        return NULL;
+
+    return program.arena().create<AST::Leaf>(node->line(), QString(), result);
+}
+
+void Optimizer::visit(AST::Noop* /*node*/)
+{
+}
+
+void Optimizer::visit(AST::Leaf* node)
+{
+    if (!propagate || !node->is_identifier())
+        return;
+
+    const AST::Binding& binding = node->binding();
+    if (binding.count != 1 || binding.addresses[0].depth != 0)
+        return;
+
+    QHash<int, WS::SP_Object>::const_iterator value = constants.constFind(binding.addresses[0].slot);
+    if (value != constants.constEnd())
+        folded = program.arena().create<AST::Leaf>(node->line(), QString(), value.value());
+}
+
+void Optimizer::visit(AST::FunctionCall* node)
+{
+    node->set_function_object(optimized(node->function_object()));
+
+    const AST::NodeList<AST::Expression>& args = node->arguments_expressions();
+    for (int i = 0; i < args.size(); ++i)
+        args.replace(i, optimized(args[i]));
+}
+
+void Optimizer::visit(AST::UnaryOperator* node)
+{
+    node->_argument = optimized(node->argument());
+
+    AST::Leaf* argument = constant(node->argument());
+    if (argument != NULL)
+        folded = evaluate(node, argument, node->type(), NULL);
+}
+
+void Optimizer::visit(AST::BinaryOperator* node)
+{
+    if (node->type() == OperatorTypes::Assign)
+    {
+        node->_right_branch = optimized(node->right());
+    }
+    else if (node->type() == OperatorTypes::Dot)
+    {
+        // the method name isn't a variable
+        node->_left_branch = optimized(node->left());
+
+        const AST::NodeList<AST::Expression>& args = static_cast<AST::FunctionCall*>(node->right())->arguments_expressions();
+        for (int i = 0; i < args.size(); ++i)
+            args.replace(i, optimized(args[i]));
+    }
+    else
+    {
+        node->_left_branch = optimized(node->left());
+        node->_right_branch = optimized(node->right());
+
+        AST::Leaf* left = constant(node->left());
+        AST::Leaf* right = constant(node->right());
+        if (left != NULL && right != NULL)
+            folded = evaluate(node, left, node->type(), right);
+    }
+}
+
+void Optimizer::visit(AST::Return* node)
+{
+    node->_expr = optimized(node->expr());
+}
+
+void Optimizer::visit(AST::Continue* /*node*/)
+{
+}
+
+void Optimizer::visit(AST::Break* /*node*/)
+{
+}
+
+void Optimizer::visit(AST::Block* node)
+{
+    optimize_statements(node->values());
+}
+
+void Optimizer::optimize_statements(const AST::NodeList<AST::Node>& statements)
+{
+    foreach(AST::Node* stmt, statements)
+    {
+        stmt->accept(this);
+        // a statement that is a constant expression isn't worth replacing
+        folded = NULL;
+
+        // from here on the block has the variable, holding the constant
+        AST::BinaryOperator* assign = dynamic_cast<AST::BinaryOperator*>(stmt);
+        if (!propagate || assign == NULL || assign->type() != OperatorTypes::Assign)
+            continue;
+
+        const AST::Binding& binding = static_cast<AST::Leaf*>(assign->left())->binding();
+        AST::Leaf* value = constant(assign->right());
+        if (value != NULL && binding.count == 1 && writes.value(binding.addresses[0].slot) == 1)
+            constants.insert(binding.addresses[0].slot, value->object());
+    }
+}
+
+void Optimizer::visit(AST::FunctionDeclaration* node)
+{
+    // deferred bodies are optimized when they get parsed
+    if (!node->is_body_parsed())
+        return;
+
+    Optimizer optimizer(program, propagate);
+    if (propagate)
+        optimizer.optimize_function(node->body()->values(), node->parameters().size());
+    else
+        node->body()->accept(&optimizer);
+}
+
+void Optimizer::visit(AST::While* node)
+{
+    node->_condition = optimized(node->condition());
+    node->body()->accept(this);
+    folded = NULL;
+}
+
+void Optimizer::visit(AST::If* node)
+{
+    node->_condition = optimized(node->condition());
+    node->then_stmt()->accept(this);
+    node->else_stmt()->accept(this);
+    folded = NULL;
+}
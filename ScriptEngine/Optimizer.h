@@ -0,0 +1,57 @@
+#pragma once
+
+#include "AST.h"
+#include "Program.h"
+
+#include <QHash>
+
+namespace VTScript
+{
+    /*
+        Rewrites the tree in place so that work on constants is done once instead of on
+        every execution.
+
+        Folding: an operator whose operands are constant leaves becomes a leaf holding
+        the result, computed by the same WS method the interpreter would invoke. Operators
+        that would throw, or divide an integer by zero, are left for the interpreter to
+        report at run time.
+
+        Propagation (needs Resolver's bindings): a variable that one assignment of a
+        constant, a statement of its own in a block, is the only write to, holds that
+        constant in every statement after the assignment in the block. Reads there that
+        can only mean this variable become the constant and get folded further. Reads
+        inside nested functions are left alone: those may run after the block is gone.
+    */
+    class Optimizer : public ASTTools::NodeVisitor
+    {
+    public:
+        // folds and propagates in a resolved program, function bodies parsed so far included
+        static void optimize(Program& program);
+
+        // a deferred body once Resolver has bound it, see WS::UserFunction::body
+        static void optimize_body(Program& program, AST::Block* body, int parameter_count);
+
+        // folds a statement that isn't resolved yet, see Parser::parse_statements
+        static void fold(Program& program, AST::Node* statement);
+
+        VISITOR_METHODS
+
+    private:
+        Optimizer(Program& program, bool propagate) : program(program), propagate(propagate), folded(NULL) {}
+
+        void optimize_function(const AST::NodeList<AST::Node>& statements, int parameter_count);
+        // statements of one block, in the order they run
+        void optimize_statements(const AST::NodeList<AST::Node>& statements);
+        // the node or the constant leaf replacing it
+        AST::Expression* optimized(AST::Expression* node);
+        AST::Leaf* evaluate(AST::Expression* node, AST::Leaf* left, OperatorType type, AST::Leaf* right);
+        static AST::Leaf* constant(AST::Expression* node);
+
+        Program& program;
+        bool propagate;
+        AST::Expression* folded;        // set by a visit that replaces its node
+        QHash<int, int> writes;         // slot -> assignments, declarations and parameters writing it
+        QHash<int, WS::SP_Object> constants;
+    };
+
+};
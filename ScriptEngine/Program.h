@@ -0,0 +1,69 @@
+#pragma once
+
+#include "AST.h"
+#include "Arena.h"
+#include "Identifiers.h"
+
+#include <QString>
+
+namespace VTScript
+{
+    struct FrameLayout;
+
+    /*
+        A compiled script: its tree together with the memory the tree lives in.
+
+        Nodes, their child lists and the cleanup records of nodes holding strings or
+        objects are allocated from the program's arena in the order the parser creates
+        them, so the nodes of one function sit next to each other. Names of identifiers
+        are shared with the identifier table instead of being copied into every leaf.
+        Deleting the program frees the whole tree at once.
+    */
+    class Program
+    {
+    public:
+        Program() : _root(NULL), _layout(NULL), _inlined_calls(0) {}
+
+        inline AST::Block* root() const { return _root; }
+        inline void set_root(AST::Block* root) { _root = root; }
+
+        // frame of the top level, set by Resolver; a program can't run before it's resolved
+        inline FrameLayout* layout() const { return _layout; }
+        inline void set_layout(FrameLayout* layout) { _layout = layout; }
+
+        // call sites Inliner has inlined
+        inline int inlined_calls() const { return _inlined_calls; }
+        inline void set_inlined_calls(int count) { _inlined_calls = count; }
+
+        inline Arena& arena() { return _arena; }
+        inline IdentifierTable& identifiers() { return _identifiers; }
+        inline const IdentifierTable& identifiers() const { return _identifiers; }
+
+    private:
+        Q_DISABLE_COPY(Program)
+
+        IdentifierTable _identifiers;
+        Arena _arena;
+        AST::Block* _root;
+        FrameLayout* _layout;
+        int _inlined_calls;
+    };
+
+    /*
+        Text of a function body that is parsed and checked only when the function is called
+        for the first time, see Flags::LazyFunctions. 'text' is shared with the source of
+        the script when it was parsed from a string.
+    */
+    struct DeferredBody
+    {
+        DeferredBody(Program& program, const QString& text, int begin, int end, ulong line) :
+            program(program), text(text), begin(begin), end(end), line(line) {}
+
+        Program& program;   // the body is allocated in this program
+        QString text;
+        int begin;          // the opening "{"
+        int end;            // one past the closing "}"
+        ulong line;         // line of 'begin'
+    };
+
+};
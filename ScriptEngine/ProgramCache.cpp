@@ -0,0 +1,223 @@
+#include "ProgramCache.h"
+#include "ScriptParser.h"
+#include "CompiledScript.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QCryptographicHash>
+#include <QMutexLocker>
+#include <QDebug>
+
+using namespace VTScript;
+
+ProgramCache& ProgramCache::instance()
+{
+    static ProgramCache cache;
+    return cache;
+}
+
+ProgramCache::ProgramCache() :
+    _capacity( default_capacity ), _memory( 0 ), _hits( 0 ), _misses( 0 ), tick( 0 )
+{
+}
+
+ProgramCache::~ProgramCache()
+{
+    clear();
+}
+
+Program* ProgramCache::load( const QString& path )
+{
+    if ( CompiledScript::is_compiled( path ) )
+        return CompiledScript::load( path );
+
+    QFile file( path );
+    if ( !file.open( QIODevice::ReadOnly | QIODevice::Text ) )
+    {
+        qDebug() << "Couldn't open file:" << path;
+        return NULL;
+    }
+
+    // sources may be huge, so they're lexed while being read, and they define many
+    // more functions than they call, so bodies are parsed on demand
+    return Parser::parse( &file, true );
+}
+
+QByteArray ProgramCache::hash_of( const QString& path )
+{
+    QFile file( path );
+    QCryptographicHash hash( QCryptographicHash::Sha1 );
+
+    if ( !file.open( QIODevice::ReadOnly ) || !hash.addData( &file ) )
+        return QByteArray();
+
+    return hash.result();
+}
+
+/*
+    The file is hashed and the script loaded without holding the mutex, so entries are
+    looked up again afterwards: meanwhile another thread may have loaded the same script.
+*/
+Program* ProgramCache::acquire( const QString& path )
+{
+    QFileInfo info( path );
+    const QString key = info.canonicalFilePath();
+    if ( key.isEmpty() )
+    {
+        qDebug() << "Couldn't find file:" << path;
+        return NULL;
+    }
+
+    const QDateTime modified = info.lastModified();
+    const qint64 size = info.size();
+    bool touched = false;
+
+    {
+        QMutexLocker locker( &mutex );
+        QHash<QString, Entry>::iterator entry = entries.find( key );
+
+        if ( entry != entries.end() && !entry->busy )
+        {
+            if ( entry->modified == modified && entry->size == size )
+            {
+                entry->busy = true;
+                ++_hits;
+                return entry->program;
+            }
+            touched = true;
+        }
+    }
+
+    QByteArray hash = hash_of( key );
+
+    if ( touched )
+    {
+        QMutexLocker locker( &mutex );
+        QHash<QString, Entry>::iterator entry = entries.find( key );
+
+        if ( entry != entries.end() && !entry->busy && !hash.isEmpty() && entry->hash == hash )
+        {
+            entry->modified = modified;
+            entry->size = size;
+            entry->busy = true;
+            ++_hits;
+            return entry->program;
+        }
+    }
+
+    Program* program = load( key );
+
+    QMutexLocker locker( &mutex );
+    ++_misses;
+
+    if ( program == NULL || hash.isEmpty() )
+        return program;
+
+    QHash<QString, Entry>::iterator entry = entries.find( key );
+    if ( entry != entries.end() )
+    {
+        // a running copy stays where it is, this one is private to the caller
+        if ( entry->busy )
+            return program;
+
+        _memory -= entry->memory;
+        delete entry->program;
+    }
+
+    Entry loaded = { program, modified, size, hash, program->arena().allocated(), ++tick, true };
+    entries.insert( key, loaded );
+    _memory += loaded.memory;
+    trim();
+
+    return program;
+}
+
+void ProgramCache::release( Program* program )
+{
+    {
+        QMutexLocker locker( &mutex );
+
+        for ( QHash<QString, Entry>::iterator entry = entries.begin(); entry != entries.end(); ++entry )
+        {
+            if ( entry->program == program )
+            {
+                // deferred function bodies parsed by the run are part of the program now
+                _memory -= entry->memory;
+                entry->memory = program->arena().allocated();
+                _memory += entry->memory;
+                entry->last_used = ++tick;
+                entry->busy = false;
+                trim();
+                return;
+            }
+        }
+    }
+
+    // a private copy, or dropped from the cache while it was running
+    delete program;
+}
+
+void ProgramCache::trim()
+{
+    while ( _memory > _capacity )
+    {
+        QHash<QString, Entry>::iterator oldest = entries.end();
+        for ( QHash<QString, Entry>::iterator entry = entries.begin(); entry != entries.end(); ++entry )
+        {
+            if ( !entry->busy && ( oldest == entries.end() || entry->last_used < oldest->last_used ) )
+                oldest = entry;
+        }
+
+        if ( oldest == entries.end() )
+            break;
+
+        _memory -= oldest->memory;
+        delete oldest->program;
+        entries.erase( oldest );
+    }
+}
+
+void ProgramCache::set_capacity( size_t bytes )
+{
+    QMutexLocker locker( &mutex );
+    _capacity = bytes;
+    trim();
+}
+
+size_t ProgramCache::capacity() const
+{
+    QMutexLocker locker( &mutex );
+    return _capacity;
+}
+
+void ProgramCache::clear()
+{
+    QMutexLocker locker( &mutex );
+
+    // running programs are deleted when they are released
+    for ( QHash<QString, Entry>::iterator entry = entries.begin(); entry != entries.end(); entry = entries.erase( entry ) )
+    {
+        if ( !entry->busy )
+            delete entry->program;
+    }
+
+    _memory = 0;
+}
+
+quint64 ProgramCache::hits() const
+{
+    QMutexLocker locker( &mutex );
+    return _hits;
+}
+
+quint64 ProgramCache::misses() const
+{
+    QMutexLocker locker( &mutex );
+    return _misses;
+}
+
+size_t ProgramCache::memory() const
+{
+    QMutexLocker locker( &mutex );
+    return _memory;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "Program.h"
+
+#include <QString>
+#include <QHash>
+#include <QDateTime>
+#include <QByteArray>
+#include <QMutex>
+
+namespace VTScript
+{
+    /*
+        Process-wide cache of loaded scripts (sources or .vtsc files) for exec, so that
+        running the same file again skips the whole front end.
+
+        Entries are keyed by canonical path. A cached program is reused while the file's
+        modification time and size are the same; when they change, the file is hashed,
+        and only if the contents differ too the script is loaded again.
+        Memory taken by the cached programs (their arenas, which also hold function bodies
+        parsed on demand) is kept under a cap by dropping least recently used entries.
+
+        A program is lent to one interpreter at a time, between acquire() and release():
+        running a script sets up its function objects and parses deferred bodies, so two
+        interpreters can't share one. Asking for a script that is already running (from
+        another thread, or recursively) gives a private copy that isn't cached.
+    */
+    class ProgramCache
+    {
+    public:
+        static ProgramCache& instance();
+
+        // returns NULL if the script can't be loaded; the program has to be given back with release()
+        Program* acquire( const QString& path );
+        void release( Program* program );
+
+        // loads a script without caching it; NULL on failure
+        static Program* load( const QString& path );
+
+        void set_capacity( size_t bytes );
+        size_t capacity() const;
+        void clear();
+
+        quint64 hits() const;
+        quint64 misses() const;
+        // bytes taken by cached programs, measured when they were released
+        size_t memory() const;
+
+        static const size_t default_capacity = 64 * 1024 * 1024;
+
+    private:
+        ProgramCache();
+        ~ProgramCache();
+        Q_DISABLE_COPY(ProgramCache)
+
+        struct Entry
+        {
+            Program* program;
+            QDateTime modified;
+            qint64 size;
+            QByteArray hash;
+            size_t memory;
+            quint64 last_used;
+            bool busy;
+        };
+
+        static QByteArray hash_of( const QString& path );
+
+        // drops least recently used idle entries until memory fits the capacity; mutex has to be locked
+        void trim();
+
+        mutable QMutex mutex;
+        QHash<QString, Entry> entries;
+        size_t _capacity;
+        size_t _memory;
+        quint64 _hits;
+        quint64 _misses;
+        quint64 tick;
+    };
+
+};
@@ -0,0 +1,321 @@
+#include "Resolver.h"
+#include "Builtin.h"
+#include "Errors.h"
+
+#include <QVector>
+
+using namespace VTScript;
+
+namespace
+{
+    /*
+        Collects the names a block assigns directly: statements of nested blocks run in
+        their own scope, function bodies in the function's.
+    */
+    class Declarer : public ASTTools::NodeVisitor
+    {
+    public:
+        Declarer(LexicalScope* scope) : scope(scope) {}
+
+        VISITOR_METHODS
+
+    private:
+        LexicalScope* scope;
+    };
+
+    void Declarer::visit(AST::Noop* /*node*/)
+    {
+    }
+
+    void Declarer::visit(AST::Leaf* /*node*/)
+    {
+    }
+
+    void Declarer::visit(AST::FunctionCall* node)
+    {
+        node->function_object()->accept(this);
+
+        foreach(AST::Expression* expr, node->arguments_expressions())
+            expr->accept(this);
+    }
+
+    void Declarer::visit(AST::UnaryOperator* node)
+    {
+        node->argument()->accept(this);
+    }
+
+    void Declarer::visit(AST::BinaryOperator* node)
+    {
+        if (node->type() == OperatorTypes::Assign)
+        {
+            scope->declare(static_cast<AST::Leaf*>(node->left())->name());
+            node->right()->accept(this);
+        }
+        else if (node->type() == OperatorTypes::Dot)
+        {
+            node->left()->accept(this);
+
+            foreach(AST::Expression* expr, static_cast<AST::FunctionCall*>(node->right())->arguments_expressions())
+                expr->accept(this);
+        }
+        else
+        {
+            node->left()->accept(this);
+            node->right()->accept(this);
+        }
+    }
+
+    void Declarer::visit(AST::Return* node)
+    {
+        node->expr()->accept(this);
+    }
+
+    void Declarer::visit(AST::Continue* /*node*/)
+    {
+    }
+
+    void Declarer::visit(AST::Break* /*node*/)
+    {
+    }
+
+    void Declarer::visit(AST::Block* /*node*/)
+    {
+    }
+
+    void Declarer::visit(AST::FunctionDeclaration* node)
+    {
+        scope->declare(node->name());
+    }
+
+    void Declarer::visit(AST::While* node)
+    {
+        node->condition()->accept(this);
+        node->body()->accept(this);
+    }
+
+    void Declarer::visit(AST::If* node)
+    {
+        node->condition()->accept(this);
+        node->then_stmt()->accept(this);
+        node->else_stmt()->accept(this);
+    }
+}
+
+
+int LexicalScope::declare(const QString& name)
+{
+    QHash<QString, int>::const_iterator found = names.constFind(name);
+    if (found != names.constEnd())
+        return found.value();
+
+    const int slot = function->slot_count++;
+    names.insert(name, slot);
+    return slot;
+}
+
+
+void Resolver::resolve(Program& program)
+{
+    FrameLayout* layout = program.arena().create<FrameLayout>(static_cast<const FrameLayout*>(NULL), static_cast<const LexicalScope*>(NULL));
+    Resolver resolver(program, layout);
+    program.root()->accept(&resolver);
+    program.set_layout(layout);
+}
+
+void Resolver::resolve_body(Program& program, FrameLayout& layout, const QStringList& parameters, AST::Block* body)
+{
+    Resolver resolver(program, &layout);
+    resolver.resolve_function(&layout, parameters, body);
+}
+
+void Resolver::declare(LexicalScope* block_scope, const AST::NodeList<AST::Node>& statements)
+{
+    Declarer declarer(block_scope);
+    foreach(AST::Node* stmt, statements)
+        stmt->accept(&declarer);
+}
+
+void Resolver::resolve_statements(LexicalScope* block_scope, const AST::NodeList<AST::Node>& statements)
+{
+    const LexicalScope* outer = scope;
+    scope = block_scope;
+
+    foreach(AST::Node* stmt, statements)
+        stmt->accept(this);
+
+    scope = outer;
+}
+
+void Resolver::resolve_function(FrameLayout* layout, const QStringList& parameters, AST::Block* body)
+{
+    layout->slot_count = 0;
+    LexicalScope* body_scope = program.arena().create<LexicalScope>(layout->enclosing, layout);
+
+    // argument i goes to slot i; of repeated parameters the last one is seen
+    foreach(const QString& parameter, parameters)
+        body_scope->names.insert(parameter, layout->slot_count++);
+
+    declare(body_scope, body->values());
+
+    Resolver resolver(program, layout);
+    resolver.resolve_statements(body_scope, body->values());
+}
+
+AST::Binding Resolver::make_binding(const QVector<AST::Address>& addresses, const WS::SP_Object* builtin)
+{
+    AST::Binding binding;
+    AST::Address* array = program.arena().allocate_array<AST::Address>(addresses.size());
+    for (int i = 0; i < addresses.size(); ++i)
+        array[i] = addresses[i];
+
+    binding.addresses = array;
+    binding.count = addresses.size();
+    binding.builtin = builtin;
+    return binding;
+}
+
+AST::Binding Resolver::bind_read(const QString& name, ulong line)
+{
+    QVector<AST::Address> addresses;
+
+    for (const LexicalScope* s = scope; s != NULL; s = s->parent)
+    {
+        QHash<QString, int>::const_iterator found = s->names.constFind(name);
+        if (found != s->names.constEnd())
+        {
+            AST::Address address = { function->level - s->function->level, found.value() };
+            addresses.append(address);
+        }
+    }
+
+    const QHash<QString, WS::SP_Object>& builtins = Builtin::table();
+    QHash<QString, WS::SP_Object>::const_iterator builtin = builtins.constFind(name);
+
+    if (addresses.isEmpty() && builtin == builtins.constEnd())
+        throw CheckerError(QString("Line %1: Undefined name '%2'").arg(line).arg(name));
+
+    return make_binding(addresses, builtin != builtins.constEnd() ? &builtin.value() : NULL);
+}
+
+AST::Binding Resolver::bind_write(const QString& name)
+{
+    // the innermost scope comes first: Declarer has put the name there
+    QVector<AST::Address> addresses;
+
+    for (const LexicalScope* s = scope; s != NULL && s->function == function; s = s->parent)
+    {
+        QHash<QString, int>::const_iterator found = s->names.constFind(name);
+        if (found != s->names.constEnd())
+        {
+            AST::Address address = { 0, found.value() };
+            addresses.append(address);
+        }
+    }
+
+    return make_binding(addresses, NULL);
+}
+
+void Resolver::visit(AST::Noop* /*node*/)
+{
+}
+
+void Resolver::visit(AST::Leaf* node)
+{
+    if (node->is_identifier())
+        node->set_binding(bind_read(node->name(), node->line()));
+}
+
+void Resolver::visit(AST::FunctionCall* node)
+{
+    // copies Inliner made and LoopInvariants' caches are in slots of the old layout
+    node->set_inlined(NULL);
+    node->set_cache_slot(-1);
+    node->function_object()->accept(this);
+
+    foreach(AST::Expression* expr, node->arguments_expressions())
+        expr->accept(this);
+}
+
+void Resolver::visit(AST::UnaryOperator* node)
+{
+    node->set_cache_slot(-1);
+    node->argument()->accept(this);
+}
+
+void Resolver::visit(AST::BinaryOperator* node)
+{
+    node->set_cache_slot(-1);
+
+    if (node->type() == OperatorTypes::Assign)
+    {
+        AST::Leaf* name = static_cast<AST::Leaf*>(node->left());
+        name->set_binding(bind_write(name->name()));
+        node->right()->accept(this);
+    }
+    else if (node->type() == OperatorTypes::Dot)
+    {
+        // the method name isn't a variable
+        node->left()->accept(this);
+
+        foreach(AST::Expression* expr, static_cast<AST::FunctionCall*>(node->right())->arguments_expressions())
+            expr->accept(this);
+    }
+    else
+    {
+        node->left()->accept(this);
+        node->right()->accept(this);
+    }
+}
+
+void Resolver::visit(AST::Return* node)
+{
+    node->expr()->accept(this);
+}
+
+void Resolver::visit(AST::Continue* /*node*/)
+{
+}
+
+void Resolver::visit(AST::Break* /*node*/)
+{
+}
+
+void Resolver::visit(AST::Block* node)
+{
+    LexicalScope* block_scope = program.arena().create<LexicalScope>(scope, function);
+    declare(block_scope, node->values());
+
+    int* scope_slots = program.arena().allocate_array<int>(block_scope->names.size());
+    int count = 0;
+    foreach(int slot, block_scope->names)
+        scope_slots[count++] = slot;
+    node->set_scope_slots(scope_slots, count);
+
+    resolve_statements(block_scope, node->values());
+}
+
+void Resolver::visit(AST::FunctionDeclaration* node)
+{
+    node->set_binding(bind_write(node->name()));
+
+    FrameLayout* layout = program.arena().create<FrameLayout>(static_cast<const FrameLayout*>(function), scope);
+    node->fnc()->set_layout(layout);
+
+    // deferred bodies are resolved when they get parsed
+    if (node->is_body_parsed())
+        resolve_function(layout, node->parameters(), node->body());
+}
+
+void Resolver::visit(AST::While* node)
+{
+    node->set_cache_slots(NULL, 0);
+    node->condition()->accept(this);
+    node->body()->accept(this);
+}
+
+void Resolver::visit(AST::If* node)
+{
+    node->condition()->accept(this);
+    node->then_stmt()->accept(this);
+    node->else_stmt()->accept(this);
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "AST.h"
+#include "Program.h"
+
+#include <QHash>
+#include <QString>
+#include <QStringList>
+
+namespace VTScript
+{
+    struct LexicalScope;
+
+    /*
+        Variables of one function, or of the top level of a script, laid out in a frame:
+        one slot for every name assigned in every block, parameters first.
+    */
+    struct FrameLayout
+    {
+        FrameLayout(const FrameLayout* parent, const LexicalScope* enclosing) :
+            parent(parent), enclosing(enclosing), level(parent ? parent->level + 1 : 0), slot_count(0) {}
+
+        const FrameLayout* parent;          // function the function is declared in, NULL for the top level
+        const LexicalScope* enclosing;      // block the function is declared in, a deferred body is resolved there
+        int level;                          // number of functions around this one
+        int slot_count;
+    };
+
+    /*
+        Names declared in a block (in the body of a function, its parameters too) and
+        their slots in the frame of the function.
+    */
+    struct LexicalScope
+    {
+        LexicalScope(const LexicalScope* parent, FrameLayout* function) : parent(parent), function(function) {}
+
+        // slot of 'name', given a new one if the scope doesn't have it yet
+        int declare(const QString& name);
+
+        const LexicalScope* parent;
+        FrameLayout* function;
+        QHash<QString, int> names;
+    };
+
+    /*
+        Lexical addressing: binds every identifier, assignment and function declaration to
+        the frame slots its name may refer to (AST::Binding), so the interpreter reads and
+        writes variables by index instead of looking names up.
+
+        An assignment creates the variable in the innermost block unless one of the blocks
+        around it, up to the body of the function, already holds a variable of that name.
+        A read sees the blocks around it, then the blocks around the function, and so on
+        out to the top level of the script, then builtins. Whether a variable exists
+        depends on what has run, so each block gets its own slot for every name assigned
+        in it and the interpreter takes the first slot holding a value.
+
+        Names that aren't assigned in any scope a read can see and aren't builtins are
+        reported as CheckerError.
+
+        Scopes are allocated in the arena of the program: deferred function bodies are
+        resolved when they get parsed, against the scope they were declared in.
+    */
+    class Resolver : public ASTTools::NodeVisitor
+    {
+    public:
+        // resolves the tree of 'program' and sets its top level layout
+        static void resolve(Program& program);
+
+        // resolves a body parsed after the rest of the program, see WS::UserFunction::body
+        static void resolve_body(Program& program, FrameLayout& layout, const QStringList& parameters, AST::Block* body);
+
+        VISITOR_METHODS
+
+    private:
+        Resolver(Program& program, FrameLayout* function) : program(program), function(function), scope(NULL) {}
+
+        // declares the names a list of statements assigns in 'block_scope', without going into nested blocks
+        void declare(LexicalScope* block_scope, const AST::NodeList<AST::Node>& statements);
+        void resolve_statements(LexicalScope* block_scope, const AST::NodeList<AST::Node>& statements);
+        void resolve_function(FrameLayout* layout, const QStringList& parameters, AST::Block* body);
+
+        AST::Binding bind_read(const QString& name, ulong line);
+        AST::Binding bind_write(const QString& name);
+        AST::Binding make_binding(const QVector<AST::Address>& addresses, const WS::SP_Object* builtin);
+
+        Program& program;
+        FrameLayout* function;
+        const LexicalScope* scope;
+    };
+
+};
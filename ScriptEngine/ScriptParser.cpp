@@ -1,8 +1,15 @@
 #include "ScriptParser.h"
 #include "Errors.h"
 #include "Checker.h"
-
-#include <QRegExp>
+#include "Resolver.h"
+#include "Optimizer.h"
+#include "LoopInvariants.h"
+#include "Inliner.h"
+#include "TypeInference.h"
+#include "Lexer.h"
+
+#include <QVarLengthArray>
+#include <QScopedPointer>
 #include <QDebug>
 
 #include <exception>
@@ -15,82 +22,80 @@ const Statics Parser::statics;
 
 Statics::Statics()
 {
-    keywords << "while" << "if" << "else" << "def" << "true" << "false"
-        << "return" << "break" << "continue" << "or" << "and" << "not" << "None";
-
-    regexps[Token::Identifier] = QRegExp( "^(" "[_A-Za-z][_A-Za-z0-9]*"
-                                           "|" "operator.+(?=\\()"
-                                           ")" );
-    regexps[Token::Rational] = QRegExp( "^\\d*\\.\\d+" );
-    regexps[Token::Integral] = QRegExp( "^\\d+" );
-    regexps[Token::Literal] = QRegExp( "^("    "\"[^\"\\r\\n]*\""
-                                           "|" "\'[^\'\\r\\n]*\'"
-                                       ")" );
-
-    regexps[Token::Operator] = QRegExp( "^("    "="
-                                            "|" "<"
-                                            "|" ">"
-                                            "|" "<="
-                                            "|" ">="
-                                            "|" "=="
-                                            "|" "!="
-                                            "|" "\\+"
-                                            "|" "-"
-                                            "|" "\\*"
-                                            "|" "/"
-                                            "|" "%"
-                                            "|" "\\("
-                                            "|" "\\)"
-                                            "|" "\\{"
-                                            "|" "\\}"
-                                            "|" "\\["
-                                            "|" "\\]"
-                                            "|" ";"
-                                            "|" "\\."
-                                            "|" ","
-                                        ")" );
-
-    regexps[Token::Whitespace] = QRegExp( "^[ \t]*" );
-    regexps[Token::Newline] = QRegExp( "^(\\n|\\r\\n)" );
-    regexps[Token::Comment] = QRegExp( "^//[^\\n\\r]*" );
-
-    precedence_to_operators[3] = QSet<QString>() << "*" << "/" << "%";
-    precedence_to_operators[4] = QSet<QString>() << "+" << "-";
-    precedence_to_operators[5] = QSet<QString>() << ">" << "<" << "<=" << ">=";
-    precedence_to_operators[6] = QSet<QString>() << "==" << "!=";
-    precedence_to_operators[7] = QSet<QString>() << "and";
-    precedence_to_operators[8] = QSet<QString>() << "or";
-
-    string_to_oper_type["="] = OperatorTypes::Assign;
-    string_to_oper_type["[]"] = OperatorTypes::Subscript;
-    string_to_oper_type["."] = OperatorTypes::Dot;
-    string_to_oper_type["unary_not"] = OperatorTypes::Not;
-    string_to_oper_type["+"] = OperatorTypes::Plus;
-    string_to_oper_type["unary_+"] = OperatorTypes::UnaryPlus;
-    string_to_oper_type["-"] = OperatorTypes::Minus;
-    string_to_oper_type["unary_-"] = OperatorTypes::UnaryMinus;
-    string_to_oper_type["*"] = OperatorTypes::Mult;
-    string_to_oper_type["/"] = OperatorTypes::Div;
-    string_to_oper_type["%"] = OperatorTypes::Mod;
-    string_to_oper_type["<"] = OperatorTypes::Less;
-    string_to_oper_type[">"] = OperatorTypes::Greater;
-    string_to_oper_type["<="] = OperatorTypes::LessEq;
-    string_to_oper_type[">="] = OperatorTypes::GreaterEq;
-    string_to_oper_type["=="] = OperatorTypes::Equal;
-    string_to_oper_type["!="] = OperatorTypes::NotEqual;
-    string_to_oper_type["and"] = OperatorTypes::And;
-    string_to_oper_type["or"] = OperatorTypes::Or;
+    for ( int code = 0; code < TokenCodes::CodeCount; ++code )
+    {
+        binary_precedence[code] = 0;
+        binary_oper_type[code] = OperatorTypes::Error;
+        unary_oper_type[code] = OperatorTypes::Error;
+    }
+
+    binary_precedence[TokenCodes::Mult] = 3;
+    binary_precedence[TokenCodes::Div] = 3;
+    binary_precedence[TokenCodes::Mod] = 3;
+    binary_precedence[TokenCodes::Plus] = 4;
+    binary_precedence[TokenCodes::Minus] = 4;
+    binary_precedence[TokenCodes::Greater] = 5;
+    binary_precedence[TokenCodes::Less] = 5;
+    binary_precedence[TokenCodes::LessEq] = 5;
+    binary_precedence[TokenCodes::GreaterEq] = 5;
+    binary_precedence[TokenCodes::Equal] = 6;
+    binary_precedence[TokenCodes::NotEqual] = 6;
+    binary_precedence[TokenCodes::And] = 7;
+    binary_precedence[TokenCodes::Or] = 8;
+
+    binary_oper_type[TokenCodes::Assign] = OperatorTypes::Assign;
+    binary_oper_type[TokenCodes::LeftBracket] = OperatorTypes::Subscript;
+    binary_oper_type[TokenCodes::Dot] = OperatorTypes::Dot;
+    binary_oper_type[TokenCodes::Plus] = OperatorTypes::Plus;
+    binary_oper_type[TokenCodes::Minus] = OperatorTypes::Minus;
+    binary_oper_type[TokenCodes::Mult] = OperatorTypes::Mult;
+    binary_oper_type[TokenCodes::Div] = OperatorTypes::Div;
+    binary_oper_type[TokenCodes::Mod] = OperatorTypes::Mod;
+    binary_oper_type[TokenCodes::Less] = OperatorTypes::Less;
+    binary_oper_type[TokenCodes::Greater] = OperatorTypes::Greater;
+    binary_oper_type[TokenCodes::LessEq] = OperatorTypes::LessEq;
+    binary_oper_type[TokenCodes::GreaterEq] = OperatorTypes::GreaterEq;
+    binary_oper_type[TokenCodes::Equal] = OperatorTypes::Equal;
+    binary_oper_type[TokenCodes::NotEqual] = OperatorTypes::NotEqual;
+    binary_oper_type[TokenCodes::And] = OperatorTypes::And;
+    binary_oper_type[TokenCodes::Or] = OperatorTypes::Or;
+
+    unary_oper_type[TokenCodes::Not] = OperatorTypes::Not;
+    unary_oper_type[TokenCodes::Plus] = OperatorTypes::UnaryPlus;
+    unary_oper_type[TokenCodes::Minus] = OperatorTypes::UnaryMinus;
 }
 
 
-TokenStream::TokenStream( QVector<Token> tokens, int position ) : tokens( tokens ), position ( position )
+TokenStream::TokenStream( const QVector<Token>& tokens, int position ) : tokens( tokens ), position ( position ), lexer( NULL )
 {
     if ( 0 > position || position >= tokens.size() )
         throw std::logic_error( "Starting position of a TokenStream is out of range" );
 }
 
+TokenStream::TokenStream( StreamLexer& lexer ) : position( 0 ), lexer( &lexer )
+{
+    if ( !lexer.next_batch( tokens ) )
+        throw std::logic_error( "TokenStream created on a finished StreamLexer" );
+}
+
+/*
+    In streaming mode only the current batch is kept; when it's used up the next one
+    is pulled from the lexer. The last token of the old batch is kept for previous(),
+    StreamLexer keeps its text alive for one more batch.
+*/
 void TokenStream::advance()
 {
+    if ( lexer != NULL && position + 1 == tokens.size() )
+    {
+        Token last = tokens.last();
+        if ( lexer->next_batch( tokens ) )
+        {
+            last_of_previous_batch = last;
+            position = 0;
+            return;
+        }
+    }
+
     if ( ++position > tokens.size() )
         throw std::logic_error( "Advanced past the end of the stream" );
 }
@@ -108,9 +113,9 @@ void TokenStream::match( const Token& token, bool only_try_to )
                               .arg(token.to_string(), current().to_string()) );
 }
 
-void TokenStream::match( const QString& value, bool only_try_to )
+void TokenStream::match( TokenCode code, bool only_try_to )
 {
-    if ( current().data() == value )
+    if ( current().code() == code )
     {
         advance();
         return;
@@ -118,7 +123,7 @@ void TokenStream::match( const QString& value, bool only_try_to )
 
     if ( !only_try_to )
         throw ParseError( QString("Expected \"%1\", but got \"%2\" instead")
-                              .arg( value, current().data() ) );
+                              .arg( TokenCodes::to_string(code), current().data() ) );
 }
 
 void TokenStream::match( const Token::Type& type, bool only_try_to )
@@ -134,19 +139,128 @@ void TokenStream::match( const Token::Type& type, bool only_try_to )
                               .arg( Token::type_toString(type), Token::type_toString(current().type()) ) );
 }
 
-Node* Parser::parse( QString script )
+Program* Parser::parse( QString script, bool lazy_functions, bool optimize, bool inline_functions )
+{
+    return _parse_source( &script, NULL, lazy_functions, optimize, inline_functions );
+}
+
+Program* Parser::parse( QIODevice* device, bool lazy_functions )
+{
+    return _parse_source( NULL, device, lazy_functions );
+}
+
+Block* Parser::parse_function_body( const DeferredBody& body )
+{
+    Program& program = body.program;
+    QVector<Token> tokens = Lexer::lex( body.text, body.begin, body.end, body.line, program.identifiers() );
+    TokenStream tstream( tokens );
+    // functions declared inside are deferred as well
+    Flags flags( Flags::NoSemicolon | Flags::LazyFunctions );
+    Block* block = NULL;
+
+    try
+    {
+        // the body is wrapped in the implicit braces of a script
+        tstream.match( TokenCodes::LeftBrace );
+        block = parse_block( tstream, flags, program );
+        tstream.match( TokenCodes::RightBrace );
+        tstream.match( Token::Eof );
+    }
+    catch ( const ParseError& e )
+    {
+        throw ParseError( QString("Parser: Error in token: %1 ;  %2").arg(tstream.current().to_string()).arg(e.what()) );
+    }
+
+    Checker checker( block, true );
+    checker.run();
+
+    return block;
+}
+
+void Parser::prepare( Program& program, bool optimize, bool inline_functions )
 {
+    Resolver::resolve( program );
+    if ( optimize )
+    {
+        Optimizer::optimize( program );
+        LoopInvariants::hoist( program );
+        if ( inline_functions )
+            Inliner::inline_calls( program );
+        TypeInference::infer( program );
+    }
+}
+
+QList<Node*> Parser::parse_statements( const QString& source, int begin, int end, ulong line,
+                                      Program& program, QVector<StatementStart>& starts )
+{
+    QVector<Token> tokens = Lexer::lex( source, begin, end, line, program.identifiers() );
+    TokenStream tstream( tokens );
+    Flags flags( Flags::NoSemicolon );
+    QList<Node*> statements;
+
+    starts.clear();
+
     try
     {
-        QVector<Token> tokens = _lex( script );
+        tstream.match( TokenCodes::LeftBrace );
 
-        /*
-        qDebug() << "Lexer:";
-        for ( int i = 0; i < tokens.size(); ++i )
-            qDebug() << qPrintable(tokens[i].to_string());
-        */
+        while ( !tstream.is_at( TokenCodes::RightBrace ) )
+        {
+            // literal tokens start after the opening quote
+            const Token& first = tstream.current();
+            StatementStart start = { first.type() == Token::Literal ? first.position() - 1 : first.position(), first.line() };
+            starts << start;
+
+            statements << parse_statement( tstream, flags, program );
+
+            Checker checker( statements.last() );
+            checker.run();
+            // folded once here; propagation needs bindings, which depend on the rest of the document
+            Optimizer::fold( program, statements.last() );
+        }
+
+        tstream.match( TokenCodes::RightBrace );
+        // a stray "}" would end the list early
+        tstream.match( Token::Eof );
+    }
+    catch ( const ParseError& e )
+    {
+        throw ParseError( QString("Parser: Error in token: %1 ;  %2").arg(tstream.current().to_string()).arg(e.what()) );
+    }
+
+    return statements;
+}
+
+Program* Parser::_parse_source( const QString* script, QIODevice* device, bool lazy_functions, bool optimize, bool inline_functions )
+{
+    const int extra_flags = lazy_functions ? Flags::LazyFunctions : 0;
+
+    // everything parsed so far goes away with the program if parsing fails
+    QScopedPointer<Program> program( new Program );
+
+    try
+    {
+        Block* root = NULL;
+
+        if ( script != NULL )
+        {
+            QVector<Token> tokens = _lex( *script, program->identifiers() );
+
+            /*
+            qDebug() << "Lexer:";
+            for ( int i = 0; i < tokens.size(); ++i )
+                qDebug() << qPrintable(tokens[i].to_string());
+            */
+
+            root = _parse_tokens( tokens, *program, lazy_functions );
+        }
+        else
+        {
+            StreamLexer lexer( device, program->identifiers() );
+            TokenStream tstream( lexer );
+            root = _parse( tstream, *program, extra_flags );
+        }
 
-        Node* root = _parse( tokens );
         if (root == NULL)
             return NULL;
 
@@ -160,7 +274,9 @@ Node* Parser::parse( QString script )
         Checker checker(root);
         checker.run();
 
-        return root;
+        program->set_root( root );
+        prepare( *program, optimize, inline_functions );
+        return program.take();
     }
     catch (const LexError& e)
     {
@@ -178,81 +294,25 @@ Node* Parser::parse( QString script )
     return NULL;
 }
 
-QVector<Token> VTScript::Parser::_lex( QString source )
+QVector<Token> VTScript::Parser::_lex( const QString& source, IdentifierTable& identifiers )
 {
-    QVector<Token> tokens;
-    ulong line = 1;
-    int position = 0;
-
-    tokens << Token(Token::Operator, "{", line);
-
-    while ( position < source.size() )
-    {
-        int max_len = 0;
-        Token::Type type;
-
-        for ( QHash<Token::Type, QRegExp>::const_iterator it = statics.regexps.begin(); it != statics.regexps.end(); ++it )
-        {
-            if ( -1 != it.value().indexIn( source, position, QRegExp::CaretAtOffset ) )
-            {
-                int len = it.value().matchedLength();
-                QString data = it.value().cap( 0 );
-
-                if ( len > max_len )
-                {
-                    max_len = len;
-                    type = it.key();
-                }
-            }
-        }
-
-        if ( max_len == 0 )
-        {
-            throw LexError( QString("Couldn't match any token in line %1").arg(line) );
-        }
-
-        if ( type == Token::Comment || type == Token::Whitespace )
-        {
-            //skip
-        }
-        else if ( type == Token::Newline )
-        {
-            line++;
-        }
-        else
-        {
-            QString value = statics.regexps[type].cap( 0 );
-
-            if ( type == Token::Literal )
-                value = value.mid(1, value.size()-2);
-
-            if ( type == Token::Identifier )
-            {
-                if ( statics.keywords.contains( value ) )
-                    type = Token::Keyword;
-            }
-
-            tokens << Token( type, value, line );
-        }
-
-        position += max_len;
-    }
-
-    tokens << Token(Token::Operator, "}", line);
-    tokens << Token(Token::Eof, "", line);
-    return tokens;
+    return Lexer::lex( source, identifiers );
 }
 
-Node* Parser::_parse( QVector<Token> tokens )
+Block* Parser::_parse_tokens( const QVector<Token>& tokens, Program& program, bool lazy_functions )
 {
     TokenStream tstream( tokens );
+    return _parse( tstream, program, lazy_functions ? Flags::LazyFunctions : 0 );
+}
 
-    Flags flags(Flags::NoSemicolon);
+Block* Parser::_parse( TokenStream& tstream, Program& program, int extra_flags )
+{
+    Flags flags(Flags::NoSemicolon | extra_flags);
 
     try
     {
         //main block is just a list of statements (block without curly braces)
-        return parse_block( tstream, flags );
+        return parse_block( tstream, flags, program );
     }
     catch ( const ParseError& e )
     {
@@ -270,33 +330,33 @@ Node* Parser::_parse( QVector<Token> tokens )
                |  CONTINUE
                |  EXPRESSION [;]
 */
-Node* Parser::parse_statement( TokenStream& tstream, Flags flags )
+Node* Parser::parse_statement( TokenStream& tstream, Flags flags, Program& program )
 {
-    if ( tstream.is_at("def") )
-        return parse_function_declaration(tstream,flags);
+    if ( tstream.is_at(TokenCodes::Def) )
+        return parse_function_declaration(tstream, flags, program);
 
-    else if ( tstream.is_at("while") )
-        return parse_while(tstream, flags);
+    else if ( tstream.is_at(TokenCodes::While) )
+        return parse_while(tstream, flags, program);
 
-    else if ( tstream.is_at("if") )
-        return parse_if(tstream, flags);
+    else if ( tstream.is_at(TokenCodes::If) )
+        return parse_if(tstream, flags, program);
 
-    else if ( tstream.is_at("{") )
-        return parse_block(tstream, flags);
+    else if ( tstream.is_at(TokenCodes::LeftBrace) )
+        return parse_block(tstream, flags, program);
 
-    else if ( tstream.is_at("return") )
-        return parse_return(tstream, flags);
+    else if ( tstream.is_at(TokenCodes::Return) )
+        return parse_return(tstream, flags, program);
 
-    else if ( tstream.is_at("break") )
-        return parse_break(tstream, flags);
+    else if ( tstream.is_at(TokenCodes::Break) )
+        return parse_break(tstream, flags, program);
 
-    else if ( tstream.is_at("continue") )
-        return parse_continue(tstream, flags);
+    else if ( tstream.is_at(TokenCodes::Continue) )
+        return parse_continue(tstream, flags, program);
 
     else
     {
-        Expression* expr = parse_expression_root(tstream, flags);
-        tstream.match( ";", flags.is_set(Flags::NoSemicolon) );
+        Expression* expr = parse_expression_root(tstream, flags, program);
+        tstream.match( TokenCodes::Semicolon, flags.is_set(Flags::NoSemicolon) );
         return expr;
     }
 }
@@ -304,30 +364,30 @@ Node* Parser::parse_statement( TokenStream& tstream, Flags flags )
 /*
     BLOCK ->  "{" STMT STMT ... "}"
 */
-Block* Parser::parse_block( TokenStream& tstream, Flags flags)
+Block* Parser::parse_block( TokenStream& tstream, Flags flags, Program& program )
 {
     ulong line = tstream.current().line();
-    QList<Node*> statements;
+    QVarLengthArray<Node*, 16> statements;
 
-    tstream.match( "{" );
+    tstream.match( TokenCodes::LeftBrace );
 
     while ( true )
     {
-        if (tstream.is_at("}"))
+        if (tstream.is_at(TokenCodes::RightBrace))
             break;
 
-        statements << parse_statement( tstream, flags );
+        statements.append( parse_statement( tstream, flags, program ) );
     }
 
-    tstream.match( "}" );
+    tstream.match( TokenCodes::RightBrace );
 
-    return new Block(line, statements);
+    return program.arena().create<Block>(line, NodeList<Node>::copy(program.arena(), statements));
 }
 
 /*
     FUNCTION ->  "def" <Identifier> "(" <Identifier> "," <Identifier> "," ... ")" BLOCK
 */
-FunctionDeclaration* Parser::parse_function_declaration( TokenStream& tstream, Flags flags )
+FunctionDeclaration* Parser::parse_function_declaration( TokenStream& tstream, Flags flags, Program& program )
 {
     ulong line = tstream.current().line();
 
@@ -335,46 +395,100 @@ FunctionDeclaration* Parser::parse_function_declaration( TokenStream& tstream, F
     QStringList params;
     Block* body;
 
-    tstream.match("def");
+    tstream.match(TokenCodes::Def);
     tstream.match(Token::Identifier);
-    name = tstream.previous().data();
-    tstream.match("(");
+    name = program.identifiers().name(tstream.previous().symbol());
+    tstream.match(TokenCodes::LeftParen);
 
     while ( true )
     {
-        if (tstream.is_at(")"))
+        if (tstream.is_at(TokenCodes::RightParen))
             break;
 
         tstream.match(Token::Identifier);
-        params << tstream.previous().data();
+        params << program.identifiers().name(tstream.previous().symbol());
 
-        if (tstream.is_at(")"))
+        if (tstream.is_at(TokenCodes::RightParen))
             break;
 
-        tstream.match(",");
+        tstream.match(TokenCodes::Comma);
     }
 
-    tstream.match( ")" );
-    body = parse_block(tstream, flags);
+    tstream.match( TokenCodes::RightParen );
+
+    if ( flags.is_set(Flags::LazyFunctions) )
+        return program.arena().create<FunctionDeclaration>(line, name, params, skip_function_body(tstream, flags, program));
 
-    return new FunctionDeclaration(line, name, params, body);
+    body = parse_block(tstream, flags, program);
+
+    return program.arena().create<FunctionDeclaration>(line, name, params, body);
+}
+
+/*
+    Steps over a brace balanced BLOCK without building anything and keeps its text
+    for Parser::parse_function_body.
+    Tokens of a script parsed from a string all view the same QString, which the body
+    then shares. A streamed script comes in batches with buffers of their own: pieces
+    of the body from every batch it spans are joined into a copy (the buffers of
+    consecutive batches follow each other without gaps, so line numbers stay right).
+*/
+DeferredBody* Parser::skip_function_body( TokenStream& tstream, Flags /*flags*/, Program& program )
+{
+    const Token open = tstream.current();
+    tstream.match( TokenCodes::LeftBrace );
+
+    const QString* source = open.source();
+    int piece_begin = open.position();
+    QString joined;
+    int depth = 1;
+
+    while ( true )
+    {
+        const Token& token = tstream.current();
+
+        if ( token.type() == Token::Eof )
+            throw ParseError( "Unexpected end of script in function body" );
+
+        if ( token.source() != source )
+        {
+            joined += source->mid( piece_begin );
+            source = token.source();
+            piece_begin = 0;
+        }
+
+        if ( token.code() == TokenCodes::LeftBrace )
+            ++depth;
+        else if ( token.code() == TokenCodes::RightBrace && --depth == 0 )
+            break;
+
+        tstream.advance();
+    }
+
+    const int end = tstream.current().position() + tstream.current().size();
+    tstream.advance();
+
+    if ( joined.isEmpty() )
+        return program.arena().create<DeferredBody>( program, *source, open.position(), end, open.line() );
+
+    joined += source->left( end );
+    return program.arena().create<DeferredBody>( program, joined, 0, joined.size(), open.line() );
 }
 
 /*
     WHILE ->  "while" "(" EXPRESSION ")" STATEMENT
      * here EXPRESSION has to actually be convertible to bool
 */
-While* Parser::parse_while( TokenStream& tstream, Flags flags )
+While* Parser::parse_while( TokenStream& tstream, Flags flags, Program& program )
 {
     ulong line = tstream.current().line();
 
-    tstream.match("while");
-    tstream.match("(");
-    Expression* cond = parse_expression_root(tstream, flags);
-    tstream.match(")");
-    Node* body = parse_statement(tstream, flags);
+    tstream.match(TokenCodes::While);
+    tstream.match(TokenCodes::LeftParen);
+    Expression* cond = parse_expression_root(tstream, flags, program);
+    tstream.match(TokenCodes::RightParen);
+    Node* body = parse_statement(tstream, flags, program);
     
-    return new While(line, cond, body);
+    return program.arena().create<While>(line, cond, body);
 }
 
 /*
@@ -382,26 +496,26 @@ While* Parser::parse_while( TokenStream& tstream, Flags flags )
      * here EXPRESSION has to actually be convertible to bool
      * "else STATEMENT" is filled with Noop if not present
 */
-If* Parser::parse_if( TokenStream& tstream, Flags flags )
+If* Parser::parse_if( TokenStream& tstream, Flags flags, Program& program )
 {
     ulong line = tstream.current().line();
 
-    tstream.match("if");
-    tstream.match("(");
-    Expression* cond = parse_expression_root(tstream, flags);
-    tstream.match(")");
-    Node* then_ = parse_statement(tstream, flags);
+    tstream.match(TokenCodes::If);
+    tstream.match(TokenCodes::LeftParen);
+    Expression* cond = parse_expression_root(tstream, flags, program);
+    tstream.match(TokenCodes::RightParen);
+    Node* then_ = parse_statement(tstream, flags, program);
     Node* else_ = NULL;
 
-    if ( tstream.is_at("else") )
+    if ( tstream.is_at(TokenCodes::Else) )
     {
         tstream.advance();
-        else_ = parse_statement(tstream, flags);
+        else_ = parse_statement(tstream, flags, program);
     }
     else
-        else_ = new Noop(line);
+        else_ = program.arena().create<Noop>(line);
 
-    return new If(line, cond, then_, else_);
+    return program.arena().create<If>(line, cond, then_, else_);
 }
 
 /*
@@ -409,41 +523,41 @@ If* Parser::parse_if( TokenStream& tstream, Flags flags )
      * here EXPRESSION has to evaluate to some object (as ALL expressions do, I guess...)
      * EXPRESSION should always be present
 */
-Return* Parser::parse_return( TokenStream& tstream, Flags flags )
+Return* Parser::parse_return( TokenStream& tstream, Flags flags, Program& program )
 {
     ulong line = tstream.current().line();
 
-    tstream.match("return");
-    Expression* expr = parse_expression_root(tstream, flags);
-    tstream.match( ";", flags.is_set(Flags::NoSemicolon) );
+    tstream.match(TokenCodes::Return);
+    Expression* expr = parse_expression_root(tstream, flags, program);
+    tstream.match( TokenCodes::Semicolon, flags.is_set(Flags::NoSemicolon) );
 
-    return new Return(line, expr);
+    return program.arena().create<Return>(line, expr);
 }
 
 /*
     BREAK ->  "break" [;]
 */
-Break* Parser::parse_break( TokenStream& tstream, Flags flags )
+Break* Parser::parse_break( TokenStream& tstream, Flags flags, Program& program )
 {
     ulong line = tstream.current().line();
 
-    tstream.match("break");
-    tstream.match( ";", flags.is_set(Flags::NoSemicolon) );
+    tstream.match(TokenCodes::Break);
+    tstream.match( TokenCodes::Semicolon, flags.is_set(Flags::NoSemicolon) );
 
-    return new Break(line);
+    return program.arena().create<Break>(line);
 }
 
 /*
     CONTINUE ->  "continue" [;]
 */
-Continue* Parser::parse_continue( TokenStream& tstream, Flags flags )
+Continue* Parser::parse_continue( TokenStream& tstream, Flags flags, Program& program )
 {
     ulong line = tstream.current().line();
 
-    tstream.match("continue");
-    tstream.match( ";", flags.is_set(Flags::NoSemicolon) );
+    tstream.match(TokenCodes::Continue);
+    tstream.match( TokenCodes::Semicolon, flags.is_set(Flags::NoSemicolon) );
 
-    return new Continue(line);
+    return program.arena().create<Continue>(line);
 }
 
 /*
@@ -475,25 +589,43 @@ Continue* Parser::parse_continue( TokenStream& tstream, Flags flags )
   IX    Assignment              =
 */
 
-Expression* Parser::parse_expression_root( TokenStream& tstream, Flags flags )
+Expression* Parser::parse_expression_root( TokenStream& tstream, Flags flags, Program& program )
 {
-    return parse_expression<9>( tstream, flags );
+    return parse_operators( tstream, flags, program, assignment_precedence );
 }
 
 
 /*
-    LVL_IX -> LVL_VIII "=" LVL_IX
-        
-        Luckily, we can leave this as it is.
+    Precedence climbing (Pratt parser) over the levels above, driven by statics.binary_precedence.
 
+    Operators III - VIII: the right operand of an operator of precedence P is parsed with
+    'level' P - 1, so it stops at the next operator of the same precedence, which is then
+    picked up by the loop here (left-to-right association).
+    IX: assignment is right-to-left and its left side has to be an identifier.
+    A leaf costs four calls whatever its depth in the table: operators, unary, postfix, leaf.
 */
-template<>
-Expression* Parser::parse_expression<9>( TokenStream& tstream, Flags flags )
+Expression* Parser::parse_operators( TokenStream& tstream, Flags flags, Program& program, int level )
 {
-    Expression* left_branch = parse_expression<8>( tstream, flags );
-    if ( tstream.is_at("=") )
+    Expression* left_branch = parse_unary( tstream, flags, program );
+
+    while ( true )
     {
-        OperatorType type = statics.string_to_oper_type["="];
+        TokenCode code = tstream.current().code();
+        int precedence = statics.binary_precedence[code];
+        if ( precedence == 0 || precedence > level )
+            break;
+
+        OperatorType type = statics.binary_oper_type[code];
+        ulong line = tstream.current().line();
+
+        tstream.advance();
+        Expression* right = parse_operators( tstream, flags, program, precedence - 1 );
+        left_branch = program.arena().create<BinaryOperator>( line, left_branch, right, type );
+    }
+
+    if ( level == assignment_precedence && tstream.is_at(TokenCodes::Assign) )
+    {
+        OperatorType type = statics.binary_oper_type[TokenCodes::Assign];
         ulong line = tstream.current().line();
 
         tstream.advance();
@@ -503,208 +635,86 @@ Expression* Parser::parse_expression<9>( TokenStream& tstream, Flags flags )
         if (name == NULL || !name->is_identifier())
             throw ParseError("Not a valid lvalue for assignment");
 
-        Expression* right = parse_expression<9>(tstream, flags);
-        return new BinaryOperator( line, left_branch, right, type );
-    }
-    else
-    {
-        return left_branch;
+        Expression* right = parse_operators( tstream, flags, program, assignment_precedence );
+        return program.arena().create<BinaryOperator>( line, left_branch, right, type );
     }
-}
-
-
-/*
-Left-recursive version:
-    LVL_III -> LVL_III "*" LVL_II
-             | LVL_III "/" LVL_II
-             | LVL_III "%" LVL_II
-             | LVL_II
-
-    LVL_IV -> LVL_IV "+" LVL_III
-            | LVL_IV "-" LVL_III
-            | LVL_III
-
-    LVL_V -> LVL_V ">" LVL_IV
-           | LVL_V "<" LVL_IV
-           | LVL_V ">=" LVL_IV
-           | LVL_V "<=" LVL_IV
-           | LVL_IV
-
-    LVL_VI -> LVL_VI "==" LVL_V
-            | LVL_VI "!=" LVL_V
-            | LVL_V
-
-    LVL_VII -> LVL_VII "and" LVL_VI
-             | LVL_VI
-
-    LVL_VIII -> LVL_VIII "or" LVL_VII
-              | LVL_VII
-
-   Sadly, we must convert this version to right-recursive to be able to implement it in top-down parser
-
-Right-recursive version:
-    LVL_III -> LVL_II SUB_LVL_III
-
-    SUB_LVL_III -> "*" LVL_II SUB_LVL_III
-                 | "/" LVL_II SUB_LVL_III
-                 | "%" LVL_II SUB_LVL_III
-                 | e
-
-     and so on ...
 
-        * Left branch becomes a child of right branch (left-to-right association)
-*/
-template<int precedence>
-Expression* Parser::parse_expression( TokenStream& tstream, Flags flags )
-{
-    Expression* left_branch = parse_expression<precedence-1>( tstream, flags );
-    Expression* root = parse_expression_subtree<precedence>( left_branch, tstream, flags );
-
-    if ( root == NULL )
-        root = left_branch;
-
-    return root;
+    return left_branch;
 }
 
-// SUB_LVL_PRECEDENCE
-template<int precedence>
-Expression* Parser::parse_expression_subtree( AST::Expression* left_branch, TokenStream& tstream, Flags flags )
+// II (right-to-left association)
+Expression* Parser::parse_unary( TokenStream& tstream, Flags flags, Program& program )
 {
-    Expression* result;
-    if ( ( tstream.current().type() == Token::Operator || tstream.current().type() == Token::Keyword )
-        && statics.precedence_to_operators[precedence].contains(tstream.current().data()) )
+    OperatorType type = statics.unary_oper_type[tstream.current().code()];
+    if ( type != OperatorTypes::Error )
     {
-        OperatorType type = statics.string_to_oper_type[tstream.current().data()];
         ulong line = tstream.current().line();
 
         tstream.advance();
-        Expression* right = parse_expression<precedence-1>(tstream, flags);
-        result = new BinaryOperator( line, left_branch, right, type );
+        Expression* arg = parse_unary( tstream, flags, program );
+        return program.arena().create<UnaryOperator>( line, arg, type );
     }
-    else
-        return NULL;
-
-    // Parse next "same-level" expression in chain
-    Expression* root = parse_expression_subtree<precedence>( result, tstream, flags );
-
-    if ( root == NULL )
-        root = result;
 
-    return root;
+    return parse_postfix( tstream, flags, program );
 }
 
-
-/*
-    LVL_II -> not LVL_II
-            | + LVL_II
-            | - LVL_II
-            | LVL_I
-
-    Luckily, we can leave this as it is.
-
-     * (right-to-left association)
-*/
-template<>
-Expression* Parser::parse_expression<2>( TokenStream& tstream, Flags flags )
+// I (left-to-right association)
+Expression* Parser::parse_postfix( TokenStream& tstream, Flags flags, Program& program )
 {
-    if ( tstream.is_at("not") || tstream.is_at("+") || tstream.is_at("-") )
+    Expression* result = parse_expression_leaf( tstream, flags, program );
+
+    while ( true )
     {
-        OperatorType type = statics.string_to_oper_type["unary_" + tstream.current().data()];
         ulong line = tstream.current().line();
 
-        tstream.advance();
-        Expression* arg = parse_expression<2>(tstream, flags);
-        return new UnaryOperator(line, arg, type);
+        if ( tstream.is_at(TokenCodes::LeftParen) )             // function call
+        {
+            NodeList<Expression> args = parse_call_arguments( tstream, flags, program );
+            result = program.arena().create<FunctionCall>( line, result, args );
+        }
+        else if ( tstream.is_at(TokenCodes::LeftBracket) )      // Subscription
+        {
+            OperatorType type = statics.binary_oper_type[TokenCodes::LeftBracket];
+            tstream.advance();
+            Expression* right = parse_expression_root( tstream, flags, program );
+            tstream.match( TokenCodes::RightBracket );
+            result = program.arena().create<BinaryOperator>( line, result, right, type );
+        }
+        else if ( tstream.is_at(TokenCodes::Dot) )              // Element selection
+        {
+            OperatorType type = statics.binary_oper_type[TokenCodes::Dot];
+            tstream.advance();
+            Expression* right = parse_expression_root( tstream, flags, program );
+            result = program.arena().create<BinaryOperator>( line, result, right, type );
+        }
+        else
+            return result;
     }
-
-    return parse_expression<1>(tstream, flags);   //fall-through
 }
 
-
 /*
-Left-recursive version:
-    LVL_I -> LVL_I "(" EXPRESSION "," EXPRESSION "," ... ")"
-           | LVL_I "[" EXPRESSION "]"
-           | LVL_I "." LVL_0
-           | LVL_0
-
-   Sadly, we must convert this version to right-recursive to be able to implement it in top-down parser
-
-Right-recursive version:
-    LVL_I -> LVL_0 SUB_LVL_I
-
-    SUB_LVL_I -> "(" EXPRESSION "," EXPRESSION "," ... ")" SUB_LVL_I    // unary operator
-               | "[" EXPRESSION "]" SUB_LVL_I                           // unary operator
-               | "." LVL_0 SUB_LVL_I                                    // binary operator
-               | e                                                      // empty token
-
-        * Left branch becomes a child of right branch (left-to-right association)
+    ARGUMENTS ->  "(" EXPRESSION "," EXPRESSION "," ... ")"
 */
-template<>
-Expression* Parser::parse_expression<1>( TokenStream& tstream, Flags flags )
+NodeList<Expression> Parser::parse_call_arguments( TokenStream& tstream, Flags flags, Program& program )
 {
-    Expression* left_branch = parse_expression_leaf( tstream, flags );
-    Expression* root = parse_expression_subtree<1>( left_branch, tstream, flags );
-
-    if ( root == NULL )
-        root = left_branch;
+    tstream.match(TokenCodes::LeftParen);
+    QVarLengthArray<Expression*, 8> args;
 
-    return root;
-}
-
-// SUB_LVL_I
-template<>
-Expression* Parser::parse_expression_subtree<1>( AST::Expression* left_branch, TokenStream& tstream, Flags flags )
-{
-    Expression* result;
-    ulong line = tstream.current().line();
-
-    if (tstream.is_at("("))             // function call
+    while ( true )
     {
-        tstream.match("(");
-        QList<Expression*> args;
-
-        while ( true )
-        {
-            if (tstream.is_at(")"))
-                break;
-
-            args << parse_expression_root(tstream, flags);
+        if (tstream.is_at(TokenCodes::RightParen))
+            break;
 
-            if (tstream.is_at(")"))
-                break;
+        args.append(parse_expression_root(tstream, flags, program));
 
-            tstream.match(",");
-        }
+        if (tstream.is_at(TokenCodes::RightParen))
+            break;
 
-        tstream.match(")");
-        result = new FunctionCall(line, left_branch, args);
-    }
-    else if (tstream.is_at("["))        // Subscription
-    {
-        OperatorType type = statics.string_to_oper_type["[]"];
-        tstream.match("[");
-        Expression* right = parse_expression_root(tstream, flags);
-        tstream.match("]");
-        result = new BinaryOperator(line, left_branch, right, type);
-    }
-    else if (tstream.is_at("."))        // Element selection
-    {
-        OperatorType type = statics.string_to_oper_type["."];
-        tstream.match(".");
-        Expression* right = parse_expression_root(tstream, flags);
-        result = new BinaryOperator(line, left_branch, right, type);
+        tstream.match(TokenCodes::Comma);
     }
-    else                                        // e
-        return NULL;
-
-    // Parse next "same-level" expression in chain (SUB_LVL_I)
-    Expression* root = parse_expression_subtree<1>( result, tstream, flags );
-
-    if ( root == NULL )
-        root = result;
 
-    return root;
+    tstream.match(TokenCodes::RightParen);
+    return NodeList<Expression>::copy(program.arena(), args);
 }
 
 
@@ -716,34 +726,40 @@ Expression* Parser::parse_expression_subtree<1>( AST::Expression* left_branch, T
            | "false"
            | "(" EXPRESSION ")"
 */
-Expression* Parser::parse_expression_leaf( TokenStream& tstream, Flags flags )
+Expression* Parser::parse_expression_leaf( TokenStream& tstream, Flags flags, Program& program )
 {
-    if ( tstream.is_at("(") )
+    if ( tstream.is_at(TokenCodes::LeftParen) )
     {
-        tstream.match("(");
-        Expression* expr = parse_expression_root( tstream, flags );
-        tstream.match(")");
+        tstream.match(TokenCodes::LeftParen);
+        Expression* expr = parse_expression_root( tstream, flags, program );
+        tstream.match(TokenCodes::RightParen);
         return expr;
     }
     else if ( tstream.is_at(Token::Identifier) ||
               tstream.is_at(Token::Integral) ||
               tstream.is_at(Token::Rational) ||
               tstream.is_at(Token::Literal) ||
-              tstream.is_at("true") ||
-              tstream.is_at("false") ||
-              tstream.is_at("None"))
+              tstream.is_at(TokenCodes::True) ||
+              tstream.is_at(TokenCodes::False) ||
+              tstream.is_at(TokenCodes::None))
     {
         ulong line = tstream.current().line();
-        Token token = tstream.current();
+        QString name;
         WS::SP_Object object;
 
-        // create WSObjects for the token, so we don't need to do it in interpreter
+        // create WSObjects for the token, so we don't need to do it in interpreter;
+        // identifier is the only token whose text is kept in the tree, shared with the identifier table
         switch (tstream.current().type())
         {
+        case Token::Identifier:
+            {
+                name = program.identifiers().name(tstream.current().symbol());
+            }
+            break;
         case Token::Rational:
             {
                 bool ok;
-                double d = tstream.current().data().toDouble(&ok);
+                double d = tstream.current().text().toDouble(&ok);
                 if (ok)
                     object = WS::SP_Object(new WS::Rational(d));
                 else
@@ -753,7 +769,7 @@ Expression* Parser::parse_expression_leaf( TokenStream& tstream, Flags flags )
         case Token::Integral:
             {
                 bool ok;
-                long long l = tstream.current().data().toLongLong(&ok);
+                long long l = tstream.current().text().toLongLong(&ok);
                 if (ok)
                     object = WS::SP_Object(new WS::Integral(l));
                 else
@@ -767,18 +783,18 @@ Expression* Parser::parse_expression_leaf( TokenStream& tstream, Flags flags )
             break;
         case Token::Keyword:
             {
-                if (tstream.current().data() == "true")
+                if (tstream.is_at(TokenCodes::True))
                     object = WS::SP_Object(new WS::Bool(true));
-                else if (tstream.current().data() == "false")
+                else if (tstream.is_at(TokenCodes::False))
                     object = WS::SP_Object(new WS::Bool(false));
-                else if (tstream.current().data() == "None")
+                else if (tstream.is_at(TokenCodes::None))
                     object = WS::SP_Object(new WS::None());
             }
             break;
         }
 
         tstream.advance();
-        return new Leaf(line, token, object);
+        return program.arena().create<Leaf>(line, name, object);
     }
 
     throw ParseError( QString("Unexpected token \"%1\" while parsing expression leaf")
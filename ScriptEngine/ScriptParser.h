@@ -2,47 +2,64 @@
 #define _WOW_SCRIPT_PARSER_H_
 
 #include "AST.h"
+#include "Program.h"
 #include "Token.h"
+#include "Identifiers.h"
 
 #include <QString>
 #include <QVector>
 #include <QHash>
 #include <QSet>
 
+class QIODevice;
+
 namespace VTScript
 {
+    class StreamLexer;
+
     /* Used by parser to iterate, query and check tokens */
     class TokenStream
     {
     public:
-        TokenStream( QVector<Token> tokens, int position = 0 );
+        TokenStream( const QVector<Token>& tokens, int position = 0 );
+        // pulls tokens from 'lexer' in batches, as parser consumes them; throws LexError
+        TokenStream( StreamLexer& lexer );
 
         void advance();
         void match( const Token& token, bool only_try_to = false );
-        void match( const QString& value, bool only_try_to = false );
+        void match( TokenCode code, bool only_try_to = false );
         void match( const Token::Type& type, bool only_try_to = false );
 
-        inline bool is_at(const QString& value) const { return current().data() == value; }
+        inline bool is_at(TokenCode code) const { return current().code() == code; }
         inline bool is_at(const Token::Type& type) const { return current().type() == type; }
 
         const Token& current() const { return tokens[position]; }
-        const Token& previous() const { return tokens[position-1]; }
+        const Token& previous() const { return position > 0 ? tokens[position-1] : last_of_previous_batch; }
 
     private:
         QVector<Token> tokens;
         int position;
+        StreamLexer* lexer;
+        Token last_of_previous_batch;
     };
 
-    /* Constant data structures, used by parser and lexer; never change */
+    /* Constant data structures, used by parser; never change */
     struct Statics
     {
         Statics();
         ~Statics() {}
 
-        QSet<QString> keywords;
-        QHash<Token::Type, QRegExp> regexps;
-        QHash<int, QSet<QString> > precedence_to_operators;
-        QHash<QString, OperatorTypes::OperatorType> string_to_oper_type;
+        // indexed by TokenCode
+        int binary_precedence[TokenCodes::CodeCount];  // 0 if token isn't a binary operator
+        OperatorType binary_oper_type[TokenCodes::CodeCount];
+        OperatorType unary_oper_type[TokenCodes::CodeCount];
+    };
+
+    /* Where a top level statement starts, see Parser::parse_statements */
+    struct StatementStart
+    {
+        int position;   // first character of the statement
+        ulong line;     // line of that character
     };
 
     /* Options, used by parsing routines */
@@ -51,9 +68,10 @@ namespace VTScript
     public:
         enum _Flags
         {
-            NoSemicolon = 1
+            NoSemicolon = 1,
+            LazyFunctions = 2           // function bodies are parsed on first call, see Parser::skip_function_body
             /*
-            2, 4, 8, 16, ...
+            4, 8, ...
             */
         };
 
@@ -68,7 +86,7 @@ namespace VTScript
         int parse_flags;
     };
 
-#define PARSE_ARGUMENTS TokenStream& tstream, Flags flags
+#define PARSE_ARGUMENTS TokenStream& tstream, Flags flags, Program& program
 
     class Parser
     {
@@ -77,13 +95,49 @@ namespace VTScript
         /*
             TODO: add parsing for lists
         */
-        // returns NULL on failure
-        static AST::Node* parse( QString script );
+        /*
+            With 'lazy_functions' bodies of functions are only skipped over and get parsed
+            and checked when the function is called for the first time, so errors in them
+            show up only then, see WS::UserFunction::body.
+            Without 'optimize' the tree is left as written instead of going through
+            Optimizer, LoopInvariants and TypeInference; bodies parsed on demand are
+            optimized anyway.
+            Without 'inline_functions' the optimized tree keeps every call, see Inliner.
+        */
+        // returns NULL on failure; caller owns the program
+        static Program* parse( QString script, bool lazy_functions = false, bool optimize = true, bool inline_functions = true );
+
+        // reads and lexes 'device' in chunks while parsing, so that the whole token
+        // stream never has to be in memory at once; returns NULL on failure
+        static Program* parse( QIODevice* device, bool lazy_functions = false );
+
+        // throws LexError, ParseError, CheckerError; allocates the body in the program it belongs to
+        static AST::Block* parse_function_body( const DeferredBody& body );
+
+        /*
+            Resolves a checked tree and puts it through the passes parse() runs: Optimizer,
+            LoopInvariants, Inliner (unless not 'inline_functions') and TypeInference, or
+            none of them without 'optimize'. For trees that don't come from parse(), see
+            IncrementalParser and CompiledScript.
+        */
+        // throws CheckerError
+        static void prepare( Program& program, bool optimize = true, bool inline_functions = true );
+
+        /*
+            Parses source[begin, end), starting at 'line', as a list of top level statements
+            and checks them one by one. 'starts' receives where every statement starts.
+            Statements are allocated in 'program', also when parsing fails.
+            Used to reparse parts of a document, see IncrementalParser.
+        */
+        // throws LexError, ParseError, CheckerError
+        static QList<AST::Node*> parse_statements( const QString& source, int begin, int end, ulong line,
+                                                   Program& program, QVector<StatementStart>& starts );
 
     private:
         static AST::Node* parse_statement( PARSE_ARGUMENTS );
         static AST::Block* parse_block( PARSE_ARGUMENTS );
         static AST::FunctionDeclaration* parse_function_declaration( PARSE_ARGUMENTS );
+        static DeferredBody* skip_function_body( PARSE_ARGUMENTS );
         static AST::While* parse_while( PARSE_ARGUMENTS );
         static AST::If* parse_if( PARSE_ARGUMENTS );
         static AST::Return* parse_return( PARSE_ARGUMENTS );
@@ -91,31 +145,31 @@ namespace VTScript
         static AST::Continue* parse_continue( PARSE_ARGUMENTS );
 
         static AST::Expression* parse_expression_root( PARSE_ARGUMENTS );
+        // binary operators of precedence up to 'level', and assignment if 'level' allows it
+        static AST::Expression* parse_operators( PARSE_ARGUMENTS, int level );
+        static AST::Expression* parse_unary( PARSE_ARGUMENTS );
+        static AST::Expression* parse_postfix( PARSE_ARGUMENTS );
+        static AST::NodeList<AST::Expression> parse_call_arguments( PARSE_ARGUMENTS );
         static AST::Expression* parse_expression_leaf( PARSE_ARGUMENTS );
 
-        template<int precedence>
-        static AST::Expression* parse_expression( PARSE_ARGUMENTS );
-        template<>
-        static AST::Expression* parse_expression<1>( PARSE_ARGUMENTS );
-        template<>
-        static AST::Expression* parse_expression<2>( PARSE_ARGUMENTS );
-        template<>
-        static AST::Expression* parse_expression<9>( PARSE_ARGUMENTS );
-
-        template<int precedence>
-        static AST::Expression* parse_expression_subtree( AST::Expression* left_branch, PARSE_ARGUMENTS );
-        template<>
-        static AST::Expression* parse_expression_subtree<1>( AST::Expression* left_branch, PARSE_ARGUMENTS );
+        static const int assignment_precedence = 9;
 
     public:
         static const Statics statics;
 
+        // throws ParseError; parses lexed 'tokens' into 'program' without checking them
+        static AST::Block* _parse_tokens( const QVector<Token>& tokens, Program& program, bool lazy_functions = false );
+
     private:
         // throws LexError
-        static QVector<Token> _lex( QString source );
+        static QVector<Token> _lex( const QString& source, IdentifierTable& identifiers );
 
         // throws ParseError
-        static AST::Node* _parse( QVector<Token> tokens );
+        static AST::Block* _parse( TokenStream& tstream, Program& program, int extra_flags = 0 );
+
+        // exactly one of 'script' and 'device' is set; returns NULL on failure
+        static Program* _parse_source( const QString* script, QIODevice* device, bool lazy_functions,
+                                       bool optimize = true, bool inline_functions = true );
     };
 
 }
@@ -1 +1,82 @@
 #include "Token.h"
+
+using namespace VTScript;
+
+namespace
+{
+    struct Spelling
+    {
+        const char* text;
+        TokenCode code;
+    };
+
+    const Spelling operators[] =
+    {
+        { "=", TokenCodes::Assign },        { "<", TokenCodes::Less },
+        { ">", TokenCodes::Greater },       { "<=", TokenCodes::LessEq },
+        { ">=", TokenCodes::GreaterEq },    { "==", TokenCodes::Equal },
+        { "!=", TokenCodes::NotEqual },     { "+", TokenCodes::Plus },
+        { "-", TokenCodes::Minus },         { "*", TokenCodes::Mult },
+        { "/", TokenCodes::Div },           { "%", TokenCodes::Mod },
+        { "(", TokenCodes::LeftParen },     { ")", TokenCodes::RightParen },
+        { "{", TokenCodes::LeftBrace },     { "}", TokenCodes::RightBrace },
+        { "[", TokenCodes::LeftBracket },   { "]", TokenCodes::RightBracket },
+        { ";", TokenCodes::Semicolon },     { ".", TokenCodes::Dot },
+        { ",", TokenCodes::Comma },
+        { 0, TokenCodes::Nothing }
+    };
+
+    const Spelling keywords[] =
+    {
+        { "while", TokenCodes::While },     { "if", TokenCodes::If },
+        { "else", TokenCodes::Else },       { "def", TokenCodes::Def },
+        { "true", TokenCodes::True },       { "false", TokenCodes::False },
+        { "return", TokenCodes::Return },   { "break", TokenCodes::Break },
+        { "continue", TokenCodes::Continue }, { "or", TokenCodes::Or },
+        { "and", TokenCodes::And },         { "not", TokenCodes::Not },
+        { "None", TokenCodes::None },
+        { 0, TokenCodes::Nothing }
+    };
+
+    bool spelled( const char* text, const QChar* data, int size )
+    {
+        int i = 0;
+        for ( ; i < size && text[i]; ++i )
+            if ( data[i].unicode() != static_cast<ushort>(text[i]) )
+                return false;
+        return i == size && !text[i];
+    }
+
+    TokenCode find( const Spelling* table, const QChar* data, int size )
+    {
+        for ( ; table->text; ++table )
+            if ( spelled( table->text, data, size ) )
+                return table->code;
+        return TokenCodes::Nothing;
+    }
+}
+
+
+const char* TokenCodes::to_string( TokenCode code )
+{
+    for ( const Spelling* s = operators; s->text; ++s )
+        if ( s->code == code )
+            return s->text;
+    for ( const Spelling* s = keywords; s->text; ++s )
+        if ( s->code == code )
+            return s->text;
+    return "";
+}
+
+TokenCode TokenCodes::operator_code( const QChar* data, int size )
+{
+    return find( operators, data, size );
+}
+
+TokenCode TokenCodes::keyword_code( const QChar* data, int size )
+{
+    // most identifiers are rejected here: keywords are 2 to 8 lower case letters, except "None"
+    if ( size < 2 || size > 8 || ( data[0].unicode() > 'w' ) || ( data[0].unicode() < 'a' && data[0].unicode() != 'N' ) )
+        return TokenCodes::Nothing;
+    return find( keywords, data, size );
+}
@@ -3,9 +3,71 @@
 #include "Enums.h"
 
 #include <QString>
+#include <QStringRef>
 
 namespace VTScript
 {
+    namespace TokenCodes
+    {
+        /*
+            Dense code of operator and keyword tokens, so that parser decisions
+            are integer compares and table lookups instead of string compares.
+        */
+        enum TokenCode
+        {
+            Nothing = 0,    // identifiers, numbers, literals
+
+            // operators
+            Assign,         // "="
+            Less,           // "<"
+            Greater,        // ">"
+            LessEq,         // "<="
+            GreaterEq,      // ">="
+            Equal,          // "=="
+            NotEqual,       // "!="
+            Plus,           // "+"
+            Minus,          // "-"
+            Mult,           // "*"
+            Div,            // "/"
+            Mod,            // "%"
+            LeftParen,      // "("
+            RightParen,     // ")"
+            LeftBrace,      // "{"
+            RightBrace,     // "}"
+            LeftBracket,    // "["
+            RightBracket,   // "]"
+            Semicolon,      // ";"
+            Dot,            // "."
+            Comma,          // ","
+
+            // keywords
+            While,
+            If,
+            Else,
+            Def,
+            True,
+            False,
+            Return,
+            Break,
+            Continue,
+            Or,
+            And,
+            Not,
+            None,
+
+            CodeCount
+        };
+
+        const char* to_string( TokenCode code );
+
+        // code of operator text; Nothing if it isn't one
+        TokenCode operator_code( const QChar* data, int size );
+        // code of keyword text; Nothing if it isn't one
+        TokenCode keyword_code( const QChar* data, int size );
+    };
+
+    typedef TokenCodes::TokenCode TokenCode;
+
     struct Token
     {
         enum Type
@@ -42,34 +104,51 @@ namespace VTScript
             }
         }
 
-        Token(): _type( Error ), _data( "Error" ), _line( -1 ) {}
-        Token( Type t, QString d ) : _type( t ), _data( d ), _line( -1 ) {}
-        Token( Type t, QString d, ulong l ) : _type( t ), _data( d ), _line( l ) {}
+        /*
+            Tokens don't own their text, they are views into the source buffer they were lexed from
+            (or into a static string for tokens that don't come from source, like the implicit
+            braces around the script). The buffer has to outlive the tokens.
+            Use text() for comparisons; data() makes a copy.
+
+            'id' is the TokenCode of operators and keywords and the interned symbol id
+            (see IdentifierTable) of identifiers.
+        */
+        Token(): _type( Error ), _id( 0 ), _source( &error_text() ), _position( 0 ), _size( error_text().size() ), _line( -1 ) {}
+        Token( Type t, const QString* text, ulong l, int id = 0 ) :
+            _type( t ), _id( id ), _source( text ), _position( 0 ), _size( text->size() ), _line( l ) {}
+        Token( Type t, const QString* source, int position, int size, ulong l, int id = 0 ) :
+            _type( t ), _id( id ), _source( source ), _position( position ), _size( size ), _line( l ) {}
 
         inline bool operator==( const Token& other ) const
-        { return ( this->type() == other.type() && this->data() == other.data() ); }
+        { return ( this->type() == other.type() && this->_id == other._id && this->text() == other.text() ); }
 
         inline bool operator!=( const Token& other ) const
         { return !( *this == other ); }
 
-        inline Token& operator=( const Token& other )
-        {
-            this->_type = other.type();
-            this->_data = other.data();
-            this->_line = other.line();
-            return *this;
-        }
-
         inline QString to_string() const
-        { return QString( "line: %1 { %2 } '%3'" ).arg( _line ).arg( type_toString( _type ) ).arg( _data ); }
+        { return QString( "line: %1 { %2 } '%3'" ).arg( _line ).arg( type_toString( _type ) ).arg( data() ); }
 
         inline const Type& type() const { return _type; }
-        inline const QString& data() const { return _data; }
+        inline TokenCode code() const
+        { return ( _type == Operator || _type == Keyword ) ? static_cast<TokenCode>( _id ) : TokenCodes::Nothing; }
+        inline int symbol() const { return _type == Identifier ? _id : -1; }
+        inline void set_symbol( int symbol ) { _id = symbol; }
+        inline QStringRef text() const { return QStringRef( _source, _position, _size ); }
+        inline QString data() const { return text().toString(); }
+        inline const QString* source() const { return _source; }
+        inline int position() const { return _position; }
+        inline int size() const { return _size; }
         inline const ulong line() const { return _line; }
+        inline void set_line( ulong line ) { _line = line; }
 
     private:
+        static const QString& error_text() { static const QString text( "Error" ); return text; }
+
         Type _type;
-        QString _data;
+        int _id;
+        const QString* _source;
+        int _position;
+        int _size;
         ulong _line;
     };
 
@@ -0,0 +1,384 @@
+#include "TypeInference.h"
+#include "Builtin.h"
+
+using namespace VTScript;
+
+namespace
+{
+    bool is_comparison(OperatorType type)
+    {
+        switch (type)
+        {
+        case OperatorTypes::Less:
+        case OperatorTypes::Greater:
+        case OperatorTypes::LessEq:
+        case OperatorTypes::GreaterEq:
+        case OperatorTypes::Equal:
+        case OperatorTypes::NotEqual:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    // type of what a builtin conversion returns when it doesn't throw
+    WSType conversion_result(const AST::Binding& binding)
+    {
+        if (binding.count != 0 || binding.builtin == NULL)
+            return WSTypes::Base;
+
+        const QHash<QString, WS::SP_Object>& builtins = Builtin::table();
+        if (binding.builtin == &builtins.constFind("int").value())
+            return WSTypes::Integral;
+        if (binding.builtin == &builtins.constFind("double").value())
+            return WSTypes::Rational;
+        if (binding.builtin == &builtins.constFind("bool").value())
+            return WSTypes::Bool;
+
+        return WSTypes::Base;
+    }
+}
+
+
+WSType TypeInference::binary_result(OperatorType type, WSType operands)
+{
+    switch (operands)
+    {
+    case WSTypes::Integral:
+        if (type == OperatorTypes::Plus || type == OperatorTypes::Minus || type == OperatorTypes::Mult
+                || type == OperatorTypes::Div || type == OperatorTypes::Mod)
+            return WSTypes::Integral;
+        return is_comparison(type) ? WSTypes::Bool : WSTypes::Base;
+
+    case WSTypes::Rational:
+        if (type == OperatorTypes::Plus || type == OperatorTypes::Minus || type == OperatorTypes::Mult
+                || type == OperatorTypes::Div)
+            return WSTypes::Rational;
+        return is_comparison(type) ? WSTypes::Bool : WSTypes::Base;
+
+    case WSTypes::String:
+        if (type == OperatorTypes::Plus)
+            return WSTypes::String;
+        return is_comparison(type) ? WSTypes::Bool : WSTypes::Base;
+
+    case WSTypes::Bool:
+        if (type == OperatorTypes::And || type == OperatorTypes::Or
+                || type == OperatorTypes::Equal || type == OperatorTypes::NotEqual)
+            return WSTypes::Bool;
+        return WSTypes::Base;
+
+    default:
+        return WSTypes::Base;
+    }
+}
+
+WSType TypeInference::unary_result(OperatorType type, WSType operand)
+{
+    if (type == OperatorTypes::UnaryMinus && (operand == WSTypes::Integral || operand == WSTypes::Rational))
+        return operand;
+    if (type == OperatorTypes::Not && operand == WSTypes::Bool)
+        return WSTypes::Bool;
+    return WSTypes::Base;
+}
+
+
+bool TypeInference::Types::operator==(const Types& other) const
+{
+    if (reachable != other.reachable || variables.size() != other.variables.size())
+        return false;
+
+    for (QHash<int, WSType>::const_iterator slot = variables.constBegin(); slot != variables.constEnd(); ++slot)
+    {
+        QHash<int, WSType>::const_iterator found = other.variables.constFind(slot.key());
+        if (found == other.variables.constEnd() || found.value() != slot.value())
+            return false;
+    }
+    return true;
+}
+
+void TypeInference::Types::join(const Types& other)
+{
+    if (!other.reachable)
+        return;
+
+    if (!reachable)
+    {
+        *this = other;
+        return;
+    }
+
+    for (QHash<int, WSType>::const_iterator slot = other.variables.constBegin(); slot != other.variables.constEnd(); ++slot)
+    {
+        QHash<int, WSType>::iterator own = variables.find(slot.key());
+        if (own == variables.end())
+            variables.insert(slot.key(), slot.value());
+        else if (own.value() != slot.value())
+            own.value() = WSTypes::Base;
+    }
+}
+
+
+void TypeInference::infer(Program& program)
+{
+    TypeInference inference;
+    inference.infer_function(program.root()->values(), 0);
+}
+
+void TypeInference::infer_body(AST::Block* body, int parameter_count)
+{
+    TypeInference inference;
+    inference.infer_function(body->values(), parameter_count);
+}
+
+void TypeInference::infer_function(const AST::NodeList<AST::Node>& statements, int parameter_count)
+{
+    // arguments take the first slots and may be anything
+    for (int slot = 0; slot < parameter_count; ++slot)
+        types.variables.insert(slot, WSTypes::Base);
+
+    foreach(AST::Node* stmt, statements)
+        stmt->accept(this);
+}
+
+WSType TypeInference::type_of(AST::Node* node)
+{
+    result = WSTypes::Base;
+    node->accept(this);
+    return result;
+}
+
+void TypeInference::assign(const AST::Binding& binding, WSType type)
+{
+    // the value goes to the first candidate holding one, or to the first if none does;
+    // with several candidates any one that may hold a value may be the variable
+    for (int i = 0; i < binding.count; ++i)
+    {
+        const int slot = binding.addresses[i].slot;
+        QHash<int, WSType>::iterator own = types.variables.find(slot);
+
+        if (own == types.variables.end())
+        {
+            if (i == 0)
+                types.variables.insert(slot, type);
+        }
+        else if (binding.count == 1)
+            own.value() = type;
+        else if (own.value() != type)
+            own.value() = WSTypes::Base;
+    }
+}
+
+void TypeInference::visit(AST::Noop* /*node*/)
+{
+    result = WSTypes::None;
+}
+
+void TypeInference::visit(AST::Leaf* node)
+{
+    result = WSTypes::Base;
+
+    if (!node->is_identifier())
+    {
+        result = node->object()->__type__();
+        return;
+    }
+
+    // a read that may end up anywhere but in a slot of this frame isn't typed
+    const AST::Binding& binding = node->binding();
+    if (binding.count == 0 || binding.builtin != NULL)
+        return;
+
+    // the value is in one of the candidates that may hold one
+    bool found = false;
+    for (int i = 0; i < binding.count; ++i)
+    {
+        if (binding.addresses[i].depth != 0)
+        {
+            result = WSTypes::Base;
+            return;
+        }
+
+        QHash<int, WSType>::const_iterator slot = types.variables.constFind(binding.addresses[i].slot);
+        if (slot == types.variables.constEnd())
+            continue;
+
+        if (found && slot.value() != result)
+        {
+            result = WSTypes::Base;
+            return;
+        }
+        result = slot.value();
+        found = true;
+    }
+}
+
+void TypeInference::visit(AST::FunctionCall* node)
+{
+    type_of(node->function_object());
+
+    QList<WSType> arguments;
+    foreach(AST::Expression* expr, node->arguments_expressions())
+        arguments << type_of(expr);
+
+    AST::Leaf* fnc = dynamic_cast<AST::Leaf*>(node->function_object());
+    result = fnc != NULL && fnc->is_identifier() ? conversion_result(fnc->binding()) : WSTypes::Base;
+
+    if (node->inlined() != NULL)
+        infer_inlined(node->inlined(), arguments);
+}
+
+void TypeInference::infer_inlined(const AST::Inlined* inlined, const QList<WSType>& arguments)
+{
+    // the copy writes its own slots only, what is known about the others holds after the call
+    const Types before = types;
+
+    for (int i = 0; i < arguments.size(); ++i)
+        types.variables.insert(inlined->first_slot + i, arguments[i]);
+
+    returns.push(QList<WSType>());
+    foreach(AST::Node* stmt, inlined->body->values())
+        stmt->accept(this);
+    QList<WSType> values = returns.pop();
+
+    // falling off the end returns None
+    if (types.reachable)
+        values << WSTypes::None;
+
+    result = inlined->exclusive && !values.isEmpty() ? values.first() : WSTypes::Base;
+    foreach(WSType value, values)
+    {
+        if (value != result)
+            result = WSTypes::Base;
+    }
+
+    types = before;
+}
+
+void TypeInference::visit(AST::UnaryOperator* node)
+{
+    const WSType operand = type_of(node->argument());
+    result = unary_result(node->type(), operand);
+    node->set_operand_type(result != WSTypes::Base ? operand : WSTypes::Base);
+}
+
+void TypeInference::visit(AST::BinaryOperator* node)
+{
+    if (node->type() == OperatorTypes::Assign)
+    {
+        result = type_of(node->right());
+        assign(static_cast<AST::Leaf*>(node->left())->binding(), result);
+    }
+    else if (node->type() == OperatorTypes::Dot)
+    {
+        type_of(node->left());
+
+        foreach(AST::Expression* expr, static_cast<AST::FunctionCall*>(node->right())->arguments_expressions())
+            type_of(expr);
+
+        result = WSTypes::Base;
+    }
+    else
+    {
+        const WSType left = type_of(node->left());
+        const WSType right = type_of(node->right());
+
+        result = left == right ? binary_result(node->type(), left) : WSTypes::Base;
+        node->set_operand_type(result != WSTypes::Base ? left : WSTypes::Base);
+    }
+}
+
+void TypeInference::visit(AST::Return* node)
+{
+    const WSType value = type_of(node->expr());
+    if (!returns.isEmpty())
+        returns.top() << value;
+    types.reachable = false;
+}
+
+void TypeInference::visit(AST::Continue* /*node*/)
+{
+    if (!loops.isEmpty())
+        loops.top().continues << types;
+    types.reachable = false;
+}
+
+void TypeInference::visit(AST::Break* /*node*/)
+{
+    if (!loops.isEmpty())
+        loops.top().breaks << types;
+    types.reachable = false;
+}
+
+void TypeInference::visit(AST::Block* node)
+{
+    foreach(AST::Node* stmt, node->values())
+        stmt->accept(this);
+
+    // variables of the block are gone after it
+    for (int i = 0; i < node->scope_slot_count(); ++i)
+        types.variables.remove(node->scope_slots()[i]);
+}
+
+void TypeInference::visit(AST::FunctionDeclaration* node)
+{
+    assign(node->binding(), WSTypes::Function);
+
+    // deferred bodies are inferred when they get parsed
+    if (node->is_body_parsed())
+    {
+        TypeInference inference;
+        inference.infer_function(node->body()->values(), node->parameters().size());
+    }
+}
+
+void TypeInference::visit(AST::While* node)
+{
+    // the body is walked again until the types at the condition stop changing;
+    // the last walk, which marks the operators, is the one with the final types
+    const Types entry = types;
+    Types head = entry;
+
+    while (true)
+    {
+        types = head;
+        type_of(node->condition());
+        const Types exit = types;
+
+        loops.push(Loop());
+        node->body()->accept(this);
+        Loop loop = loops.pop();
+
+        foreach(const Types& from, loop.continues)
+            types.join(from);
+
+        Types next = entry;
+        next.join(types);
+
+        if (next == head)
+        {
+            types = exit;
+            foreach(const Types& from, loop.breaks)
+                types.join(from);
+            break;
+        }
+
+        head = next;
+    }
+
+    result = WSTypes::Base;
+}
+
+void TypeInference::visit(AST::If* node)
+{
+    type_of(node->condition());
+    const Types before = types;
+
+    node->then_stmt()->accept(this);
+    const Types after_then = types;
+
+    types = before;
+    node->else_stmt()->accept(this);
+    types.join(after_then);
+
+    result = WSTypes::Base;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "AST.h"
+#include "Program.h"
+
+#include <QHash>
+#include <QList>
+#include <QStack>
+
+namespace VTScript
+{
+    /*
+        Flow-sensitive type inference over one function at a time. Marks unary and binary
+        operators whose operands provably have one type with a fast path in the
+        interpreter (Integral, Rational, String, Bool), see AST::BinaryOperator::operand_type.
+
+        Types come from constant leaves, int(), double() and bool() when they are the
+        builtins, operators already marked, and variables: an assignment gives its slot
+        the type of the value, the types of a slot are joined where control flow meets,
+        and loops are walked until the types at their start stop changing. Only reads
+        of variables of the running function are typed, a call can't assign those.
+        Anything else is WSTypes::Base, i.e. not known. Copies of bodies Inliner made are
+        typed with the types of the arguments of their call.
+
+        Needs Resolver's bindings; marks are overwritten by every run, so a program can
+        be inferred again after it has been resolved again.
+    */
+    class TypeInference : public ASTTools::NodeVisitor
+    {
+    public:
+        // marks the whole resolved program, function bodies parsed so far included
+        static void infer(Program& program);
+
+        // a deferred body once it's resolved, see WS::UserFunction::body
+        static void infer_body(AST::Block* body, int parameter_count);
+
+        // type of 'left type right' for operands of type 'operands', WSTypes::Base if it has no fast path
+        static WSType binary_result(OperatorType type, WSType operands);
+        // type of 'type argument', WSTypes::Base if it has no fast path
+        static WSType unary_result(OperatorType type, WSType operand);
+
+        VISITOR_METHODS
+
+    private:
+        /*
+            What is known about the frame at a point of the function: the type of every
+            slot that may hold a value there. A slot that is missing holds none.
+        */
+        struct Types
+        {
+            Types() : reachable(true) {}
+
+            bool operator==(const Types& other) const;
+            bool operator!=(const Types& other) const { return !(*this == other); }
+
+            // the types at a point both 'this' and 'other' lead to
+            void join(const Types& other);
+
+            bool reachable;
+            QHash<int, WSType> variables;   // by frame slot
+        };
+
+        // where 'continue' and 'break' of the innermost loop jump from
+        struct Loop
+        {
+            QList<Types> continues;
+            QList<Types> breaks;
+        };
+
+        TypeInference() : result(WSTypes::Base) {}
+
+        void infer_function(const AST::NodeList<AST::Node>& statements, int parameter_count);
+        WSType type_of(AST::Node* node);
+        void assign(const AST::Binding& binding, WSType type);
+        // types a copy of a body Inliner made with the types of the arguments
+        void infer_inlined(const AST::Inlined* inlined, const QList<WSType>& arguments);
+
+        Types types;
+        WSType result;          // type of the last expression visited
+        QStack<Loop> loops;
+        QStack<QList<WSType> > returns;     // values returned in the inlined copies being walked
+    };
+
+};
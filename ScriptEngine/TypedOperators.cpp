@@ -0,0 +1,135 @@
+#include "TypedOperators.h"
+
+#include <functional>
+
+using namespace VTScript;
+
+namespace
+{
+    // 'Operation' on the values of two objects of type T, the result wrapped in a 'Result'
+    template <typename T, typename Result, typename Operation>
+    WS::SP_Object computed(WS::Object* left, WS::Object* right)
+    {
+        return WS::SP_Object(new Result(Operation()(static_cast<T*>(left)->value(), static_cast<T*>(right)->value())));
+    }
+
+    // these don't throw, they crash; the generic path is left to do it as it always has
+    WS::SP_Object integral_div(WS::Object* left, WS::Object* right)
+    {
+        const long long b = static_cast<WS::Integral*>(right)->value();
+        if (b == 0 || b == -1)
+            return WS::SP_Object();
+        return WS::SP_Object(new WS::Integral(static_cast<WS::Integral*>(left)->value() / b));
+    }
+
+    WS::SP_Object integral_mod(WS::Object* left, WS::Object* right)
+    {
+        const long long b = static_cast<WS::Integral*>(right)->value();
+        if (b == 0 || b == -1)
+            return WS::SP_Object();
+        return WS::SP_Object(new WS::Integral(static_cast<WS::Integral*>(left)->value() % b));
+    }
+
+    WS::SP_Object integral_minus(WS::Object* argument)
+    {
+        return WS::SP_Object(new WS::Integral(- static_cast<WS::Integral*>(argument)->value()));
+    }
+
+    WS::SP_Object rational_minus(WS::Object* argument)
+    {
+        return WS::SP_Object(new WS::Rational(- static_cast<WS::Rational*>(argument)->value()));
+    }
+
+    WS::SP_Object bool_not(WS::Object* argument)
+    {
+        return WS::SP_Object(new WS::Bool(! static_cast<WS::Bool*>(argument)->value()));
+    }
+
+    template <typename T, typename Value>
+    TypedOperators::Binary compared(OperatorType type)
+    {
+        switch (type)
+        {
+        case OperatorTypes::Less      : return &computed<T, WS::Bool, std::less<Value> >;
+        case OperatorTypes::Greater   : return &computed<T, WS::Bool, std::greater<Value> >;
+        case OperatorTypes::LessEq    : return &computed<T, WS::Bool, std::less_equal<Value> >;
+        case OperatorTypes::GreaterEq : return &computed<T, WS::Bool, std::greater_equal<Value> >;
+        case OperatorTypes::Equal     : return &computed<T, WS::Bool, std::equal_to<Value> >;
+        case OperatorTypes::NotEqual  : return &computed<T, WS::Bool, std::not_equal_to<Value> >;
+        default                       : return NULL;
+        }
+    }
+
+    template <typename T, typename Value>
+    TypedOperators::Binary arithmetic(OperatorType type)
+    {
+        switch (type)
+        {
+        case OperatorTypes::Plus  : return &computed<T, T, std::plus<Value> >;
+        case OperatorTypes::Minus : return &computed<T, T, std::minus<Value> >;
+        case OperatorTypes::Mult  : return &computed<T, T, std::multiplies<Value> >;
+        case OperatorTypes::Div   : return &computed<T, T, std::divides<Value> >;
+        default                   : return compared<T, Value>(type);
+        }
+    }
+}
+
+
+TypedOperators::Binary TypedOperators::binary_for(OperatorType type, WSType operands)
+{
+    switch (operands)
+    {
+    case WSTypes::Integral:
+        if (type == OperatorTypes::Div)
+            return &integral_div;
+        if (type == OperatorTypes::Mod)
+            return &integral_mod;
+        return arithmetic<WS::Integral, long long>(type);
+
+    case WSTypes::Rational:
+        if (type == OperatorTypes::Mod)
+            return NULL;
+        return arithmetic<WS::Rational, double>(type);
+
+    case WSTypes::String:
+        if (type == OperatorTypes::Plus)
+            return &computed<WS::String, WS::String, std::plus<QString> >;
+        return compared<WS::String, QString>(type);
+
+    case WSTypes::Bool:
+        switch (type)
+        {
+        case OperatorTypes::And      : return &computed<WS::Bool, WS::Bool, std::logical_and<bool> >;
+        case OperatorTypes::Or       : return &computed<WS::Bool, WS::Bool, std::logical_or<bool> >;
+        case OperatorTypes::Equal    : return &computed<WS::Bool, WS::Bool, std::equal_to<bool> >;
+        case OperatorTypes::NotEqual : return &computed<WS::Bool, WS::Bool, std::not_equal_to<bool> >;
+        default                      : return NULL;
+        }
+
+    default:
+        return NULL;
+    }
+}
+
+TypedOperators::Unary TypedOperators::unary_for(OperatorType type, WSType operand)
+{
+    if (type == OperatorTypes::UnaryMinus && operand == WSTypes::Integral)
+        return &integral_minus;
+    if (type == OperatorTypes::UnaryMinus && operand == WSTypes::Rational)
+        return &rational_minus;
+    if (type == OperatorTypes::Not && operand == WSTypes::Bool)
+        return &bool_not;
+    return NULL;
+}
+
+WS::SP_Object TypedOperators::binary(OperatorType type, WSType operands, WS::Object* left, WS::Object* right)
+{
+    Binary operation = binary_for(type, operands);
+    return operation != NULL ? operation(left, right) : WS::SP_Object();
+}
+
+WS::SP_Object TypedOperators::unary(OperatorType type, WSType operand, WS::Object* argument)
+{
+    Unary operation = unary_for(type, operand);
+    return operation != NULL ? operation(argument) : WS::SP_Object();
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "Enums.h"
+#include "Objects.h"
+
+namespace VTScript
+{
+    /*
+        Fast paths for operators TypeInference marked: the same results the WS methods
+        give, without method lookup, argument lists and type checks. A NULL result means
+        the generic path has to do it. Used by the tree walker and the bytecode loop.
+    */
+    namespace TypedOperators
+    {
+        WS::SP_Object binary(OperatorType type, WSType operands, WS::Object* left, WS::Object* right);
+        WS::SP_Object unary(OperatorType type, WSType operand, WS::Object* argument);
+
+        // the fast path of one operator on one type, to be chosen once and called many times; NULL if there's none
+        typedef WS::SP_Object (*Binary)(WS::Object* left, WS::Object* right);
+        typedef WS::SP_Object (*Unary)(WS::Object* argument);
+        Binary binary_for(OperatorType type, WSType operands);
+        Unary unary_for(OperatorType type, WSType operand);
+    }
+
+};
@@ -0,0 +1,328 @@
+#include "X86Assembler.h"
+
+#include <assert.h>
+
+using namespace VTScript;
+using namespace VTScript::Jit;
+
+X86Assembler::Label X86Assembler::new_label()
+{
+    labels.append(-1);
+    return labels.size() - 1;
+}
+
+void X86Assembler::bind(Label label)
+{
+    labels[label] = bytes.size();
+}
+
+void X86Assembler::int32(int value)
+{
+    for (int i = 0; i < 4; ++i)
+        byte((value >> (8 * i)) & 0xFF);
+}
+
+void X86Assembler::int64(qint64 value)
+{
+    for (int i = 0; i < 8; ++i)
+        byte(int((value >> (8 * i)) & 0xFF));
+}
+
+void X86Assembler::rex(bool wide, int reg, int base)
+{
+    const int value = 0x40 | (wide ? 0x08 : 0) | ((reg & 8) ? 0x04 : 0) | ((base & 8) ? 0x01 : 0);
+    if (value != 0x40)
+        byte(value);
+}
+
+void X86Assembler::modrm(int mod, int reg, int rm)
+{
+    byte((mod << 6) | ((reg & 7) << 3) | (rm & 7));
+}
+
+void X86Assembler::memory(int reg, Register base, int displacement)
+{
+    modrm(2, reg, base);
+    if ((base & 7) == rsp)
+        byte(0x24);
+    int32(displacement);
+}
+
+void X86Assembler::sse(int prefix, int opcode, int reg, int rm)
+{
+    byte(prefix);
+    rex(false, reg, rm);
+    byte(0x0F);
+    byte(opcode);
+    modrm(3, reg, rm);
+}
+
+void X86Assembler::push(Register reg)
+{
+    rex(false, 0, reg);
+    byte(0x50 + (reg & 7));
+}
+
+void X86Assembler::pop(Register reg)
+{
+    rex(false, 0, reg);
+    byte(0x58 + (reg & 7));
+}
+
+void X86Assembler::ret()
+{
+    byte(0xC3);
+}
+
+void X86Assembler::mov(Register to, Register from)
+{
+    rex(true, from, to);
+    byte(0x89);
+    modrm(3, from, to);
+}
+
+void X86Assembler::mov(Register to, qint64 immediate)
+{
+    rex(true, 0, to);
+    byte(0xB8 + (to & 7));
+    int64(immediate);
+}
+
+void X86Assembler::mov_32(Register to, int immediate)
+{
+    rex(false, 0, to);
+    byte(0xB8 + (to & 7));
+    int32(immediate);
+}
+
+void X86Assembler::load(Register to, Register base, int displacement)
+{
+    rex(true, to, base);
+    byte(0x8B);
+    memory(to, base, displacement);
+}
+
+void X86Assembler::store(Register base, int displacement, Register from)
+{
+    rex(true, from, base);
+    byte(0x89);
+    memory(from, base, displacement);
+}
+
+void X86Assembler::lea(Register to, Register base, int displacement)
+{
+    rex(true, to, base);
+    byte(0x8D);
+    memory(to, base, displacement);
+}
+
+void X86Assembler::add(Register to, Register from)
+{
+    rex(true, from, to);
+    byte(0x01);
+    modrm(3, from, to);
+}
+
+void X86Assembler::add(Register to, int immediate)
+{
+    rex(true, 0, to);
+    byte(0x81);
+    modrm(3, 0, to);
+    int32(immediate);
+}
+
+void X86Assembler::sub(Register to, Register from)
+{
+    rex(true, from, to);
+    byte(0x29);
+    modrm(3, from, to);
+}
+
+void X86Assembler::sub(Register to, int immediate)
+{
+    rex(true, 0, to);
+    byte(0x81);
+    modrm(3, 5, to);
+    int32(immediate);
+}
+
+void X86Assembler::imul(Register to, Register from)
+{
+    rex(true, to, from);
+    byte(0x0F);
+    byte(0xAF);
+    modrm(3, to, from);
+}
+
+void X86Assembler::cqo()
+{
+    byte(0x48);
+    byte(0x99);
+}
+
+void X86Assembler::idiv(Register divisor)
+{
+    rex(true, 0, divisor);
+    byte(0xF7);
+    modrm(3, 7, divisor);
+}
+
+void X86Assembler::cmp(Register left, Register right)
+{
+    rex(true, right, left);
+    byte(0x39);
+    modrm(3, right, left);
+}
+
+void X86Assembler::cmp(Register left, Register base, int displacement)
+{
+    rex(true, left, base);
+    byte(0x3B);
+    memory(left, base, displacement);
+}
+
+void X86Assembler::cmp(Register left, signed char immediate)
+{
+    rex(true, 0, left);
+    byte(0x83);
+    modrm(3, 7, left);
+    byte(immediate);
+}
+
+void X86Assembler::cmp_8(Register base, int displacement, signed char immediate)
+{
+    rex(false, 0, base);
+    byte(0x80);
+    memory(7, base, displacement);
+    byte(immediate);
+}
+
+void X86Assembler::test(Register left, Register right)
+{
+    rex(true, right, left);
+    byte(0x85);
+    modrm(3, right, left);
+}
+
+void X86Assembler::test_32(Register left, Register right)
+{
+    rex(false, right, left);
+    byte(0x85);
+    modrm(3, right, left);
+}
+
+void X86Assembler::set(Condition condition, Register reg)
+{
+    // without a REX prefix only the first four have their low byte encoded
+    assert(reg <= rbx);
+
+    byte(0x0F);
+    byte(0x90 | condition);
+    modrm(3, 0, reg);
+
+    // movzx reg32, reg8
+    byte(0x0F);
+    byte(0xB6);
+    modrm(3, reg, reg);
+}
+
+void X86Assembler::and_32(Register to, Register from)
+{
+    rex(false, from, to);
+    byte(0x21);
+    modrm(3, from, to);
+}
+
+void X86Assembler::or_32(Register to, Register from)
+{
+    rex(false, from, to);
+    byte(0x09);
+    modrm(3, from, to);
+}
+
+void X86Assembler::movsd(XmmRegister to, Register base, int displacement)
+{
+    byte(0xF2);
+    rex(false, to, base);
+    byte(0x0F);
+    byte(0x10);
+    memory(to, base, displacement);
+}
+
+void X86Assembler::addsd(XmmRegister to, XmmRegister from)
+{
+    sse(0xF2, 0x58, to, from);
+}
+
+void X86Assembler::subsd(XmmRegister to, XmmRegister from)
+{
+    sse(0xF2, 0x5C, to, from);
+}
+
+void X86Assembler::mulsd(XmmRegister to, XmmRegister from)
+{
+    sse(0xF2, 0x59, to, from);
+}
+
+void X86Assembler::divsd(XmmRegister to, XmmRegister from)
+{
+    sse(0xF2, 0x5E, to, from);
+}
+
+void X86Assembler::ucomisd(XmmRegister left, XmmRegister right)
+{
+    sse(0x66, 0x2E, left, right);
+}
+
+void X86Assembler::jump_to(Label label)
+{
+    jumps.append(qMakePair(bytes.size(), label));
+    int32(0);
+}
+
+void X86Assembler::jmp(Label label)
+{
+    byte(0xE9);
+    jump_to(label);
+}
+
+void X86Assembler::jmp(Register target)
+{
+    rex(false, 0, target);
+    byte(0xFF);
+    modrm(3, 4, target);
+}
+
+void X86Assembler::j(Condition condition, Label label)
+{
+    byte(0x0F);
+    byte(0x80 | condition);
+    jump_to(label);
+}
+
+void X86Assembler::call(Register target)
+{
+    rex(false, 0, target);
+    byte(0xFF);
+    modrm(3, 2, target);
+}
+
+void X86Assembler::call(const void* function)
+{
+    mov(rax, qint64(function));
+    call(rax);
+}
+
+void X86Assembler::resolve()
+{
+    for (int i = 0; i < jumps.size(); ++i)
+    {
+        const int at = jumps[i].first;
+        assert(labels[jumps[i].second] >= 0);
+
+        // relative to the end of the displacement
+        const int displacement = labels[jumps[i].second] - (at + 4);
+        for (int b = 0; b < 4; ++b)
+            bytes.data()[at + b] = char((displacement >> (8 * b)) & 0xFF);
+    }
+}
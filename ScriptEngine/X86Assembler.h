@@ -0,0 +1,114 @@
+#pragma once
+
+#include <QByteArray>
+#include <QVector>
+#include <QPair>
+
+namespace VTScript
+{
+    namespace Jit
+    {
+        /*
+            Just the x86-64 instructions JitCompiler emits, encoded into a byte array.
+            Registers are 64 bit unless a name says otherwise; memory operands are
+            [base + displacement]. Jumps go to labels, which may be bound later.
+        */
+        class X86Assembler
+        {
+        public:
+            enum Register
+            {
+                rax, rcx, rdx, rbx, rsp, rbp, rsi, rdi,
+                r8, r9, r10, r11, r12, r13, r14, r15
+            };
+
+            enum XmmRegister
+            {
+                xmm0, xmm1
+            };
+
+            // the low nibble of jcc and setcc
+            enum Condition
+            {
+                Below = 0x2, AboveEqual = 0x3, Equal = 0x4, NotEqual = 0x5, Above = 0x7,
+                Sign = 0x8, Parity = 0xA, NoParity = 0xB,
+                Less = 0xC, GreaterEqual = 0xD, LessEqual = 0xE, Greater = 0xF
+            };
+
+            typedef int Label;
+
+            const QByteArray& code() const { return bytes; }
+            int size() const { return bytes.size(); }
+
+            Label new_label();
+            void bind(Label label);
+            // where a bound label is in the code
+            int offset(Label label) const { return labels[label]; }
+
+            void push(Register reg);
+            void pop(Register reg);
+            void ret();
+
+            void mov(Register to, Register from);
+            void mov(Register to, qint64 immediate);
+            void mov_32(Register to, int immediate);
+            void load(Register to, Register base, int displacement);
+            void store(Register base, int displacement, Register from);
+            void lea(Register to, Register base, int displacement);
+
+            void add(Register to, Register from);
+            void add(Register to, int immediate);
+            void sub(Register to, Register from);
+            void sub(Register to, int immediate);
+            void imul(Register to, Register from);
+            // rdx:rax / divisor, quotient in rax, remainder in rdx
+            void cqo();
+            void idiv(Register divisor);
+
+            // flags of 'left - right'
+            void cmp(Register left, Register right);
+            void cmp(Register left, Register base, int displacement);
+            void cmp(Register left, signed char immediate);
+            void cmp_8(Register base, int displacement, signed char immediate);
+            void test(Register left, Register right);
+            void test_32(Register left, Register right);
+            // low byte of 'reg' (rax to rbx) set to the condition, then zero extended to 32 bits
+            void set(Condition condition, Register reg);
+            void and_32(Register to, Register from);
+            void or_32(Register to, Register from);
+
+            void movsd(XmmRegister to, Register base, int displacement);
+            void addsd(XmmRegister to, XmmRegister from);
+            void subsd(XmmRegister to, XmmRegister from);
+            void mulsd(XmmRegister to, XmmRegister from);
+            void divsd(XmmRegister to, XmmRegister from);
+            void ucomisd(XmmRegister left, XmmRegister right);
+
+            void jmp(Label label);
+            void jmp(Register target);
+            void j(Condition condition, Label label);
+            void call(Register target);
+            // moves the address to rax and calls it
+            void call(const void* function);
+
+            // sets the 32 bit displacements of jumps to the labels they go to
+            void resolve();
+
+        private:
+            void byte(int value) { bytes.append(char(value)); }
+            void int32(int value);
+            void int64(qint64 value);
+            void rex(bool wide, int reg, int base);
+            void modrm(int mod, int reg, int rm);
+            // ModRM (and SIB for rsp and r12) of [base + disp32]
+            void memory(int reg, Register base, int displacement);
+            void sse(int prefix, int opcode, int reg, int rm);
+            void jump_to(Label label);
+
+            QByteArray bytes;
+            QVector<int> labels;                // offset of every label, -1 until bound
+            QVector<QPair<int, Label> > jumps;  // where a displacement to a label goes
+        };
+    }
+
+};
@@ -46,10 +46,14 @@ void ScriptingConsole::execute_script()
         if (running_script && running_script->is_finished())
             delete running_script;
 
-        VTScript::AST::Node* ast = VTScript::Parser::parse( ui->script_edit->toPlainText() );
-        if (ast == NULL)
+        // only statements touched since the last run are parsed again
+        VTScript::Program* program = parser.update( ui->script_edit->toPlainText() );
+        if (program == NULL)
             return;
-        running_script = new VTScript::Interpreter(ast);
+        // the items of the combo box are in the order of VTScript::Engines
+        VTScript::Engine engine = VTScript::Engine(ui->engine->currentIndex());
+        running_script = new VTScript::Interpreter(program, false, engine);
+        running_script->set_quickening(ui->quicken->isChecked());
         running_script->start();
     }
     else
@@ -3,6 +3,7 @@
 
 #include "Highlighter.h"
 #include "ScriptEngine/Interpreter.h"
+#include "ScriptEngine/IncrementalParser.h"
 
 #include <QMainWindow>
 
@@ -21,6 +22,7 @@ public:
 private:
     Ui::ScriptingConsoleClass* ui;
     VTScript::Interpreter* running_script;
+    VTScript::IncrementalParser parser;    // owns the program of running_script
 
 private slots:
     void execute_script();
@@ -0,0 +1,195 @@
+#include "ScriptParser.h"
+#include "Interpreter.h"
+#include "CompiledScript.h"
+#include "ProgramCache.h"
+#include "AotCompiler.h"
+
+#include <QFile>
+#include <QDir>
+#include <QIODevice>
+#include <QTextStream>
+#include <QStringList>
+#include <QScopedPointer>
+
+#include <cstdio>
+
+using namespace VTScript;
+
+namespace
+{
+    // how a configuration gets the program it runs
+    enum Pipeline
+    {
+        AsWritten,      // the tree as the parser made it, no passes after Resolver
+        Optimized,      // Parser::parse, the way scripts are run
+        LazyBodies,     // function bodies parsed on their first call
+        Compiled,       // written to a .vtsc file and loaded from it
+        Native          // loaded the way exec does, with the functions compile_native built
+    };
+
+    struct Configuration
+    {
+        const char* name;
+        Pipeline pipeline;
+        Engine engine;
+        bool quickening;
+    };
+
+    // the first one is the reference the others have to print the same as
+    const Configuration configurations[] =
+    {
+        { "tree walker, as written",    AsWritten,  Engines::TreeWalker,  false },
+        { "tree walker",                Optimized,  Engines::TreeWalker,  false },
+        { "tree walker, quickening",    Optimized,  Engines::TreeWalker,  true  },
+        { "tree walker, lazy bodies",   LazyBodies, Engines::TreeWalker,  true  },
+        { "tree walker, .vtsc",         Compiled,   Engines::TreeWalker,  true  },
+        { "bytecode",                   Optimized,  Engines::BytecodeVM,  true  },
+        { "closures",                   Optimized,  Engines::ClosureTree, true  },
+        { "bytecode + JIT",             Optimized,  Engines::BaselineJIT, true  },
+        { "native code",                Native,     Engines::TreeWalker,  true  },
+    };
+
+    // everything the interpreter prints goes through qDebug
+    QStringList messages;
+
+    void collect( QtMsgType /*type*/, const QMessageLogContext& /*context*/, const QString& message )
+    {
+        messages << message;
+    }
+
+    QString temp_path( const QString& name )
+    {
+        return QDir::tempPath() + QDir::separator() + name;
+    }
+
+    // NULL if the script doesn't load; 'native_path' is the script file native code was built for, if any
+    Program* load( const QString& source, Pipeline pipeline, const QString& native_path )
+    {
+        switch ( pipeline )
+        {
+        case AsWritten:
+            return Parser::parse( source, false, false );
+        case Optimized:
+            return Parser::parse( source );
+        case LazyBodies:
+            return Parser::parse( source, true );
+        case Compiled:
+            {
+                const QString path = temp_path( "vtscript_tests" + CompiledScript::extension );
+                Program* program = CompiledScript::compile( source, path ) ? CompiledScript::load( path ) : NULL;
+                QFile::remove( path );
+                return program;
+            }
+        case Native:
+            return ProgramCache::load( native_path );
+        }
+
+        return NULL;
+    }
+
+    // what the script printed, its errors included; false if it doesn't load
+    bool run( const QString& source, const Configuration& configuration, const QString& native_path, QStringList& printed )
+    {
+        messages.clear();
+        QtMessageHandler previous = qInstallMessageHandler( collect );
+
+        QScopedPointer<Program> program( load( source, configuration.pipeline, native_path ) );
+        if ( !program.isNull() )
+        {
+            Interpreter interpreter( program.data(), false, configuration.engine );
+            interpreter.set_quickening( configuration.quickening );
+            if ( configuration.pipeline == Native )
+                interpreter.load_native_code( native_path );
+            interpreter.run();
+        }
+
+        qInstallMessageHandler( previous );
+
+        // statistics the engines add after the script are no part of its output
+        printed.clear();
+        foreach ( const QString& message, messages )
+        {
+            if ( !message.startsWith( "JIT:" ) && !message.startsWith( "Native code:" ) )
+                printed << message;
+        }
+
+        return !program.isNull();
+    }
+
+    // the first line that differs, empty if there's none
+    QString difference( const QStringList& expected, const QStringList& actual )
+    {
+        for ( int i = 0; i < qMax( expected.size(), actual.size() ); ++i )
+        {
+            const QString want = i < expected.size() ? expected[i] : "<end of output>";
+            const QString got = i < actual.size() ? actual[i] : "<end of output>";
+            if ( want != got )
+                return QString( "line %1: expected \"%2\", got \"%3\"" ).arg( i + 1 ).arg( want ).arg( got );
+        }
+
+        return QString();
+    }
+}
+
+int main( int argc, char* argv[] )
+{
+    if ( argc != 2 )
+    {
+        std::fputs( "Usage: VTScriptTests <script_path>\n", stderr );
+        return 2;
+    }
+
+    QFile file( QString::fromLocal8Bit( argv[1] ) );
+    if ( !file.open( QIODevice::ReadOnly | QIODevice::Text ) )
+    {
+        std::fprintf( stderr, "Couldn't open file: %s\n", argv[1] );
+        return 1;
+    }
+    const QString source = QTextStream( &file ).readAll();
+
+    // compile_native reads the script from a file; without a compiler native code is skipped, not failed
+    const QString native_path = temp_path( "vtscript_tests_native.txt" );
+    QString log = "couldn't write " + native_path;
+    bool native_built = false;
+    {
+        QFile native_file( native_path );
+        if ( native_file.open( QIODevice::WriteOnly | QIODevice::Text ) && native_file.write( source.toUtf8() ) >= 0 )
+        {
+            native_file.close();
+            log.clear();
+            native_built = AotCompiler::build( native_path, log );
+        }
+    }
+
+    QStringList expected;
+    int failed = 0;
+
+    for ( size_t i = 0; i < sizeof(configurations) / sizeof(configurations[0]); ++i )
+    {
+        const Configuration& configuration = configurations[i];
+        if ( configuration.pipeline == Native && !native_built )
+        {
+            std::printf( "  skipped  %s: %s\n", configuration.name, qPrintable( log.trimmed() ) );
+            continue;
+        }
+
+        QStringList printed;
+        QString error;
+        if ( !run( source, configuration, native_path, printed ) )
+            error = "script doesn't load: " + printed.join( "; " );
+        else if ( i == 0 )
+            expected = printed;
+        else
+            error = difference( expected, printed );
+
+        if ( !error.isEmpty() )
+            ++failed;
+        std::printf( "  %s %s%s\n", error.isEmpty() ? "ok      " : "FAILED  ", configuration.name,
+                     error.isEmpty() ? "" : qPrintable( ": " + error ) );
+    }
+
+    QFile::remove( native_path );
+
+    std::printf( "%d lines of output, %d configurations failed\n", expected.size(), failed );
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,49 @@
+# Behavioural tests of the script engine, a console app of its own:
+#   VTScriptTests <script_path>
+# runs the script on every engine and pipeline and compares what it prints.
+# Build it with 'qmake Tests/Tests.pro'; the application doesn't contain any of it.
+
+DESTDIR = $$shadowed($$PWD)
+ROOTDIR = $$PWD/..
+
+TEMPLATE = app
+TARGET = VTScriptTests
+
+CONFIG += depend_includepath
+CONFIG += c++11
+CONFIG += console
+CONFIG -= app_bundle
+QT += core
+QT -= gui
+greaterThan(QT_MAJOR_VERSION, 4): QT += concurrent
+
+CONFIG(debug, debug|release) : DEFINES *= _DEBUG
+CONFIG(release, debug|release) : DEFINES *= NDEBUG
+DEFINES += _CRT_SECURE_NO_WARNINGS
+
+unix {
+    CONFIG += object_parallel_to_source   # prevent object name collisions
+    QMAKE_CXXFLAGS_WARN_ON = ""
+    QMAKE_CXXFLAGS += -Wall -Wextra
+    QMAKE_CXXFLAGS += -Wno-unknown-pragmas -Wno-missing-braces -Wno-missing-field-initializers
+
+    CONFIG(release, debug|release) {
+        QMAKE_CXXFLAGS += -flto
+    }
+
+    # compile_native builds native code with the compiler the application is built with
+    DEFINES += VTSCRIPT_AOT_CXX=\\\"$$QMAKE_CXX\\\"
+}
+
+win32-msvc* {
+    # don't create separate debug and release folders (QtCreater does this instead)
+    CONFIG -= debug_and_release debug_and_release_target
+
+    QMAKE_CFLAGS_WARN_ON -= -W3
+    QMAKE_CFLAGS_WARN_ON += -W4
+}
+
+INCLUDEPATH += $$ROOTDIR/ScriptEngine
+
+HEADERS += $$files(*.h) $$files($$ROOTDIR/ScriptEngine/*.h)
+SOURCES += $$files(*.cpp) $$files($$ROOTDIR/ScriptEngine/*.cpp)
@@ -8,7 +8,7 @@ CONFIG += depend_includepath
 CONFIG += c++11
 CONFIG += qt
 QT += core gui
-greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets concurrent
 
 CONFIG(debug, debug|release) : DEFINES *= _DEBUG
 CONFIG(release, debug|release) : DEFINES *= NDEBUG
@@ -24,6 +24,9 @@ unix {
     CONFIG(release, debug|release) {
         QMAKE_CXXFLAGS += -flto
     }
+
+    # compile_native builds native code with the compiler the application is built with
+    DEFINES += VTSCRIPT_AOT_CXX=\\\"$$QMAKE_CXX\\\"
 }
 
 win32-msvc* {